@@ -104,6 +104,16 @@ int test_op_multi_times_queue(int a, int b) {
   return a + b;
 }
 
+int test_batch_1(int a, int b) {
+  LOG("**> test_batch_1 called");
+  return a + b;
+}
+
+int test_batch_2(int a, int b) {
+  LOG("**> test_batch_2 called");
+  return a + b;
+}
+
 void *get_hidden_func_addr(void) {
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wpointer-arith"
@@ -28,6 +28,7 @@
 int test_t16_for_unique(int a, int b);
 int test_t16_for_multi(int a, int b);
 int test_t16_for_shared(int a, int b);
+int test_t16_for_histogram(int a, int b);
 
 int test_t16_helper_global(int a, int b);
 int test_t16_b_t1(int a, int b);
@@ -96,6 +97,7 @@ int test_a32_instr(int a, int b);
 int test_a64_for_unique(int a, int b);
 int test_a64_for_multi(int a, int b);
 int test_a64_for_shared(int a, int b);
+int test_a64_for_histogram(int a, int b);
 
 int test_a64_helper_global(int a, int b);
 int test_a64_b(int a, int b);
@@ -135,4 +137,7 @@ int test_op_multi_times_shared(int a, int b);
 int test_op_multi_times_multi(int a, int b);
 int test_op_multi_times_queue(int a, int b);
 
+int test_batch_1(int a, int b);
+int test_batch_2(int a, int b);
+
 void *get_hidden_func_addr(void);
@@ -0,0 +1,181 @@
+// Copyright (c) 2021-2025 ByteDance Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+// the liveness scan of sh_a64_get_dead_regs() and the choice of sh_a64_get_scratch_reg()
+
+#include "sh_a64.c"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "host_test.h"
+
+#define X(n) SH_A64_REG(n)
+
+#define NOP           0xd503201f
+#define RET           0xd65f03c0
+#define RETAA         0xd65f0bff
+#define BR_X0         0xd61f0000
+#define BL_0          0x94000000
+#define BLR_X17       0xd63f0220
+#define B_8           0x14000002
+#define B_0           0x14000000
+#define CBZ_X0_12     0xb4000060
+#define CBZ_X16_8     0xb4000050
+#define TBNZ_W0_3_12  0x37180060
+#define B_EQ_12       0x54000060
+#define MOV_X17_1     0xd2800031
+#define MOV_X17_0     0xd2800011
+#define MOV_X16_X17   0xaa1103f0
+#define MOV_X0_X16    0xaa1003e0
+#define ADD_X0_X17_1  0x91000620
+#define ADD_X0_X9_0   0x91000120
+#define ADD_X0_X13_0  0x910001a0
+#define LDR_X16_X17   0xf9400230
+#define LDP_X16_X17   0xa94047f0
+#define STP_X16_X17   0xa90047f0
+#define CCMP_X17      0xfa400a20
+#define MOVK_X17_1    0xf2800031
+#define ADC_X9_X0_X1  0x9a010009
+#define RMIF_X0_0_9   0xba000409  // the mask is in the Rd field: 9
+#define SETF8_W17     0x3a000a2d  // the Rd field is always 13
+#define SETF16_W17    0x3a004a2d
+
+#define SCRATCH (X(9) | X(16) | X(17))
+
+// dead registers of regs at the first instruction
+#define DEAD(regs, ...)                                                                                 \
+  sh_a64_get_dead_regs((const uint32_t[]){__VA_ARGS__}, sizeof((const uint32_t[]){__VA_ARGS__}) / 4, 0, \
+                       (regs))
+
+static int sh_a64_dead_regs_straight(void) {
+  int r = 0;
+  CHECK(SCRATCH == DEAD(SCRATCH, MOV_X17_1, MOV_X16_X17, RET));
+  CHECK((X(9) | X(16)) == DEAD(SCRATCH, ADD_X0_X17_1, RET));
+  CHECK(SCRATCH == DEAD(SCRATCH, LDP_X16_X17, RET));
+  CHECK(X(9) == DEAD(SCRATCH, STP_X16_X17, RET));
+  CHECK((X(9) | X(16)) == DEAD(SCRATCH, LDR_X16_X17, RET));
+
+  // read-modify-write and flag-only instructions
+  CHECK((X(9) | X(16)) == DEAD(SCRATCH, MOVK_X17_1, RET));
+  CHECK((X(9) | X(16)) == DEAD(SCRATCH, CCMP_X17, RET));
+  CHECK(SCRATCH == DEAD(SCRATCH, ADC_X9_X0_X1, ADD_X0_X9_0, RET));
+  CHECK((X(16) | X(17)) == DEAD(SCRATCH, RMIF_X0_0_9, ADD_X0_X9_0, RET));
+  CHECK(0 == DEAD(X(13), SETF8_W17, ADD_X0_X13_0, RET));
+  CHECK(0 == DEAD(X(13), SETF16_W17, ADD_X0_X13_0, RET));
+
+  // out of the function, indirect branch, unrecognized instruction
+  CHECK(0 == DEAD(SCRATCH, NOP));
+  CHECK(0 == DEAD(SCRATCH, BR_X0, RET));
+  CHECK(0 == DEAD(SCRATCH, 0x00000000, RET));
+  return r;
+}
+
+static int sh_a64_dead_regs_branches(void) {
+  int r = 0;
+  // both paths are followed: read on one of them is live
+  CHECK((X(9) | X(16)) == DEAD(SCRATCH, CBZ_X0_12, LDR_X16_X17, RET, MOV_X17_0, RET));
+  CHECK((X(9) | X(16)) == DEAD(SCRATCH, TBNZ_W0_3_12, MOV_X17_0, RET, ADD_X0_X17_1, RET));
+  CHECK((X(9) | X(16)) == DEAD(SCRATCH, B_EQ_12, LDR_X16_X17, RET, MOV_X17_0, RET));
+
+  // the register tested by the branch is read
+  CHECK((X(9) | X(17)) == DEAD(SCRATCH, CBZ_X16_8, RET, RET));
+
+  // unconditional branch skips the read
+  CHECK(SCRATCH == DEAD(SCRATCH, B_8, ADD_X0_X17_1, RET));
+
+  // endless loop: out of the step budget
+  CHECK(0 == DEAD(SCRATCH, B_0));
+  return r;
+}
+
+static int sh_a64_dead_regs_calls(void) {
+  int r = 0;
+  // the callee does not preserve the caller-saved registers
+  CHECK(SCRATCH == DEAD(SCRATCH, BL_0, ADD_X0_X17_1, RET));
+  CHECK((X(9) | X(17)) == DEAD(SCRATCH, MOV_X0_X16, BL_0, RET));
+  CHECK((X(9) | X(16)) == DEAD(SCRATCH, BLR_X17, RET));
+
+  // but it reads the arguments, and the callee-saved registers survive it
+  CHECK(X(9) == DEAD(X(0) | X(9) | X(19), BL_0, RET));
+
+  // the caller needs the return value and the callee-saved registers
+  CHECK(X(9) == DEAD(X(0) | X(9) | X(19), RET));
+  CHECK(X(9) == DEAD(X(0) | X(9) | X(19), RETAA));
+  return r;
+}
+
+static uint32_t code[1024] __attribute__((aligned(4096)));
+
+static uint32_t scratch_reg(bool is_proc_start, size_t pc_idx, size_t addr_idx, size_t sym_cnt) {
+  sh_addr_info_t addr_info;
+  memset(&addr_info, 0, sizeof(addr_info));
+  addr_info.is_proc_start = is_proc_start;
+  if (0 != sym_cnt) {
+    addr_info.is_sym_addr = true;
+    addr_info.dli_saddr = code;
+    addr_info.dli_ssize = sym_cnt * 4;
+  }
+  sh_a64_rewrite_info_t rinfo;
+  memset(&rinfo, 0, sizeof(rinfo));
+  rinfo.start_addr = (uintptr_t)code;
+  rinfo.addr_info = &addr_info;
+  return sh_a64_get_scratch_reg((uintptr_t)&code[addr_idx], (uintptr_t)&code[pc_idx], &rinfo);
+}
+
+#define SET_CODE(...)                                                                       \
+  do {                                                                                      \
+    memset(code, 0, sizeof(code));                                                          \
+    memcpy(code, (const uint32_t[]){__VA_ARGS__}, sizeof((const uint32_t[]){__VA_ARGS__})); \
+  } while (0)
+
+static int sh_a64_scratch_reg(void) {
+  int r = 0;
+  // function start: all but the registers written by the rewritten instructions
+  SET_CODE(MOV_X17_1, MOV_X16_X17, ADD_X0_X17_1, ADD_X0_X9_0, BR_X0);
+  CHECK(15 == scratch_reg(true, 2, 2, 0));
+
+  // function start with an unrecognized rewritten instruction: fall back to the scan
+  SET_CODE(BR_X0, ADD_X0_X17_1, RET);
+  CHECK(16 == scratch_reg(true, 1, 1, 0));
+
+  // not the function start: scan forward, within the symbol if it is known
+  SET_CODE(NOP, ADD_X0_X17_1, RET);
+  CHECK(16 == scratch_reg(false, 1, 1, 3));
+  SET_CODE(NOP, NOP, RET);
+  CHECK(17 == scratch_reg(false, 1, 1, 0));
+  CHECK(0 == scratch_reg(false, 1, 1, 2));
+
+  // nothing is known to be dead
+  SET_CODE(BR_X0);
+  CHECK(0 == scratch_reg(false, 0, 0, 0));
+  return r;
+}
+
+int main(void) {
+  int r = 0;
+  RUN_CHECK(sh_a64_dead_regs_straight);
+  RUN_CHECK(sh_a64_dead_regs_branches);
+  RUN_CHECK(sh_a64_dead_regs_calls);
+  RUN_CHECK(sh_a64_scratch_reg);
+  return 0 == r ? 0 : 1;
+}
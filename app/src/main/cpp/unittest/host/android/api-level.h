@@ -0,0 +1,43 @@
+// Copyright (c) 2021-2025 ByteDance Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+// minimal <android/api-level.h> for the host tests
+
+#pragma once
+
+#define __ANDROID_API_J__     16
+#define __ANDROID_API_J_MR1__ 17
+#define __ANDROID_API_J_MR2__ 18
+#define __ANDROID_API_K__     19
+#define __ANDROID_API_L__     21
+#define __ANDROID_API_L_MR1__ 22
+#define __ANDROID_API_M__     23
+#define __ANDROID_API_N__     24
+#define __ANDROID_API_N_MR1__ 25
+#define __ANDROID_API_O__     26
+#define __ANDROID_API_O_MR1__ 27
+#define __ANDROID_API_P__     28
+#define __ANDROID_API_Q__     29
+#define __ANDROID_API_R__     30
+#define __ANDROID_API_S__     31
+#define __ANDROID_API_T__     33
+#define __ANDROID_API_U__     34
+#define __ANDROID_API_V__     35
@@ -0,0 +1,76 @@
+// Copyright (c) 2021-2025 ByteDance Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+// the table-driven sh_t16_get_type() returns the same type as the old if-else chain, for every encoding
+
+#include "sh_t16.c"
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "host_test.h"
+
+// sh_t16_get_type() before the decoder tables
+static sh_t16_type_t sh_t16_get_type_old(uint16_t inst) {
+  if (((inst & 0xFF00u) == 0xBF00) && ((inst & 0x000Fu) != 0x0000) && ((inst & 0x00F0u) != 0x00F0))
+    return IT_T1;
+  else if (((inst & 0xF000u) == 0xD000) && ((inst & 0x0F00u) != 0x0F00) && ((inst & 0x0F00u) != 0x0E00))
+    return B_T1;
+  else if ((inst & 0xF800u) == 0xE000)
+    return B_T2;
+  else if ((inst & 0xFFF8u) == 0x4778)
+    return BX_T1;
+  else if (((inst & 0xFF78u) == 0x4478) && ((inst & 0x0087u) != 0x0085))
+    return ADD_REG_T2;
+  else if ((inst & 0xFF78u) == 0x4678)
+    return MOV_REG_T1;
+  else if ((inst & 0xF800u) == 0xA000)
+    return ADR_T1;
+  else if ((inst & 0xF800u) == 0x4800)
+    return LDR_LIT_T1;
+  else if ((inst & 0xFD00u) == 0xB100)
+    return CBZ_T1;
+  else if ((inst & 0xFD00u) == 0xB900)
+    return CBNZ_T1;
+  else
+    return IGNORED;
+}
+
+static int sh_t16_all_encodings(void) {
+  int r = 0;
+  uint64_t mismatches = 0;
+  for (uint64_t i = 0; i <= UINT16_MAX; i++) {
+    uint16_t inst = (uint16_t)i;
+    sh_t16_type_t type_old = sh_t16_get_type_old(inst);
+    sh_t16_type_t type_new = sh_t16_get_type(inst);
+    if (type_old != type_new && mismatches++ < 16)
+      fprintf(stderr, "inst %04" PRIx16 ": old type %d, new type %d\n", inst, type_old, type_new);
+  }
+  CHECK(0 == mismatches);
+  return r;
+}
+
+int main(void) {
+  int r = 0;
+  RUN_CHECK(sh_t16_all_encodings);
+  return 0 == r ? 0 : 1;
+}
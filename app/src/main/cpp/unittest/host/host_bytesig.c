@@ -0,0 +1,55 @@
+// Copyright (c) 2021-2025 ByteDance Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+// the part of bytesig used by sh_patch, on top of sigaction(): bytesig.c itself needs bionic
+
+#include <signal.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "bytesig.h"
+
+static bytesig_interceptor_t host_bytesig_interceptors[_NSIG];
+
+static void host_bytesig_handler(int signum, siginfo_t *siginfo, void *context) {
+  bytesig_interceptor_t interceptor = host_bytesig_interceptors[signum];
+  if (NULL != interceptor && interceptor(signum, siginfo, context)) return;
+
+  // not handled: crash with the default action when returning to the faulting instruction
+  signal(signum, SIG_DFL);
+}
+
+int bytesig_init(int signum) {
+  if (signum <= 0 || signum >= _NSIG) return -1;
+  struct sigaction act;
+  memset(&act, 0, sizeof(act));
+  sigfillset(&act.sa_mask);
+  act.sa_sigaction = host_bytesig_handler;
+  act.sa_flags = SA_SIGINFO | SA_RESTART | SA_ONSTACK;
+  return sigaction(signum, &act, NULL);
+}
+
+int bytesig_set_interceptor(int signum, bytesig_interceptor_t interceptor) {
+  if (signum <= 0 || signum >= _NSIG) return -1;
+  __atomic_store_n(&host_bytesig_interceptors[signum], interceptor, __ATOMIC_RELEASE);
+  return 0;
+}
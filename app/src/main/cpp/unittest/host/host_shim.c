@@ -0,0 +1,112 @@
+// Copyright (c) 2021-2025 ByteDance Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+// the symbols that the shadowhook sources under test take from the rest of libshadowhook
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sh_island.h"
+#include "sh_log.h"
+#include "sh_util.h"
+
+android_LogPriority sh_log_priority = ANDROID_LOG_WARN;
+
+int __android_log_vprint(int prio, const char *tag, const char *fmt, va_list ap) {
+  if (prio < (int)sh_log_priority) return 0;
+  fprintf(stderr, "%s: ", tag);
+  int r = vfprintf(stderr, fmt, ap);
+  fputc('\n', stderr);
+  return r;
+}
+
+int __android_log_print(int prio, const char *tag, const char *fmt, ...) {
+  va_list ap;
+  va_start(ap, fmt);
+  int r = __android_log_vprint(prio, tag, fmt, ap);
+  va_end(ap);
+  return r;
+}
+
+size_t sh_util_get_page_size(void) {
+  return (size_t)sysconf(_SC_PAGESIZE);
+}
+
+uintptr_t sh_util_page_start(uintptr_t x) {
+  return x & ~((uintptr_t)sh_util_get_page_size() - 1);
+}
+
+uintptr_t sh_util_page_end(uintptr_t x) {
+  return sh_util_page_start(x + sh_util_get_page_size() - 1);
+}
+
+time_t sh_util_get_stable_timestamp(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + 86400;  // never close to 0, as on the device
+}
+
+void sh_util_clear_cache(uintptr_t addr, size_t len) {
+  __builtin___clear_cache((char *)addr, (char *)(addr + len));
+}
+
+// the code is mapped RWX by the tests, the stores are the same as on the device
+int sh_util_write_inst(uintptr_t target_addr, void *inst, size_t inst_len) {
+  if ((2 == inst_len) && (0 == target_addr % 2))
+    __atomic_store_n((uint16_t *)target_addr, *((uint16_t *)inst), __ATOMIC_SEQ_CST);
+  else if ((4 == inst_len) && (0 == target_addr % 4))
+    __atomic_store_n((uint32_t *)target_addr, *((uint32_t *)inst), __ATOMIC_SEQ_CST);
+  else if ((8 == inst_len) && (0 == target_addr % 8))
+    __atomic_store_n((uint64_t *)target_addr, *((uint64_t *)inst), __ATOMIC_SEQ_CST);
+  else
+    memcpy((void *)target_addr, inst, inst_len);
+
+  sh_util_clear_cache(target_addr, inst_len);
+  return 0;
+}
+
+bool sh_util_is_thumb32(uintptr_t target_addr) {
+  uint16_t opcode = *((uint16_t *)target_addr);
+  int tmp = opcode >> 11u;
+  return (tmp == 0x1d) || (tmp == 0x1e) || (tmp == 0x1f);
+}
+
+uint32_t sh_util_arm_expand_imm(uint32_t opcode) {
+  uint32_t imm = opcode & 0xFFu;
+  uint32_t amt = 2 * ((opcode >> 8u) & 0xFu);
+  return amt == 0 ? imm : ((imm >> amt) | (imm << (32 - amt)));
+}
+
+// no island near the target: the relocators fall back to absolute addressing
+void sh_island_alloc(sh_island_t *self, size_t size, uintptr_t range_low, uintptr_t range_high, uintptr_t pc,
+                     sh_addr_info_t *addr_info) {
+  (void)size, (void)range_low, (void)range_high, (void)pc, (void)addr_info;
+  memset(self, 0, sizeof(sh_island_t));
+}
+
+uintptr_t sh_island_get_rw_addr(sh_island_t *self) {
+  return self->addr;
+}
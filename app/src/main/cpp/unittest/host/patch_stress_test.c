@@ -0,0 +1,190 @@
+// Copyright (c) 2021-2025 ByteDance Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+// threads keep calling a function while sh_patch_write_inst() replaces it again and again, a thread entering
+// it must only ever run the old function, the new one, or the redirection, never the new first instruction
+// unit with the old tail (run it natively, or by qemu-aarch64 / qemu-arm as CMAKE_CROSSCOMPILING_EMULATOR for
+// arm64 / thumb)
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "host_test.h"
+#include "sh_util.h"
+
+// let the callers run between the steps of sh_patch_write_inst(), even on a single CPU
+static int sh_test_write_inst(uintptr_t target_addr, void *inst, size_t inst_len) {
+  int r = sh_util_write_inst(target_addr, inst, inst_len);
+  sched_yield();
+  return r;
+}
+#define sh_util_write_inst sh_test_write_inst
+#include "sh_patch.c"
+#undef sh_util_write_inst
+
+#define THREAD_CNT 4
+#define ROUND_CNT  1000
+
+// the function of round i returns VALUE(i), the low half of it is set by the first instruction unit
+#if defined(__arm__)
+#define VALUE(i)       (((uint32_t)(i) & 0xFFu) * 0x10001u)
+#define VALUE_REDIRECT 0xFFFF00FFu
+#else
+#define VALUE(i)       ((uint32_t)(i) * 0x10001u)
+#define VALUE_REDIRECT 0xFFFFFFFFu
+#endif
+
+// a function returning value, which is longer than one instruction unit
+#if defined(__aarch64__)
+#define IS_THUMB false
+#define FUNC_LEN 12
+static void make_func(uint8_t *buf, uint32_t value) {
+  uint32_t insts[3] = {
+      0x52800000u | (value & 0xFFFFu) << 5,  // MOVZ W0, #<lo>
+      0x72A00000u | (value >> 16) << 5,      // MOVK W0, #<hi>, LSL #16
+      0xd65f03c0u                            // RET
+  };
+  memcpy(buf, insts, sizeof(insts));
+}
+
+// A thread which has run the old MOVZ before the tail is written runs the new MOVK: it was already inside
+// the old function, which is not covered by the three steps.
+static bool is_in_flight(uint32_t value) {
+  return (value & 0xFFFFu) < (value >> 16);
+}
+#elif defined(__arm__)
+// thumb, the first instruction unit is a whole T16 instruction, the tail starts with a T32 instruction
+#define IS_THUMB true
+#define FUNC_LEN 8
+static void make_func(uint8_t *buf, uint32_t value) {
+  uint32_t hi = value >> 16;
+  uint16_t insts[4] = {
+      (uint16_t)(0x2000u | (value & 0xFFu)),                          // MOVS R0, #<lo>
+      (uint16_t)(0xF2C0u | (((hi >> 11) & 1u) << 10) | (hi >> 12)),  // MOVT R0, #<hi>
+      (uint16_t)((((hi >> 8) & 7u) << 12) | (hi & 0xFFu)),            //
+      0x4770u                                                         // BX LR
+  };
+  memcpy(buf, insts, sizeof(insts));
+}
+
+// A thread which has run the old MOVS before the tail is written runs the new MOVT (the low half wraps).
+static bool is_in_flight(uint32_t value) {
+  return ((value + 1u) & 0xFFu) == (value >> 16);
+}
+#elif defined(__x86_64__)
+#define IS_THUMB false
+#define FUNC_LEN 6
+static void make_func(uint8_t *buf, uint32_t value) {
+  buf[0] = 0xB8;  // MOV EAX, <value>
+  memcpy(buf + 1, &value, sizeof(value));
+  buf[5] = 0xC3;  // RET
+}
+
+// one instruction only
+static bool is_in_flight(uint32_t value) {
+  (void)value;
+  return false;
+}
+#endif
+
+typedef uint32_t (*func_t)(void);
+
+static func_t target;
+static bool stop = false;
+static size_t started_cnt = 0;
+static uint64_t calls_cnt = 0;
+static uint64_t redirects_cnt = 0;
+static uint64_t in_flights_cnt = 0;
+static uint64_t mixes_cnt = 0;
+static uint32_t mix_value = 0;
+
+static void *worker(void *arg) {
+  (void)arg;
+  uint64_t calls = 0, redirects = 0, in_flights = 0;
+  __atomic_add_fetch(&started_cnt, 1, __ATOMIC_RELAXED);
+  while (!__atomic_load_n(&stop, __ATOMIC_RELAXED)) {
+    uint32_t value = target();
+    calls++;
+    if (VALUE_REDIRECT == value) {
+      redirects++;
+    } else if (is_in_flight(value)) {
+      in_flights++;
+    } else if ((value & 0xFFFFu) != (value >> 16)) {
+      __atomic_store_n(&mix_value, value, __ATOMIC_RELAXED);
+      __atomic_add_fetch(&mixes_cnt, 1, __ATOMIC_RELAXED);
+    }
+  }
+  __atomic_add_fetch(&calls_cnt, calls, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&redirects_cnt, redirects, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&in_flights_cnt, in_flights, __ATOMIC_RELAXED);
+  return NULL;
+}
+
+static int sh_patch_stress(void) {
+  int r = 0;
+  uint8_t *code = mmap(NULL, 4096, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  CHECK(MAP_FAILED != code);
+  if (MAP_FAILED == code) return r;
+
+  // the function at the start of the page, the redirection (as the enter) in the middle of it
+  make_func(code, VALUE(0));
+  make_func(code + 2048, VALUE_REDIRECT);
+  __builtin___clear_cache((char *)code, (char *)code + 4096);
+  target = (func_t)((uintptr_t)code + (IS_THUMB ? 1 : 0));
+
+  sh_patch_init();
+  CHECK(sh_patch_trap_enabled);
+
+  pthread_t threads[THREAD_CNT];
+  for (size_t i = 0; i < THREAD_CNT; i++) CHECK(0 == pthread_create(&threads[i], NULL, worker, NULL));
+  while (THREAD_CNT != __atomic_load_n(&started_cnt, __ATOMIC_RELAXED)) sched_yield();
+
+  // a new function in each round, with and without the redirection
+  for (size_t i = 1; i <= ROUND_CNT; i++) {
+    uint8_t func[FUNC_LEN];
+    make_func(func, VALUE(i));
+    uintptr_t redirect_addr = (0 == (i & 1) ? (uintptr_t)code + 2048 + (IS_THUMB ? 1 : 0) : 0);
+    CHECK(0 == sh_patch_write_inst((uintptr_t)code, func, FUNC_LEN, redirect_addr, IS_THUMB));
+  }
+
+  __atomic_store_n(&stop, true, __ATOMIC_RELAXED);
+  for (size_t i = 0; i < THREAD_CNT; i++) pthread_join(threads[i], NULL);
+
+  printf("calls: %" PRIu64 ", redirected: %" PRIu64 ", in flight: %" PRIu64 ", mixed: %" PRIu64
+         " (e.g. %08" PRIx32 ")\n",
+         calls_cnt, redirects_cnt, in_flights_cnt, mixes_cnt, mix_value);
+  CHECK(0 == mixes_cnt);
+  CHECK(0 < calls_cnt);
+  munmap(code, 4096);
+  return r;
+}
+
+int main(void) {
+  int r = 0;
+  RUN_CHECK(sh_patch_stress);
+  return 0 == r ? 0 : 1;
+}
@@ -0,0 +1,330 @@
+// Copyright (c) 2021-2025 ByteDance Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+// the AUIPC, JAL and branch rewrites of the riscv64 relocator, for each distance between the original
+// instruction and the enter: the rewritten code is run by a small interpreter of the instructions it may
+// contain, and natively as well when the test is built for riscv64 (e.g. run by qemu-riscv64)
+
+#include "sh_rv64.c"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#if defined(__riscv)
+#include <sys/mman.h>
+#endif
+
+#include "host_test.h"
+
+#define REG_RA 1
+#define REG_T1 6
+#define REG_A0 10
+#define REG_A1 11
+
+#define AUIPC_A0_1     0x00001517  // AUIPC A0, 1
+#define AUIPC_X0_1     0x00001017  // AUIPC X0, 1 (HINT)
+#define JAL_RA_100     0x100000ef  // JAL RA, 0x100
+#define J_100          0x1000006f  // JAL X0, 0x100
+#define C_J_100        0xa201      // C.J 0x100
+#define BEQ_A0_A1_40   0x04b50063  // BEQ A0, A1, 0x40
+#define BEQ_A0_A1_4    0x00b50263  // BEQ A0, A1, 4
+#define C_BEQZ_A0_20   0xc105      // C.BEQZ A0, 0x20
+#define ADDI_A0_A0_1   0x00150513  // ADDI A0, A0, 1
+#define LI_A0_0        0x00000513  // ADDI A0, X0, 0
+#define LI_A0_1        0x00100513  // ADDI A0, X0, 1
+#define RET            0x00008067  // JALR X0, 0(RA)
+
+// the distance from the original instruction to the enter
+#define NEAR      0x400
+#define FAR_JAL   0x400000     // out of the range of JAL
+#define FAR_AUIPC 0x200000000  // out of the range of AUIPC
+
+#define BUF_SIZE 64
+
+typedef struct {
+  uint64_t x[32];
+  uintptr_t pc;
+} cpu_t;
+
+static int64_t sext(uint64_t v, unsigned bits) {
+  return (int64_t)(v << (64 - bits)) >> (64 - bits);
+}
+
+// Run the rewritten code (len bytes of buf, executed at buf_pc) from its first instruction until the pc
+// leaves it. Only the instructions emitted by the relocator are known, return false for the others.
+static bool run(cpu_t *cpu, const uint8_t *buf, uintptr_t buf_pc, size_t len) {
+  cpu->pc = buf_pc;
+  for (size_t steps = 0; cpu->pc - buf_pc < len; steps++) {
+    if (steps >= 8) return false;
+    uint32_t inst;
+    memcpy(&inst, buf + (cpu->pc - buf_pc), sizeof(inst));
+    uint32_t rd = (inst >> 7) & 0x1Fu, rs1 = (inst >> 15) & 0x1Fu, rs2 = (inst >> 20) & 0x1Fu;
+    uint32_t funct3 = (inst >> 12) & 0x7u;
+    int64_t imm_i = sext(inst >> 20, 12);
+    uintptr_t next = cpu->pc + 4;
+
+    switch (inst & 0x7Fu) {
+      case 0x17:  // AUIPC
+        cpu->x[rd] = cpu->pc + (uint64_t)sext(inst & 0xFFFFF000u, 32);
+        break;
+      case 0x13:  // ADDI
+        if (0 != funct3) return false;
+        cpu->x[rd] = cpu->x[rs1] + (uint64_t)imm_i;
+        break;
+      case 0x03: {  // LD, only from the literal pool of buf
+        uintptr_t addr = cpu->x[rs1] + (uint64_t)imm_i;
+        if (3 != funct3 || addr < buf_pc || addr + 8 > buf_pc + BUF_SIZE) return false;
+        memcpy(&cpu->x[rd], buf + (addr - buf_pc), sizeof(uint64_t));
+        break;
+      }
+      case 0x67:  // JALR
+        if (0 != funct3) return false;
+        next = (cpu->x[rs1] + (uint64_t)imm_i) & ~(uintptr_t)1;
+        cpu->x[rd] = cpu->pc + 4;
+        break;
+      case 0x6F:  // JAL
+        next = cpu->pc + (uint64_t)sext((inst >> 31) << 20 | ((inst >> 12) & 0xFFu) << 12 |
+                                            ((inst >> 20) & 0x1u) << 11 | ((inst >> 21) & 0x3FFu) << 1,
+                                        21);
+        cpu->x[rd] = cpu->pc + 4;
+        break;
+      case 0x63: {  // BEQ, BNE, BLT, BGE, BLTU, BGEU
+        uint64_t a = cpu->x[rs1], b = cpu->x[rs2];
+        bool taken;
+        if (0 == funct3) taken = (a == b);
+        else if (1 == funct3) taken = (a != b);
+        else if (4 == funct3) taken = ((int64_t)a < (int64_t)b);
+        else if (5 == funct3) taken = ((int64_t)a >= (int64_t)b);
+        else if (6 == funct3) taken = (a < b);
+        else if (7 == funct3) taken = (a >= b);
+        else return false;
+        if (taken)
+          next = cpu->pc + (uint64_t)sext((inst >> 31) << 12 | ((inst >> 7) & 0x1u) << 11 |
+                                              ((inst >> 25) & 0x3Fu) << 5 | ((inst >> 8) & 0xFu) << 1,
+                                          13);
+        break;
+      }
+      default:
+        return false;
+    }
+    cpu->x[0] = 0;
+    cpu->pc = next;
+  }
+  return true;
+}
+
+// the original instructions, 2-byte aligned as in any riscv64 code
+static uint16_t code[64];
+
+static void set_code(uint32_t inst, size_t len) {
+  memset(code, 0, sizeof(code));
+  memcpy(code, &inst, len);
+}
+
+// rewrite code[0] into buf, as if buf was executed at code + distance, return the length (0: failed)
+static size_t rewrite(uint8_t *buf, uintptr_t distance, uint8_t scratch_reg, sh_rv64_rewrite_info_t *rinfo) {
+  memset(buf, 0, BUF_SIZE);
+  memset(rinfo, 0, sizeof(sh_rv64_rewrite_info_t));
+  rinfo->start_addr = (uintptr_t)code;
+  rinfo->end_addr = (uintptr_t)code + 4;
+  rinfo->buf = buf;
+  rinfo->buf_pc = (uintptr_t)code + distance;
+  rinfo->buf_size = BUF_SIZE;
+  rinfo->scratch_reg = scratch_reg;
+
+  size_t len = sh_rv64_get_rewrite_inst_len((uintptr_t)code, rinfo);
+  if (0 == len) return 0;
+  size_t written = sh_rv64_rewrite(buf, (uintptr_t)code, rinfo);
+  return written == len ? len : 0;
+}
+
+static int sh_rv64_rewrite_auipc_test(void) {
+  int r = 0;
+  uint8_t buf[BUF_SIZE];
+  sh_rv64_rewrite_info_t rinfo;
+  uintptr_t target = (uintptr_t)code + 0x1000;
+
+  set_code(AUIPC_A0_1, 4);
+  uintptr_t distances[] = {NEAR, FAR_JAL, FAR_AUIPC};
+  size_t lens[] = {8, 8, 8};  // AUIPC + ADDI, or AUIPC + LD from the pool
+  for (size_t i = 0; i < sizeof(distances) / sizeof(distances[0]); i++) {
+    size_t len = rewrite(buf, distances[i], 0, &rinfo);
+    CHECK(lens[i] == len);
+    CHECK((FAR_AUIPC == distances[i] ? 1 : 0) == rinfo.pool_cnt);
+    cpu_t cpu = {0};
+    CHECK(run(&cpu, buf, rinfo.buf_pc, len));
+    CHECK(target == cpu.x[REG_A0]);
+    CHECK(rinfo.buf_pc + len == cpu.pc);
+  }
+
+  // HINT: copied as is
+  set_code(AUIPC_X0_1, 4);
+  CHECK(4 == rewrite(buf, FAR_AUIPC, 0, &rinfo));
+  CHECK(0 == memcmp(buf, code, 4));
+  return r;
+}
+
+static int sh_rv64_rewrite_jal_test(void) {
+  int r = 0;
+  uint8_t buf[BUF_SIZE];
+  sh_rv64_rewrite_info_t rinfo;
+  uintptr_t target = (uintptr_t)code + 0x100;
+  uintptr_t distances[] = {NEAR, FAR_JAL, FAR_AUIPC};
+  size_t lens[] = {4, 8, 12};  // JAL, AUIPC + JALR, AUIPC + LD + JALR
+
+  // JAL RA: RA is the link and the register of the far jump
+  set_code(JAL_RA_100, 4);
+  for (size_t i = 0; i < sizeof(distances) / sizeof(distances[0]); i++) {
+    size_t len = rewrite(buf, distances[i], 0, &rinfo);
+    CHECK(lens[i] == len);
+    cpu_t cpu = {0};
+    CHECK(run(&cpu, buf, rinfo.buf_pc, len));
+    CHECK(target == cpu.pc);
+    CHECK(rinfo.buf_pc + len == cpu.x[REG_RA]);
+  }
+
+  // J, C.J: the far jump corrupts the scratch register only
+  uint32_t insts[] = {J_100, C_J_100};
+  size_t inst_lens[] = {4, 2};
+  for (size_t j = 0; j < sizeof(insts) / sizeof(insts[0]); j++) {
+    set_code(insts[j], inst_lens[j]);
+    for (size_t i = 0; i < sizeof(distances) / sizeof(distances[0]); i++) {
+      size_t len = rewrite(buf, distances[i], REG_T1, &rinfo);
+      CHECK(lens[i] == len);
+      cpu_t cpu = {0};
+      CHECK(run(&cpu, buf, rinfo.buf_pc, len));
+      CHECK(target == cpu.pc);
+      for (size_t reg = 1; reg < 32; reg++)
+        if (REG_T1 != reg) CHECK(0 == cpu.x[reg]);
+    }
+    // no scratch register: only the near one is possible
+    CHECK(4 == rewrite(buf, NEAR, 0, &rinfo));
+    CHECK(0 == rewrite(buf, FAR_JAL, 0, &rinfo));
+  }
+  return r;
+}
+
+static int sh_rv64_rewrite_branch_test(void) {
+  int r = 0;
+  uint8_t buf[BUF_SIZE];
+  sh_rv64_rewrite_info_t rinfo;
+  uintptr_t distances[] = {NEAR, FAR_JAL, FAR_AUIPC};
+  size_t lens[] = {8, 12, 16};  // B!cond + the jump
+
+  // BEQ A0, A1 and C.BEQZ A0: taken when A0 and A1 are 0, not taken when they are 5 and 6
+  uint32_t insts[] = {BEQ_A0_A1_40, C_BEQZ_A0_20};
+  size_t inst_lens[] = {4, 2};
+  uintptr_t targets[] = {(uintptr_t)code + 0x40, (uintptr_t)code + 0x20};
+  for (size_t j = 0; j < sizeof(insts) / sizeof(insts[0]); j++) {
+    set_code(insts[j], inst_lens[j]);
+    for (size_t i = 0; i < sizeof(distances) / sizeof(distances[0]); i++) {
+      size_t len = rewrite(buf, distances[i], REG_T1, &rinfo);
+      CHECK(lens[i] == len);
+      cpu_t taken = {.x[REG_A0] = 0, .x[REG_A1] = 0};
+      CHECK(run(&taken, buf, rinfo.buf_pc, len));
+      CHECK(targets[j] == taken.pc);
+      cpu_t not_taken = {.x[REG_A0] = 5, .x[REG_A1] = 6};
+      CHECK(run(&not_taken, buf, rinfo.buf_pc, len));
+      CHECK(rinfo.buf_pc + len == not_taken.pc);
+    }
+    CHECK(0 == rewrite(buf, FAR_JAL, 0, &rinfo));
+  }
+
+  // into the relocated instructions: a branch within the rewritten code
+  set_code(BEQ_A0_A1_4, 4);
+  code[2] = (uint16_t)ADDI_A0_A0_1;
+  code[3] = (uint16_t)(ADDI_A0_A0_1 >> 16);
+  memset(buf, 0, BUF_SIZE);
+  memset(&rinfo, 0, sizeof(rinfo));
+  rinfo.start_addr = (uintptr_t)code;
+  rinfo.end_addr = (uintptr_t)code + 8;
+  rinfo.buf = buf;
+  rinfo.buf_pc = (uintptr_t)code + FAR_AUIPC;
+  rinfo.buf_size = BUF_SIZE;
+  rinfo.inst_lens[0] = sh_rv64_get_rewrite_inst_len((uintptr_t)code, &rinfo);
+  rinfo.inst_lens[1] = sh_rv64_get_rewrite_inst_len((uintptr_t)code + 4, &rinfo);
+  rinfo.inst_lens_cnt = 2;
+  CHECK(4 == rinfo.inst_lens[0] && 4 == rinfo.inst_lens[1]);
+  CHECK(4 == sh_rv64_rewrite(buf, (uintptr_t)code, &rinfo));
+  CHECK(4 == sh_rv64_rewrite(buf + 4, (uintptr_t)code + 4, &rinfo));
+  cpu_t cpu = {.x[REG_A0] = 1, .x[REG_A1] = 1};
+  CHECK(run(&cpu, buf, rinfo.buf_pc, 4));
+  CHECK(rinfo.buf_pc + 4 == cpu.pc);
+  return r;
+}
+
+#if defined(__riscv)
+typedef uint64_t (*func_t)(uint64_t a0, uint64_t a1);
+
+// run the near rewrites natively: the original code and the rewritten code in one executable buffer
+static int sh_rv64_rewrite_native_test(void) {
+  int r = 0;
+  uint8_t *exec = mmap(NULL, 4096, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  CHECK(MAP_FAILED != exec);
+  if (MAP_FAILED == exec) return r;
+
+  uint32_t ret = RET, li_a0_0 = LI_A0_0, li_a0_1 = LI_A0_1;
+  sh_rv64_rewrite_info_t rinfo;
+  memset(&rinfo, 0, sizeof(rinfo));
+  rinfo.buf = exec;
+  rinfo.buf_pc = (uintptr_t)exec;
+  rinfo.buf_size = 0x100;
+  rinfo.scratch_reg = REG_T1;
+
+  // AUIPC A0, 1 at exec + 0x100 ==> A0 = exec + 0x1100
+  uint32_t inst = AUIPC_A0_1;
+  memcpy(exec + 0x100, &inst, 4);
+  rinfo.start_addr = (uintptr_t)exec + 0x100;
+  rinfo.end_addr = rinfo.start_addr + 4;
+  size_t len = sh_rv64_rewrite(exec, (uintptr_t)exec + 0x100, &rinfo);
+  memcpy(exec + len, &ret, 4);
+  __builtin___clear_cache((char *)exec, (char *)exec + 4096);
+  CHECK((uintptr_t)exec + 0x1100 == ((func_t)(uintptr_t)exec)(0, 0));
+
+  // BEQ A0, A1, 0x40 at exec + 0x100 ==> return 1 if taken, 0 if not
+  inst = BEQ_A0_A1_40;
+  memcpy(exec + 0x100, &inst, 4);
+  memcpy(exec + 0x140, &li_a0_1, 4);
+  memcpy(exec + 0x144, &ret, 4);
+  len = sh_rv64_rewrite(exec, (uintptr_t)exec + 0x100, &rinfo);
+  memcpy(exec + len, &li_a0_0, 4);
+  memcpy(exec + len + 4, &ret, 4);
+  __builtin___clear_cache((char *)exec, (char *)exec + 4096);
+  CHECK(1 == ((func_t)(uintptr_t)exec)(7, 7));
+  CHECK(0 == ((func_t)(uintptr_t)exec)(7, 8));
+
+  munmap(exec, 4096);
+  return r;
+}
+#endif
+
+int main(void) {
+  int r = 0;
+  RUN_CHECK(sh_rv64_rewrite_auipc_test);
+  RUN_CHECK(sh_rv64_rewrite_jal_test);
+  RUN_CHECK(sh_rv64_rewrite_branch_test);
+#if defined(__riscv)
+  RUN_CHECK(sh_rv64_rewrite_native_test);
+#endif
+  return 0 == r ? 0 : 1;
+}
@@ -0,0 +1,182 @@
+// Copyright (c) 2021-2025 ByteDance Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+// the trampos are never in a writable and executable mapping with SH_CONFIG_TRAMPO_WXORX, and a freed trampo
+// is reused only after the delay, without any allocation when it is freed
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sh_util.h"
+
+// the allocations of sh_trampo, they fail when malloc_fail is set
+static bool malloc_fail = false;
+static size_t malloc_cnt = 0;
+static void *sh_test_malloc(size_t size) {
+  malloc_cnt++;
+  return malloc_fail ? NULL : malloc(size);
+}
+static void *sh_test_calloc(size_t n, size_t size) {
+  malloc_cnt++;
+  return malloc_fail ? NULL : calloc(n, size);
+}
+
+// the clock of sh_trampo, moved forward by the test
+static time_t time_offset = 0;
+static time_t sh_test_get_stable_timestamp(void) {
+  return sh_util_get_stable_timestamp() + time_offset;
+}
+
+#define malloc                       sh_test_malloc
+#define calloc                       sh_test_calloc
+#define sh_util_get_stable_timestamp sh_test_get_stable_timestamp
+#include "sh_trampo.c"
+#undef malloc
+#undef calloc
+#undef sh_util_get_stable_timestamp
+
+#include "host_test.h"
+
+#define TRAMPO_SIZE 24
+#define TRAMPO_CNT  600  // more than one chunk
+#define DELAY_SEC   10
+
+typedef struct {
+  uintptr_t start;
+  uintptr_t end;
+  char perms[5];
+  char name[256];
+} vma_t;
+
+// the VMA of /proc/self/maps which contains addr
+static bool find_vma(uintptr_t addr, vma_t *vma) {
+  FILE *fp = fopen("/proc/self/maps", "r");
+  if (NULL == fp) return false;
+
+  char line[512];
+  bool found = false;
+  while (!found && NULL != fgets(line, sizeof(line), fp)) {
+    memset(vma, 0, sizeof(vma_t));
+    if (sscanf(line, "%" SCNxPTR "-%" SCNxPTR " %4s %*s %*s %*s %255[^\n]", &vma->start, &vma->end,
+               vma->perms, vma->name) < 3)
+      continue;
+    found = (vma->start <= addr && addr < vma->end);
+  }
+  fclose(fp);
+  return found;
+}
+
+static int sh_trampo_maps(void) {
+  int r = 0;
+  sh_trampo_mgr_t mgr;
+  sh_trampo_init_mgr(&mgr, TRAMPO_SIZE, DELAY_SEC);
+  size_t chunk_size = sh_trampo_get_chunk_size();
+
+  static uintptr_t trampos[TRAMPO_CNT];
+  for (size_t i = 0; i < TRAMPO_CNT; i++) {
+    trampos[i] = sh_trampo_alloc(&mgr);
+    CHECK(0 != trampos[i]);
+    if (0 == trampos[i]) return r;
+  }
+
+  for (size_t i = 0; i < TRAMPO_CNT; i++) {
+    vma_t exec_vma, rw_vma;
+    uintptr_t trampo = trampos[i];
+    uintptr_t rw = sh_trampo_get_rw_addr(trampo);
+    CHECK(find_vma(trampo, &exec_vma));
+    CHECK(find_vma(rw, &rw_vma));
+
+#ifdef SH_CONFIG_TRAMPO_WXORX
+    // [RX alias][RW alias] of the same memfd
+    CHECK(rw == trampo + chunk_size);
+    CHECK(0 == strcmp(exec_vma.perms, "r-xs"));
+    CHECK(0 == strcmp(rw_vma.perms, "rw-s"));
+    CHECK(exec_vma.end == rw_vma.start);
+    CHECK(exec_vma.end - exec_vma.start == rw_vma.end - rw_vma.start);
+    CHECK(NULL != strstr(exec_vma.name, SH_TRAMPO_CHUNK_ANON_NAME));
+    CHECK(0 == strcmp(exec_vma.name, rw_vma.name));
+#else
+    (void)chunk_size;
+    CHECK(rw == trampo);
+    CHECK(0 == strcmp(exec_vma.perms, "rwxp"));
+#endif
+
+    // written through the RW alias, seen through the exec alias
+    *((volatile uint64_t *)rw) = 0x5348000000000000ULL + i;
+    CHECK(*((volatile uint64_t *)trampo) == 0x5348000000000000ULL + i);
+  }
+
+#ifdef SH_CONFIG_TRAMPO_WXORX
+  // no writable and executable trampo mapping at all
+  FILE *fp = fopen("/proc/self/maps", "r");
+  CHECK(NULL != fp);
+  if (NULL == fp) return r;
+  char line[512];
+  while (NULL != fgets(line, sizeof(line), fp)) {
+    if (NULL != strstr(line, SH_TRAMPO_CHUNK_ANON_NAME)) CHECK(NULL == strstr(line, " rwx"));
+  }
+  fclose(fp);
+#endif
+
+  return r;
+}
+
+static int sh_trampo_free_delay(void) {
+  int r = 0;
+  sh_trampo_mgr_t mgr;
+  sh_trampo_init_mgr(&mgr, TRAMPO_SIZE, DELAY_SEC);
+  size_t trampo_count = sh_util_get_page_size() / mgr.trampo_size;
+
+  // delayed: not reused within the delay
+  uintptr_t trampo = sh_trampo_alloc(&mgr);
+  CHECK(0 != trampo);
+  sh_trampo_free(&mgr, trampo);
+  for (size_t i = 0; i < trampo_count * 2; i++) CHECK(trampo != sh_trampo_alloc(&mgr));
+
+  // expired: reused
+  time_offset += DELAY_SEC + 1;
+  bool is_reused = false;
+  for (size_t i = 0; i < trampo_count * 2 && !is_reused; i++) is_reused = (trampo == sh_trampo_alloc(&mgr));
+  CHECK(is_reused);
+
+  // free never allocates, so it can not fail and the trampo is still delayed
+  trampo = sh_trampo_alloc(&mgr);
+  CHECK(0 != trampo);
+  malloc_fail = true;
+  malloc_cnt = 0;
+  sh_trampo_free(&mgr, trampo);
+  CHECK(0 == malloc_cnt);
+  malloc_fail = false;
+  for (size_t i = 0; i < trampo_count * 2; i++) CHECK(trampo != sh_trampo_alloc(&mgr));
+
+  return r;
+}
+
+int main(void) {
+  int r = 0;
+  RUN_CHECK(sh_trampo_maps);
+  RUN_CHECK(sh_trampo_free_delay);
+  return 0 == r ? 0 : 1;
+}
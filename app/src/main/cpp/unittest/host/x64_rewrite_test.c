@@ -0,0 +1,440 @@
+// Copyright (c) 2021-2025 ByteDance Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+// the instruction lengths of the x86_64 decoder, and the RIP-relative and branch rewrites of the relocator,
+// for each distance between the original instruction and the enter: the rewritten code is run by a small
+// interpreter of the instructions it may contain, and natively as well when the test is built for x86_64
+
+#include "sh_x64.c"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#if defined(__x86_64__)
+#include <sys/mman.h>
+#endif
+
+#include "host_test.h"
+
+// the distance from the original instruction to the enter
+#define NEAR 0x1000
+#define FAR  0x100000000  // out of the range of rel32
+
+#define BUF_SIZE 64
+
+typedef struct {
+  uint8_t bytes[16];
+  size_t len;  // 0: not recognized
+  bool is_end;
+} inst_t;
+
+static const inst_t insts[] = {
+    {{0x90}, 1, false},                                                         // NOP
+    {{0xC3}, 1, true},                                                          // RET
+    {{0x55}, 1, false},                                                         // PUSH RBP
+    {{0x48, 0x89, 0xE5}, 3, false},                                             // MOV RBP, RSP
+    {{0x48, 0x83, 0xEC, 0x10}, 4, false},                                       // SUB RSP, 0x10
+    {{0xB8, 0x78, 0x56, 0x34, 0x12}, 5, false},                                 // MOV EAX, imm32
+    {{0x48, 0xB8, 0x88, 0x77, 0x66, 0x55, 0x44, 0x33, 0x22, 0x11}, 10, false},  // MOV RAX, imm64
+    {{0x48, 0xA1, 0x88, 0x77, 0x66, 0x55, 0x44, 0x33, 0x22, 0x11}, 10, false},  // MOV RAX, moffs64
+    {{0x48, 0x8D, 0x05, 0x00, 0x01, 0x00, 0x00}, 7, false},                     // LEA RAX, [RIP + 0x100]
+    {{0x48, 0x8B, 0x44, 0x24, 0x08}, 5, false},                                 // MOV RAX, [RSP + 8]
+    {{0x48, 0x89, 0x7D, 0xF8}, 4, false},                                       // MOV [RBP - 8], RDI
+    {{0x64, 0x48, 0x8B, 0x04, 0x25, 0x28, 0x00, 0x00, 0x00}, 9, false},         // MOV RAX, FS:[0x28]
+    {{0x66, 0xC7, 0x00, 0x34, 0x12}, 5, false},                                 // MOV WORD [RAX], imm16
+    {{0xF3, 0x0F, 0x1E, 0xFA}, 4, false},                                       // ENDBR64
+    {{0xA8, 0x01}, 2, false},                                                   // TEST AL, 1
+    {{0xF7, 0x00, 0x78, 0x56, 0x34, 0x12}, 6, false},                           // TEST DWORD [RAX], imm32
+    {{0x80, 0x3D, 0x00, 0x01, 0x00, 0x00, 0x05}, 7, false},                     // CMP BYTE [RIP + 0x100], 5
+    {{0x66, 0x0F, 0x6F, 0x05, 0x00, 0x01, 0x00, 0x00}, 8, false},               // MOVDQA XMM0, [RIP + 0x100]
+    {{0x66, 0x0F, 0x70, 0xC0, 0x1B}, 5, false},                                 // PSHUFD XMM0, XMM0, 0x1B
+    {{0x66, 0x0F, 0x3A, 0x0F, 0xC1, 0x08}, 6, false},                           // PALIGNR XMM0, XMM1, 8
+    {{0xC5, 0xF8, 0x77}, 3, false},                                             // VZEROUPPER
+    {{0xC5, 0xFE, 0x6F, 0x07}, 4, false},                                       // VMOVDQU YMM0, [RDI]
+    {{0x62, 0xF3, 0x75, 0x48, 0x25, 0xC2, 0xFF}, 7, false},                     // VPTERNLOGD ZMM0, ZMM1, ZMM2
+    {{0x74, 0x10}, 2, false},                                                   // JE rel8
+    {{0x0F, 0x84, 0x00, 0x10, 0x00, 0x00}, 6, false},                           // JE rel32
+    {{0xE3, 0x10}, 2, false},                                                   // JRCXZ rel8
+    {{0x67, 0xE3, 0x10}, 3, false},                                             // JECXZ rel8
+    {{0xE2, 0x10}, 2, false},                                                   // LOOP rel8
+    {{0xE8, 0x00, 0x10, 0x00, 0x00}, 5, false},                                 // CALL rel32
+    {{0x66, 0xE8, 0x00, 0x10, 0x00, 0x00}, 6, false},                           // CALL rel32 (padding)
+    {{0xE9, 0x00, 0x10, 0x00, 0x00}, 5, true},                                  // JMP rel32
+    {{0xEB, 0x10}, 2, true},                                                    // JMP rel8
+    {{0xFF, 0xE0}, 2, true},                                                    // JMP RAX
+    {{0xFF, 0x25, 0x10, 0x00, 0x00, 0x00}, 6, true},                            // JMP [RIP + 0x10]
+    {{0x0F, 0x0B}, 2, true},                                                    // UD2
+    {{0xCC}, 1, true},                                                          // INT3
+    {{0xF4}, 1, true},                                                          // HLT
+    {{0x06}, 0, false},                                                         // PUSH ES (invalid)
+    {{0x66, 0x74, 0x10}, 0, false},                                             // JE rel16 (invalid)
+    {{0xC7, 0xF8, 0x00, 0x10, 0x00, 0x00}, 0, false},                           // XBEGIN rel32
+    {{0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x48, 0xB8}, 0,
+     false},  // longer than 15 bytes
+};
+
+// the interpreter state: the original condition of Jcc (or JRCXZ / LOOP) holds or not, where the control
+// leaves the rewritten code, the return address of a CALL, and the register of MOV imm64
+typedef struct {
+  uint8_t cond;
+  bool is_cond_true;
+  uintptr_t pc;
+  uintptr_t ret;
+  uint8_t reg;
+  uint64_t imm;
+} cpu_t;
+
+static int32_t rel32_at(const uint8_t *p) {
+  int32_t rel;
+  memcpy(&rel, p, sizeof(rel));
+  return rel;
+}
+
+// Run the rewritten code (len bytes of buf, executed at buf_pc) from its first instruction until the pc
+// leaves it. Only the instructions emitted by the relocator are known, return false for the others.
+static bool run(cpu_t *cpu, const uint8_t *buf, uintptr_t buf_pc, size_t len) {
+  cpu->pc = buf_pc;
+  for (size_t steps = 0; cpu->pc - buf_pc < len; steps++) {
+    if (steps >= 8) return false;
+    const uint8_t *p = buf + (cpu->pc - buf_pc);
+    size_t prefixes = (0x67 == p[0] ? 1 : 0);
+    uint8_t op = p[prefixes];
+
+    if (op >= 0x70 && op <= 0x7F) {  // Jcc rel8
+      bool taken = ((op & 0x0Fu) == cpu->cond) == cpu->is_cond_true;
+      cpu->pc += 2 + (taken ? (uintptr_t)(int64_t)(int8_t)p[1] : 0);
+    } else if (0x0F == op && 0x80 == (p[1] & 0xF0u)) {  // Jcc rel32
+      bool taken = ((p[1] & 0x0Fu) == cpu->cond) == cpu->is_cond_true;
+      cpu->pc += 6 + (taken ? (uintptr_t)(int64_t)rel32_at(p + 2) : 0);
+    } else if (op >= 0xE0 && op <= 0xE3) {  // JRCXZ, LOOPcc rel8
+      if (op != cpu->cond) return false;
+      cpu->pc += prefixes + 2 + (cpu->is_cond_true ? (uintptr_t)(int64_t)(int8_t)p[prefixes + 1] : 0);
+    } else if (0xEB == op) {  // JMP rel8
+      cpu->pc += 2 + (uintptr_t)(int64_t)(int8_t)p[1];
+    } else if (0xE9 == op) {  // JMP rel32
+      cpu->pc += 5 + (uintptr_t)(int64_t)rel32_at(p + 1);
+    } else if (0xE8 == op) {  // CALL rel32
+      cpu->ret = cpu->pc + 5;
+      cpu->pc += 5 + (uintptr_t)(int64_t)rel32_at(p + 1);
+      return true;
+    } else if (0xFF == op && (0x15 == p[1] || 0x25 == p[1])) {  // CALL / JMP [RIP + disp32], from buf
+      uintptr_t addr = cpu->pc + 6 + (uintptr_t)(int64_t)rel32_at(p + 2);
+      if (addr < buf_pc || addr + 8 > buf_pc + len) return false;
+      if (0x15 == p[1]) cpu->ret = cpu->pc + 6;
+      memcpy(&cpu->pc, buf + (addr - buf_pc), sizeof(cpu->pc));
+      if (0x15 == p[1]) return true;
+    } else if (0x48 == (op & 0xFEu) && 0xB8 == (p[1] & 0xF8u)) {  // MOV r64, imm64
+      cpu->reg = (uint8_t)((p[1] & 7u) | ((op & 1u) << 3u));
+      memcpy(&cpu->imm, p + 2, sizeof(cpu->imm));
+      cpu->pc += 10;
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+// the original instructions
+static uint8_t code[64];
+
+static void set_code(const uint8_t *inst, size_t len) {
+  memset(code, 0x90, sizeof(code));  // NOP
+  memcpy(code, inst, len);
+}
+
+// rewrite the first inst_len bytes of code into buf, as if buf was executed at code + distance,
+// return the length (0: failed)
+static size_t rewrite(uint8_t *buf, size_t inst_len, uintptr_t distance, sh_x64_rewrite_info_t *rinfo) {
+  memset(buf, 0, BUF_SIZE);
+  memset(rinfo, 0, sizeof(sh_x64_rewrite_info_t));
+  rinfo->start_addr = (uintptr_t)code;
+  rinfo->end_addr = (uintptr_t)code + inst_len;
+  rinfo->buf = buf;
+  rinfo->buf_pc = (uintptr_t)code + distance;
+  rinfo->buf_size = BUF_SIZE;
+  rinfo->inst_lens_cnt = 1;
+
+  size_t len = sh_x64_get_rewrite_inst_len((uintptr_t)code, rinfo);
+  if (0 == len) return 0;
+  rinfo->inst_lens[0] = len;
+  size_t written = sh_x64_rewrite(buf, (uintptr_t)code, rinfo);
+  return written == len ? len : 0;
+}
+
+static int sh_x64_inst_len_test(void) {
+  int r = 0;
+  for (size_t i = 0; i < sizeof(insts) / sizeof(insts[0]); i++) {
+    bool is_end = !insts[i].is_end;
+    size_t len = sh_x64_get_inst_len(insts[i].bytes, &is_end);
+    if (insts[i].len != len) fprintf(stderr, "inst %zu: len %zu, expected %zu\n", i, len, insts[i].len);
+    CHECK(insts[i].len == len);
+    if (0 != len) CHECK(insts[i].is_end == is_end);
+  }
+  return r;
+}
+
+static int sh_x64_rewrite_rip_rel_test(void) {
+  int r = 0;
+  uint8_t buf[BUF_SIZE];
+  sh_x64_rewrite_info_t rinfo;
+
+  // LEA RAX / R9, [RIP + 0x100]: the disp32 is fixed, or MOV RAX / R9, imm64
+  static const uint8_t lea_rax[] = {0x48, 0x8D, 0x05, 0x00, 0x01, 0x00, 0x00};
+  static const uint8_t lea_r9[] = {0x4C, 0x8D, 0x0D, 0x00, 0x01, 0x00, 0x00};
+  const uint8_t *leas[] = {lea_rax, lea_r9};
+  uint8_t regs[] = {0, 9};
+  for (size_t j = 0; j < 2; j++) {
+    set_code(leas[j], 7);
+    uintptr_t target = (uintptr_t)code + 7 + 0x100;
+    CHECK(7 == rewrite(buf, 7, NEAR, &rinfo));
+    CHECK(0 == memcmp(buf, leas[j], 3));
+    CHECK(target == rinfo.buf_pc + 7 + (uintptr_t)(int64_t)rel32_at(buf + 3));
+    CHECK(10 == rewrite(buf, 7, FAR, &rinfo));
+    cpu_t cpu = {0};
+    CHECK(run(&cpu, buf, rinfo.buf_pc, 10));
+    CHECK(regs[j] == cpu.reg);
+    CHECK(target == cpu.imm);
+  }
+
+  // CMP BYTE [RIP + 0x100], 5: the immediate follows the disp32, and it is a part of the instruction
+  static const uint8_t cmp[] = {0x80, 0x3D, 0x00, 0x01, 0x00, 0x00, 0x05};
+  set_code(cmp, 7);
+  CHECK(7 == rewrite(buf, 7, NEAR, &rinfo));
+  CHECK(0 == memcmp(buf, cmp, 2) && 0x05 == buf[6]);
+  CHECK((uintptr_t)code + 7 + 0x100 == rinfo.buf_pc + 7 + (uintptr_t)(int64_t)rel32_at(buf + 2));
+
+  // MOVDQA XMM0, [RIP + 0x100]: the prefixes are kept, only the near one is possible
+  static const uint8_t movdqa[] = {0x66, 0x0F, 0x6F, 0x05, 0x00, 0x01, 0x00, 0x00};
+  set_code(movdqa, 8);
+  CHECK(8 == rewrite(buf, 8, NEAR, &rinfo));
+  CHECK(0 == memcmp(buf, movdqa, 4));
+  CHECK((uintptr_t)code + 8 + 0x100 == rinfo.buf_pc + 8 + (uintptr_t)(int64_t)rel32_at(buf + 4));
+  CHECK(0 == rewrite(buf, 8, FAR, &rinfo));
+  return r;
+}
+
+static int sh_x64_rewrite_branch_test(void) {
+  int r = 0;
+  uint8_t buf[BUF_SIZE];
+  sh_x64_rewrite_info_t rinfo;
+  uintptr_t distances[] = {NEAR, FAR};
+
+  // Jcc, JRCXZ / LOOP: to the target if the condition holds, to the next instruction if not
+  static const inst_t jccs[] = {
+      {{0x74, 0x10}, 2, false},                          // JE rel8
+      {{0x0F, 0x85, 0x00, 0x10, 0x00, 0x00}, 6, false},  // JNE rel32
+      {{0xE3, 0x10}, 2, false},                          // JRCXZ rel8
+      {{0x67, 0xE3, 0x10}, 3, false},                    // JECXZ rel8
+      {{0xE2, 0x10}, 2, false},                          // LOOP rel8
+  };
+  uint8_t conds[] = {0x4, 0x5, 0xE3, 0xE3, 0xE2};
+  uintptr_t rels[] = {0x10, 0x1000, 0x10, 0x10, 0x10};
+  size_t lens[][2] = {{6, 16}, {6, 16}, {9, 18}, {10, 19}, {9, 18}};
+  for (size_t j = 0; j < sizeof(jccs) / sizeof(jccs[0]); j++) {
+    set_code(jccs[j].bytes, jccs[j].len);
+    uintptr_t target = (uintptr_t)code + jccs[j].len + rels[j];
+    for (size_t i = 0; i < sizeof(distances) / sizeof(distances[0]); i++) {
+      size_t len = rewrite(buf, jccs[j].len, distances[i], &rinfo);
+      CHECK(lens[j][i] == len);
+      cpu_t taken = {.cond = conds[j], .is_cond_true = true};
+      CHECK(run(&taken, buf, rinfo.buf_pc, len));
+      CHECK(target == taken.pc);
+      cpu_t not_taken = {.cond = conds[j], .is_cond_true = false};
+      CHECK(run(&not_taken, buf, rinfo.buf_pc, len));
+      CHECK(rinfo.buf_pc + len == not_taken.pc);
+    }
+    // 0x67 selects ECX
+    if (0x67 == jccs[j].bytes[0]) CHECK(0x67 == buf[0]);
+  }
+
+  // CALL rel32: the return address is the next instruction of the rewritten code
+  static const uint8_t call[] = {0xE8, 0x00, 0x10, 0x00, 0x00};
+  set_code(call, 5);
+  size_t call_lens[] = {5, 16};  // CALL rel32, or CALL [RIP + 2] + JMP + the address
+  for (size_t i = 0; i < sizeof(distances) / sizeof(distances[0]); i++) {
+    size_t len = rewrite(buf, 5, distances[i], &rinfo);
+    CHECK(call_lens[i] == len);
+    cpu_t cpu = {0};
+    CHECK(run(&cpu, buf, rinfo.buf_pc, len));
+    CHECK((uintptr_t)code + 5 + 0x1000 == cpu.pc);
+    if (FAR == distances[i]) {
+      // the JMP after the CALL skips the address
+      CHECK(rinfo.buf_pc + 6 == cpu.ret);
+      cpu_t back = {0};
+      CHECK(run(&back, buf + 6, cpu.ret, len - 6));
+      CHECK(rinfo.buf_pc + len == back.pc);
+    } else {
+      CHECK(rinfo.buf_pc + len == cpu.ret);
+    }
+  }
+
+  // JMP rel8 / rel32: JMP rel32, or JMP [RIP + 0] + the address
+  static const inst_t jmps[] = {
+      {{0xEB, 0x10}, 2, true},                    // JMP rel8
+      {{0xE9, 0x00, 0x10, 0x00, 0x00}, 5, true},  // JMP rel32
+  };
+  uintptr_t jmp_rels[] = {0x10, 0x1000};
+  size_t jmp_lens[] = {5, 14};
+  for (size_t j = 0; j < sizeof(jmps) / sizeof(jmps[0]); j++) {
+    set_code(jmps[j].bytes, jmps[j].len);
+    for (size_t i = 0; i < sizeof(distances) / sizeof(distances[0]); i++) {
+      size_t len = rewrite(buf, jmps[j].len, distances[i], &rinfo);
+      CHECK(jmp_lens[i] == len);
+      cpu_t cpu = {0};
+      CHECK(run(&cpu, buf, rinfo.buf_pc, len));
+      CHECK((uintptr_t)code + jmps[j].len + jmp_rels[j] == cpu.pc);
+    }
+  }
+  return r;
+}
+
+static int sh_x64_rewrite_branch_inside_test(void) {
+  int r = 0;
+  uint8_t buf[BUF_SIZE];
+  sh_x64_rewrite_info_t rinfo;
+
+  // JE +1; NOP; NOP: the target is the second NOP, which is relocated too, even if the enter is far away
+  static const uint8_t je_nop_nop[] = {0x74, 0x01, 0x90, 0x90};
+  set_code(je_nop_nop, 4);
+  memset(buf, 0, BUF_SIZE);
+  memset(&rinfo, 0, sizeof(rinfo));
+  rinfo.start_addr = (uintptr_t)code;
+  rinfo.end_addr = (uintptr_t)code + 4;
+  rinfo.buf = buf;
+  rinfo.buf_pc = (uintptr_t)code + FAR;
+  rinfo.buf_size = BUF_SIZE;
+  rinfo.inst_lens_cnt = 3;
+  uintptr_t pc = (uintptr_t)code;
+  for (size_t i = 0; i < rinfo.inst_lens_cnt; i++) {
+    rinfo.inst_lens[i] = sh_x64_get_rewrite_inst_len(pc, &rinfo);
+    pc += sh_x64_get_inst_len((uint8_t *)pc, NULL);
+  }
+  CHECK(6 == rinfo.inst_lens[0] && 1 == rinfo.inst_lens[1] && 1 == rinfo.inst_lens[2]);
+  CHECK(6 == sh_x64_rewrite(buf, (uintptr_t)code, &rinfo));
+  cpu_t cpu = {.cond = 0x4, .is_cond_true = true};
+  CHECK(run(&cpu, buf, rinfo.buf_pc, 6));
+  CHECK(rinfo.buf_pc + 7 == cpu.pc);
+
+  // JE +1; MOV RBP, RSP: the target is in the middle of a relocated instruction
+  static const uint8_t je_mov[] = {0x74, 0x01, 0x48, 0x89, 0xE5};
+  set_code(je_mov, 5);
+  rinfo.end_addr = (uintptr_t)code + 5;
+  rinfo.inst_lens_cnt = 2;
+  rinfo.inst_lens[0] = 6;
+  rinfo.inst_lens[1] = 3;
+  CHECK(0 == sh_x64_rewrite(buf, (uintptr_t)code, &rinfo));
+  return r;
+}
+
+static int sh_x64_is_branch_into_test(void) {
+  int r = 0;
+  uintptr_t low = (uintptr_t)code, high = (uintptr_t)code + 5;
+
+  // 5 NOPs are the patched range (low, high), then the code which may branch into it
+  static const uint8_t je_low[] = {0x74, 0xF9};                                    // JE code + 0
+  static const uint8_t je_inside[] = {0x74, 0xFA};                                 // JE code + 1
+  static const uint8_t jmp_high[] = {0xEB, 0xFE};                                  // JMP code + 5
+  static const uint8_t call_inside[] = {0xE8, 0xF8, 0xFF, 0xFF, 0xFF};             // CALL code + 2
+  static const uint8_t jrcxz_inside[] = {0xE3, 0xFC};                              // JRCXZ code + 3
+  static const uint8_t lea_inside[] = {0x48, 0x8D, 0x05, 0xF5, 0xFF, 0xFF, 0xFF};  // LEA RAX, [code + 1]
+  static const uint8_t invalid_je_inside[] = {0x06, 0x74, 0xF9};                   // PUSH ES; JE code + 1
+  struct {
+    const uint8_t *bytes;
+    size_t len;
+    bool is_into;
+  } cases[] = {
+      {je_low, sizeof(je_low), false},
+      {je_inside, sizeof(je_inside), true},
+      {jmp_high, sizeof(jmp_high), false},
+      {call_inside, sizeof(call_inside), true},
+      {jrcxz_inside, sizeof(jrcxz_inside), true},
+      {lea_inside, sizeof(lea_inside), false},
+      {invalid_je_inside, sizeof(invalid_je_inside), false},
+  };
+  for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+    memset(code, 0x90, sizeof(code));
+    memcpy(code + 5, cases[i].bytes, cases[i].len);
+    CHECK(cases[i].is_into == sh_x64_is_branch_into(high, high + cases[i].len, low, high));
+  }
+  return r;
+}
+
+#if defined(__x86_64__)
+typedef uint64_t (*func_t)(uint64_t rdi);
+
+// run the near rewrites natively: the original code and the rewritten code in one executable buffer
+static int sh_x64_rewrite_native_test(void) {
+  int r = 0;
+  uint8_t *exec = mmap(NULL, 4096, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  CHECK(MAP_FAILED != exec);
+  if (MAP_FAILED == exec) return r;
+
+  sh_x64_rewrite_info_t rinfo;
+  memset(&rinfo, 0, sizeof(rinfo));
+  rinfo.buf = exec;
+  rinfo.buf_pc = (uintptr_t)exec;
+  rinfo.buf_size = 0x100;
+  rinfo.inst_lens_cnt = 1;
+
+  // LEA RAX, [RIP + 0x100] at exec + 0x100 ==> RAX = exec + 0x207
+  static const uint8_t lea[] = {0x48, 0x8D, 0x05, 0x00, 0x01, 0x00, 0x00};
+  memcpy(exec + 0x100, lea, sizeof(lea));
+  rinfo.start_addr = (uintptr_t)exec + 0x100;
+  rinfo.end_addr = rinfo.start_addr + sizeof(lea);
+  size_t len = sh_x64_rewrite(exec, (uintptr_t)exec + 0x100, &rinfo);
+  exec[len] = 0xC3;  // RET
+  CHECK((uintptr_t)exec + 0x207 == ((func_t)(uintptr_t)exec)(0));
+
+  // TEST EDI, EDI; JE +0x40 at exec + 0x100 ==> return 1 if taken, 0 if not
+  static const uint8_t je[] = {0x74, 0x40};
+  static const uint8_t ret_1[] = {0xB8, 0x01, 0x00, 0x00, 0x00, 0xC3};  // MOV EAX, 1; RET
+  static const uint8_t ret_0[] = {0x31, 0xC0, 0xC3};                    // XOR EAX, EAX; RET
+  memcpy(exec + 0x100, je, sizeof(je));
+  memcpy(exec + 0x142, ret_1, sizeof(ret_1));
+  exec[0] = 0x85;  // TEST EDI, EDI
+  exec[1] = 0xFF;
+  rinfo.end_addr = rinfo.start_addr + sizeof(je);
+  rinfo.buf = exec + 2;
+  rinfo.buf_pc = (uintptr_t)exec + 2;
+  len = sh_x64_rewrite(exec + 2, (uintptr_t)exec + 0x100, &rinfo);
+  memcpy(exec + 2 + len, ret_0, sizeof(ret_0));
+  CHECK(1 == ((func_t)(uintptr_t)exec)(0));
+  CHECK(0 == ((func_t)(uintptr_t)exec)(1));
+
+  munmap(exec, 4096);
+  return r;
+}
+#endif
+
+int main(void) {
+  int r = 0;
+  RUN_CHECK(sh_x64_inst_len_test);
+  RUN_CHECK(sh_x64_rewrite_rip_rel_test);
+  RUN_CHECK(sh_x64_rewrite_branch_test);
+  RUN_CHECK(sh_x64_rewrite_branch_inside_test);
+  RUN_CHECK(sh_x64_is_branch_into_test);
+#if defined(__x86_64__)
+  RUN_CHECK(sh_x64_rewrite_native_test);
+#endif
+  return 0 == r ? 0 : 1;
+}
@@ -39,6 +39,7 @@
 #include <sched.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/sysinfo.h>
@@ -1309,6 +1310,46 @@ static void unittest_benchmark_in_mode(const char *mode, test_t test_func) {
   LOG("%zu cycles take %" PRIu64 " us (in %s mode)", cycles, end - start, mode);
 }
 
+static void unittest_benchmark_histogram(test_t test_func) {
+  void *histogram = NULL;
+  void *stub = shadowhook_histogram((void *)test_func, &histogram);
+  if (NULL == stub) {
+    LOG("unittest: histogram FAILED. errno %d", shadowhook_get_errno());
+    return;
+  }
+
+  unittest_benchmark_in_mode("HISTOGRAM", test_func);
+
+  shadowhook_histogram_t result;
+  shadowhook_get_histogram(histogram, &result);
+  LOG("histogram: %" PRIu64 " calls recorded", result.count);
+  for (size_t i = 0; i < SHADOWHOOK_HISTOGRAM_BUCKET_CNT; i++) {
+    if (0 == result.buckets[i]) continue;
+    LOG("histogram: [%llu, %llu) ns: %" PRIu64, 1ULL << i, 1ULL << (i + 1), result.buckets[i]);
+  }
+
+  shadowhook_unhook(stub);
+}
+
+// memory footprint: number of VMAs, and how many of them are created by shadowhook
+static void unittest_benchmark_vma(const char *when) {
+  FILE *fp = fopen("/proc/self/maps", "r");
+  if (NULL == fp) return;
+
+  // the trampolines are anonymous pages, or memfd pages when they are mapped W^X
+  size_t vma_cnt = 0, sh_vma_cnt = 0, sh_rwx_vma_cnt = 0;
+  char line[1024];
+  while (NULL != fgets(line, sizeof(line), fp)) {
+    if (NULL != strstr(line, "[anon:shadowhook-") || NULL != strstr(line, "/memfd:shadowhook-")) {
+      sh_vma_cnt++;
+      if (NULL != strstr(line, " rwx")) sh_rwx_vma_cnt++;
+    }
+    if (NULL != strchr(line, '\n')) vma_cnt++;
+  }
+  fclose(fp);
+  LOG("VMA count %s benchmark: %zu (shadowhook: %zu, rwx: %zu)", when, vma_cnt, sh_vma_cnt, sh_rwx_vma_cnt);
+}
+
 static void unittest_benchmark_in_core(bool big_core) {
   LOG("*** UNIT TEST: benchmark ***");
   unittest_set_cpu_affinity(big_core);
@@ -1317,17 +1358,21 @@ static void unittest_benchmark_in_core(bool big_core) {
   unittest_benchmark_in_mode("UNIQUE", test_t16_for_unique);
   unittest_benchmark_in_mode("MULTI", test_t16_for_multi);
   unittest_benchmark_in_mode("SHARED", test_t16_for_shared);
+  unittest_benchmark_histogram(test_t16_for_histogram);
 #elif defined(__aarch64__)
   unittest_benchmark_in_mode("UNIQUE", test_a64_for_unique);
   unittest_benchmark_in_mode("MULTI", test_a64_for_multi);
   unittest_benchmark_in_mode("SHARED", test_a64_for_shared);
+  unittest_benchmark_histogram(test_a64_for_histogram);
 #endif
 }
 
 int unittest_benchmark(void) {
   unittest_is_benchmark = true;
+  unittest_benchmark_vma("before");
   unittest_benchmark_in_core(true);
   unittest_benchmark_in_core(false);
+  unittest_benchmark_vma("after");
   unittest_is_benchmark = false;
   return 0;
 }
@@ -38,3 +38,4 @@ int unittest_unintercept(void);
 
 int unittest_run(bool hookee2_loaded);
 int unittest_benchmark(void);
+int unittest_api(void);
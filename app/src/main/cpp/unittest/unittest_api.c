@@ -0,0 +1,189 @@
+// Copyright (c) 2021-2025 ByteDance Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+// checks of the bulk and query APIs, each one reports PASS or FAIL
+
+#include <android/log.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hookee.h"
+#include "hooker.h"
+#include "shadowhook.h"
+#include "unittest.h"
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wgnu-zero-variadic-macro-arguments"
+
+#define LOG(fmt, ...) __android_log_print(ANDROID_LOG_INFO, "shadowhook_tag", fmt, ##__VA_ARGS__)
+
+#define CHECK(cond)                                               \
+  do {                                                            \
+    if (!(cond)) {                                                \
+      LOG("unittest api: %s: check failed: %s", __func__, #cond); \
+      r = -1;                                                     \
+    }                                                             \
+  } while (0)
+
+typedef int (*test_t)(int, int);
+
+static int batch_1_calls = 0;
+static int batch_2_calls = 0;
+static test_t orig_batch_1 = NULL;
+static test_t orig_batch_2 = NULL;
+
+static int proxy_batch_1(int a, int b) {
+  batch_1_calls++;
+  return orig_batch_1(a, b);
+}
+
+static int proxy_batch_2(int a, int b) {
+  batch_2_calls++;
+  return orig_batch_2(a, b);
+}
+
+static int replace_old_calls = 0;
+static int replace_new_calls = 0;
+static bool replace_is_shared = false;
+static test_t orig_replace = NULL;
+
+static int proxy_replace_old(int a, int b) {
+  replace_old_calls++;
+  if (!replace_is_shared) return orig_replace(a, b);
+  int c = SHADOWHOOK_CALL_PREV(proxy_replace_old, test_t, a, b);
+  SHADOWHOOK_POP_STACK();
+  return c;
+}
+
+static int proxy_replace_new(int a, int b) {
+  replace_new_calls++;
+  if (!replace_is_shared) return orig_replace(a, b);
+  int c = SHADOWHOOK_CALL_PREV(proxy_replace_new, test_t, a, b);
+  SHADOWHOOK_POP_STACK();
+  return c;
+}
+
+// unhook_by_lib() only removes the hooks created by code in the given lib
+static int unittest_api_unhook_by_lib(void) {
+  int r = 0;
+  void *stub_1 = shadowhook_hook_sym_addr_2((void *)test_batch_1, (void *)proxy_batch_1,
+                                            (void **)&orig_batch_1, SHADOWHOOK_HOOK_WITH_UNIQUE_MODE);
+  void *stub_2 = hooker_hook((void *)test_batch_2, (void *)proxy_batch_2, (void **)&orig_batch_2,
+                             SHADOWHOOK_HOOK_WITH_UNIQUE_MODE);
+  CHECK(NULL != stub_1);
+  CHECK(NULL != stub_2);
+  if (0 != r) goto end;
+
+  CHECK(0 == shadowhook_unhook_by_lib("libhooker.so"));
+  CHECK(shadowhook_is_hooked((void *)test_batch_1));
+  CHECK(!shadowhook_is_hooked((void *)test_batch_2));
+
+  batch_1_calls = batch_2_calls = 0;
+  CHECK(12 == test_batch_1(4, 8));
+  CHECK(12 == test_batch_2(4, 8));
+  CHECK(1 == batch_1_calls);
+  CHECK(0 == batch_2_calls);
+
+end:
+  if (NULL != stub_1) shadowhook_unhook(stub_1);
+  if (NULL != stub_2 && shadowhook_is_hooked((void *)test_batch_2)) shadowhook_unhook(stub_2);
+  return r;
+}
+
+// replace_proxy() moves the calls to the new proxy in each mode, and back again (the replaced proxy is
+// not re-enabled in place of the new one)
+static int unittest_api_replace_proxy(void) {
+  int r = 0;
+  uint32_t modes[] = {SHADOWHOOK_HOOK_WITH_UNIQUE_MODE, SHADOWHOOK_HOOK_WITH_MULTI_MODE,
+                      SHADOWHOOK_HOOK_WITH_SHARED_MODE};
+  for (size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); i++) {
+    replace_is_shared = (SHADOWHOOK_HOOK_WITH_SHARED_MODE == modes[i]);
+    void *stub = shadowhook_hook_sym_addr_2((void *)test_batch_1, (void *)proxy_replace_old,
+                                            (void **)&orig_replace, modes[i]);
+    CHECK(NULL != stub);
+    if (NULL == stub) continue;
+
+    replace_old_calls = replace_new_calls = 0;
+    CHECK(12 == test_batch_1(4, 8));
+    CHECK(1 == replace_old_calls && 0 == replace_new_calls);
+
+    CHECK(0 == shadowhook_replace_proxy(stub, (void *)proxy_replace_new));
+    CHECK(12 == test_batch_1(4, 8));
+    CHECK(1 == replace_old_calls && 1 == replace_new_calls);
+
+    CHECK(0 == shadowhook_replace_proxy(stub, (void *)proxy_replace_old));
+    CHECK(12 == test_batch_1(4, 8));
+    CHECK(2 == replace_old_calls && 1 == replace_new_calls);
+
+    CHECK(0 == shadowhook_unhook(stub));
+    CHECK(12 == test_batch_1(4, 8));
+    CHECK(2 == replace_old_calls && 1 == replace_new_calls);
+  }
+  return r;
+}
+
+// probes survive unhook_all(), and their probe set can still be collected and destroyed
+static int unittest_api_probe_unhook_all(void) {
+  int r = 0;
+  void *funcs[] = {(void *)test_batch_1, (void *)test_batch_2};
+  void *probes = shadowhook_probe_once(funcs, sizeof(funcs) / sizeof(funcs[0]));
+  CHECK(NULL != probes);
+  if (NULL == probes) return r;
+
+  CHECK(0 == shadowhook_unhook_all());
+  CHECK(shadowhook_is_hooked((void *)test_batch_1));
+  CHECK(shadowhook_is_hooked((void *)test_batch_2));
+
+  uint8_t hits = 0;
+  CHECK(12 == test_batch_1(4, 8));
+  CHECK(1 == shadowhook_probe_collect(probes, &hits));
+  CHECK(0x1 == hits);
+  CHECK(!shadowhook_is_hooked((void *)test_batch_1));
+  CHECK(shadowhook_is_hooked((void *)test_batch_2));
+
+  CHECK(0 == shadowhook_probe_destroy(probes));
+  CHECK(!shadowhook_is_hooked((void *)test_batch_2));
+  return r;
+}
+
+#define RUN_CHECK(name)                                                     \
+  do {                                                                      \
+    int check_r = unittest_api_##name();                                    \
+    LOG("unittest api: %-21s : %s", #name, 0 == check_r ? "PASS" : "FAIL"); \
+    if (0 != check_r) r = -1;                                               \
+  } while (0)
+
+int unittest_api(void) {
+  LOG("*** UNIT TEST: api ***");
+  int r = 0;
+
+  // some checks call shadowhook_unhook_all(), drop the stubs held by the other unit tests first
+  unittest_unhook();
+  unittest_unintercept();
+
+  RUN_CHECK(unhook_by_lib);
+  RUN_CHECK(replace_proxy);
+  RUN_CHECK(probe_unhook_all);
+  return r;
+}
+
+#pragma clang diagnostic pop
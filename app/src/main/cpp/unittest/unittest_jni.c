@@ -97,6 +97,11 @@ static int unittest_jni_benchmark(JNIEnv *env, jobject thiz) {
   return unittest_benchmark();
 }
 
+static int unittest_jni_api(JNIEnv *env, jobject thiz) {
+  (void)env, (void)thiz;
+  return unittest_api();
+}
+
 static void unittest_jni_dlopen(JNIEnv *env, jobject thiz) {
   (void)env;
   (void)thiz;
@@ -161,6 +166,7 @@ JNIEXPORT jint JNICALL JNI_OnLoad(JavaVM *vm, void *reserved) {
       {"nativeDlclose", "()V", (void *)unittest_jni_dlclose},
       {"nativeRun", "()I", (void *)unittest_jni_run},
       {"nativeBenchmark", "()I", (void *)unittest_jni_benchmark},
+      {"nativeApi", "()I", (void *)unittest_jni_api},
       {"nativeDumpRecords", "(Ljava/lang/String;)V", (void *)unittest_jni_dump_records}};
   if (0 != (*env)->RegisterNatives(env, cls, m, sizeof(m) / sizeof(m[0]))) return JNI_ERR;
 
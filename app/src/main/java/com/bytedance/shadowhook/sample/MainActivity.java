@@ -139,6 +139,12 @@ public class MainActivity extends AppCompatActivity {
             }
         });
 
+        findViewById(R.id.unitTestApi).setOnClickListener(new View.OnClickListener() {
+            public void onClick(View v) {
+                NativeHandler.nativeApi();
+            }
+        });
+
         findViewById(R.id.systemtestTestHook).setOnClickListener(new View.OnClickListener() {
             public void onClick(View v) {
                 SysTest.hook();
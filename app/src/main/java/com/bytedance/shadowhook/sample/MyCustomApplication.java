@@ -35,6 +35,7 @@ public class MyCustomApplication extends Application {
         super.attachBaseContext(base);
 
         System.loadLibrary("hookee");
+        System.loadLibrary("hooker");
         System.loadLibrary("unittest");
 
         SysTest.init(ShadowHook.Mode.SHARED, true, true);
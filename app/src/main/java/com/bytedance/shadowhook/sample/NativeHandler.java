@@ -38,5 +38,6 @@ public class NativeHandler {
     public static native void nativeDlclose();
     public static native int nativeRun();
     public static native int nativeBenchmark();
+    public static native int nativeApi();
     public static native void nativeDumpRecords(String pathname);
 }
@@ -62,63 +62,137 @@ typedef enum {
   LDRSH_REG_A1
 } sh_a32_type_t;
 
+// decode rules, grouped by the opcode bits [27:20]
+// the first matching rule in the group wins, the last rule of each group always matches
+typedef struct {
+  uint32_t mask;
+  uint32_t value;
+  sh_a32_type_t type;
+} sh_a32_rule_t;
+
+static const sh_a32_rule_t sh_a32_rules[] = {
+    {0x0E5F0FF0, 0x000F00D0, LDRD_REG_A1},
+    {0x00000000, 0x00000000, IGNORED},
+    {0x0E5F0FF0, 0x001F00B0, LDRH_REG_A1},
+    {0x0E5F0FF0, 0x001F00D0, LDRSB_REG_A1},
+    {0x0E5F0FF0, 0x001F00F0, LDRSH_REG_A1},
+    {0x00000000, 0x00000000, IGNORED},
+    {0x0F7F0FF0, 0x002F00D0, IGNORED},
+    {0x0E5F0FF0, 0x000F00D0, LDRD_REG_A1},
+    {0x00000000, 0x00000000, IGNORED},
+    {0x0F7F0FF0, 0x003F00B0, IGNORED},
+    {0x0E5F0FF0, 0x001F00B0, LDRH_REG_A1},
+    {0x0F7F0FF0, 0x003F00D0, IGNORED},
+    {0x0E5F0FF0, 0x001F00D0, LDRSB_REG_A1},
+    {0x0F7F0FF0, 0x003F00F0, IGNORED},
+    {0x0E5F0FF0, 0x001F00F0, LDRSH_REG_A1},
+    {0x00000000, 0x00000000, IGNORED},
+    {0x0FEF0010, 0x004D0000, IGNORED},
+    {0x0FEFF010, 0x004FF000, SUB_REG_PC_A1},
+    {0x0FEF0010, 0x004F0000, SUB_REG_A1},
+    {0x0FE0F01F, 0x0040F00F, SUB_REG_PC_A1},
+    {0x0FE0001F, 0x0040000F, SUB_REG_A1},
+    {0x00000000, 0x00000000, IGNORED},
+    {0x0FF0F010, 0x0050F000, IGNORED},
+    {0x0FEF0010, 0x004D0000, IGNORED},
+    {0x0FEFF010, 0x004FF000, SUB_REG_PC_A1},
+    {0x0FEF0010, 0x004F0000, SUB_REG_A1},
+    {0x0FE0F01F, 0x0040F00F, SUB_REG_PC_A1},
+    {0x0FE0001F, 0x0040000F, SUB_REG_A1},
+    {0x00000000, 0x00000000, IGNORED},
+    {0x00000000, 0x00000000, IGNORED},
+    {0x0FEF0010, 0x008D0000, IGNORED},
+    {0x0FEFF010, 0x008FF000, ADD_REG_PC_A1},
+    {0x0FEF0010, 0x008F0000, ADD_REG_A1},
+    {0x0FE0F01F, 0x0080F00F, ADD_REG_PC_A1},
+    {0x0FE0001F, 0x0080000F, ADD_REG_A1},
+    {0x0E5F0FF0, 0x000F00D0, LDRD_REG_A1},
+    {0x00000000, 0x00000000, IGNORED},
+    {0x0FF0F010, 0x0090F000, IGNORED},
+    {0x0FEF0010, 0x008D0000, IGNORED},
+    {0x0FEFF010, 0x008FF000, ADD_REG_PC_A1},
+    {0x0FEF0010, 0x008F0000, ADD_REG_A1},
+    {0x0FE0F01F, 0x0080F00F, ADD_REG_PC_A1},
+    {0x0FE0001F, 0x0080000F, ADD_REG_A1},
+    {0x0E5F0FF0, 0x001F00B0, LDRH_REG_A1},
+    {0x0E5F0FF0, 0x001F00D0, LDRSB_REG_A1},
+    {0x0E5F0FF0, 0x001F00F0, LDRSH_REG_A1},
+    {0x00000000, 0x00000000, IGNORED},
+    {0x0FFFFFFF, 0x012FFF1F, BX_A1},
+    {0x0E5F0FF0, 0x000F00D0, LDRD_REG_A1},
+    {0x00000000, 0x00000000, IGNORED},
+    {0x0F7F00F0, 0x014F00D0, LDRD_LIT_A1},
+    {0x00000000, 0x00000000, IGNORED},
+    {0x0F7F00F0, 0x015F00B0, LDRH_LIT_A1},
+    {0x0F7F00F0, 0x015F00D0, LDRSB_LIT_A1},
+    {0x0F7F00F0, 0x015F00F0, LDRSH_LIT_A1},
+    {0x00000000, 0x00000000, IGNORED},
+    {0x0FEFFFFF, 0x01A0F00F, MOV_REG_PC_A1},
+    {0x0FEFF01F, 0x01A0F00F, IGNORED},
+    {0x0FEF001F, 0x01A0000F, MOV_REG_A1},
+    {0x0E5F0FF0, 0x000F00D0, LDRD_REG_A1},
+    {0x00000000, 0x00000000, IGNORED},
+    {0x0FFFF01F, 0x01B0F00F, IGNORED},
+    {0x0FEFFFFF, 0x01A0F00F, MOV_REG_PC_A1},
+    {0x0FEFF01F, 0x01A0F00F, IGNORED},
+    {0x0FEF001F, 0x01A0000F, MOV_REG_A1},
+    {0x0E5F0FF0, 0x001F00B0, LDRH_REG_A1},
+    {0x0E5F0FF0, 0x001F00D0, LDRSB_REG_A1},
+    {0x0E5F0FF0, 0x001F00F0, LDRSH_REG_A1},
+    {0x00000000, 0x00000000, IGNORED},
+    {0x0FFF0000, 0x024F0000, ADR_A2},
+    {0x00000000, 0x00000000, IGNORED},
+    {0x0FFF0000, 0x028F0000, ADR_A1},
+    {0x00000000, 0x00000000, IGNORED},
+    {0x0F7FF000, 0x051FF000, LDR_LIT_PC_A1},
+    {0x0F7F0000, 0x051F0000, LDR_LIT_A1},
+    {0x00000000, 0x00000000, IGNORED},
+    {0x0F7F0000, 0x055F0000, LDRB_LIT_A1},
+    {0x00000000, 0x00000000, IGNORED},
+    {0x0E5FF010, 0x061FF000, LDR_REG_PC_A1},
+    {0x0E5F0010, 0x061F0000, LDR_REG_A1},
+    {0x00000000, 0x00000000, IGNORED},
+    {0x0F7F0010, 0x063F0000, IGNORED},
+    {0x0E5FF010, 0x061FF000, LDR_REG_PC_A1},
+    {0x0E5F0010, 0x061F0000, LDR_REG_A1},
+    {0x00000000, 0x00000000, IGNORED},
+    {0x0E5F0010, 0x065F0000, LDRB_REG_A1},
+    {0x00000000, 0x00000000, IGNORED},
+    {0x0F7F0010, 0x067F0000, IGNORED},
+    {0x0E5F0010, 0x065F0000, LDRB_REG_A1},
+    {0x00000000, 0x00000000, IGNORED},
+    {0x0F000000, 0x0A000000, B_A1},
+    {0x0F000000, 0x0B000000, BL_IMM_A1},
+};
+
+// index of the first rule of each group in sh_a32_rules[]
+static const uint8_t sh_a32_rules_idx[256] = {
+    0, 2, 6, 9, 16, 22, 29, 29, 30, 37, 6, 9, 29, 29, 29, 29,
+    0, 2, 47, 2, 50, 52, 29, 29, 0, 2, 56, 61, 50, 52, 29, 29,
+    29, 29, 29, 29, 69, 29, 29, 29, 71, 29, 29, 29, 29, 29, 29, 29,
+    29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29,
+    29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29,
+    29, 73, 29, 29, 29, 76, 29, 29, 29, 73, 29, 29, 29, 76, 29, 29,
+    29, 78, 29, 81, 29, 85, 29, 87, 29, 78, 29, 81, 29, 85, 29, 87,
+    29, 78, 29, 78, 29, 85, 29, 85, 29, 78, 29, 78, 29, 85, 29, 85,
+    29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29,
+    29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29,
+    90, 90, 90, 90, 90, 90, 90, 90, 90, 90, 90, 90, 90, 90, 90, 90,
+    91, 91, 91, 91, 91, 91, 91, 91, 91, 91, 91, 91, 91, 91, 91, 91,
+    29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29,
+    29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29,
+    29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29,
+    29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29,
+};
+
 static sh_a32_type_t sh_a32_get_type(uint32_t inst) {
-  if (((inst & 0x0F000000u) == 0x0A000000) && ((inst & 0xF0000000) != 0xF0000000))
-    return B_A1;
-  else if (((inst & 0x0FFFFFFFu) == 0x012FFF1F) && ((inst & 0xF0000000) != 0xF0000000))
-    return BX_A1;
-  else if (((inst & 0x0F000000u) == 0x0B000000) && ((inst & 0xF0000000) != 0xF0000000))
-    return BL_IMM_A1;
-  else if ((inst & 0xFE000000) == 0xFA000000)
-    return BLX_IMM_A2;
-  else if (((inst & 0x0FE00010u) == 0x00800000) && ((inst & 0xF0000000) != 0xF0000000) &&
-           ((inst & 0x0010F000u) != 0x0010F000) && ((inst & 0x000F0000u) != 0x000D0000) &&
-           (((inst & 0x000F0000u) == 0x000F0000) || ((inst & 0x0000000Fu) == 0x0000000F)))
-    return ((inst & 0x0000F000u) == 0x0000F000) ? ADD_REG_PC_A1 : ADD_REG_A1;
-  else if (((inst & 0x0FE00010u) == 0x00400000) && ((inst & 0xF0000000) != 0xF0000000) &&
-           ((inst & 0x0010F000u) != 0x0010F000) && ((inst & 0x000F0000u) != 0x000D0000) &&
-           (((inst & 0x000F0000u) == 0x000F0000) || ((inst & 0x0000000Fu) == 0x0000000F)))
-    return ((inst & 0x0000F000u) == 0x0000F000) ? SUB_REG_PC_A1 : SUB_REG_A1;
-  else if (((inst & 0x0FFF0000u) == 0x028F0000) && ((inst & 0xF0000000) != 0xF0000000))
-    return ADR_A1;
-  else if (((inst & 0x0FFF0000u) == 0x024F0000) && ((inst & 0xF0000000) != 0xF0000000))
-    return ADR_A2;
-  else if (((inst & 0x0FEF001Fu) == 0x01A0000F) && ((inst & 0xF0000000) != 0xF0000000) &&
-           ((inst & 0x0010F000u) != 0x0010F000) &&
-           (!(((inst & 0x0000F000u) == 0x0000F000) && ((inst & 0x00000FF0u) != 0x00000000))))
-    return ((inst & 0x0000F000u) == 0x0000F000) ? MOV_REG_PC_A1 : MOV_REG_A1;
-  else if (((inst & 0x0F7F0000u) == 0x051F0000) && ((inst & 0xF0000000) != 0xF0000000))
-    return ((inst & 0x0000F000u) == 0x0000F000) ? LDR_LIT_PC_A1 : LDR_LIT_A1;
-  else if (((inst & 0x0F7F0000u) == 0x055F0000) && ((inst & 0xF0000000) != 0xF0000000))
-    return LDRB_LIT_A1;
-  else if (((inst & 0x0F7F00F0u) == 0x014F00D0) && ((inst & 0xF0000000) != 0xF0000000))
-    return LDRD_LIT_A1;
-  else if (((inst & 0x0F7F00F0u) == 0x015F00B0) && ((inst & 0xF0000000) != 0xF0000000))
-    return LDRH_LIT_A1;
-  else if (((inst & 0x0F7F00F0u) == 0x015F00D0) && ((inst & 0xF0000000) != 0xF0000000))
-    return LDRSB_LIT_A1;
-  else if (((inst & 0x0F7F00F0u) == 0x015F00F0) && ((inst & 0xF0000000) != 0xF0000000))
-    return LDRSH_LIT_A1;
-  else if (((inst & 0x0E5F0010u) == 0x061F0000) && ((inst & 0xF0000000) != 0xF0000000) &&
-           ((inst & 0x01200000u) != 0x00200000))
-    return ((inst & 0x0000F000u) == 0x0000F000) ? LDR_REG_PC_A1 : LDR_REG_A1;
-  else if (((inst & 0x0E5F0010u) == 0x065F0000) && ((inst & 0xF0000000) != 0xF0000000) &&
-           ((inst & 0x01200000u) != 0x00200000))
-    return LDRB_REG_A1;
-  else if (((inst & 0x0E5F0FF0u) == 0x000F00D0) && ((inst & 0xF0000000) != 0xF0000000) &&
-           ((inst & 0x01200000u) != 0x00200000))
-    return LDRD_REG_A1;
-  else if (((inst & 0x0E5F0FF0u) == 0x001F00B0) && ((inst & 0xF0000000) != 0xF0000000) &&
-           ((inst & 0x01200000u) != 0x00200000))
-    return LDRH_REG_A1;
-  else if (((inst & 0x0E5F0FF0u) == 0x001F00D0) && ((inst & 0xF0000000) != 0xF0000000) &&
-           ((inst & 0x01200000u) != 0x00200000))
-    return LDRSB_REG_A1;
-  else if (((inst & 0x0E5F0FF0u) == 0x001F00F0) && ((inst & 0xF0000000) != 0xF0000000) &&
-           ((inst & 0x01200000u) != 0x00200000))
-    return LDRSH_REG_A1;
-  else
-    return IGNORED;
+  // only BLX (immediate) is unconditional
+  if ((inst & 0xF0000000) == 0xF0000000)
+    return ((inst & 0xFE000000) == 0xFA000000) ? BLX_IMM_A2 : IGNORED;
+
+  const sh_a32_rule_t *rule = &sh_a32_rules[sh_a32_rules_idx[SH_UTIL_GET_BITS_32(inst, 27, 20)]];
+  while ((inst & rule->mask) != rule->value) rule++;
+  return rule->type;
 }
 
 size_t sh_a32_get_rewrite_inst_len(uint32_t inst) {
@@ -168,7 +242,7 @@ static uintptr_t sh_a32_fix_addr(uintptr_t addr, sh_a32_rewrite_info_t *rinfo) {
       cursor_addr += 4;
       offset += rinfo->inst_lens[i];
     }
-    uintptr_t fixed_addr = (uintptr_t)rinfo->buf + rinfo->inst_prolog_len + offset;
+    uintptr_t fixed_addr = rinfo->buf_pc + rinfo->inst_prolog_len + offset;
     SH_LOG_INFO("a32 rewrite: fix addr %" PRIxPTR " -> %" PRIxPTR, addr, fixed_addr);
     return fixed_addr;
   }
@@ -36,6 +36,7 @@
 #include "sh_island.h"
 #include "sh_linker.h"
 #include "sh_log.h"
+#include "sh_patch.h"
 #include "sh_sig.h"
 #include "sh_t16.h"
 #include "sh_t32.h"
@@ -44,6 +45,38 @@
 #include "shadowhook.h"
 #include "xdl.h"
 
+// B T4: [-16M, +16M - 2]
+#define SH_INST_T32_B_RANGE_LOW  (16777216)
+#define SH_INST_T32_B_RANGE_HIGH (16777214)
+
+// B A1: [-32M, +32M - 4]
+#define SH_INST_A32_B_RANGE_LOW  (33554432)
+#define SH_INST_A32_B_RANGE_HIGH (33554428)
+
+static bool sh_inst_is_in_range(uintptr_t addr, uintptr_t pc, uintptr_t range_low, uintptr_t range_high) {
+  if (addr >= pc)
+    return addr - pc <= range_high;
+  else
+    return pc - addr <= range_low;
+}
+
+// Alloc an enter from the smallest size class which fits len.
+// The enter allocated by the previous attempt (with or without island) is reused if it fits.
+static int sh_inst_alloc_enter(sh_inst_t *self, uintptr_t target_addr, size_t len) {
+  size_t size = sh_enter_get_size(len);
+  if (0 == size) return SHADOWHOOK_ERRNO_HOOK_REWRITE_FAILED;
+
+  if (0 != self->enter && self->enter_size < size) {
+    sh_enter_free(self->enter, self->enter_size);
+    self->enter = 0;
+  }
+  if (0 == self->enter) {
+    if (0 == (self->enter = sh_enter_alloc_near(target_addr, size))) return SHADOWHOOK_ERRNO_HOOK_ENTER;
+    self->enter_size = size;
+  }
+  return 0;
+}
+
 static void sh_inst_thumb_get_rewrite_info(sh_inst_t *self, uintptr_t target_addr,
                                            sh_txx_rewrite_info_t *rinfo) {
   memset(rinfo, 0, sizeof(sh_txx_rewrite_info_t));
@@ -101,7 +134,6 @@ static void sh_inst_thumb_get_rewrite_info(sh_inst_t *self, uintptr_t target_add
 
   rinfo->start_addr = target_addr;
   rinfo->end_addr = target_addr + rewrite_len;
-  rinfo->buf = (uint16_t *)self->enter;
   rinfo->buf_offset = 0;
   rinfo->inst_prolog_len = 0;
   rinfo->inst_lens_cnt = idx;
@@ -116,8 +148,18 @@ static int sh_inst_thumb_rewrite(sh_inst_t *self, uintptr_t target_addr, sh_addr
   sh_txx_rewrite_info_t rinfo;
   sh_inst_thumb_get_rewrite_info(self, target_addr, &rinfo);
 
+  // alloc enter (length: prolog + rewritten instructions + jump back)
+  size_t enter_len = (addr_info->is_proc_start ? 0 : 4) + 8;
+  for (size_t i = 0; i < rinfo.inst_lens_cnt; i++) enter_len += rinfo.inst_lens[i];
+  int r;
+  if (0 != (r = sh_inst_alloc_enter(self, target_addr, enter_len))) return r;
+  // the enter is filled in via its writable address
+  uintptr_t enter_rw = sh_enter_get_rw_addr(self->enter);
+  rinfo.buf = (uint16_t *)enter_rw;
+  rinfo.buf_pc = self->enter;
+
   if (!addr_info->is_proc_start) {
-    rinfo.buf_offset += sh_t32_restore_ip((uint16_t *)self->enter);
+    rinfo.buf_offset += sh_t32_restore_ip((uint16_t *)enter_rw);
     rinfo.inst_prolog_len = rinfo.buf_offset;
   }
 
@@ -132,7 +174,7 @@ static int sh_inst_thumb_rewrite(sh_inst_t *self, uintptr_t target_addr, sh_addr
       self->rewritten_len += (2 + it.insts_len);
 
       // save space holder point of IT-else B instruction
-      uintptr_t enter_inst_else_p = self->enter + rinfo.buf_offset;
+      uintptr_t enter_inst_else_p = enter_rw + rinfo.buf_offset;
       rinfo.buf_offset += 2;  // B<c> <label>
       rinfo.buf_offset += 2;  // NOP
 
@@ -143,7 +185,7 @@ static int sh_inst_thumb_rewrite(sh_inst_t *self, uintptr_t target_addr, sh_addr
       for (size_t i = 0, j = 0; i < it.insts_cnt; i++) {
         if (i == it.insts_else_cnt) {
           // save space holder point of IT-then (for B instruction)
-          enter_inst_then_p = self->enter + rinfo.buf_offset;
+          enter_inst_then_p = enter_rw + rinfo.buf_offset;
           rinfo.buf_offset += 2;  // B <label>
           rinfo.buf_offset += 2;  // NOP
 
@@ -155,10 +197,10 @@ static int sh_inst_thumb_rewrite(sh_inst_t *self, uintptr_t target_addr, sh_addr
         bool is_thumb32 = sh_util_is_thumb32((uintptr_t)(&(it.insts[j])));
         size_t len;
         if (is_thumb32)
-          len = sh_t32_rewrite((uint16_t *)(self->enter + rinfo.buf_offset), it.insts[j], it.insts[j + 1],
+          len = sh_t32_rewrite((uint16_t *)(enter_rw + rinfo.buf_offset), it.insts[j], it.insts[j + 1],
                                it.pcs[i], &rinfo);
         else
-          len = sh_t16_rewrite((uint16_t *)(self->enter + rinfo.buf_offset), it.insts[j], it.pcs[i], &rinfo);
+          len = sh_t16_rewrite((uint16_t *)(enter_rw + rinfo.buf_offset), it.insts[j], it.pcs[i], &rinfo);
         if (0 == len) return SHADOWHOOK_ERRNO_HOOK_REWRITE_FAILED;
         rinfo.buf_offset += len;
         j += (is_thumb32 ? 2 : 1);
@@ -188,11 +230,11 @@ static int sh_inst_thumb_rewrite(sh_inst_t *self, uintptr_t target_addr, sh_addr
       SH_LOG_INFO("thumb rewrite: offset %zu, pc %" PRIxPTR, rinfo.buf_offset, pc);
       size_t len;
       if (is_thumb32)
-        len = sh_t32_rewrite((uint16_t *)(self->enter + rinfo.buf_offset),
+        len = sh_t32_rewrite((uint16_t *)(enter_rw + rinfo.buf_offset),
                              *((uint16_t *)(target_addr + target_addr_offset)),
                              *((uint16_t *)(target_addr + target_addr_offset + 2)), pc, &rinfo);
       else
-        len = sh_t16_rewrite((uint16_t *)(self->enter + rinfo.buf_offset),
+        len = sh_t16_rewrite((uint16_t *)(enter_rw + rinfo.buf_offset),
                              *((uint16_t *)(target_addr + target_addr_offset)), pc, &rinfo);
       if (0 == len) return SHADOWHOOK_ERRNO_HOOK_REWRITE_FAILED;
       rinfo.buf_offset += len;
@@ -203,11 +245,20 @@ static int sh_inst_thumb_rewrite(sh_inst_t *self, uintptr_t target_addr, sh_addr
   }
   SH_LOG_INFO("thumb rewrite: len %zu to %zu", self->rewritten_len, rinfo.buf_offset);
 
-  // absolute jump back to remaining original instructions (fill in enter)
-  uintptr_t resume_addr = SH_UTIL_SET_BIT0(target_addr + self->rewritten_len);
-  rinfo.buf_offset += sh_t32_absolute_jump((uint16_t *)(self->enter + rinfo.buf_offset), true, resume_addr);
+  // jump back to remaining original instructions (fill in enter)
+  // relative jump if they are within the range of B.W, otherwise absolute jump
+  uintptr_t back_p = self->enter + rinfo.buf_offset;
+  uint16_t *back_buf = (uint16_t *)(enter_rw + rinfo.buf_offset);
+  uintptr_t resume_addr = target_addr + self->rewritten_len;
+  if (sh_inst_is_in_range(resume_addr, back_p + 4, SH_INST_T32_B_RANGE_LOW, SH_INST_T32_B_RANGE_HIGH))
+    rinfo.buf_offset += sh_t32_relative_jump(back_buf, resume_addr, back_p + 4);
+  else
+    rinfo.buf_offset += sh_t32_absolute_jump(back_buf, true, SH_UTIL_SET_BIT0(resume_addr));
   sh_util_clear_cache(self->enter, rinfo.buf_offset);
 
+  // the threads hitting target while patching run the enter without the prolog
+  self->redirect = self->enter + rinfo.inst_prolog_len;
+
   // save original function address
   if (NULL != set_orig_addr) set_orig_addr(SH_UTIL_SET_BIT0(self->enter), set_orig_addr_arg);
   return 0;
@@ -287,10 +338,6 @@ static bool sh_inst_thumb_is_long_enough(sh_inst_t *self, uintptr_t target_addr,
 
 #ifdef SH_CONFIG_TRY_HOOK_WITH_ISLAND
 
-// B T4: [-16M, +16M - 2]
-#define SH_INST_T32_B_RANGE_LOW  (16777216)
-#define SH_INST_T32_B_RANGE_HIGH (16777214)
-
 static int sh_inst_thumb_rewrite_with_island(sh_inst_t *self, uintptr_t target_addr,
                                              sh_addr_info_t *addr_info, sh_inst_set_orig_addr_t set_orig_addr,
                                              void *set_orig_addr_arg) {
@@ -315,12 +362,12 @@ static int sh_inst_thumb_reloc_with_island(sh_inst_t *self, uintptr_t target_add
   if (0 == new_island_exit.addr) return SHADOWHOOK_ERRNO_HOOK_ISLAND_EXIT;
 
   // absolute jump to new_addr in island-exit
-  sh_t32_absolute_jump((uint16_t *)new_island_exit.addr, true, new_addr);
+  sh_t32_absolute_jump((uint16_t *)sh_island_get_rw_addr(&new_island_exit), true, new_addr);
   sh_util_clear_cache(new_island_exit.addr, new_island_exit.size);
 
   // relative jump to the island-exit by overwriting the head of original function
   sh_t32_relative_jump((uint16_t *)new_exit, new_island_exit.addr, pc);
-  if (0 != (r = sh_util_write_inst(target_addr, new_exit, self->backup_len))) {
+  if (0 != (r = sh_patch_write_inst(target_addr, new_exit, self->backup_len, self->redirect, true))) {
     sh_island_free(&new_island_exit);
     return r;
   }
@@ -369,7 +416,7 @@ static int sh_inst_thumb_reloc_without_island(sh_inst_t *self, uintptr_t target_
   int r;
 
   sh_t32_absolute_jump((uint16_t *)new_exit, is_align4, new_addr);
-  if (0 != (r = sh_util_write_inst(target_addr, new_exit, self->backup_len))) return r;
+  if (0 != (r = sh_patch_write_inst(target_addr, new_exit, self->backup_len, self->redirect, true))) return r;
   memcpy(self->exit, new_exit, self->backup_len);
 
   SH_LOG_INFO("thumb: %shook (without island) OK. target %" PRIxPTR " -> new %" PRIxPTR " -> enter %" PRIxPTR
@@ -400,32 +447,50 @@ static int sh_inst_arm_rewrite(sh_inst_t *self, uintptr_t target_addr, sh_addr_i
   sh_a32_rewrite_info_t rinfo;
   rinfo.start_addr = target_addr;
   rinfo.end_addr = target_addr + self->backup_len;
-  rinfo.buf = (uint32_t *)self->enter;
   rinfo.buf_offset = 0;
   rinfo.inst_prolog_len = 0;
   rinfo.inst_lens_cnt = self->backup_len / 4;
   for (uintptr_t i = 0; i < self->backup_len; i += 4)
     rinfo.inst_lens[i / 4] = sh_a32_get_rewrite_inst_len(*((uint32_t *)(target_addr + i)));
 
+  // alloc enter (length: prolog + rewritten instructions + jump back)
+  size_t enter_len = (addr_info->is_proc_start ? 0 : 4) + 8;
+  for (size_t i = 0; i < rinfo.inst_lens_cnt; i++) enter_len += rinfo.inst_lens[i];
+  int r;
+  if (0 != (r = sh_inst_alloc_enter(self, target_addr, enter_len))) return r;
+  // the enter is filled in via its writable address
+  uintptr_t enter_rw = sh_enter_get_rw_addr(self->enter);
+  rinfo.buf = (uint32_t *)enter_rw;
+  rinfo.buf_pc = self->enter;
+
   if (!addr_info->is_proc_start) {
-    rinfo.buf_offset += sh_a32_restore_ip((uint32_t *)self->enter);
+    rinfo.buf_offset += sh_a32_restore_ip((uint32_t *)enter_rw);
     rinfo.inst_prolog_len = rinfo.buf_offset;
   }
 
   // rewrite original instructions (fill in enter)
   uintptr_t pc = target_addr + 8;
   for (uintptr_t i = 0; i < self->backup_len; i += 4, pc += 4) {
-    size_t offset = sh_a32_rewrite((uint32_t *)(self->enter + rinfo.buf_offset),
+    size_t offset = sh_a32_rewrite((uint32_t *)(enter_rw + rinfo.buf_offset),
                                    *((uint32_t *)(target_addr + i)), pc, &rinfo);
     if (0 == offset) return SHADOWHOOK_ERRNO_HOOK_REWRITE_FAILED;
     rinfo.buf_offset += offset;
   }
 
-  // absolute jump back to remaining original instructions (fill in enter)
+  // jump back to remaining original instructions (fill in enter)
+  // relative jump if they are within the range of B, otherwise absolute jump
+  uintptr_t back_p = self->enter + rinfo.buf_offset;
+  uint32_t *back_buf = (uint32_t *)(enter_rw + rinfo.buf_offset);
   uintptr_t resume_addr = target_addr + self->backup_len;
-  rinfo.buf_offset += sh_a32_absolute_jump((uint32_t *)(self->enter + rinfo.buf_offset), resume_addr);
+  if (sh_inst_is_in_range(resume_addr, back_p + 8, SH_INST_A32_B_RANGE_LOW, SH_INST_A32_B_RANGE_HIGH))
+    rinfo.buf_offset += sh_a32_relative_jump(back_buf, resume_addr, back_p + 8);
+  else
+    rinfo.buf_offset += sh_a32_absolute_jump(back_buf, resume_addr);
   sh_util_clear_cache(self->enter, rinfo.buf_offset);
 
+  // the threads hitting target while patching run the enter without the prolog
+  self->redirect = self->enter + rinfo.inst_prolog_len;
+
   // save original function address
   if (NULL != set_orig_addr) set_orig_addr(self->enter, set_orig_addr_arg);
   return 0;
@@ -449,10 +514,6 @@ static int sh_inst_arm_safe_rewrite(sh_inst_t *self, uintptr_t target_addr, sh_a
 
 #ifdef SH_CONFIG_TRY_HOOK_WITH_ISLAND
 
-// B A1: [-32M, +32M - 4]
-#define SH_INST_A32_B_RANGE_LOW  (33554432)
-#define SH_INST_A32_B_RANGE_HIGH (33554428)
-
 static int sh_inst_arm_rewrite_with_island(sh_inst_t *self, uintptr_t target_addr, sh_addr_info_t *addr_info,
                                            sh_inst_set_orig_addr_t set_orig_addr, void *set_orig_addr_arg) {
   self->backup_len = 4;
@@ -475,12 +536,12 @@ static int sh_inst_arm_reloc_with_island(sh_inst_t *self, uintptr_t target_addr,
   if (0 == new_island_exit.addr) return SHADOWHOOK_ERRNO_HOOK_ISLAND_EXIT;
 
   // absolute jump to new_addr in island-exit
-  sh_a32_absolute_jump((uint32_t *)new_island_exit.addr, new_addr);
+  sh_a32_absolute_jump((uint32_t *)sh_island_get_rw_addr(&new_island_exit), new_addr);
   sh_util_clear_cache(new_island_exit.addr, new_island_exit.size);
 
   // relative jump to the island-exit by overwriting the head of original function
   sh_a32_relative_jump((uint32_t *)new_exit, new_island_exit.addr, pc);
-  if (0 != (r = sh_util_write_inst(target_addr, new_exit, self->backup_len))) {
+  if (0 != (r = sh_patch_write_inst(target_addr, new_exit, self->backup_len, self->redirect, false))) {
     sh_island_free(&new_island_exit);
     return r;
   }
@@ -541,7 +602,8 @@ static int sh_inst_arm_reloc_without_island(sh_inst_t *self, uintptr_t target_ad
   int r;
 
   sh_a32_absolute_jump((uint32_t *)new_exit, new_addr);
-  if (0 != (r = sh_util_write_inst(target_addr, new_exit, self->backup_len))) return r;
+  if (0 != (r = sh_patch_write_inst(target_addr, new_exit, self->backup_len, self->redirect, false)))
+    return r;
   memcpy(self->exit, new_exit, self->backup_len);
 
   SH_LOG_INFO("a32: %shook (without island) OK. target %" PRIxPTR " -> new %" PRIxPTR " -> enter %" PRIxPTR
@@ -566,8 +628,9 @@ int sh_inst_hook(sh_inst_t *self, uintptr_t target_addr, sh_addr_info_t *addr_in
                  bool is_to_interceptor, sh_inst_set_orig_addr_t set_orig_addr, void *set_orig_addr_arg) {
   (void)is_to_interceptor;
 
-  self->enter = sh_enter_alloc();
-  if (0 == self->enter) return SHADOWHOOK_ERRNO_HOOK_ENTER;
+  // the enter is allocated when rewriting, after the length of it is known
+  self->enter = 0;
+  self->enter_size = 0;
 
   int r = -1;
   if (SH_UTIL_IS_THUMB(target_addr)) {
@@ -608,7 +671,7 @@ int sh_inst_hook(sh_inst_t *self, uintptr_t target_addr, sh_addr_info_t *addr_in
 err:
   // hook failed
   if (NULL != set_orig_addr) set_orig_addr(0, set_orig_addr_arg);
-  sh_enter_free(self->enter);
+  if (0 != self->enter) sh_enter_free(self->enter, self->enter_size);
   return r;
 }
 
@@ -664,14 +727,15 @@ int sh_inst_unhook(sh_inst_t *self, uintptr_t target_addr) {
   }
   SH_SIG_EXIT
   if (0 != r) return SHADOWHOOK_ERRNO_UNHOOK_TRAMPO_MISMATCH;
-  if (0 != (r = sh_util_write_inst(target_addr, self->backup, self->backup_len))) return r;
+  if (0 != (r = sh_patch_write_inst(target_addr, self->backup, self->backup_len, self->redirect, is_thumb)))
+    return r;
   __atomic_thread_fence(__ATOMIC_SEQ_CST);
 
   // free memory space for island-exit
   if (0 != self->island_exit.addr) sh_island_free(&self->island_exit);
 
   // free memory space for enter
-  sh_enter_free(self->enter);
+  sh_enter_free(self->enter, self->enter_size);
 
   SH_LOG_INFO("%s: unhook OK. target %" PRIxPTR, is_thumb ? "thumb" : "a32", target_addr);
   return 0;
@@ -682,12 +746,16 @@ void sh_inst_free_after_dlclose(sh_inst_t *self, uintptr_t target_addr) {
   if (0 != self->island_exit.addr) sh_island_free_after_dlclose(&self->island_exit);
 
   // free memory space for enter
-  sh_enter_free(self->enter);
+  sh_enter_free(self->enter, self->enter_size);
 
   bool is_thumb = SH_UTIL_IS_THUMB(target_addr);
   SH_LOG_INFO("%s: free_after_dlclose OK. target %" PRIxPTR, is_thumb ? "thumb" : "a32", target_addr);
 }
 
+size_t sh_inst_get_island_count(sh_inst_t *self) {
+  return 0 != self->island_exit.addr ? 1 : 0;
+}
+
 extern void shadowhook_interceptor_glue(void);
 extern void shadowhook_interceptor_glue_vfpv3d16(void);
 extern void shadowhook_interceptor_glue_vfpv3d32(void);
@@ -34,6 +34,8 @@ typedef struct {
   size_t rewritten_len;  // = backup_len(arm); >= backup_len(thumb)
   uint32_t exit[3];      // max-length = 10 (4-byte alignment), length == backup_len
   uintptr_t enter;
+  size_t enter_size;        // = 32 or 64 or 128 or 256
+  uintptr_t redirect;       // for the threads hitting target while patching
   sh_island_t island_exit;  // .size = 8(arm & thumb)
 } sh_inst_t;
 
@@ -46,4 +48,6 @@ int sh_inst_unhook(sh_inst_t *self, uintptr_t target_addr);
 
 void sh_inst_free_after_dlclose(sh_inst_t *self, uintptr_t target_addr);
 
+size_t sh_inst_get_island_count(sh_inst_t *self);
+
 void sh_inst_build_glue_launcher(void *buf, void *ctx);
@@ -48,29 +48,60 @@ typedef enum {
   CBNZ_T1
 } sh_t16_type_t;
 
+// decode rules, grouped by the opcode bits [15:8]
+// the first matching rule in the group wins, the last rule of each group always matches
+typedef struct {
+  uint16_t mask;
+  uint16_t value;
+  sh_t16_type_t type;
+} sh_t16_rule_t;
+
+static const sh_t16_rule_t sh_t16_rules[] = {
+    {0x0000, 0x0000, IGNORED},
+    {0xFFFF, 0x44FD, IGNORED},
+    {0xFF78, 0x4478, ADD_REG_T2},
+    {0x0000, 0x0000, IGNORED},
+    {0xFF78, 0x4678, MOV_REG_T1},
+    {0x0000, 0x0000, IGNORED},
+    {0xFFF8, 0x4778, BX_T1},
+    {0x0000, 0x0000, IGNORED},
+    {0xF800, 0x4800, LDR_LIT_T1},
+    {0xF800, 0xA000, ADR_T1},
+    {0xFD00, 0xB100, CBZ_T1},
+    {0xFD00, 0xB900, CBNZ_T1},
+    {0xFF0F, 0xBF00, IGNORED},
+    {0xFFF0, 0xBFF0, IGNORED},
+    {0xFF00, 0xBF00, IT_T1},
+    {0xF000, 0xD000, B_T1},
+    {0xFF00, 0xDE00, IGNORED},
+    {0xFF00, 0xDF00, IGNORED},
+    {0xF800, 0xE000, B_T2},
+};
+
+// index of the first rule of each group in sh_t16_rules[]
+static const uint8_t sh_t16_rules_idx[256] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 1, 0, 4, 6, 8, 8, 8, 8, 8, 8, 8, 8,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    9, 9, 9, 9, 9, 9, 9, 9, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 10, 0, 10, 0, 0, 0, 0, 0, 11, 0, 11, 0, 0, 0, 12,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 16, 17,
+    18, 18, 18, 18, 18, 18, 18, 18, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+};
+
 static sh_t16_type_t sh_t16_get_type(uint16_t inst) {
-  if (((inst & 0xFF00u) == 0xBF00) && ((inst & 0x000Fu) != 0x0000) && ((inst & 0x00F0u) != 0x00F0))
-    return IT_T1;
-  else if (((inst & 0xF000u) == 0xD000) && ((inst & 0x0F00u) != 0x0F00) && ((inst & 0x0F00u) != 0x0E00))
-    return B_T1;
-  else if ((inst & 0xF800u) == 0xE000)
-    return B_T2;
-  else if ((inst & 0xFFF8u) == 0x4778)
-    return BX_T1;
-  else if (((inst & 0xFF78u) == 0x4478) && ((inst & 0x0087u) != 0x0085))
-    return ADD_REG_T2;
-  else if ((inst & 0xFF78u) == 0x4678)
-    return MOV_REG_T1;
-  else if ((inst & 0xF800u) == 0xA000)
-    return ADR_T1;
-  else if ((inst & 0xF800u) == 0x4800)
-    return LDR_LIT_T1;
-  else if ((inst & 0xFD00u) == 0xB100)
-    return CBZ_T1;
-  else if ((inst & 0xFD00u) == 0xB900)
-    return CBNZ_T1;
-  else
-    return IGNORED;
+  const sh_t16_rule_t *rule = &sh_t16_rules[sh_t16_rules_idx[inst >> 8u]];
+  while ((inst & rule->mask) != rule->value) rule++;
+  return rule->type;
 }
 
 size_t sh_t16_get_rewrite_inst_len(uint16_t inst) {
@@ -54,43 +54,79 @@ typedef enum {
   VLDR_LIT_T1
 } sh_t32_type_t;
 
+// decode rules, grouped by the opcode bits [31:24] (the high 8 bits of the first halfword)
+// the first matching rule in the group wins, the last rule of each group always matches
+typedef struct {
+  uint32_t mask;
+  uint32_t value;
+  sh_t32_type_t type;
+} sh_t32_rule_t;
+
+static const sh_t32_rule_t sh_t32_rules[] = {
+    {0x00000000, 0x00000000, IGNORED},
+    {0xFFF0FFF0, 0xE8D0F000, TBB_T1},
+    {0xFFF0FFF0, 0xE8D0F010, TBH_T1},
+    {0x00000000, 0x00000000, IGNORED},
+    {0xFF7F0000, 0xE95F0000, LDRD_LIT_T1},
+    {0x00000000, 0x00000000, IGNORED},
+    {0xFF3F0C00, 0xED1F0800, VLDR_LIT_T1},
+    {0x00000000, 0x00000000, IGNORED},
+    {0xF800D000, 0xF0008000, B_T3},
+    {0xF800D000, 0xF0009000, B_T4},
+    {0xF800D000, 0xF000D000, BL_IMM_T1},
+    {0xF800D000, 0xF000C000, BLX_IMM_T2},
+    {0x00000000, 0x00000000, IGNORED},
+    {0xF800D000, 0xF0008000, B_T3},
+    {0xF800D000, 0xF0009000, B_T4},
+    {0xF800D000, 0xF000D000, BL_IMM_T1},
+    {0xF800D000, 0xF000C000, BLX_IMM_T2},
+    {0xFBFF8000, 0xF2AF0000, ADR_T2},
+    {0xFBFF8000, 0xF20F0000, ADR_T3},
+    {0x00000000, 0x00000000, IGNORED},
+    {0xFB80D000, 0xF3808000, IGNORED},
+    {0xF800D000, 0xF0008000, B_T3},
+    {0xF800D000, 0xF0009000, B_T4},
+    {0xF800D000, 0xF000D000, BL_IMM_T1},
+    {0xF800D000, 0xF000C000, BLX_IMM_T2},
+    {0x00000000, 0x00000000, IGNORED},
+    {0xFF7FF000, 0xF85FF000, LDR_LIT_PC_T2},
+    {0xFF7F0000, 0xF85F0000, LDR_LIT_T2},
+    {0xFF7FF000, 0xF81FF000, PLD_LIT_T1},
+    {0xFF7F0000, 0xF81F0000, LDRB_LIT_T1},
+    {0xFF7FF000, 0xF83FF000, IGNORED},
+    {0xFF7F0000, 0xF83F0000, LDRH_LIT_T1},
+    {0x00000000, 0x00000000, IGNORED},
+    {0xFF7FF000, 0xF91FF000, PLI_LIT_T3},
+    {0xFF7F0000, 0xF91F0000, LDRSB_LIT_T1},
+    {0xFF7FF000, 0xF93FF000, IGNORED},
+    {0xFF7F0000, 0xF93F0000, LDRSH_LIT_T1},
+    {0x00000000, 0x00000000, IGNORED},
+};
+
+// index of the first rule of each group in sh_t32_rules[]
+static const uint8_t sh_t32_rules_idx[256] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 4, 0, 0, 0, 6, 0, 0,
+    8, 8, 13, 20, 8, 8, 13, 20, 26, 33, 0, 0, 0, 0, 0, 0,
+};
+
 static sh_t32_type_t sh_t32_get_type(uint32_t inst) {
-  if (((inst & 0xF800D000) == 0xF0008000) && ((inst & 0x03800000u) != 0x03800000u))
-    return B_T3;
-  else if ((inst & 0xF800D000) == 0xF0009000)
-    return B_T4;
-  else if ((inst & 0xF800D000) == 0xF000D000)
-    return BL_IMM_T1;
-  else if ((inst & 0xF800D000) == 0xF000C000)
-    return BLX_IMM_T2;
-  else if ((inst & 0xFBFF8000) == 0xF2AF0000)
-    return ADR_T2;
-  else if ((inst & 0xFBFF8000) == 0xF20F0000)
-    return ADR_T3;
-  else if ((inst & 0xFF7F0000) == 0xF85F0000)
-    return ((inst & 0x0000F000u) == 0x0000F000) ? LDR_LIT_PC_T2 : LDR_LIT_T2;
-  else if (((inst & 0xFF7F0000) == 0xF81F0000) && ((inst & 0xF000u) != 0xF000u))
-    return LDRB_LIT_T1;
-  else if ((inst & 0xFF7F0000) == 0xE95F0000)
-    return LDRD_LIT_T1;
-  else if (((inst & 0xFF7F0000) == 0xF83F0000) && ((inst & 0xF000u) != 0xF000u))
-    return LDRH_LIT_T1;
-  else if (((inst & 0xFF7F0000) == 0xF91F0000) && ((inst & 0xF000u) != 0xF000u))
-    return LDRSB_LIT_T1;
-  else if (((inst & 0xFF7F0000) == 0xF93F0000) && ((inst & 0xF000u) != 0xF000u))
-    return LDRSH_LIT_T1;
-  else if ((inst & 0xFF7FF000) == 0xF81FF000)
-    return PLD_LIT_T1;
-  else if ((inst & 0xFF7FF000) == 0xF91FF000)
-    return PLI_LIT_T3;
-  else if ((inst & 0xFFF0FFF0) == 0xE8D0F000)
-    return TBB_T1;
-  else if ((inst & 0xFFF0FFF0) == 0xE8D0F010)
-    return TBH_T1;
-  else if ((inst & 0xFF3F0C00) == 0xED1F0800)
-    return VLDR_LIT_T1;
-  else
-    return IGNORED;
+  const sh_t32_rule_t *rule = &sh_t32_rules[sh_t32_rules_idx[inst >> 24u]];
+  while ((inst & rule->mask) != rule->value) rule++;
+  return rule->type;
 }
 
 size_t sh_t32_get_rewrite_inst_len(uint16_t high_inst, uint16_t low_inst) {
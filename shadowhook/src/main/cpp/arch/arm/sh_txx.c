@@ -48,7 +48,7 @@ uintptr_t sh_txx_fix_addr(uintptr_t addr, sh_txx_rewrite_info_t *rinfo) {
       cursor_addr += 2;
       offset += rinfo->inst_lens[i];
     }
-    uintptr_t fixed_addr = (uintptr_t)rinfo->buf + rinfo->inst_prolog_len + offset;
+    uintptr_t fixed_addr = rinfo->buf_pc + rinfo->inst_prolog_len + offset;
     if (is_thumb) fixed_addr = SH_UTIL_SET_BIT0(fixed_addr);
 
     SH_LOG_INFO("txx rewrite: fix addr %" PRIxPTR " -> %" PRIxPTR, addr, fixed_addr);
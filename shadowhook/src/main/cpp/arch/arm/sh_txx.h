@@ -30,6 +30,7 @@ typedef struct {
   uintptr_t start_addr;
   uintptr_t end_addr;
   uint16_t *buf;
+  uintptr_t buf_pc;  // where buf is executed, buf may be the writable alias of it
   size_t buf_offset;
   size_t inst_prolog_len;
   size_t inst_lens[13];  // 26 / 2 = 13
@@ -53,44 +53,63 @@ typedef enum {
   TBNZ
 } sh_a64_type_t;
 
+// decode rules, grouped by the opcode bits [31:24]
+// the first matching rule in the group wins, the last rule of each group always matches
+typedef struct {
+  uint32_t mask;
+  uint32_t value;
+  sh_a64_type_t type;
+} sh_a64_rule_t;
+
+static const sh_a64_rule_t sh_a64_rules[] = {
+    {0x00000000, 0x00000000, IGNORED},
+    {0x9F000000, 0x10000000, ADR},
+    {0xFC000000, 0x14000000, B},
+    {0xFF000000, 0x18000000, LDR_LIT_32},
+    {0xFF000000, 0x1C000000, LDR_SIMD_LIT_32},
+    {0x7F000000, 0x34000000, CBZ},
+    {0x7F000000, 0x35000000, CBNZ},
+    {0x7F000000, 0x36000000, TBZ},
+    {0x7F000000, 0x37000000, TBNZ},
+    {0xFF000010, 0x54000000, B_COND},
+    {0x00000000, 0x00000000, IGNORED},
+    {0xFF000000, 0x58000000, LDR_LIT_64},
+    {0xFF000000, 0x5C000000, LDR_SIMD_LIT_64},
+    {0x9F000000, 0x90000000, ADRP},
+    {0xFC000000, 0x94000000, BL},
+    {0xFF000000, 0x98000000, LDRSW_LIT},
+    {0xFF000000, 0x9C000000, LDR_SIMD_LIT_128},
+    {0xFF000000, 0xD8000000, PRFM_LIT},
+};
+
+// index of the first rule of each group in sh_a64_rules[]
+static const uint8_t sh_a64_rules_idx[256] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    1, 0, 0, 0, 2, 2, 2, 2, 3, 0, 0, 0, 4, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    1, 0, 0, 0, 5, 6, 7, 8, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    1, 0, 0, 0, 9, 0, 0, 0, 11, 0, 0, 0, 12, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    13, 0, 0, 0, 14, 14, 14, 14, 15, 0, 0, 0, 16, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    13, 0, 0, 0, 5, 6, 7, 8, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    13, 0, 0, 0, 0, 0, 0, 0, 17, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    13, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+};
+
 static sh_a64_type_t sh_a64_get_type(uint32_t inst) {
-  if ((inst & 0xFC000000) == 0x14000000)
-    return B;
-  else if ((inst & 0xFF000010) == 0x54000000)
-    return B_COND;
-  else if ((inst & 0xFC000000) == 0x94000000)
-    return BL;
-  else if ((inst & 0x9F000000) == 0x10000000)
-    return ADR;
-  else if ((inst & 0x9F000000) == 0x90000000)
-    return ADRP;
-  else if ((inst & 0xFF000000) == 0x18000000)
-    return LDR_LIT_32;
-  else if ((inst & 0xFF000000) == 0x58000000)
-    return LDR_LIT_64;
-  else if ((inst & 0xFF000000) == 0x98000000)
-    return LDRSW_LIT;
-  else if ((inst & 0xFF000000) == 0xD8000000)
-    return PRFM_LIT;
-  else if ((inst & 0xFF000000) == 0x1C000000)
-    return LDR_SIMD_LIT_32;
-  else if ((inst & 0xFF000000) == 0x5C000000)
-    return LDR_SIMD_LIT_64;
-  else if ((inst & 0xFF000000) == 0x9C000000)
-    return LDR_SIMD_LIT_128;
-  else if ((inst & 0x7F000000u) == 0x34000000)
-    return CBZ;
-  else if ((inst & 0x7F000000u) == 0x35000000)
-    return CBNZ;
-  else if ((inst & 0x7F000000u) == 0x36000000)
-    return TBZ;
-  else if ((inst & 0x7F000000u) == 0x37000000)
-    return TBNZ;
-  else
-    return IGNORED;
+  const sh_a64_rule_t *rule = &sh_a64_rules[sh_a64_rules_idx[inst >> 24u]];
+  while ((inst & rule->mask) != rule->value) rule++;
+  return rule->type;
 }
 
-size_t sh_a64_get_rewrite_inst_len(uint32_t inst) {
+// the max length of the rewritten instruction (including the pooled literals)
+size_t sh_a64_get_rewrite_inst_max_len(uint32_t inst) {
   static uint8_t map[] = {
       4,   // IGNORED
       20,  // B
@@ -114,6 +133,203 @@ size_t sh_a64_get_rewrite_inst_len(uint32_t inst) {
   return (size_t)(map[sh_a64_get_type(inst)]);
 }
 
+bool sh_a64_is_leaf_func(uint32_t *insts, size_t cnt) {
+  // the last instruction must be RET, so the execution never falls through the end
+  if (0 == cnt || 0xd65f03c0 != insts[cnt - 1]) return false;
+
+  for (size_t i = 0; i < cnt - 1; i++) {
+    // no calls (BL), no indirect branches (BR, BLR, RET, ...)
+    if (BL == sh_a64_get_type(insts[i])) return false;
+    if (0xd6000000 == (insts[i] & 0xfe000000)) return false;
+  }
+  return true;
+}
+
+#define SH_A64_REG(n) (1u << (n))
+
+// X0-X8 pass the arguments, X0-X17 are not preserved across calls (AAPCS64)
+#define SH_A64_REGS_ARGS         0x000001FFu
+#define SH_A64_REGS_CALLER_SAVED 0x0003FFFFu
+
+// The general-purpose registers read and written by an instruction which is not a branch.
+// The reads may be over-approximated, but the writes must be exact (a missed write only makes
+// the liveness scan more conservative). Return false if the instruction is not recognized.
+static bool sh_a64_get_regs_usage(uint32_t inst, uint32_t *reads, uint32_t *writes) {
+  uint32_t rd = SH_UTIL_GET_BITS_32(inst, 4, 0);  // also Rt
+  uint32_t rn = SH_UTIL_GET_BITS_32(inst, 9, 5);
+  uint32_t ra = SH_UTIL_GET_BITS_32(inst, 14, 10);  // also Rt2
+  uint32_t rm = SH_UTIL_GET_BITS_32(inst, 20, 16);
+  uint32_t op0 = SH_UTIL_GET_BITS_32(inst, 28, 25);
+  *reads = 0;
+  *writes = 0;
+
+  if (0x8 == (op0 & 0xEu)) {
+    // data processing (immediate)
+    uint32_t op = SH_UTIL_GET_BITS_32(inst, 25, 23);
+    uint32_t opc = SH_UTIL_GET_BITS_32(inst, 30, 29);
+    if (op <= 1) {
+      // ADR, ADRP
+    } else if (op == 5) {
+      // MOVN, MOVZ, MOVK
+      if (opc == 1) return false;
+      if (opc == 3) *reads = SH_A64_REG(rd);
+    } else if (op == 6) {
+      // SBFM, BFM, UBFM
+      if (opc == 3) return false;
+      *reads = SH_A64_REG(rn) | (opc == 1 ? SH_A64_REG(rd) : 0);
+    } else if (op == 7) {
+      // EXTR
+      *reads = SH_A64_REG(rn) | SH_A64_REG(rm);
+    } else {
+      // ADD, SUB, AND, ORR, EOR, ... (immediate)
+      *reads = SH_A64_REG(rn);
+    }
+    *writes = SH_A64_REG(rd);
+    return true;
+  }
+
+  if (0x5 == (op0 & 0x7u)) {
+    // data processing (register)
+    *reads = SH_A64_REG(rn) | SH_A64_REG(rm) | SH_A64_REG(ra);
+    uint32_t op = SH_UTIL_GET_BITS_32(inst, 28, 21);
+    // not: CCMP, CCMN, RMIF, SETF8, SETF16 (RMIF and SETF are in the ADC class with op3 != 0)
+    bool is_adc = (op == 0xD0 && 0 == SH_UTIL_GET_BITS_32(inst, 15, 10));
+    if (0 == (op & 0x80u) || is_adc || op == 0xD4 || op == 0xD6 || 0xD8 == (op & 0xF8u))
+      *writes = SH_A64_REG(rd);
+    return true;
+  }
+
+  if (0x7 == (op0 & 0x7u)) {
+    // data processing (SIMD and FP), only Rn or Rm may be a general-purpose register
+    *reads = SH_A64_REG(rn) | SH_A64_REG(rm);
+    return true;
+  }
+
+  if (0x4 == (op0 & 0x5u)) {
+    // loads and stores
+    bool is_simd = (0 != (inst & 0x04000000u));
+    if (0x28000000 == (inst & 0x3A000000u)) {
+      // LDP, STP, LDNP, STNP, LDPSW, STGP
+      *reads = SH_A64_REG(rn);
+      if (is_simd) return true;
+      if (0 != (inst & 0x00400000u))
+        *writes = SH_A64_REG(rd) | SH_A64_REG(ra);
+      else
+        *reads |= SH_A64_REG(rd) | SH_A64_REG(ra);
+      return true;
+    }
+    if (0x18000000 == (inst & 0x3B000000u)) {
+      // LDR (literal), LDRSW (literal), PRFM (literal)
+      if (!is_simd && 3 != SH_UTIL_GET_BITS_32(inst, 31, 30)) *writes = SH_A64_REG(rd);
+      return true;
+    }
+    if (0x38000000 == (inst & 0x3A000000u)) {
+      // LDR, STR, LDUR, STUR, LDTR, STTR, PRFM, ... (immediate or register offset)
+      *reads = SH_A64_REG(rn);
+      if (0 == (inst & 0x01000000u) && 0 != (inst & 0x00200000u)) {
+        if (0x800 != (inst & 0xC00u)) return false;  // atomic memory operations, LDRAA, LDRAB
+        *reads |= SH_A64_REG(rm);
+      }
+      if (is_simd) return true;
+      uint32_t size = SH_UTIL_GET_BITS_32(inst, 31, 30);
+      uint32_t opc = SH_UTIL_GET_BITS_32(inst, 23, 22);
+      if (opc == 0)
+        *reads |= SH_A64_REG(rd);  // store
+      else if (size == 3 && opc == 3)
+        return false;
+      else if (!(size == 3 && opc == 2))  // not PRFM
+        *writes = SH_A64_REG(rd);         // load
+      return true;
+    }
+    return false;  // exclusive, ordered, SIMD structures, ...
+  }
+
+  if (0xD503201F == (inst & 0xFFFFF01Fu)) return true;  // hints: NOP, BTI, PACIASP, ...
+  if (0xD503301F == (inst & 0xFFFFF01Fu)) return true;  // barriers: DMB, DSB, ISB, ...
+  if (0xD5300000 == (inst & 0xFFF00000u)) {
+    *writes = SH_A64_REG(rd);  // MRS
+    return true;
+  }
+  if (0xD5100000 == (inst & 0xFFF00000u)) {
+    *reads = SH_A64_REG(rd);  // MSR (register)
+    return true;
+  }
+  return false;
+}
+
+#define SH_A64_LIVENESS_STEPS_MAX 64
+#define SH_A64_LIVENESS_PATHS_MAX 8
+
+uint32_t sh_a64_get_dead_regs(const uint32_t *insts, size_t insts_cnt, size_t idx, uint32_t regs) {
+  struct {
+    size_t idx;
+    uint32_t regs;  // not yet written or read on this path
+  } paths[SH_A64_LIVENESS_PATHS_MAX];
+  size_t paths_cnt = 0;
+  size_t steps = 0;
+  uint32_t live = 0;
+
+  paths[paths_cnt].idx = idx;
+  paths[paths_cnt++].regs = regs;
+  while (paths_cnt > 0) {
+    paths_cnt--;
+    size_t i = paths[paths_cnt].idx;
+    uint32_t undecided = paths[paths_cnt].regs;
+
+    while (0 != (undecided &= ~live)) {
+      // out of the function, or too far away: assume live
+      if (i >= insts_cnt || steps++ >= SH_A64_LIVENESS_STEPS_MAX) {
+        live |= undecided;
+        break;
+      }
+
+      uint32_t inst = insts[i];
+      sh_a64_type_t type = sh_a64_get_type(inst);
+      if (type == B || type == B_COND || type == CBZ || type == CBNZ || type == TBZ || type == TBNZ) {
+        uint32_t imm_bits = (type == B ? 26 : (type == TBZ || type == TBNZ ? 14 : 19));
+        uint32_t imm_shift = (type == B ? 0 : 5);
+        uint64_t imm = (inst >> imm_shift) & ((1u << imm_bits) - 1);
+        size_t target = i + (size_t)SH_UTIL_SIGN_EXTEND_64(imm, imm_bits);
+        if (type == CBZ || type == CBNZ || type == TBZ || type == TBNZ)
+          live |= undecided & SH_A64_REG(SH_UTIL_GET_BITS_32(inst, 4, 0));
+        if (type == B) {
+          i = target;
+          continue;
+        }
+        if (paths_cnt == SH_A64_LIVENESS_PATHS_MAX) {
+          live |= undecided;
+          break;
+        }
+        paths[paths_cnt].idx = target;
+        paths[paths_cnt++].regs = undecided;
+        i++;
+      } else if (type == BL || 0xD63F0000 == (inst & 0xFFFFFC1Fu)) {
+        // BL, BLR: the callee reads the arguments and does not preserve the caller-saved registers
+        if (type != BL) live |= undecided & SH_A64_REG(SH_UTIL_GET_BITS_32(inst, 9, 5));
+        live |= undecided & SH_A64_REGS_ARGS;
+        undecided &= ~(SH_A64_REGS_CALLER_SAVED | SH_A64_REG(30));
+        i++;
+      } else if (0xD65F0000 == (inst & 0xFFFFFC1Fu) || 0xD65F0BFF == (inst & 0xFFFFFBFFu)) {
+        // RET, RETAA, RETAB: only the temporary registers are not needed by the caller
+        if (0 == (inst & 0x800u)) live |= undecided & SH_A64_REG(SH_UTIL_GET_BITS_32(inst, 9, 5));
+        live |= undecided & ~(SH_A64_REGS_CALLER_SAVED & ~SH_A64_REGS_ARGS);
+        break;
+      } else {
+        // BR and the unrecognized instructions end the scan
+        uint32_t reads, writes;
+        if (0xD6000000 == (inst & 0xFE000000u) || !sh_a64_get_regs_usage(inst, &reads, &writes)) {
+          live |= undecided;
+          break;
+        }
+        live |= undecided & reads;
+        undecided &= ~writes;
+        i++;
+      }
+    }
+  }
+  return regs & ~live;
+}
+
 static bool sh_a64_is_addr_need_fix(uintptr_t addr, sh_a64_rewrite_info_t *rinfo) {
   return (rinfo->start_addr <= addr && addr < rinfo->end_addr);
 }
@@ -127,7 +343,7 @@ static uintptr_t sh_a64_fix_addr(uintptr_t addr, sh_a64_rewrite_info_t *rinfo) {
       cursor_addr += 4;
       offset += rinfo->inst_lens[i];
     }
-    uintptr_t fixed_addr = (uintptr_t)rinfo->buf + rinfo->inst_prolog_len + offset;
+    uintptr_t fixed_addr = rinfo->buf_pc + rinfo->inst_prolog_len + offset;
     SH_LOG_INFO("a64 rewrite: fix addr %" PRIxPTR " -> %" PRIxPTR, addr, fixed_addr);
     return fixed_addr;
   }
@@ -139,6 +355,147 @@ static uintptr_t sh_a64_fix_addr(uintptr_t addr, sh_a64_rewrite_info_t *rinfo) {
 #define SH_A64_B_OFFSET_LOW  (134217728)
 #define SH_A64_B_OFFSET_HIGH (134217724)
 
+// B.cond, CBZ, CBNZ, ADR, LDR (literal): [-1M, +1M - 4]
+#define SH_A64_IMM19_OFFSET_LOW  (1048576)
+#define SH_A64_IMM19_OFFSET_HIGH (1048572)
+
+// TBZ, TBNZ: [-32K, +32K - 4]
+#define SH_A64_IMM14_OFFSET_LOW  (32768)
+#define SH_A64_IMM14_OFFSET_HIGH (32764)
+
+static bool sh_a64_is_in_range(uintptr_t addr, uintptr_t pc, uintptr_t range_low, uintptr_t range_high) {
+  if (addr >= pc)
+    return addr - pc <= range_high;
+  else
+    return pc - addr <= range_low;
+}
+
+// The length of each rewritten instruction is measured before it is written (two-pass, the
+// lengths are needed by sh_a64_fix_addr()), so the choice of the instruction form must not
+// depend on the exact pc in buf. Check the range from both ends of buf instead.
+static bool sh_a64_is_near(uintptr_t addr, sh_a64_rewrite_info_t *rinfo, uintptr_t range_low,
+                           uintptr_t range_high) {
+  uintptr_t first = rinfo->buf_pc;
+  uintptr_t last = rinfo->buf_pc + rinfo->buf_size - 4;
+  return sh_a64_is_in_range(addr, first, range_low, range_high) &&
+         sh_a64_is_in_range(addr, last, range_low, range_high);
+}
+
+static bool sh_a64_is_near_adrp(uintptr_t addr, sh_a64_rewrite_info_t *rinfo) {
+  uintptr_t first = rinfo->buf_pc;
+  uintptr_t last = rinfo->buf_pc + rinfo->buf_size - 4;
+  return sh_a64_is_in_adrp_range(addr, first) && sh_a64_is_in_adrp_range(addr, last);
+}
+
+static uint32_t sh_a64_adrp(uint32_t rd, uintptr_t addr, uintptr_t pc) {
+  uint32_t pages = (uint32_t)((addr >> 12u) - (pc >> 12u));
+  uint32_t immlo = pages & 0x3u;
+  uint32_t immhi = (pages >> 2u) & 0x7FFFFu;
+  return 0x90000000u | (immlo << 29u) | (immhi << 5u) | rd;  // ADRP Xd, <label>
+}
+
+static uint32_t sh_a64_add_lo12(uint32_t rd, uintptr_t addr) {
+  return 0x91000000u | ((uint32_t)(addr & 0xFFFu) << 10u) | (rd << 5u) | rd;  // ADD Xd, Xd, #lo12
+}
+
+// The literals are pooled at the end of buf (growing downward) and shared by all the rewritten
+// instructions, identical literals are stored only once.
+static uintptr_t sh_a64_pool_add(sh_a64_rewrite_info_t *rinfo, uint64_t value) {
+  uint64_t *pool_end = (uint64_t *)((uintptr_t)rinfo->buf + rinfo->buf_size);
+  for (size_t i = 1; i <= rinfo->pool_cnt; i++)
+    if (value == *(pool_end - i)) return (uintptr_t)(pool_end - i);
+
+  rinfo->pool_cnt++;
+  *(pool_end - rinfo->pool_cnt) = value;
+  return (uintptr_t)(pool_end - rinfo->pool_cnt);
+}
+
+// the address where buf is executed (buf itself may be the writable alias of it)
+static uintptr_t sh_a64_get_pc(uint32_t *buf, sh_a64_rewrite_info_t *rinfo) {
+  return rinfo->buf_pc + ((uintptr_t)buf - (uintptr_t)rinfo->buf);
+}
+
+// buf == NULL: only measure the length
+static void sh_a64_put(uint32_t *buf, size_t *idx, uint32_t inst) {
+  if (NULL != buf) buf[*idx] = inst;
+  (*idx)++;
+}
+
+static void sh_a64_put_ldr_pool(uint32_t *buf, size_t *idx, uint32_t rt, uint64_t value,
+                                sh_a64_rewrite_info_t *rinfo) {
+  if (NULL != buf) {
+    uintptr_t pc = (uintptr_t)&buf[*idx];
+    uintptr_t literal = sh_a64_pool_add(rinfo, value);
+    buf[*idx] = 0x58000000u | ((uint32_t)(((literal - pc) >> 2u) & 0x7FFFFu) << 5u) | rt;  // LDR Xt, <lit>
+  } else {
+    rinfo->pool_max_cnt++;
+  }
+  (*idx)++;
+}
+
+// load addr to Xd: ADRP (+ ADD) if it is within the range of ADRP, otherwise LDR from the pool
+static void sh_a64_put_addr(uint32_t *buf, size_t *idx, uint32_t rd, uintptr_t addr,
+                            sh_a64_rewrite_info_t *rinfo) {
+  if (sh_a64_is_near_adrp(addr, rinfo)) {
+    if (NULL != buf) buf[*idx] = sh_a64_adrp(rd, addr, sh_a64_get_pc(&buf[*idx], rinfo));
+    (*idx)++;
+    if (0 != (addr & 0xFFFu)) sh_a64_put(buf, idx, sh_a64_add_lo12(rd, addr));
+  } else {
+    sh_a64_put_ldr_pool(buf, idx, rd, addr, rinfo);
+  }
+}
+
+// the scratch registers (X9-X17), IP1 (X17) is preferred
+#define SH_A64_REGS_SCRATCH 0x0003FE00u
+
+// Pick a scratch register which is dead at addr, return 0 if there is none. At the start of a
+// function, they are all dead until written by the rewritten instructions before pc. Otherwise,
+// scan forward from addr within the function (or within the page if the function is unknown).
+static uint32_t sh_a64_get_scratch_reg(uintptr_t addr, uintptr_t pc, sh_a64_rewrite_info_t *rinfo) {
+  uint32_t regs = 0;
+  if (rinfo->addr_info->is_proc_start) {
+    regs = SH_A64_REGS_SCRATCH;
+    for (uintptr_t p = rinfo->start_addr; p < pc && 0 != regs; p += 4) {
+      uint32_t reads, writes;
+      if (sh_a64_get_regs_usage(*((uint32_t *)p), &reads, &writes))
+        regs &= ~writes;
+      else
+        regs = 0;
+    }
+  }
+
+  if (0 == regs) {
+    sh_addr_info_t *addr_info = rinfo->addr_info;
+    uintptr_t low = addr & ~(uintptr_t)0xFFF;
+    uintptr_t high = low + 0x1000;
+    if (addr_info->is_sym_addr && NULL != addr_info->dli_saddr &&
+        (uintptr_t)addr_info->dli_saddr <= addr &&
+        addr < (uintptr_t)addr_info->dli_saddr + addr_info->dli_ssize) {
+      low = (uintptr_t)addr_info->dli_saddr;
+      high = low + addr_info->dli_ssize;
+    }
+    regs = sh_a64_get_dead_regs((uint32_t *)low, (high - low) / 4, (addr - low) / 4, SH_A64_REGS_SCRATCH);
+  }
+
+  for (uint32_t r = 17; r >= 9; r--)
+    if (0 != (regs & SH_A64_REG(r))) return r;
+  return 0;
+}
+
+// absolute jump with Xd (X17 when jumping to the island)
+static void sh_a64_put_jump(uint32_t *buf, size_t *idx, uint32_t rd, uintptr_t addr, bool is_link,
+                            bool is_to_island, sh_a64_rewrite_info_t *rinfo) {
+  if (is_to_island) {
+    // the address of island-rewrite is unknown when measuring, always load it from the pool
+    sh_a64_put(buf, idx, 0xa93f47f0);  // STP X16, X17, [SP, #-0x10]
+    sh_a64_put_ldr_pool(buf, idx, 17, addr, rinfo);
+    rd = 17;
+  } else {
+    sh_a64_put_addr(buf, idx, rd, addr, rinfo);
+  }
+  sh_a64_put(buf, idx, (is_link ? 0xD63F0000 : 0xD61F0000) | (rd << 5u));  // BLR Xd _or_ BR Xd
+}
+
 static int sh_a64_build_island_rewrite(uintptr_t addr, sh_a64_rewrite_info_t *rinfo) {
   // alloc island-rewrite (jump from "island-rewrite->addr + 4" to "addr")
   uintptr_t island_enter_range_low =
@@ -150,47 +507,79 @@ static int sh_a64_build_island_rewrite(uintptr_t addr, sh_a64_rewrite_info_t *ri
   if (0 == rinfo->island_rewrite->addr) return SHADOWHOOK_ERRNO_HOOK_ISLAND_REWRITE;
 
   // relative jump to "pc + 4" in island-enter
-  sh_a64_restore_ip((uint32_t *)rinfo->island_rewrite->addr);
-  sh_a64_relative_jump((uint32_t *)(rinfo->island_rewrite->addr + 4), addr, rinfo->island_rewrite->addr + 4);
+  uintptr_t island_rw = sh_island_get_rw_addr(rinfo->island_rewrite);
+  sh_a64_restore_ip((uint32_t *)island_rw);
+  sh_a64_relative_jump((uint32_t *)(island_rw + 4), addr, rinfo->island_rewrite->addr + 4);
   sh_util_clear_cache(rinfo->island_rewrite->addr, rinfo->island_rewrite->size);
   SH_LOG_INFO("a64 rewrite: branch island %" PRIxPTR " -> %" PRIxPTR, rinfo->island_rewrite->addr + 4, addr);
   return 0;
 }
 
-static size_t sh_a64_rewrite_b(uint32_t *buf, uint32_t inst, uintptr_t pc, sh_a64_type_t type,
-                               sh_a64_rewrite_info_t *rinfo) {
-  uint64_t imm64;
-  if (type == B_COND) {
-    uint64_t imm19 = SH_UTIL_GET_BITS_32(inst, 23, 5);
-    imm64 = SH_UTIL_SIGN_EXTEND_64(imm19 << 2u, 21u);
+// B, BL, B.cond, CBZ, CBNZ, TBZ, TBNZ
+static size_t sh_a64_rewrite_branch(uint32_t *buf, uint32_t inst, uintptr_t pc, sh_a64_type_t type,
+                                    sh_a64_rewrite_info_t *rinfo) {
+  uint32_t keep_mask;
+  uint32_t imm_bits;
+  uintptr_t range_low, range_high;
+  if (type == B || type == BL) {
+    keep_mask = 0xFC000000;
+    imm_bits = 26;
+    range_low = SH_A64_B_OFFSET_LOW;
+    range_high = SH_A64_B_OFFSET_HIGH;
+  } else if (type == TBZ || type == TBNZ) {
+    keep_mask = 0xFFF8001F;
+    imm_bits = 14;
+    range_low = SH_A64_IMM14_OFFSET_LOW;
+    range_high = SH_A64_IMM14_OFFSET_HIGH;
   } else {
-    uint64_t imm26 = SH_UTIL_GET_BITS_32(inst, 25, 0);
-    imm64 = SH_UTIL_SIGN_EXTEND_64(imm26 << 2u, 28u);
+    // B_COND, CBZ, CBNZ
+    keep_mask = 0xFF00001F;
+    imm_bits = 19;
+    range_low = SH_A64_IMM19_OFFSET_LOW;
+    range_high = SH_A64_IMM19_OFFSET_HIGH;
+  }
+  uint32_t imm_shift = (type == B || type == BL) ? 0 : 5;
+  uint32_t imm_mask = (1u << imm_bits) - 1;
+
+  uint64_t imm = (inst >> imm_shift) & imm_mask;
+  uintptr_t addr = pc + SH_UTIL_SIGN_EXTEND_64(imm << 2u, imm_bits + 2);
+
+  // the fixed address is in buf, it is always within the range
+  bool is_near = sh_a64_is_addr_need_fix(addr, rinfo) || sh_a64_is_near(addr, rinfo, range_low, range_high);
+  if (NULL != buf) addr = sh_a64_fix_addr(addr, rinfo);
+
+  // relative branch directly (no need to save and restore a register)
+  if (is_near) {
+    if (NULL != buf)
+      buf[0] = (inst & keep_mask) |
+               ((uint32_t)(((addr - sh_a64_get_pc(buf, rinfo)) >> 2u) & imm_mask) << imm_shift);
+    return 4;
   }
-  uint64_t addr = pc + imm64;
-  addr = sh_a64_fix_addr(addr, rinfo);
 
-  bool use_branch_island = (0 != rinfo->island_rewrite && (type == B || type == B_COND));
-  if (use_branch_island) {
+  bool use_branch_island = (0 != rinfo->island_rewrite && type != BL);
+
+  // the absolute jump corrupts a scratch register, it must be dead at addr
+  // (except for BL, the callee does not expect any value in the scratch registers)
+  uint32_t rd = 17;
+  if (!use_branch_island && type != BL && 0 == (rd = sh_a64_get_scratch_reg(addr, pc, rinfo))) {
+    SH_LOG_WARN("a64 rewrite: no dead scratch register for branch %" PRIxPTR " -> %" PRIxPTR, pc, addr);
+    return 0;  // failed
+  }
+
+  if (use_branch_island && NULL != buf) {
     if (0 != sh_a64_build_island_rewrite(addr, rinfo)) return 0;  // failed
     addr = rinfo->island_rewrite->addr;
   }
 
   size_t idx = 0;
-  if (type == B_COND) {
-    buf[idx++] = (inst & 0xFF00001F) | 0x40u;                  // B.<cond> #8
-    buf[idx++] = use_branch_island ? 0x14000007 : 0x14000006;  // B #28 _or_ B #24
+  if (type != B && type != BL) {
+    size_t jump_len = 0;
+    sh_a64_put_jump(NULL, &jump_len, rd, addr, false, use_branch_island, rinfo);
+    sh_a64_put(buf, &idx, (inst & keep_mask) | (2u << imm_shift));  // B.<cond> _or_ CB(N)Z _or_ TB(N)Z, #8
+    sh_a64_put(buf, &idx, 0x14000000u | (uint32_t)(jump_len + 1));  // B <skip the jump>
   }
-  if (use_branch_island) buf[idx++] = 0xa93f47f0;  // STP X16, X17, [SP, #-0x10]
-  buf[idx++] = 0x58000051;                         // LDR X17, #8
-  buf[idx++] = 0x14000003;                         // B #12
-  buf[idx++] = addr & 0xFFFFFFFF;
-  buf[idx++] = addr >> 32u;
-  if (type == BL)
-    buf[idx++] = 0xD63F0220;  // BLR X17
-  else
-    buf[idx++] = 0xD61F0220;  // BR X17
-  return idx * 4;             // 20(24) or 28(32)
+  sh_a64_put_jump(buf, &idx, rd, addr, type == BL, use_branch_island, rinfo);
+  return idx * 4;
 }
 
 static size_t sh_a64_rewrite_adr(uint32_t *buf, uint32_t inst, uintptr_t pc, sh_a64_type_t type,
@@ -205,11 +594,17 @@ static size_t sh_a64_rewrite_adr(uint32_t *buf, uint32_t inst, uintptr_t pc, sh_
     addr = (pc & 0xFFFFFFFFFFFFF000) + SH_UTIL_SIGN_EXTEND_64((immhi << 14u) | (immlo << 12u), 33u);
   if (sh_a64_is_addr_need_fix(addr, rinfo)) return 0;  // rewrite failed
 
-  buf[0] = 0x58000040u | xd;  // LDR Xd, #8
-  buf[1] = 0x14000003;        // B #12
-  buf[2] = addr & 0xFFFFFFFF;
-  buf[3] = addr >> 32u;
-  return 16;
+  size_t idx = 0;
+  if (type == ADR && sh_a64_is_near(addr, rinfo, SH_A64_IMM19_OFFSET_LOW, SH_A64_IMM19_OFFSET_HIGH)) {
+    if (NULL != buf) {
+      uint32_t offset = (uint32_t)(addr - sh_a64_get_pc(buf, rinfo));
+      buf[0] = 0x10000000u | ((offset & 0x3u) << 29u) | (((offset >> 2u) & 0x7FFFFu) << 5u) | xd;  // ADR Xd
+    }
+    idx++;
+  } else {
+    sh_a64_put_addr(buf, &idx, xd, addr, rinfo);  // ADRP Xd (+ ADD) _or_ LDR Xd, <lit>
+  }
+  return idx * 4;
 }
 
 static size_t sh_a64_rewrite_ldr(uint32_t *buf, uint32_t inst, uintptr_t pc, sh_a64_type_t type,
@@ -219,120 +614,93 @@ static size_t sh_a64_rewrite_ldr(uint32_t *buf, uint32_t inst, uintptr_t pc, sh_
   uint64_t offset = SH_UTIL_SIGN_EXTEND_64((imm19 << 2u), 21u);
   uint64_t addr = pc + offset;
 
+  bool is_near = false;
   if (sh_a64_is_addr_need_fix(addr, rinfo)) {
     if (type != PRFM_LIT) return 0;  // rewrite failed
-    addr = sh_a64_fix_addr(addr, rinfo);
+    if (NULL != buf) addr = sh_a64_fix_addr(addr, rinfo);
+    is_near = true;
+  } else {
+    is_near = sh_a64_is_near(addr, rinfo, SH_A64_IMM19_OFFSET_LOW, SH_A64_IMM19_OFFSET_HIGH);
+  }
+
+  // load from the literal directly
+  if (is_near) {
+    if (NULL != buf)
+      buf[0] = (inst & 0xFF00001F) |
+               ((uint32_t)(((addr - sh_a64_get_pc(buf, rinfo)) >> 2u) & 0x7FFFFu) << 5u);
+    return 4;
   }
 
+  size_t idx = 0;
   if (type == LDR_LIT_32 || type == LDR_LIT_64 || type == LDRSW_LIT) {
-    buf[0] = 0x58000060u | rt;  // LDR Xt, #12
-    if (type == LDR_LIT_32)
-      buf[1] = 0xB9400000 | rt | (rt << 5u);  // LDR Wt, [Xt]
-    else if (type == LDR_LIT_64)
-      buf[1] = 0xF9400000 | rt | (rt << 5u);  // LDR Xt, [Xt]
-    else
-      // LDRSW_LIT
-      buf[1] = 0xB9800000 | rt | (rt << 5u);  // LDRSW Xt, [Xt]
-    buf[2] = 0x14000003;                      // B #12
-    buf[3] = addr & 0xFFFFFFFF;
-    buf[4] = addr >> 32u;
-    return 20;
+    uint32_t lo12 = (uint32_t)(addr & 0xFFFu);
+    if (sh_a64_is_near_adrp(addr, rinfo) && (type != LDR_LIT_64 || 0 == lo12 % 8)) {
+      if (NULL != buf) buf[idx] = sh_a64_adrp(rt, addr, sh_a64_get_pc(&buf[idx], rinfo));  // ADRP Xt, <page>
+      idx++;
+      if (type == LDR_LIT_32)
+        sh_a64_put(buf, &idx, 0xB9400000 | ((lo12 / 4) << 10u) | rt | (rt << 5u));  // LDR Wt, [Xt, #lo12]
+      else if (type == LDR_LIT_64)
+        sh_a64_put(buf, &idx, 0xF9400000 | ((lo12 / 8) << 10u) | rt | (rt << 5u));  // LDR Xt, [Xt, #lo12]
+      else
+        // LDRSW_LIT
+        sh_a64_put(buf, &idx, 0xB9800000 | ((lo12 / 4) << 10u) | rt | (rt << 5u));  // LDRSW Xt, [Xt, #lo12]
+    } else {
+      sh_a64_put_ldr_pool(buf, &idx, rt, addr, rinfo);  // LDR Xt, <lit>
+      if (type == LDR_LIT_32)
+        sh_a64_put(buf, &idx, 0xB9400000 | rt | (rt << 5u));  // LDR Wt, [Xt]
+      else if (type == LDR_LIT_64)
+        sh_a64_put(buf, &idx, 0xF9400000 | rt | (rt << 5u));  // LDR Xt, [Xt]
+      else
+        // LDRSW_LIT
+        sh_a64_put(buf, &idx, 0xB9800000 | rt | (rt << 5u));  // LDRSW Xt, [Xt]
+    }
   } else {
-    buf[0] = 0xA93F47F0;  // STP X16, X17, [SP, -0x10]
-    buf[1] = 0x58000091;  // LDR X17, #16
+    // use a scratch register which is dead after this instruction, or save and restore X17
+    uint32_t rd = sh_a64_get_scratch_reg(pc + 4, pc + 4, rinfo);
+    if (0 == rd) sh_a64_put(buf, &idx, 0xA93F47F0);  // STP X16, X17, [SP, -0x10]
+    uint32_t rn = (0 == rd) ? 17 : rd;
+    sh_a64_put_addr(buf, &idx, rn, addr, rinfo);  // ADRP Xn (+ ADD) _or_ LDR Xn, <lit>
     if (type == PRFM_LIT)
-      buf[2] = 0xF9800220 | rt;  // PRFM Rt, [X17]
+      sh_a64_put(buf, &idx, 0xF9800000 | (rn << 5u) | rt);  // PRFM Rt, [Xn]
     else if (type == LDR_SIMD_LIT_32)
-      buf[2] = 0xBD400220 | rt;  // LDR St, [X17]
+      sh_a64_put(buf, &idx, 0xBD400000 | (rn << 5u) | rt);  // LDR St, [Xn]
     else if (type == LDR_SIMD_LIT_64)
-      buf[2] = 0xFD400220 | rt;  // LDR Dt, [X17]
+      sh_a64_put(buf, &idx, 0xFD400000 | (rn << 5u) | rt);  // LDR Dt, [Xn]
     else
       // LDR_SIMD_LIT_128
-      buf[2] = 0x3DC00220u | rt;  // LDR Qt, [X17]
-    buf[3] = 0xF85F83F1;          // LDR X17, [SP, -0x8]
-    buf[4] = 0x14000003;          // B #12
-    buf[5] = addr & 0xFFFFFFFF;
-    buf[6] = addr >> 32u;
-    return 28;
+      sh_a64_put(buf, &idx, 0x3DC00000u | (rn << 5u) | rt);  // LDR Qt, [Xn]
+    if (0 == rd) sh_a64_put(buf, &idx, 0xF85F83F1);          // LDR X17, [SP, -0x8]
   }
+  return idx * 4;
 }
 
-static size_t sh_a64_rewrite_cb(uint32_t *buf, uint32_t inst, uintptr_t pc, sh_a64_rewrite_info_t *rinfo) {
-  uint64_t imm19 = SH_UTIL_GET_BITS_32(inst, 23, 5);
-  uint64_t offset = SH_UTIL_SIGN_EXTEND_64((imm19 << 2u), 21u);
-  uint64_t addr = pc + offset;
-  addr = sh_a64_fix_addr(addr, rinfo);
-
-  bool use_branch_island = (0 != rinfo->island_rewrite);
-  if (use_branch_island) {
-    if (0 != sh_a64_build_island_rewrite(addr, rinfo)) return 0;  // failed
-    addr = rinfo->island_rewrite->addr;
-  }
-
-  size_t idx = 0;
-  buf[idx++] = (inst & 0xFF00001F) | 0x40u;  // CB(N)Z Rt, #8
-  if (use_branch_island) {
-    buf[idx++] = 0x14000006;  // B #24
-    buf[idx++] = 0xa93f47f0;  // STP X16, X17, [SP, #-0x10]
-  } else {
-    buf[idx++] = 0x14000005;  // B #20
-  }
-  buf[idx++] = 0x58000051;  // LDR X17, #8
-  buf[idx++] = 0xd61f0220;  // BR X17
-  buf[idx++] = addr & 0xFFFFFFFF;
-  buf[idx++] = addr >> 32u;
-  return idx * 4;  // 24(28);
-}
-
-static size_t sh_a64_rewrite_tb(uint32_t *buf, uint32_t inst, uintptr_t pc, sh_a64_rewrite_info_t *rinfo) {
-  uint64_t imm14 = SH_UTIL_GET_BITS_32(inst, 18, 5);
-  uint64_t offset = SH_UTIL_SIGN_EXTEND_64((imm14 << 2u), 16u);
-  uint64_t addr = pc + offset;
-  addr = sh_a64_fix_addr(addr, rinfo);
-
-  bool use_branch_island = (0 != rinfo->island_rewrite);
-  if (use_branch_island) {
-    if (0 != sh_a64_build_island_rewrite(addr, rinfo)) return 0;  // failed
-    addr = rinfo->island_rewrite->addr;
-  }
-
-  size_t idx = 0;
-  buf[idx++] = (inst & 0xFFF8001F) | 0x40u;  // TB(N)Z Rt, #<imm>, #8
-  if (use_branch_island) {
-    buf[idx++] = 0x14000006;  // B #24
-    buf[idx++] = 0xa93f47f0;  // STP X16, X17, [SP, #-0x10]
-  } else {
-    buf[idx++] = 0x14000005;  // B #20
-  }
-  buf[idx++] = 0x58000051;  // LDR X17, #8
-  buf[idx++] = 0xd61f0220;  // BR X17
-  buf[idx++] = addr & 0xFFFFFFFF;
-  buf[idx++] = addr >> 32u;
-  return idx * 4;  // 24(28);
-}
-
-size_t sh_a64_rewrite(uint32_t *buf, uint32_t inst, uintptr_t pc, sh_a64_rewrite_info_t *rinfo) {
+static size_t sh_a64_do_rewrite(uint32_t *buf, uint32_t inst, uintptr_t pc, sh_a64_rewrite_info_t *rinfo) {
   sh_a64_type_t type = sh_a64_get_type(inst);
-  SH_LOG_INFO("a64 rewrite: type %d, inst %" PRIx32, type, inst);
 
-  if (type == B || type == B_COND || type == BL)
-    return sh_a64_rewrite_b(buf, inst, pc, type, rinfo);
+  if (type == B || type == B_COND || type == BL || type == CBZ || type == CBNZ || type == TBZ ||
+      type == TBNZ)
+    return sh_a64_rewrite_branch(buf, inst, pc, type, rinfo);
   else if (type == ADR || type == ADRP)
     return sh_a64_rewrite_adr(buf, inst, pc, type, rinfo);
   else if (type == LDR_LIT_32 || type == LDR_LIT_64 || type == LDRSW_LIT || type == PRFM_LIT ||
            type == LDR_SIMD_LIT_32 || type == LDR_SIMD_LIT_64 || type == LDR_SIMD_LIT_128)
     return sh_a64_rewrite_ldr(buf, inst, pc, type, rinfo);
-  else if (type == CBZ || type == CBNZ)
-    return sh_a64_rewrite_cb(buf, inst, pc, rinfo);
-  else if (type == TBZ || type == TBNZ)
-    return sh_a64_rewrite_tb(buf, inst, pc, rinfo);
   else {
     // IGNORED
-    buf[0] = inst;
+    if (NULL != buf) buf[0] = inst;
     return 4;
   }
 }
 
+size_t sh_a64_get_rewrite_inst_len(uint32_t inst, uintptr_t pc, sh_a64_rewrite_info_t *rinfo) {
+  return sh_a64_do_rewrite(NULL, inst, pc, rinfo);
+}
+
+size_t sh_a64_rewrite(uint32_t *buf, uint32_t inst, uintptr_t pc, sh_a64_rewrite_info_t *rinfo) {
+  SH_LOG_INFO("a64 rewrite: type %d, inst %" PRIx32, sh_a64_get_type(inst), inst);
+  return sh_a64_do_rewrite(buf, inst, pc, rinfo);
+}
+
 size_t sh_a64_nop(uint32_t *buf) {
   buf[0] = 0xd503201f;  // NOP
   return 4;
@@ -398,6 +766,48 @@ size_t sh_a64_absolute_jump_with_ret_rx(uint32_t *buf, uintptr_t addr) {
   return 20;
 }
 
+// the rx registers have already been saved by sh_a64_adrp_jump_with_br_rx()
+size_t sh_a64_absolute_jump_with_br_saved_rx(uint32_t *buf, uintptr_t addr) {
+#ifdef SH_CONFIG_CORRUPT_IP_REGS
+  buf[0] = 0x58000050;  // LDR X16, #8
+  buf[1] = 0xd61f0200;  // BR X16
+#else
+  buf[0] = 0x58000040;  // LDR X0, #8
+  buf[1] = 0xd61f0000;  // BR X0
+#endif
+  buf[2] = addr & 0xFFFFFFFF;
+  buf[3] = addr >> 32u;
+  return 16;
+}
+
+// ADRP: [-4G, +4G - 4K] (by page)
+bool sh_a64_is_in_adrp_range(uintptr_t addr, uintptr_t pc) {
+  int64_t pages = (int64_t)(addr >> 12u) - (int64_t)(pc >> 12u);
+  return -1048576 <= pages && pages <= 1048575;
+}
+
+size_t sh_a64_adrp_jump_with_br_ip(uint32_t *buf, uintptr_t addr, uintptr_t pc) {
+  buf[0] = sh_a64_adrp(17, addr, pc);  // ADRP X17, <page>
+  buf[1] = sh_a64_add_lo12(17, addr);  // ADD X17, X17, #lo12
+  buf[2] = 0xd61f0220;                 // BR X17
+  return 12;
+}
+
+size_t sh_a64_adrp_jump_with_br_rx(uint32_t *buf, uintptr_t addr, uintptr_t pc) {
+#ifdef SH_CONFIG_CORRUPT_IP_REGS
+  buf[0] = 0xa93f47f0;                     // STP X16, X17, [SP, #-0x10]
+  buf[1] = sh_a64_adrp(16, addr, pc + 4);  // ADRP X16, <page>
+  buf[2] = sh_a64_add_lo12(16, addr);      // ADD X16, X16, #lo12
+  buf[3] = 0xd61f0200;                     // BR X16
+#else
+  buf[0] = 0xa93f07e0;                    // STP X0, X1, [SP, #-0x10]
+  buf[1] = sh_a64_adrp(0, addr, pc + 4);  // ADRP X0, <page>
+  buf[2] = sh_a64_add_lo12(0, addr);      // ADD X0, X0, #lo12
+  buf[3] = 0xd61f0000;                    // BR X0
+#endif
+  return 16;
+}
+
 size_t sh_a64_restore_rx(uint32_t *buf) {
 #ifdef SH_CONFIG_CORRUPT_IP_REGS
   buf[0] = 0xa97f47f0;  // LDP X16, X17, [SP, #-0x10]
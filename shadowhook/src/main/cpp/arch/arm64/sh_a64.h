@@ -22,6 +22,7 @@
 // Created by Kelun Cai (caikelun@bytedance.com) on 2021-04-11.
 
 #pragma once
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
@@ -33,15 +34,26 @@ typedef struct {
   uintptr_t start_addr;
   uintptr_t end_addr;
   uint32_t *buf;
+  uintptr_t buf_pc;  // where buf is executed, buf may be the writable alias of it
+  size_t buf_size;   // literals are pooled at the end of buf
   size_t buf_offset;
   size_t inst_prolog_len;
   size_t inst_lens[6];
   size_t inst_lens_cnt;
+  size_t pool_cnt;
+  size_t pool_max_cnt;  // counted when measuring (identical literals are not merged)
   sh_island_t *island_rewrite;  // .size = 8
   sh_addr_info_t *addr_info;
 } sh_a64_rewrite_info_t;
 
-size_t sh_a64_get_rewrite_inst_len(uint32_t inst);
+size_t sh_a64_get_rewrite_inst_max_len(uint32_t inst);
+size_t sh_a64_get_rewrite_inst_len(uint32_t inst, uintptr_t pc, sh_a64_rewrite_info_t *rinfo);
+bool sh_a64_is_leaf_func(uint32_t *insts, size_t cnt);
+
+// Forward liveness scan from insts[idx] over the next few basic blocks, insts[] is the code of
+// the function (branches out of it are not followed). Return the subset of regs (bitmap of X0-X30)
+// which are written before being read on every path, i.e. dead at insts[idx].
+uint32_t sh_a64_get_dead_regs(const uint32_t *insts, size_t insts_cnt, size_t idx, uint32_t regs);
 size_t sh_a64_rewrite(uint32_t *buf, uint32_t inst, uintptr_t pc, sh_a64_rewrite_info_t *rinfo);
 
 size_t sh_a64_nop(uint32_t *buf);
@@ -55,4 +67,10 @@ size_t sh_a64_absolute_jump_with_br_rx(uint32_t *buf, uintptr_t addr);
 size_t sh_a64_absolute_jump_with_ret_rx(uint32_t *buf, uintptr_t addr);
 size_t sh_a64_restore_rx(uint32_t *buf);
 
+size_t sh_a64_absolute_jump_with_br_saved_rx(uint32_t *buf, uintptr_t addr);
+
+bool sh_a64_is_in_adrp_range(uintptr_t addr, uintptr_t pc);
+size_t sh_a64_adrp_jump_with_br_ip(uint32_t *buf, uintptr_t addr, uintptr_t pc);
+size_t sh_a64_adrp_jump_with_br_rx(uint32_t *buf, uintptr_t addr, uintptr_t pc);
+
 size_t sh_a64_relative_jump(uint32_t *buf, uintptr_t addr, uintptr_t pc);
@@ -35,50 +35,165 @@
 #include "sh_island.h"
 #include "sh_linker.h"
 #include "sh_log.h"
+#include "sh_patch.h"
 #include "sh_sig.h"
 #include "sh_util.h"
 #include "shadowhook.h"
 
+// B: [-128M, +128M - 4]
+#define SH_INST_A64_B_OFFSET_LOW  (134217728)
+#define SH_INST_A64_B_OFFSET_HIGH (134217724)
+
+static bool sh_inst_is_in_b_range(uintptr_t addr, uintptr_t pc) {
+  if (addr >= pc)
+    return addr - pc <= SH_INST_A64_B_OFFSET_HIGH;
+  else
+    return pc - addr <= SH_INST_A64_B_OFFSET_LOW;
+}
+
+// the max length of a tiny leaf function which can be relocated as a whole (sh_a64_rewrite_info_t.inst_lens)
+#define SH_INST_A64_WHOLE_FUNC_LEN_MAX 24
+
+// Tiny leaf functions (getters, setters, ...) ending with RET are relocated as a whole to the enter,
+// so the enter never jumps back to the original function. Return 0 if not.
+static size_t sh_inst_get_whole_func_len(sh_inst_t *self, uintptr_t target_addr, sh_addr_info_t *addr_info) {
+  if (!addr_info->is_sym_addr || !addr_info->is_proc_start) return 0;
+  if ((uintptr_t)addr_info->dli_saddr != target_addr) return 0;
+
+  size_t len = addr_info->dli_ssize;
+  if (len < self->backup_len || len > SH_INST_A64_WHOLE_FUNC_LEN_MAX || 0 != len % 4) return 0;
+  if (!sh_a64_is_leaf_func((uint32_t *)target_addr, len / 4)) return 0;
+
+  size_t enter_len = 0;
+  for (uintptr_t i = 0; i < len; i += 4)
+    enter_len += sh_a64_get_rewrite_inst_max_len(*((uint32_t *)(target_addr + i)));
+  if (enter_len > sh_enter_get_max_size()) return 0;
+
+  return len;
+}
+
+// the length of enter: prolog + rewritten instructions + jump back + literal pool
+static size_t sh_inst_measure(sh_inst_t *self, uintptr_t target_addr, sh_addr_info_t *addr_info,
+                              bool is_whole, sh_a64_rewrite_info_t *rinfo) {
+  size_t len = addr_info->is_proc_start ? 0 : 4;  // LDP X16, X17, [SP, #-0x10]
+
+  rinfo->pool_max_cnt = 0;
+  for (size_t i = 0; i < rinfo->inst_lens_cnt; i++) {
+    uintptr_t pc = target_addr + i * 4;
+    rinfo->inst_lens[i] = sh_a64_get_rewrite_inst_len(*((uint32_t *)pc), pc, rinfo);
+    if (0 == rinfo->inst_lens[i]) return 0;
+    len += rinfo->inst_lens[i];
+  }
+
+  if (!is_whole) {
+    if (sh_inst_is_in_b_range(target_addr + self->backup_len, rinfo->buf_pc + len))
+      len += 4;
+    else
+      len += addr_info->is_proc_start ? 16 : 20;
+  }
+
+  return len + rinfo->pool_max_cnt * sizeof(uint64_t);
+}
+
+// The length of the rewritten instructions depends on where the enter is, so measure it at target_addr
+// first (the enter is allocated near it), then alloc an enter from the smallest fitting size class and
+// measure it again in the enter. The enter allocated by the previous attempt is reused if it fits.
+static int sh_inst_alloc_enter(sh_inst_t *self, uintptr_t target_addr, sh_addr_info_t *addr_info,
+                               bool is_whole, sh_a64_rewrite_info_t *rinfo) {
+  rinfo->buf = (uint32_t *)target_addr;
+  rinfo->buf_pc = target_addr;
+  rinfo->buf_size = sh_enter_get_max_size();
+  size_t len = sh_inst_measure(self, target_addr, addr_info, is_whole, rinfo);
+
+  while (true) {
+    if (0 == len) return SHADOWHOOK_ERRNO_HOOK_REWRITE_FAILED;
+    size_t size = sh_enter_get_size(len);
+    if (0 == size) return SHADOWHOOK_ERRNO_HOOK_REWRITE_FAILED;
+
+    if (0 != self->enter && self->enter_size < size) {
+      sh_enter_free(self->enter, self->enter_size);
+      self->enter = 0;
+    }
+    if (0 == self->enter) {
+      if (0 == (self->enter = sh_enter_alloc_near(target_addr, size))) return SHADOWHOOK_ERRNO_HOOK_ENTER;
+      self->enter_size = size;
+    }
+
+    rinfo->buf = (uint32_t *)sh_enter_get_rw_addr(self->enter);
+    rinfo->buf_pc = self->enter;
+    rinfo->buf_size = self->enter_size;
+    len = sh_inst_measure(self, target_addr, addr_info, is_whole, rinfo);
+    if (0 != len && len <= self->enter_size) return 0;
+  }
+}
+
 static int sh_inst_rewrite(sh_inst_t *self, uintptr_t target_addr, sh_addr_info_t *addr_info,
-                           uintptr_t resume_addr, sh_inst_set_orig_addr_t set_orig_addr,
-                           void *set_orig_addr_arg) {
-  // backup original instructions (length: 4 or 16 or 24)
+                           uintptr_t resume_addr, bool *is_resume_direct,
+                           sh_inst_set_orig_addr_t set_orig_addr, void *set_orig_addr_arg) {
+  // backup original instructions (length: 4 or 16 or 20 or 24)
   memcpy((void *)(self->backup), (void *)target_addr, self->backup_len);
 
+  // relocate the whole function if possible, otherwise only the backup instructions
+  size_t whole_len = sh_inst_get_whole_func_len(self, target_addr, addr_info);
+  size_t reloc_len = (0 != whole_len) ? whole_len : self->backup_len;
+
   // package the information passed to rewrite
   sh_a64_rewrite_info_t rinfo;
   rinfo.start_addr = target_addr;
-  rinfo.end_addr = target_addr + self->backup_len;
-  rinfo.buf = (uint32_t *)self->enter;
+  rinfo.end_addr = target_addr + reloc_len;
   rinfo.buf_offset = 0;
   rinfo.inst_prolog_len = 0;
-  rinfo.inst_lens_cnt = self->backup_len / 4;
-  for (uintptr_t i = 0; i < self->backup_len; i += 4)
-    rinfo.inst_lens[i / 4] = sh_a64_get_rewrite_inst_len(*((uint32_t *)(target_addr + i)));
+  rinfo.inst_lens_cnt = reloc_len / 4;
+  rinfo.pool_cnt = 0;
   rinfo.island_rewrite = (4 == self->backup_len && !addr_info->is_proc_start) ? &self->island_rewrite : NULL;
+  rinfo.addr_info = addr_info;
+
+  // alloc enter and measure the length of each rewritten instruction (the first pass)
+  int r;
+  if (0 != (r = sh_inst_alloc_enter(self, target_addr, addr_info, 0 != whole_len, &rinfo))) return r;
 
+  // the enter is filled in via its writable address
+  uintptr_t enter_rw = (uintptr_t)rinfo.buf;
   if (!addr_info->is_proc_start) {
-    rinfo.buf_offset += sh_a64_restore_ip((uint32_t *)self->enter);
+    rinfo.buf_offset += sh_a64_restore_ip((uint32_t *)enter_rw);
     rinfo.inst_prolog_len = rinfo.buf_offset;
   }
 
-  // rewrite original instructions (fill in enter)
+  // rewrite original instructions (fill in enter, the second pass)
   uintptr_t pc = target_addr;
-  for (uintptr_t i = 0; i < self->backup_len; i += 4, pc += 4) {
-    size_t offset = sh_a64_rewrite((uint32_t *)(self->enter + rinfo.buf_offset),
+  for (uintptr_t i = 0; i < reloc_len; i += 4, pc += 4) {
+    size_t offset = sh_a64_rewrite((uint32_t *)(enter_rw + rinfo.buf_offset),
                                    *((uint32_t *)(target_addr + i)), pc, &rinfo);
-    if (0 == offset) return SHADOWHOOK_ERRNO_HOOK_REWRITE_FAILED;
+    if (0 == offset || rinfo.inst_lens[i / 4] != offset) return SHADOWHOOK_ERRNO_HOOK_REWRITE_FAILED;
     rinfo.buf_offset += offset;
   }
 
-  // absolute jump back to remaining original instructions (fill in enter)
-  if (addr_info->is_proc_start)
-    rinfo.buf_offset +=
-        sh_a64_absolute_jump_with_ret_ip((uint32_t *)(self->enter + rinfo.buf_offset), resume_addr);
+  // jump back to remaining original instructions (fill in enter)
+  // no need to jump back if the whole function has been relocated (the enter ends with RET),
+  // relative jump if they are within the range of B (no need to save and restore a register),
+  // otherwise absolute jump to resume_addr
+  uintptr_t back_pc = self->enter + rinfo.buf_offset;
+  uint32_t *back_buf = (uint32_t *)(enter_rw + rinfo.buf_offset);
+  uintptr_t back_addr = target_addr + self->backup_len;
+  *is_resume_direct = (0 != whole_len || sh_inst_is_in_b_range(back_addr, back_pc));
+  if (0 != whole_len)
+    SH_LOG_INFO("a64: relocate the whole function. target %" PRIxPTR ", len %zu", target_addr, whole_len);
+  else if (*is_resume_direct)
+    rinfo.buf_offset += sh_a64_relative_jump(back_buf, back_addr, back_pc);
+  else if (addr_info->is_proc_start)
+    rinfo.buf_offset += sh_a64_absolute_jump_with_ret_ip(back_buf, resume_addr);
   else
-    rinfo.buf_offset +=
-        sh_a64_absolute_jump_with_ret_rx((uint32_t *)(self->enter + rinfo.buf_offset), resume_addr);
-  sh_util_clear_cache(self->enter, rinfo.buf_offset);
+    rinfo.buf_offset += sh_a64_absolute_jump_with_ret_rx(back_buf, resume_addr);
+
+  // the threads hitting target while patching run the enter without the prolog, unless
+  // it resumes to the last instruction of exit which restores the registers
+  self->redirect =
+      (addr_info->is_proc_start || *is_resume_direct) ? self->enter + rinfo.inst_prolog_len : 0;
+
+  // the instructions must not overlap the literal pool at the end of enter
+  if (rinfo.buf_offset + rinfo.pool_cnt * sizeof(uint64_t) > rinfo.buf_size)
+    return SHADOWHOOK_ERRNO_HOOK_REWRITE_FAILED;
+  sh_util_clear_cache(self->enter, rinfo.buf_size);
 
   // save original function address
   if (NULL != set_orig_addr) set_orig_addr(self->enter, set_orig_addr_arg);
@@ -86,14 +201,15 @@ static int sh_inst_rewrite(sh_inst_t *self, uintptr_t target_addr, sh_addr_info_
 }
 
 static int sh_inst_safe_rewrite(sh_inst_t *self, uintptr_t target_addr, sh_addr_info_t *addr_info,
-                                uintptr_t resume_addr, sh_inst_set_orig_addr_t set_orig_addr,
-                                void *set_orig_addr_arg) {
+                                uintptr_t resume_addr, bool *is_resume_direct,
+                                sh_inst_set_orig_addr_t set_orig_addr, void *set_orig_addr_arg) {
   if (0 != sh_util_mprotect(target_addr, self->backup_len, PROT_READ | PROT_WRITE | PROT_EXEC))
     return SHADOWHOOK_ERRNO_MPROT;
 
   int r;
   SH_SIG_TRY(SIGSEGV, SIGBUS) {
-    r = sh_inst_rewrite(self, target_addr, addr_info, resume_addr, set_orig_addr, set_orig_addr_arg);
+    r = sh_inst_rewrite(self, target_addr, addr_info, resume_addr, is_resume_direct, set_orig_addr,
+                        set_orig_addr_arg);
   }
   SH_SIG_CATCH() {
     return SHADOWHOOK_ERRNO_HOOK_REWRITE_CRASH;
@@ -104,10 +220,6 @@ static int sh_inst_safe_rewrite(sh_inst_t *self, uintptr_t target_addr, sh_addr_
 
 #ifdef SH_CONFIG_TRY_HOOK_WITH_ISLAND
 
-// B: [-128M, +128M - 4]
-#define SH_INST_A64_B_OFFSET_LOW  (134217728)
-#define SH_INST_A64_B_OFFSET_HIGH (134217724)
-
 static int sh_inst_rewrite_with_island(sh_inst_t *self, uintptr_t target_addr, sh_addr_info_t *addr_info,
                                        sh_inst_set_orig_addr_t set_orig_addr, void *set_orig_addr_arg) {
   uintptr_t pc = target_addr;
@@ -125,8 +237,9 @@ static int sh_inst_rewrite_with_island(sh_inst_t *self, uintptr_t target_addr, s
     if (0 == self->island_enter.addr) return SHADOWHOOK_ERRNO_HOOK_ISLAND_ENTER;
 
     // relative jump to "pc + 4" in island-enter
-    sh_a64_restore_rx((uint32_t *)self->island_enter.addr);
-    sh_a64_relative_jump((uint32_t *)(self->island_enter.addr + 4), target_addr + self->backup_len,
+    uintptr_t island_enter_rw = sh_island_get_rw_addr(&self->island_enter);
+    sh_a64_restore_rx((uint32_t *)island_enter_rw);
+    sh_a64_relative_jump((uint32_t *)(island_enter_rw + 4), target_addr + self->backup_len,
                          self->island_enter.addr + 4);
     sh_util_clear_cache(self->island_enter.addr, self->island_enter.size);
 
@@ -134,12 +247,17 @@ static int sh_inst_rewrite_with_island(sh_inst_t *self, uintptr_t target_addr, s
   }
 
   int r;
-  if (0 != (r = sh_inst_safe_rewrite(self, target_addr, addr_info, resume_addr, set_orig_addr,
-                                     set_orig_addr_arg))) {
+  bool is_resume_direct;
+  if (0 != (r = sh_inst_safe_rewrite(self, target_addr, addr_info, resume_addr, &is_resume_direct,
+                                     set_orig_addr, set_orig_addr_arg))) {
     if (0 != self->island_enter.addr) sh_island_free(&self->island_enter);
     if (0 != self->island_rewrite.addr) sh_island_free(&self->island_rewrite);
+    return r;
   }
-  return r;
+
+  // the enter jumps back directly, island-enter is not used
+  if (is_resume_direct && 0 != self->island_enter.addr) sh_island_free(&self->island_enter);
+  return 0;
 }
 
 static int sh_inst_reloc_with_island(sh_inst_t *self, uintptr_t target_addr, sh_addr_info_t *addr_info,
@@ -150,6 +268,24 @@ static int sh_inst_reloc_with_island(sh_inst_t *self, uintptr_t target_addr, sh_
   size_t new_island_exit_size = (!addr_info->is_proc_start || is_to_interceptor) ? 20 : 16;
   uint32_t new_exit[6];
 
+  // relative jump to new_addr directly if it is within the range of B (no island-exit needed),
+  // only when the island-exit would not need to save a register for new_addr
+  if (addr_info->is_proc_start && !is_to_interceptor && 0 == (new_addr & 0x3) &&
+      sh_inst_is_in_b_range(new_addr, pc)) {
+    sh_a64_relative_jump(new_exit, new_addr, pc);
+    if (0 != (r = sh_patch_write_inst(target_addr, new_exit, self->backup_len, self->redirect, false)))
+      return r;
+
+    // OK
+    if (0 != self->island_exit.addr) sh_island_free(&self->island_exit);
+    memcpy(self->exit, new_exit, self->backup_len);
+
+    SH_LOG_INFO("a64: %shook (with island, direct) OK. target %" PRIxPTR " -> new %" PRIxPTR
+                " -> enter %" PRIxPTR " -> resume %" PRIxPTR,
+                is_rehook ? "re-" : "", target_addr, new_addr, self->enter, target_addr + self->backup_len);
+    return 0;
+  }
+
   // alloc an island-exit (exit jump to island-exit)
   uintptr_t island_exit_range_low = pc > SH_INST_A64_B_OFFSET_LOW ? pc - SH_INST_A64_B_OFFSET_LOW : 0;
   uintptr_t island_exit_range_high =
@@ -160,15 +296,15 @@ static int sh_inst_reloc_with_island(sh_inst_t *self, uintptr_t target_addr, sh_
 
   // absolute jump to new_addr in island-exit
   if (!addr_info->is_proc_start || is_to_interceptor) {
-    sh_a64_absolute_jump_with_br_rx((uint32_t *)new_island_exit.addr, new_addr);
+    sh_a64_absolute_jump_with_br_rx((uint32_t *)sh_island_get_rw_addr(&new_island_exit), new_addr);
   } else {
-    sh_a64_absolute_jump_with_br_ip((uint32_t *)new_island_exit.addr, new_addr);
+    sh_a64_absolute_jump_with_br_ip((uint32_t *)sh_island_get_rw_addr(&new_island_exit), new_addr);
   }
   sh_util_clear_cache(new_island_exit.addr, new_island_exit.size);
 
   // relative jump to the island-exit by overwriting the head of original function
   sh_a64_relative_jump(new_exit, new_island_exit.addr, pc);
-  if (0 != (r = sh_util_write_inst(target_addr, new_exit, self->backup_len))) {
+  if (0 != (r = sh_patch_write_inst(target_addr, new_exit, self->backup_len, self->redirect, false))) {
     sh_island_free(&new_island_exit);
     return r;
   }
@@ -209,14 +345,26 @@ static int sh_inst_hook_with_island(sh_inst_t *self, uintptr_t target_addr, sh_a
 #endif
 
 #ifdef SH_CONFIG_TRY_HOOK_WITHOUT_ISLAND
+
+// ADRP: [-4G, +4G - 4K]
+#define SH_INST_A64_ADRP_OFFSET (4294963200)
+
+// exit length without island:
+// ADRP exit: 16 (proc start) or 20
+// LDR exit: 20 (proc start) or 24
+static bool sh_inst_is_adrp_exit(sh_inst_t *self, sh_addr_info_t *addr_info) {
+  return self->backup_len == (addr_info->is_proc_start ? 16 : 20);
+}
+
 static int sh_inst_rewrite_without_island(sh_inst_t *self, uintptr_t target_addr, sh_addr_info_t *addr_info,
-                                          sh_inst_set_orig_addr_t set_orig_addr, void *set_orig_addr_arg) {
+                                          bool with_adrp, sh_inst_set_orig_addr_t set_orig_addr,
+                                          void *set_orig_addr_arg) {
   uintptr_t resume_addr;
   if (!addr_info->is_proc_start) {
-    self->backup_len = 24;
+    self->backup_len = with_adrp ? 20 : 24;
     resume_addr = target_addr + self->backup_len - 4;
   } else {
-    self->backup_len = 20;
+    self->backup_len = with_adrp ? 16 : 20;
     resume_addr = target_addr + self->backup_len;
   }
 
@@ -235,11 +383,73 @@ static int sh_inst_rewrite_without_island(sh_inst_t *self, uintptr_t target_addr
     if (resume_len < self->backup_len) return SHADOWHOOK_ERRNO_HOOK_SYMSZ;
   }
 
-  return sh_inst_safe_rewrite(self, target_addr, addr_info, resume_addr, set_orig_addr, set_orig_addr_arg);
+  bool is_resume_direct;
+  return sh_inst_safe_rewrite(self, target_addr, addr_info, resume_addr, &is_resume_direct, set_orig_addr,
+                              set_orig_addr_arg);
+}
+
+static int sh_inst_reloc_without_island_adrp(sh_inst_t *self, uintptr_t target_addr,
+                                             sh_addr_info_t *addr_info, uintptr_t new_addr,
+                                             bool is_to_interceptor, bool is_rehook) {
+  int r;
+  uintptr_t pc = target_addr + 4;  // ADRP follows a NOP or a STP
+  bool with_rx = (!addr_info->is_proc_start || is_to_interceptor);
+  sh_island_t new_island_exit;
+  new_island_exit.addr = 0;
+  uintptr_t exit_to = new_addr;
+  uint32_t new_exit[6];
+
+  // new_addr is out of the range of ADRP (usually when rehooking),
+  // alloc an island-exit within the range and jump to new_addr from it
+  if (!sh_a64_is_in_adrp_range(new_addr, pc)) {
+    uintptr_t island_exit_range_low = pc > SH_INST_A64_ADRP_OFFSET ? pc - SH_INST_A64_ADRP_OFFSET : 0;
+    uintptr_t island_exit_range_high =
+        UINTPTR_MAX - pc > SH_INST_A64_ADRP_OFFSET ? pc + SH_INST_A64_ADRP_OFFSET : UINTPTR_MAX;
+    sh_island_alloc(&new_island_exit, 16, island_exit_range_low, island_exit_range_high, pc, addr_info);
+    if (0 == new_island_exit.addr) return SHADOWHOOK_ERRNO_HOOK_ISLAND_EXIT;
+
+    if (with_rx)
+      sh_a64_absolute_jump_with_br_saved_rx((uint32_t *)sh_island_get_rw_addr(&new_island_exit), new_addr);
+    else
+      sh_a64_absolute_jump_with_br_ip((uint32_t *)sh_island_get_rw_addr(&new_island_exit), new_addr);
+    sh_util_clear_cache(new_island_exit.addr, new_island_exit.size);
+    exit_to = new_island_exit.addr;
+  }
+
+  if (with_rx) {
+    // backup_len == 16 or 20
+    sh_a64_adrp_jump_with_br_rx(new_exit, exit_to, target_addr);
+    if (!addr_info->is_proc_start) sh_a64_restore_rx((uint32_t *)((uintptr_t)new_exit + 16));
+  } else {
+    // backup_len == 16
+    // keep the same length as the exit with rx registers, so it can be rehooked to an interceptor
+    sh_a64_nop(new_exit);
+    sh_a64_adrp_jump_with_br_ip((uint32_t *)((uintptr_t)new_exit + 4), exit_to, pc);
+  }
+
+  if (0 != (r = sh_patch_write_inst(target_addr, new_exit, self->backup_len, self->redirect, false))) {
+    if (0 != new_island_exit.addr) sh_island_free(&new_island_exit);
+    return r;
+  }
+
+  // OK
+  if (0 != self->island_exit.addr) sh_island_free(&self->island_exit);
+  if (0 != new_island_exit.addr) self->island_exit = new_island_exit;
+  memcpy(self->exit, new_exit, self->backup_len);
+
+  SH_LOG_INFO("a64: %shook (without island, ADRP) OK. target %" PRIxPTR " -> exit-to %" PRIxPTR
+              " -> new %" PRIxPTR " -> enter %" PRIxPTR " -> resume %" PRIxPTR,
+              is_rehook ? "re-" : "", target_addr, exit_to, new_addr, self->enter,
+              addr_info->is_proc_start ? target_addr + self->backup_len : target_addr + self->backup_len - 4);
+  return 0;
 }
 
 static int sh_inst_reloc_without_island(sh_inst_t *self, uintptr_t target_addr, sh_addr_info_t *addr_info,
                                         uintptr_t new_addr, bool is_to_interceptor, bool is_rehook) {
+  if (sh_inst_is_adrp_exit(self, addr_info))
+    return sh_inst_reloc_without_island_adrp(self, target_addr, addr_info, new_addr, is_to_interceptor,
+                                             is_rehook);
+
   uint32_t new_exit[6];
 
   if (!addr_info->is_proc_start) {
@@ -259,7 +469,8 @@ static int sh_inst_reloc_without_island(sh_inst_t *self, uintptr_t target_addr,
   }
 
   int r;
-  if (0 != (r = sh_util_write_inst(target_addr, new_exit, self->backup_len))) return r;
+  if (0 != (r = sh_patch_write_inst(target_addr, new_exit, self->backup_len, self->redirect, false)))
+    return r;
   memcpy(self->exit, new_exit, self->backup_len);
 
   SH_LOG_INFO("a64: %shook (without island) OK. target %" PRIxPTR " -> new %" PRIxPTR " -> enter %" PRIxPTR
@@ -273,21 +484,28 @@ static int sh_inst_reloc_without_island(sh_inst_t *self, uintptr_t target_addr,
 static int sh_inst_hook_without_island(sh_inst_t *self, uintptr_t target_addr, sh_addr_info_t *addr_info,
                                        uintptr_t new_addr, bool is_to_interceptor,
                                        sh_inst_set_orig_addr_t set_orig_addr, void *set_orig_addr_arg) {
-  int r;
-  if (0 !=
-      (r = sh_inst_rewrite_without_island(self, target_addr, addr_info, set_orig_addr, set_orig_addr_arg)))
-    return r;
-  if (0 !=
-      (r = sh_inst_reloc_without_island(self, target_addr, addr_info, new_addr, is_to_interceptor, false)))
-    return r;
-  return 0;
+  int r = -1;
+
+  // try the shorter ADRP exit first, then the LDR exit
+  for (int i = 0; i < 2; i++) {
+    bool with_adrp = (0 == i);
+    if (0 != (r = sh_inst_rewrite_without_island(self, target_addr, addr_info, with_adrp, set_orig_addr,
+                                                 set_orig_addr_arg)))
+      continue;
+    if (0 != (r = sh_inst_reloc_without_island(self, target_addr, addr_info, new_addr, is_to_interceptor,
+                                               false)))
+      continue;
+    return 0;
+  }
+  return r;
 }
 #endif
 
 int sh_inst_hook(sh_inst_t *self, uintptr_t target_addr, sh_addr_info_t *addr_info, uintptr_t new_addr,
                  bool is_to_interceptor, sh_inst_set_orig_addr_t set_orig_addr, void *set_orig_addr_arg) {
-  self->enter = sh_enter_alloc();
-  if (0 == self->enter) return SHADOWHOOK_ERRNO_HOOK_ENTER;
+  // the enter is allocated when rewriting, after the length of it is known
+  self->enter = 0;
+  self->enter_size = 0;
 
   int r = -1;
 #ifdef SH_CONFIG_TRY_HOOK_WITH_ISLAND
@@ -311,7 +529,7 @@ err:
 
   // hook failed
   if (NULL != set_orig_addr) set_orig_addr(0, set_orig_addr_arg);
-  sh_enter_free(self->enter);
+  if (0 != self->enter) sh_enter_free(self->enter, self->enter_size);
   return r;
 }
 
@@ -344,7 +562,8 @@ int sh_inst_unhook(sh_inst_t *self, uintptr_t target_addr) {
   }
   SH_SIG_EXIT
   if (0 != r) return SHADOWHOOK_ERRNO_UNHOOK_TRAMPO_MISMATCH;
-  if (0 != (r = sh_util_write_inst(target_addr, self->backup, self->backup_len))) return r;
+  if (0 != (r = sh_patch_write_inst(target_addr, self->backup, self->backup_len, self->redirect, false)))
+    return r;
   __atomic_thread_fence(__ATOMIC_SEQ_CST);
 
   // free memory space for island-exit and island-enter
@@ -353,7 +572,7 @@ int sh_inst_unhook(sh_inst_t *self, uintptr_t target_addr) {
   if (0 != self->island_rewrite.addr) sh_island_free(&self->island_rewrite);
 
   // free memory space for enter
-  sh_enter_free(self->enter);
+  sh_enter_free(self->enter, self->enter_size);
 
   SH_LOG_INFO("a64: unhook OK. target %" PRIxPTR, target_addr);
   return 0;
@@ -365,11 +584,19 @@ void sh_inst_free_after_dlclose(sh_inst_t *self, uintptr_t target_addr) {
   if (0 != self->island_enter.addr) sh_island_free_after_dlclose(&self->island_enter);
 
   // free memory space for enter
-  sh_enter_free(self->enter);
+  sh_enter_free(self->enter, self->enter_size);
 
   SH_LOG_INFO("a64: free_after_dlclose OK. target %" PRIxPTR, target_addr);
 }
 
+size_t sh_inst_get_island_count(sh_inst_t *self) {
+  size_t cnt = 0;
+  if (0 != self->island_exit.addr) cnt++;
+  if (0 != self->island_enter.addr) cnt++;
+  if (0 != self->island_rewrite.addr) cnt++;
+  return cnt;
+}
+
 extern void shadowhook_interceptor_glue(void);
 void sh_inst_build_glue_launcher(void *buf, void *ctx) {
   uint32_t *b = (uint32_t *)buf;
@@ -30,9 +30,11 @@
 
 typedef struct {
   uint8_t backup[24];
-  size_t backup_len;  // = 4 or 20 or 24
+  size_t backup_len;  // = 4 or 16 or 20 or 24
   uint32_t exit[6];   // length = backup_len
   uintptr_t enter;
+  size_t enter_size;           // = 32 or 64 or 128 or 256
+  uintptr_t redirect;          // for the threads hitting target while patching, 0: wait
   sh_island_t island_exit;     // .size = 16 or 20
   sh_island_t island_enter;    // .size = 8
   sh_island_t island_rewrite;  // .size = 8
@@ -47,4 +49,6 @@ int sh_inst_unhook(sh_inst_t *self, uintptr_t target_addr);
 
 void sh_inst_free_after_dlclose(sh_inst_t *self, uintptr_t target_addr);
 
+size_t sh_inst_get_island_count(sh_inst_t *self);
+
 void sh_inst_build_glue_launcher(void *buf, void *ctx);
@@ -0,0 +1,457 @@
+// Copyright (c) 2021-2025 ByteDance Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include "sh_inst.h"
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "sh_config.h"
+#include "sh_enter.h"
+#include "sh_island.h"
+#include "sh_linker.h"
+#include "sh_log.h"
+#include "sh_patch.h"
+#include "sh_rv64.h"
+#include "sh_sig.h"
+#include "sh_util.h"
+#include "shadowhook.h"
+
+// AUIPC + JALR: [-2G - 2K, +2G - 2K - 1], an island is allocated within [-2G, +2G - 2K - 1]
+#define SH_INST_RV64_AUIPC_OFFSET_LOW  (2147483648)
+#define SH_INST_RV64_AUIPC_OFFSET_HIGH (2147481599)
+
+// exit length with island:
+// proc start: AUIPC T1 + JALR T1 (T1 is dead at the function entry)
+// otherwise: SD T1 + AUIPC T1 + JALR T1 + LD T1 (resume to the LD which restores T1)
+#define SH_INST_RV64_EXIT_LEN_PROC 8
+#define SH_INST_RV64_EXIT_LEN_MID  16
+
+// Backup whole instructions which cover the exit.
+static int sh_inst_backup(sh_inst_t *self, uintptr_t target_addr, sh_addr_info_t *addr_info, size_t exit_len,
+                          size_t *insts_cnt) {
+  size_t len = 0, cnt = 0;
+  while (len < exit_len) {
+    bool is_end;
+    size_t inst_len = sh_rv64_get_inst_len(target_addr + len, &is_end);
+    if (0 == inst_len || cnt >= SH_RV64_INST_CNT_MAX) return SHADOWHOOK_ERRNO_HOOK_REWRITE_FAILED;
+    len += inst_len;
+    cnt++;
+
+    // the function ends before the end of exit
+    if (is_end && len < exit_len) return SHADOWHOOK_ERRNO_HOOK_SYMSZ;
+  }
+
+  // the exit must not exceed the function, and no branch may jump into the middle of it
+  if (NULL != addr_info->dli_saddr && 0 != addr_info->dli_ssize) {
+    uintptr_t sym_start = (uintptr_t)addr_info->dli_saddr;
+    uintptr_t sym_end = sym_start + addr_info->dli_ssize;
+    if (sym_start <= target_addr && target_addr < sym_end) {
+      if (len > sym_end - target_addr) return SHADOWHOOK_ERRNO_HOOK_SYMSZ;
+      if (sh_rv64_is_branch_into(sym_start, sym_end, target_addr, target_addr + len)) {
+        SH_LOG_WARN("rv64: branch into the exit, target %" PRIxPTR ", len %zu", target_addr, len);
+        return SHADOWHOOK_ERRNO_HOOK_REWRITE_FAILED;
+      }
+    }
+  }
+
+  memcpy((void *)(self->backup), (void *)target_addr, len);
+  self->backup_len = len;
+  *insts_cnt = cnt;
+  return 0;
+}
+
+// jump back to remaining original instructions:
+// relative jump if they are within the range of JAL (no need to save and restore a register),
+// otherwise jump with the scratch register (proc start), or jump to the LD at the end of exit
+// which restores T1 (the middle of a function)
+static size_t sh_inst_jump_back(sh_inst_t *self, uintptr_t target_addr, sh_addr_info_t *addr_info,
+                                uint8_t *buf, sh_rv64_rewrite_info_t *rinfo) {
+  uintptr_t back_addr = target_addr + self->backup_len;
+  if (sh_rv64_is_near_jal(back_addr, rinfo))
+    return sh_rv64_relative_jump(buf, back_addr, rinfo->buf_pc + rinfo->buf_offset);
+
+  if (addr_info->is_proc_start) return sh_rv64_jump(buf, rinfo->scratch_reg, back_addr, rinfo);
+
+  size_t len = sh_rv64_save_rx(buf);
+  size_t jump_len =
+      sh_rv64_jump(NULL != buf ? buf + len : NULL, SH_RV64_REG_T1, target_addr + self->exit_len - 4, rinfo);
+  return 0 == jump_len ? 0 : len + jump_len;
+}
+
+// the length of enter: prolog + rewritten instructions + jump back + literal pool
+static size_t sh_inst_measure(sh_inst_t *self, uintptr_t target_addr, sh_addr_info_t *addr_info,
+                              sh_rv64_rewrite_info_t *rinfo) {
+  size_t len = addr_info->is_proc_start ? 0 : 4;  // LD T1, -8(SP)
+
+  rinfo->pool_max_cnt = 0;
+  uintptr_t pc = target_addr;
+  for (size_t i = 0; i < rinfo->inst_lens_cnt; i++) {
+    rinfo->inst_lens[i] = sh_rv64_get_rewrite_inst_len(pc, rinfo);
+    if (0 == rinfo->inst_lens[i]) return 0;
+    len += rinfo->inst_lens[i];
+    pc += sh_rv64_get_inst_len(pc, NULL);
+  }
+
+  size_t back_len = sh_inst_jump_back(self, target_addr, addr_info, NULL, rinfo);
+  if (0 == back_len) return 0;
+  return len + back_len + rinfo->pool_max_cnt * sizeof(uint64_t);
+}
+
+// The length of the rewritten instructions depends on where the enter is, so measure it at target_addr
+// first (the enter is allocated near it), then alloc an enter from the smallest fitting size class and
+// measure it again in the enter. The enter allocated by the previous attempt is reused if it fits.
+static int sh_inst_alloc_enter(sh_inst_t *self, uintptr_t target_addr, sh_addr_info_t *addr_info,
+                               sh_rv64_rewrite_info_t *rinfo) {
+  rinfo->buf = (uint8_t *)target_addr;
+  rinfo->buf_pc = target_addr;
+  rinfo->buf_size = sh_enter_get_max_size();
+  size_t len = sh_inst_measure(self, target_addr, addr_info, rinfo);
+
+  while (true) {
+    if (0 == len) return SHADOWHOOK_ERRNO_HOOK_REWRITE_FAILED;
+    size_t size = sh_enter_get_size(len);
+    if (0 == size) return SHADOWHOOK_ERRNO_HOOK_REWRITE_FAILED;
+
+    if (0 != self->enter && self->enter_size < size) {
+      sh_enter_free(self->enter, self->enter_size);
+      self->enter = 0;
+    }
+    if (0 == self->enter) {
+      if (0 == (self->enter = sh_enter_alloc_near(target_addr, size))) return SHADOWHOOK_ERRNO_HOOK_ENTER;
+      self->enter_size = size;
+    }
+
+    rinfo->buf = (uint8_t *)sh_enter_get_rw_addr(self->enter);
+    rinfo->buf_pc = self->enter;
+    rinfo->buf_size = self->enter_size;
+    len = sh_inst_measure(self, target_addr, addr_info, rinfo);
+    if (0 != len && len <= self->enter_size) return 0;
+  }
+}
+
+static int sh_inst_rewrite(sh_inst_t *self, uintptr_t target_addr, sh_addr_info_t *addr_info,
+                           sh_inst_set_orig_addr_t set_orig_addr, void *set_orig_addr_arg) {
+  // backup original instructions (length: exit_len ~ exit_len + 2)
+  int r;
+  size_t insts_cnt;
+  if (0 != (r = sh_inst_backup(self, target_addr, addr_info, self->exit_len, &insts_cnt))) return r;
+
+  // package the information passed to rewrite
+  // the temporary registers are dead at the function entry, one of them is used by the far jumps
+  // unless it is written by the relocated instructions, there is none in the middle of a function
+  sh_rv64_rewrite_info_t rinfo;
+  rinfo.start_addr = target_addr;
+  rinfo.end_addr = target_addr + self->backup_len;
+  rinfo.buf_offset = 0;
+  rinfo.inst_prolog_len = 0;
+  rinfo.inst_lens_cnt = insts_cnt;
+  rinfo.pool_cnt = 0;
+  rinfo.scratch_reg =
+      addr_info->is_proc_start ? sh_rv64_get_scratch_reg(target_addr, target_addr + self->backup_len) : 0;
+
+  // alloc enter and measure the length of each rewritten instruction (the first pass)
+  if (0 != (r = sh_inst_alloc_enter(self, target_addr, addr_info, &rinfo))) return r;
+
+  // the enter is filled in via its writable address
+  if (!addr_info->is_proc_start) {
+    rinfo.buf_offset += sh_rv64_restore_rx(rinfo.buf);
+    rinfo.inst_prolog_len = rinfo.buf_offset;
+  }
+
+  // rewrite original instructions (fill in enter, the second pass)
+  uintptr_t pc = target_addr;
+  for (size_t i = 0; i < insts_cnt; i++) {
+    size_t offset = sh_rv64_rewrite(rinfo.buf + rinfo.buf_offset, pc, &rinfo);
+    if (0 == offset || rinfo.inst_lens[i] != offset) return SHADOWHOOK_ERRNO_HOOK_REWRITE_FAILED;
+    rinfo.buf_offset += offset;
+    pc += sh_rv64_get_inst_len(pc, NULL);
+  }
+
+  // jump back to remaining original instructions (fill in enter)
+  bool is_resume_direct = sh_rv64_is_near_jal(target_addr + self->backup_len, &rinfo);
+  size_t back_len = sh_inst_jump_back(self, target_addr, addr_info, rinfo.buf + rinfo.buf_offset, &rinfo);
+  if (0 == back_len) return SHADOWHOOK_ERRNO_HOOK_REWRITE_FAILED;
+  rinfo.buf_offset += back_len;
+
+  // the threads hitting target while patching run the enter without the prolog, unless
+  // it resumes to the last instruction of exit which restores T1
+  self->redirect = (addr_info->is_proc_start || is_resume_direct) ? self->enter + rinfo.inst_prolog_len : 0;
+
+  // the instructions must not overlap the literal pool at the end of enter
+  if (rinfo.buf_offset + rinfo.pool_cnt * sizeof(uint64_t) > rinfo.buf_size)
+    return SHADOWHOOK_ERRNO_HOOK_REWRITE_FAILED;
+  sh_util_clear_cache(self->enter, rinfo.buf_size);
+
+  // save original function address
+  if (NULL != set_orig_addr) set_orig_addr(self->enter, set_orig_addr_arg);
+  return 0;
+}
+
+static int sh_inst_safe_rewrite(sh_inst_t *self, uintptr_t target_addr, sh_addr_info_t *addr_info,
+                                sh_inst_set_orig_addr_t set_orig_addr, void *set_orig_addr_arg) {
+  if (0 != sh_util_mprotect(target_addr, self->exit_len, PROT_READ | PROT_WRITE | PROT_EXEC))
+    return SHADOWHOOK_ERRNO_MPROT;
+
+  int r;
+  SH_SIG_TRY(SIGSEGV, SIGBUS) {
+    r = sh_inst_rewrite(self, target_addr, addr_info, set_orig_addr, set_orig_addr_arg);
+  }
+  SH_SIG_CATCH() {
+    return SHADOWHOOK_ERRNO_HOOK_REWRITE_CRASH;
+  }
+  SH_SIG_EXIT
+  return r;
+}
+
+static int sh_inst_write_exit(sh_inst_t *self, uintptr_t target_addr, uint8_t *new_exit) {
+  // the bytes after the exit are executed (C.NOP) only when resuming to the end of exit
+  sh_rv64_nop(new_exit + self->exit_len, self->backup_len - self->exit_len);
+  return sh_patch_write_inst(target_addr, new_exit, self->backup_len, self->redirect, false);
+}
+
+// the exit jumps from target_addr (proc start) or "target_addr + 4" (after SD T1)
+static uintptr_t sh_inst_get_exit_pc(uintptr_t target_addr, sh_addr_info_t *addr_info) {
+  return addr_info->is_proc_start ? target_addr : target_addr + 4;
+}
+
+#ifdef SH_CONFIG_TRY_HOOK_WITH_ISLAND
+
+static int sh_inst_reloc_with_island(sh_inst_t *self, uintptr_t target_addr, sh_addr_info_t *addr_info,
+                                     uintptr_t new_addr, bool is_rehook) {
+  int r;
+  uintptr_t pc = sh_inst_get_exit_pc(target_addr, addr_info);
+  sh_island_t new_island_exit;
+  new_island_exit.addr = 0;
+  uintptr_t exit_to = new_addr;
+  uint8_t new_exit[40];
+
+  // new_addr is out of the range of AUIPC + JALR, alloc an island-exit within the range
+  // and jump to new_addr from it
+  if (!sh_rv64_is_in_auipc_range(new_addr, pc)) {
+    uintptr_t island_exit_range_low =
+        pc > SH_INST_RV64_AUIPC_OFFSET_LOW ? pc - SH_INST_RV64_AUIPC_OFFSET_LOW : 0;
+    uintptr_t island_exit_range_high =
+        UINTPTR_MAX - pc > SH_INST_RV64_AUIPC_OFFSET_HIGH ? pc + SH_INST_RV64_AUIPC_OFFSET_HIGH : UINTPTR_MAX;
+    sh_island_alloc(&new_island_exit, 24, island_exit_range_low, island_exit_range_high, target_addr,
+                    addr_info);
+    if (0 == new_island_exit.addr) return SHADOWHOOK_ERRNO_HOOK_ISLAND_EXIT;
+
+    // absolute jump to new_addr in island-exit
+    sh_rv64_absolute_jump((uint8_t *)sh_island_get_rw_addr(&new_island_exit), SH_RV64_REG_T1, new_addr,
+                          new_island_exit.addr);
+    sh_util_clear_cache(new_island_exit.addr, new_island_exit.size);
+    exit_to = new_island_exit.addr;
+  }
+
+  // jump to new_addr or the island-exit by overwriting the original instructions
+  size_t len = 0;
+  if (!addr_info->is_proc_start) len += sh_rv64_save_rx(new_exit);
+  len += sh_rv64_auipc_jump(new_exit + len, SH_RV64_REG_T1, exit_to, pc);
+  if (!addr_info->is_proc_start) sh_rv64_restore_rx(new_exit + len);
+  if (0 != (r = sh_inst_write_exit(self, target_addr, new_exit))) {
+    if (0 != new_island_exit.addr) sh_island_free(&new_island_exit);
+    return r;
+  }
+
+  // OK
+  if (0 != self->island_exit.addr) sh_island_free(&self->island_exit);
+  self->island_exit = new_island_exit;
+  memcpy(self->exit, new_exit, self->backup_len);
+
+  SH_LOG_INFO("rv64: %shook (with island) OK. target %" PRIxPTR " -> exit-to %" PRIxPTR " -> new %" PRIxPTR
+              " -> enter %" PRIxPTR " -> resume %" PRIxPTR,
+              is_rehook ? "re-" : "", target_addr, exit_to, new_addr, self->enter,
+              target_addr + self->backup_len);
+  return 0;
+}
+
+static int sh_inst_hook_with_island(sh_inst_t *self, uintptr_t target_addr, sh_addr_info_t *addr_info,
+                                    uintptr_t new_addr, sh_inst_set_orig_addr_t set_orig_addr,
+                                    void *set_orig_addr_arg) {
+  self->exit_len = addr_info->is_proc_start ? SH_INST_RV64_EXIT_LEN_PROC : SH_INST_RV64_EXIT_LEN_MID;
+
+  int r;
+  if (0 != (r = sh_inst_safe_rewrite(self, target_addr, addr_info, set_orig_addr, set_orig_addr_arg)))
+    return r;
+  return sh_inst_reloc_with_island(self, target_addr, addr_info, new_addr, false);
+}
+#endif
+
+#ifdef SH_CONFIG_TRY_HOOK_WITHOUT_ISLAND
+
+// exit length without island:
+// proc start: AUIPC T1 + LD T1 + JALR T1 + literal (8-byte aligned), 20 ~ 26
+// otherwise: SD T1 + (the above) + LD T1, 28 ~ 34
+static size_t sh_inst_get_exit_len_without_island(uintptr_t target_addr, sh_addr_info_t *addr_info) {
+  uintptr_t pc = sh_inst_get_exit_pc(target_addr, addr_info);
+  size_t len = sh_rv64_absolute_jump(NULL, SH_RV64_REG_T1, 0, pc);
+  return addr_info->is_proc_start ? len : 4 + len + 4;
+}
+
+static int sh_inst_reloc_without_island(sh_inst_t *self, uintptr_t target_addr, sh_addr_info_t *addr_info,
+                                        uintptr_t new_addr, bool is_rehook) {
+  uintptr_t pc = sh_inst_get_exit_pc(target_addr, addr_info);
+  uint8_t new_exit[40];
+
+  size_t len = 0;
+  if (!addr_info->is_proc_start) len += sh_rv64_save_rx(new_exit);
+  len += sh_rv64_absolute_jump(new_exit + len, SH_RV64_REG_T1, new_addr, pc);
+  if (!addr_info->is_proc_start) sh_rv64_restore_rx(new_exit + len);
+
+  int r;
+  if (0 != (r = sh_inst_write_exit(self, target_addr, new_exit))) return r;
+  memcpy(self->exit, new_exit, self->backup_len);
+
+  SH_LOG_INFO("rv64: %shook (without island) OK. target %" PRIxPTR " -> new %" PRIxPTR " -> enter %" PRIxPTR
+              " -> resume %" PRIxPTR,
+              is_rehook ? "re-" : "", target_addr, new_addr, self->enter, target_addr + self->backup_len);
+  return 0;
+}
+
+static int sh_inst_hook_without_island(sh_inst_t *self, uintptr_t target_addr, sh_addr_info_t *addr_info,
+                                       uintptr_t new_addr, sh_inst_set_orig_addr_t set_orig_addr,
+                                       void *set_orig_addr_arg) {
+  self->exit_len = sh_inst_get_exit_len_without_island(target_addr, addr_info);
+
+  int r;
+  if (0 != (r = sh_inst_safe_rewrite(self, target_addr, addr_info, set_orig_addr, set_orig_addr_arg)))
+    return r;
+  return sh_inst_reloc_without_island(self, target_addr, addr_info, new_addr, false);
+}
+#endif
+
+int sh_inst_hook(sh_inst_t *self, uintptr_t target_addr, sh_addr_info_t *addr_info, uintptr_t new_addr,
+                 bool is_to_interceptor, sh_inst_set_orig_addr_t set_orig_addr, void *set_orig_addr_arg) {
+  // T1 is always corrupted by the exit (it is saved below SP in the middle of a function),
+  // the interceptor glue launcher only corrupts T0 after saving it
+  (void)is_to_interceptor;
+
+  // the enter is allocated when rewriting, after the length of it is known
+  self->enter = 0;
+  self->enter_size = 0;
+  self->island_exit.addr = 0;
+
+  // the symbol range is needed to check the length of exit
+  int r = -1;
+  if (NULL == addr_info->dli_saddr && addr_info->is_sym_addr) {
+    if (0 != (r = sh_linker_get_addr_info_by_addr((void *)target_addr, addr_info->is_sym_addr,
+                                                  addr_info->is_proc_start, addr_info, false, NULL, 0)))
+      goto err;
+  }
+
+#ifdef SH_CONFIG_TRY_HOOK_WITH_ISLAND
+  if (0 == (r = sh_inst_hook_with_island(self, target_addr, addr_info, new_addr, set_orig_addr,
+                                         set_orig_addr_arg)))
+    return r;
+#endif
+
+#ifdef SH_CONFIG_TRY_HOOK_WITHOUT_ISLAND
+  if (0 == (r = sh_inst_hook_without_island(self, target_addr, addr_info, new_addr, set_orig_addr,
+                                            set_orig_addr_arg)))
+    return r;
+#endif
+
+err:
+  // hook failed
+  if (NULL != set_orig_addr) set_orig_addr(0, set_orig_addr_arg);
+  if (0 != self->enter) sh_enter_free(self->enter, self->enter_size);
+  return r;
+}
+
+int sh_inst_rehook(sh_inst_t *self, uintptr_t target_addr, sh_addr_info_t *addr_info, uintptr_t new_addr,
+                   bool is_to_interceptor) {
+  (void)is_to_interceptor;
+
+  // the exit keeps its length, AUIPC + JALR (with island) or the absolute jump (without island)
+  if (SH_INST_RV64_EXIT_LEN_PROC == self->exit_len || SH_INST_RV64_EXIT_LEN_MID == self->exit_len) {
+#ifdef SH_CONFIG_TRY_HOOK_WITH_ISLAND
+    return sh_inst_reloc_with_island(self, target_addr, addr_info, new_addr, true);
+#else
+    abort();
+#endif
+  } else {
+#ifdef SH_CONFIG_TRY_HOOK_WITHOUT_ISLAND
+    return sh_inst_reloc_without_island(self, target_addr, addr_info, new_addr, true);
+#else
+    abort();
+#endif
+  }
+}
+
+int sh_inst_unhook(sh_inst_t *self, uintptr_t target_addr) {
+  int r;
+
+  // restore the instructions at the target address
+  SH_SIG_TRY(SIGSEGV, SIGBUS) {
+    r = memcmp((void *)target_addr, self->exit, self->backup_len);
+  }
+  SH_SIG_CATCH() {
+    return SHADOWHOOK_ERRNO_UNHOOK_CMP_CRASH;
+  }
+  SH_SIG_EXIT
+  if (0 != r) return SHADOWHOOK_ERRNO_UNHOOK_TRAMPO_MISMATCH;
+  if (0 != (r = sh_patch_write_inst(target_addr, self->backup, self->backup_len, self->redirect, false)))
+    return r;
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+  // free memory space for island-exit
+  if (0 != self->island_exit.addr) sh_island_free(&self->island_exit);
+
+  // free memory space for enter
+  sh_enter_free(self->enter, self->enter_size);
+
+  SH_LOG_INFO("rv64: unhook OK. target %" PRIxPTR, target_addr);
+  return 0;
+}
+
+void sh_inst_free_after_dlclose(sh_inst_t *self, uintptr_t target_addr) {
+  // free memory space for island-exit
+  if (0 != self->island_exit.addr) sh_island_free_after_dlclose(&self->island_exit);
+
+  // free memory space for enter
+  sh_enter_free(self->enter, self->enter_size);
+
+  SH_LOG_INFO("rv64: free_after_dlclose OK. target %" PRIxPTR, target_addr);
+}
+
+size_t sh_inst_get_island_count(sh_inst_t *self) {
+  return 0 != self->island_exit.addr ? 1 : 0;
+}
+
+extern void shadowhook_interceptor_glue(void);
+void sh_inst_build_glue_launcher(void *buf, void *ctx) {
+  static const uint32_t code[] = {
+      0xFE513823,  // SD T0, -16(SP)
+      0x00000317,  // AUIPC T1, 0
+      0x01433283,  // LD T0, 20(T1)  (shadowhook_interceptor_glue)
+      0x01C33303,  // LD T1, 28(T1)  (context-pointer)
+      0x00028067,  // JR T0
+      0x00000013   // NOP
+  };
+  uintptr_t glue = (uintptr_t)shadowhook_interceptor_glue;
+  uint8_t *b = (uint8_t *)buf;
+  memcpy(b, code, sizeof(code));
+  memcpy(b + sizeof(code), &glue, sizeof(glue));
+  memcpy(b + sizeof(code) + sizeof(glue), &ctx, sizeof(ctx));
+}
@@ -0,0 +1,459 @@
+// Copyright (c) 2021-2025 ByteDance Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include "sh_rv64.h"
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "sh_log.h"
+#include "sh_util.h"
+
+// https://github.com/riscv/riscv-isa-manual
+// RV64GC: the "I" base instructions and the "C" compressed instructions are relocated
+
+typedef enum { IGNORED = 0, AUIPC, JAL, BRANCH, C_J, C_BEQZ, C_BNEZ } sh_rv64_type_t;
+
+#define SH_RV64_REG_SP 2
+
+// the instruction at pc, 2 or 4 bytes (pc is 2-byte aligned), len = 0 if it is 48-bit or longer
+static uint32_t sh_rv64_fetch(uintptr_t pc, size_t *len) {
+  uint32_t inst = *((uint16_t *)pc);
+  if (3 != (inst & 0x3u)) {
+    *len = 2;
+  } else if (0x1C == (inst & 0x1Cu)) {
+    *len = 0;
+  } else {
+    inst |= (uint32_t)(*((uint16_t *)(pc + 2))) << 16u;
+    *len = 4;
+  }
+  return inst;
+}
+
+static sh_rv64_type_t sh_rv64_get_type(uint32_t inst, size_t len) {
+  if (2 == len) {
+    if (1 != (inst & 0x3u)) return IGNORED;
+    uint32_t funct3 = SH_UTIL_GET_BITS_32(inst, 15, 13);
+    if (5 == funct3) return C_J;
+    if (6 == funct3) return C_BEQZ;
+    if (7 == funct3) return C_BNEZ;
+    return IGNORED;
+  }
+
+  uint32_t opcode = inst & 0x7Fu;
+  if (0x17 == opcode) return AUIPC;
+  if (0x6F == opcode) return JAL;
+  if (0x63 == opcode) return BRANCH;
+  return IGNORED;
+}
+
+static bool sh_rv64_is_end(uint32_t inst, size_t len) {
+  if (2 == len) {
+    if (0 == inst || 0x9002 == inst) return true;                                   // C.UNIMP, C.EBREAK
+    if (1 == (inst & 0x3u) && 5 == SH_UTIL_GET_BITS_32(inst, 15, 13)) return true;  // C.J
+    return 0x8002 == (inst & 0xF07Fu) && 0 != SH_UTIL_GET_BITS_32(inst, 11, 7);     // C.JR
+  }
+
+  uint32_t opcode = inst & 0x7Fu;
+  if ((0x6F == opcode || 0x67 == opcode) && 0 == SH_UTIL_GET_BITS_32(inst, 11, 7)) return true;  // J, JR
+  return 0x00100073 == inst || 0xC0001073 == inst;  // EBREAK, UNIMP
+}
+
+size_t sh_rv64_get_inst_len(uintptr_t pc, bool *is_end) {
+  size_t len;
+  uint32_t inst = sh_rv64_fetch(pc, &len);
+  if (NULL != is_end) *is_end = (0 != len && sh_rv64_is_end(inst, len));
+  return len;
+}
+
+// the offset of the relative branch (JAL, BRANCH, C_J, C_BEQZ, C_BNEZ)
+static int64_t sh_rv64_get_branch_offset(uint32_t inst, sh_rv64_type_t type) {
+  uint64_t imm;
+  if (JAL == type) {
+    imm = SH_UTIL_GET_BIT_32(inst, 31) << 20u | SH_UTIL_GET_BITS_32(inst, 19, 12) << 12u |
+          SH_UTIL_GET_BIT_32(inst, 20) << 11u | SH_UTIL_GET_BITS_32(inst, 30, 21) << 1u;
+    return (int64_t)SH_UTIL_SIGN_EXTEND_64(imm, 21u);
+  } else if (BRANCH == type) {
+    imm = SH_UTIL_GET_BIT_32(inst, 31) << 12u | SH_UTIL_GET_BIT_32(inst, 7) << 11u |
+          SH_UTIL_GET_BITS_32(inst, 30, 25) << 5u | SH_UTIL_GET_BITS_32(inst, 11, 8) << 1u;
+    return (int64_t)SH_UTIL_SIGN_EXTEND_64(imm, 13u);
+  } else if (C_J == type) {
+    imm = SH_UTIL_GET_BIT_32(inst, 12) << 11u | SH_UTIL_GET_BIT_32(inst, 11) << 4u |
+          SH_UTIL_GET_BITS_32(inst, 10, 9) << 8u | SH_UTIL_GET_BIT_32(inst, 8) << 10u |
+          SH_UTIL_GET_BIT_32(inst, 7) << 6u | SH_UTIL_GET_BIT_32(inst, 6) << 7u |
+          SH_UTIL_GET_BITS_32(inst, 5, 3) << 1u | SH_UTIL_GET_BIT_32(inst, 2) << 5u;
+    return (int64_t)SH_UTIL_SIGN_EXTEND_64(imm, 12u);
+  } else {
+    // C_BEQZ, C_BNEZ
+    imm = SH_UTIL_GET_BIT_32(inst, 12) << 8u | SH_UTIL_GET_BITS_32(inst, 11, 10) << 3u |
+          SH_UTIL_GET_BITS_32(inst, 6, 5) << 6u | SH_UTIL_GET_BITS_32(inst, 4, 3) << 1u |
+          SH_UTIL_GET_BIT_32(inst, 2) << 5u;
+    return (int64_t)SH_UTIL_SIGN_EXTEND_64(imm, 9u);
+  }
+}
+
+bool sh_rv64_is_branch_into(uintptr_t start, uintptr_t end, uintptr_t low, uintptr_t high) {
+  size_t len;
+  for (uintptr_t pc = start; pc < end; pc += len) {
+    uint32_t inst = sh_rv64_fetch(pc, &len);
+    if (0 == len) break;  // unknown instruction, stop here
+    sh_rv64_type_t type = sh_rv64_get_type(inst, len);
+    if (IGNORED == type || AUIPC == type) continue;
+    uintptr_t addr = pc + (uintptr_t)sh_rv64_get_branch_offset(inst, type);
+    if (low < addr && addr < high) return true;
+  }
+  return false;
+}
+
+// the register written by the instruction (over-approximated, 0: none or unknown)
+static uint8_t sh_rv64_get_rd(uint32_t inst, size_t len) {
+  // compressed quadrant 0 only writes X8-X15
+  if (2 == len) return 0 == (inst & 0x3u) ? 0 : (uint8_t)SH_UTIL_GET_BITS_32(inst, 11, 7);
+
+  uint32_t opcode = inst & 0x7Fu;
+  if (0x23 == opcode || 0x27 == opcode || 0x63 == opcode) return 0;  // STORE, STORE-FP, BRANCH
+  return (uint8_t)SH_UTIL_GET_BITS_32(inst, 11, 7);
+}
+
+uint8_t sh_rv64_get_scratch_reg(uintptr_t start, uintptr_t end) {
+  // T1, T3-T6, they are not used to pass arguments and are dead at the function entry,
+  // T0 (alternate link register) and T2 (landing pad label) are never used
+  static const uint8_t regs[] = {6, 28, 29, 30, 31};
+
+  uint32_t written = 0;
+  size_t len;
+  for (uintptr_t pc = start; pc < end; pc += len) {
+    uint32_t inst = sh_rv64_fetch(pc, &len);
+    if (0 == len) return 0;
+    written |= 1u << sh_rv64_get_rd(inst, len);
+  }
+
+  for (size_t i = 0; i < sizeof(regs) / sizeof(regs[0]); i++)
+    if (0 == (written & (1u << regs[i]))) return regs[i];
+  return 0;
+}
+
+static bool sh_rv64_is_addr_need_fix(uintptr_t addr, sh_rv64_rewrite_info_t *rinfo) {
+  return (rinfo->start_addr <= addr && addr < rinfo->end_addr);
+}
+
+// return 0 if addr is not at the start of a relocated instruction
+static uintptr_t sh_rv64_fix_addr(uintptr_t addr, sh_rv64_rewrite_info_t *rinfo) {
+  uintptr_t cursor_addr = rinfo->start_addr;
+  size_t offset = rinfo->inst_prolog_len;
+  for (size_t i = 0; i < rinfo->inst_lens_cnt; i++) {
+    if (cursor_addr >= addr) break;
+    size_t len = sh_rv64_get_inst_len(cursor_addr, NULL);
+    if (0 == len) return 0;
+    cursor_addr += len;
+    offset += rinfo->inst_lens[i];
+  }
+  if (cursor_addr != addr) return 0;
+
+  uintptr_t fixed_addr = rinfo->buf_pc + offset;
+  SH_LOG_INFO("rv64 rewrite: fix addr %" PRIxPTR " -> %" PRIxPTR, addr, fixed_addr);
+  return fixed_addr;
+}
+
+// JAL: [-1M, +1M - 2]
+bool sh_rv64_is_in_jal_range(uintptr_t addr, uintptr_t pc) {
+  int64_t offset = (int64_t)(addr - pc);
+  return offset >= -1048576 && offset <= 1048574;
+}
+
+// AUIPC + 12-bit signed offset: [-2G - 2K, +2G - 2K - 1]
+bool sh_rv64_is_in_auipc_range(uintptr_t addr, uintptr_t pc) {
+  int64_t offset = (int64_t)(addr - pc);
+  return offset >= (int64_t)INT32_MIN - 2048 && offset <= (int64_t)INT32_MAX - 2048;
+}
+
+// The length of each rewritten instruction is measured before it is written (two-pass, the
+// lengths are needed by sh_rv64_fix_addr()), so the choice of the instruction form must not
+// depend on the exact pc in buf. Check the range from both ends of buf instead.
+bool sh_rv64_is_near_jal(uintptr_t addr, sh_rv64_rewrite_info_t *rinfo) {
+  uintptr_t first = rinfo->buf_pc;
+  uintptr_t last = rinfo->buf_pc + rinfo->buf_size;
+  return sh_rv64_is_in_jal_range(addr, first) && sh_rv64_is_in_jal_range(addr, last);
+}
+
+static bool sh_rv64_is_near_auipc(uintptr_t addr, sh_rv64_rewrite_info_t *rinfo) {
+  uintptr_t first = rinfo->buf_pc;
+  uintptr_t last = rinfo->buf_pc + rinfo->buf_size;
+  return sh_rv64_is_in_auipc_range(addr, first) && sh_rv64_is_in_auipc_range(addr, last);
+}
+
+static uint32_t sh_rv64_i_type(uint32_t opcode, uint32_t funct3, uint8_t rd, uint8_t rs1, int64_t imm) {
+  return ((uint32_t)imm & 0xFFFu) << 20u | (uint32_t)rs1 << 15u | funct3 << 12u | (uint32_t)rd << 7u | opcode;
+}
+
+static uint32_t sh_rv64_auipc(uint8_t rd, int64_t hi) {
+  return ((uint32_t)hi & 0xFFFFFu) << 12u | (uint32_t)rd << 7u | 0x17u;
+}
+
+static uint32_t sh_rv64_addi(uint8_t rd, uint8_t rs1, int64_t imm) {
+  return sh_rv64_i_type(0x13, 0, rd, rs1, imm);
+}
+
+static uint32_t sh_rv64_ld(uint8_t rd, uint8_t rs1, int64_t imm) {
+  return sh_rv64_i_type(0x03, 3, rd, rs1, imm);
+}
+
+static uint32_t sh_rv64_jalr(uint8_t rd, uint8_t rs1, int64_t imm) {
+  return sh_rv64_i_type(0x67, 0, rd, rs1, imm);
+}
+
+static uint32_t sh_rv64_sd(uint8_t rs2, uint8_t rs1, int64_t imm) {
+  uint32_t i = (uint32_t)imm;
+  return SH_UTIL_GET_BITS_32(i, 11, 5) << 25u | (uint32_t)rs2 << 20u | (uint32_t)rs1 << 15u | 3u << 12u |
+         SH_UTIL_GET_BITS_32(i, 4, 0) << 7u | 0x23u;
+}
+
+static uint32_t sh_rv64_jal(uint8_t rd, int64_t offset) {
+  uint32_t i = (uint32_t)offset;
+  return SH_UTIL_GET_BIT_32(i, 20) << 31u | SH_UTIL_GET_BITS_32(i, 10, 1) << 21u |
+         SH_UTIL_GET_BIT_32(i, 11) << 20u | SH_UTIL_GET_BITS_32(i, 19, 12) << 12u | (uint32_t)rd << 7u |
+         0x6Fu;
+}
+
+static uint32_t sh_rv64_branch(uint32_t funct3, uint8_t rs1, uint8_t rs2, int64_t offset) {
+  uint32_t i = (uint32_t)offset;
+  return SH_UTIL_GET_BIT_32(i, 12) << 31u | SH_UTIL_GET_BITS_32(i, 10, 5) << 25u | (uint32_t)rs2 << 20u |
+         (uint32_t)rs1 << 15u | funct3 << 12u | SH_UTIL_GET_BITS_32(i, 4, 1) << 8u |
+         SH_UTIL_GET_BIT_32(i, 11) << 7u | 0x63u;
+}
+
+// split offset for AUIPC (hi) + a 12-bit signed immediate (lo)
+static int64_t sh_rv64_hi(int64_t offset) {
+  return (offset + 0x800) >> 12;
+}
+
+static int64_t sh_rv64_lo(int64_t offset) {
+  return offset - (sh_rv64_hi(offset) << 12);
+}
+
+// the address where buf is executed (buf itself may be the writable alias of it)
+static uintptr_t sh_rv64_get_pc(uint8_t *buf, sh_rv64_rewrite_info_t *rinfo) {
+  return rinfo->buf_pc + ((uintptr_t)buf - (uintptr_t)rinfo->buf);
+}
+
+static void sh_rv64_put(uint8_t *buf, size_t *idx, uint32_t inst) {
+  if (NULL != buf) memcpy(buf + *idx, &inst, sizeof(inst));
+  *idx += sizeof(inst);
+}
+
+// the address of a new literal in the pool at the end of buf
+static uintptr_t sh_rv64_put_literal(uint8_t *buf, uint64_t value, sh_rv64_rewrite_info_t *rinfo) {
+  if (NULL == buf) {
+    rinfo->pool_max_cnt++;
+    return 0;
+  }
+  rinfo->pool_cnt++;
+  uintptr_t literal = (uintptr_t)rinfo->buf + rinfo->buf_size - rinfo->pool_cnt * sizeof(uint64_t);
+  memcpy((void *)literal, &value, sizeof(value));
+  return literal;
+}
+
+static size_t sh_rv64_get_jump_len(uint8_t reg, uintptr_t addr, sh_rv64_rewrite_info_t *rinfo) {
+  if (sh_rv64_is_near_jal(addr, rinfo)) return 4;
+  if (0 == reg) return 0;  // failed
+  return sh_rv64_is_near_auipc(addr, rinfo) ? 8 : 12;
+}
+
+// jump (and link if link_reg is not X0) to addr, corrupting reg if it is out of the range of JAL
+static size_t sh_rv64_put_jump(uint8_t *buf, size_t *idx, uint8_t link_reg, uint8_t reg, uintptr_t addr,
+                               sh_rv64_rewrite_info_t *rinfo) {
+  size_t len = sh_rv64_get_jump_len(reg, addr, rinfo);
+  uintptr_t pc = sh_rv64_get_pc(buf, rinfo) + *idx;
+  int64_t offset = (int64_t)(addr - pc);
+
+  if (4 == len) {
+    sh_rv64_put(buf, idx, sh_rv64_jal(link_reg, offset));  // JAL link_reg, <addr>
+  } else if (8 == len) {
+    sh_rv64_put(buf, idx, sh_rv64_auipc(reg, sh_rv64_hi(offset)));           // AUIPC reg, <hi>
+    sh_rv64_put(buf, idx, sh_rv64_jalr(link_reg, reg, sh_rv64_lo(offset)));  // JALR link_reg, <lo>(reg)
+  } else if (12 == len) {
+    uintptr_t literal = sh_rv64_put_literal(buf, addr, rinfo);
+    offset = (int64_t)(sh_rv64_get_pc((uint8_t *)literal, rinfo) - pc);
+    sh_rv64_put(buf, idx, sh_rv64_auipc(reg, sh_rv64_hi(offset)));    // AUIPC reg, <hi>
+    sh_rv64_put(buf, idx, sh_rv64_ld(reg, reg, sh_rv64_lo(offset)));  // LD reg, <lo>(reg)
+    sh_rv64_put(buf, idx, sh_rv64_jalr(link_reg, reg, 0));            // JALR link_reg, 0(reg)
+  }
+  return len;
+}
+
+static size_t sh_rv64_rewrite_auipc(uint8_t *buf, uint32_t inst, uintptr_t pc,
+                                    sh_rv64_rewrite_info_t *rinfo) {
+  uint8_t rd = (uint8_t)SH_UTIL_GET_BITS_32(inst, 11, 7);
+  uintptr_t addr = pc + (uintptr_t)(int64_t)(int32_t)(inst & 0xFFFFF000u);
+
+  size_t idx = 0;
+  if (0 == rd) {
+    sh_rv64_put(buf, &idx, inst);  // HINT
+  } else if (sh_rv64_is_near_auipc(addr, rinfo)) {
+    int64_t offset = (int64_t)(addr - sh_rv64_get_pc(buf, rinfo));
+    sh_rv64_put(buf, &idx, sh_rv64_auipc(rd, sh_rv64_hi(offset)));      // AUIPC rd, <hi>
+    sh_rv64_put(buf, &idx, sh_rv64_addi(rd, rd, sh_rv64_lo(offset)));  // ADDI rd, rd, <lo>
+  } else {
+    uintptr_t literal = sh_rv64_put_literal(buf, addr, rinfo);
+    int64_t offset = (int64_t)(literal - (uintptr_t)buf);
+    sh_rv64_put(buf, &idx, sh_rv64_auipc(rd, sh_rv64_hi(offset)));    // AUIPC rd, <hi>
+    sh_rv64_put(buf, &idx, sh_rv64_ld(rd, rd, sh_rv64_lo(offset)));  // LD rd, <lo>(rd)
+  }
+  return idx;
+}
+
+static size_t sh_rv64_rewrite_branch(uint8_t *buf, uint32_t inst, sh_rv64_type_t type, uintptr_t pc,
+                                     sh_rv64_rewrite_info_t *rinfo) {
+  uintptr_t addr = pc + (uintptr_t)sh_rv64_get_branch_offset(inst, type);
+  bool is_need_fix = sh_rv64_is_addr_need_fix(addr, rinfo);
+  if (NULL != buf && is_need_fix) {
+    if (0 == (addr = sh_rv64_fix_addr(addr, rinfo))) return 0;  // failed
+  }
+  int64_t offset = (int64_t)(addr - sh_rv64_get_pc(buf, rinfo));
+
+  size_t idx = 0;
+  if (JAL == type || C_J == type) {
+    uint8_t rd = (JAL == type) ? (uint8_t)SH_UTIL_GET_BITS_32(inst, 11, 7) : 0;
+
+    // the fixed address is in buf, it is always within the range of JAL
+    if (is_need_fix) {
+      sh_rv64_put(buf, &idx, sh_rv64_jal(rd, offset));
+      return idx;
+    }
+
+    // JAL rd links to the next rewritten instruction, rd is corrupted anyway
+    if (0 == sh_rv64_put_jump(buf, &idx, rd, 0 != rd ? rd : rinfo->scratch_reg, addr, rinfo)) {
+      SH_LOG_WARN("rv64 rewrite: no register for the jump %" PRIxPTR " -> %" PRIxPTR, pc, addr);
+      return 0;  // failed
+    }
+    return idx;
+  }
+
+  uint32_t funct3;
+  uint8_t rs1, rs2;
+  if (BRANCH == type) {
+    funct3 = SH_UTIL_GET_BITS_32(inst, 14, 12);
+    if (2 == funct3 || 3 == funct3) return 0;  // reserved
+    rs1 = (uint8_t)SH_UTIL_GET_BITS_32(inst, 19, 15);
+    rs2 = (uint8_t)SH_UTIL_GET_BITS_32(inst, 24, 20);
+  } else {
+    // C.BEQZ rs1', <offset> ==> BEQ rs1, X0, <offset> (C.BNEZ ==> BNE)
+    funct3 = (C_BEQZ == type) ? 0 : 1;
+    rs1 = (uint8_t)(SH_UTIL_GET_BITS_32(inst, 9, 7) + 8);
+    rs2 = 0;
+  }
+
+  if (is_need_fix) {
+    sh_rv64_put(buf, &idx, sh_rv64_branch(funct3, rs1, rs2, offset));
+    return idx;
+  }
+
+  // B!cond <skip the jump>, <jump to addr>
+  size_t jump_len = sh_rv64_get_jump_len(rinfo->scratch_reg, addr, rinfo);
+  if (0 == jump_len) {
+    SH_LOG_WARN("rv64 rewrite: no register for the branch %" PRIxPTR " -> %" PRIxPTR, pc, addr);
+    return 0;  // failed
+  }
+  sh_rv64_put(buf, &idx, sh_rv64_branch(funct3 ^ 1u, rs1, rs2, (int64_t)(4 + jump_len)));
+  sh_rv64_put_jump(buf, &idx, 0, rinfo->scratch_reg, addr, rinfo);
+  return idx;
+}
+
+static size_t sh_rv64_do_rewrite(uint8_t *buf, uintptr_t pc, sh_rv64_rewrite_info_t *rinfo) {
+  size_t len;
+  uint32_t inst = sh_rv64_fetch(pc, &len);
+  if (0 == len) {
+    SH_LOG_WARN("rv64 rewrite: unknown instruction at %" PRIxPTR, pc);
+    return 0;  // failed
+  }
+
+  sh_rv64_type_t type = sh_rv64_get_type(inst, len);
+  if (AUIPC == type) {
+    return sh_rv64_rewrite_auipc(buf, inst, pc, rinfo);
+  } else if (IGNORED != type) {
+    return sh_rv64_rewrite_branch(buf, inst, type, pc, rinfo);
+  } else {
+    if (NULL != buf) memcpy(buf, &inst, len);
+    return len;
+  }
+}
+
+size_t sh_rv64_get_rewrite_inst_len(uintptr_t pc, sh_rv64_rewrite_info_t *rinfo) {
+  return sh_rv64_do_rewrite(NULL, pc, rinfo);
+}
+
+size_t sh_rv64_rewrite(uint8_t *buf, uintptr_t pc, sh_rv64_rewrite_info_t *rinfo) {
+  SH_LOG_INFO("rv64 rewrite: pc %" PRIxPTR ", inst %" PRIx16, pc, *((uint16_t *)pc));
+  return sh_rv64_do_rewrite(buf, pc, rinfo);
+}
+
+size_t sh_rv64_nop(uint8_t *buf, size_t len) {
+  for (size_t i = 0; i + 2 <= len; i += 2) {
+    buf[i] = 0x01;  // C.NOP
+    buf[i + 1] = 0x00;
+  }
+  return len;
+}
+
+size_t sh_rv64_jump(uint8_t *buf, uint8_t reg, uintptr_t addr, sh_rv64_rewrite_info_t *rinfo) {
+  size_t idx = 0;
+  return sh_rv64_put_jump(buf, &idx, 0, reg, addr, rinfo);
+}
+
+size_t sh_rv64_relative_jump(uint8_t *buf, uintptr_t addr, uintptr_t pc) {
+  size_t idx = 0;
+  sh_rv64_put(buf, &idx, sh_rv64_jal(0, (int64_t)(addr - pc)));  // J <addr>
+  return idx;
+}
+
+size_t sh_rv64_auipc_jump(uint8_t *buf, uint8_t reg, uintptr_t addr, uintptr_t pc) {
+  int64_t offset = (int64_t)(addr - pc);
+  size_t idx = 0;
+  sh_rv64_put(buf, &idx, sh_rv64_auipc(reg, sh_rv64_hi(offset)));    // AUIPC reg, <hi>
+  sh_rv64_put(buf, &idx, sh_rv64_jalr(0, reg, sh_rv64_lo(offset)));  // JALR X0, <lo>(reg)
+  return idx;
+}
+
+size_t sh_rv64_absolute_jump(uint8_t *buf, uint8_t reg, uintptr_t addr, uintptr_t pc) {
+  size_t literal_offset = SH_UTIL_ALIGN_END(pc + 12, sizeof(uint64_t)) - pc;
+  if (NULL != buf) {
+    size_t idx = 0;
+    sh_rv64_put(buf, &idx, sh_rv64_auipc(reg, 0));                          // AUIPC reg, 0
+    sh_rv64_put(buf, &idx, sh_rv64_ld(reg, reg, (int64_t)literal_offset));  // LD reg, <literal>(reg)
+    sh_rv64_put(buf, &idx, sh_rv64_jalr(0, reg, 0));                        // JALR X0, 0(reg)
+    sh_rv64_nop(buf + idx, literal_offset - idx);
+    memcpy(buf + literal_offset, &addr, sizeof(addr));
+  }
+  return literal_offset + sizeof(uint64_t);
+}
+
+size_t sh_rv64_save_rx(uint8_t *buf) {
+  size_t idx = 0;
+  sh_rv64_put(buf, &idx, sh_rv64_sd(SH_RV64_REG_T1, SH_RV64_REG_SP, -8));  // SD T1, -8(SP)
+  return idx;
+}
+
+size_t sh_rv64_restore_rx(uint8_t *buf) {
+  size_t idx = 0;
+  sh_rv64_put(buf, &idx, sh_rv64_ld(SH_RV64_REG_T1, SH_RV64_REG_SP, -8));  // LD T1, -8(SP)
+  return idx;
+}
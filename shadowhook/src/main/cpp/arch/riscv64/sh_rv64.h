@@ -0,0 +1,76 @@
+// Copyright (c) 2021-2025 ByteDance Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// the max count of the relocated instructions (at least 2 bytes each, the longest exit is 34 bytes)
+#define SH_RV64_INST_CNT_MAX 18
+
+#define SH_RV64_REG_T1 6  // RX: saved below SP when it can not be corrupted
+
+typedef struct {
+  uintptr_t start_addr;
+  uintptr_t end_addr;
+  uint8_t *buf;
+  uintptr_t buf_pc;  // where buf is executed, buf may be the writable alias of it
+  size_t buf_size;   // literals are pooled at the end of buf
+  size_t buf_offset;
+  size_t inst_prolog_len;
+  size_t inst_lens[SH_RV64_INST_CNT_MAX];  // rewritten length of each relocated instruction
+  size_t inst_lens_cnt;
+  size_t pool_cnt;
+  size_t pool_max_cnt;  // counted when measuring (identical literals are not merged)
+  uint8_t scratch_reg;  // a register which can be corrupted by the far jumps, 0: none
+} sh_rv64_rewrite_info_t;
+
+// Return the length of the instruction at pc (2 or 4, 0 if it is longer), and whether it never
+// falls through to the next instruction (J, JR, RET, EBREAK, UNIMP, ...).
+size_t sh_rv64_get_inst_len(uintptr_t pc, bool *is_end);
+
+// Whether any relative branch in [start, end) jumps into (low, high).
+bool sh_rv64_is_branch_into(uintptr_t start, uintptr_t end, uintptr_t low, uintptr_t high);
+
+// Return a temporary register which is not written by the instructions in [start, end), 0 if none.
+uint8_t sh_rv64_get_scratch_reg(uintptr_t start, uintptr_t end);
+
+size_t sh_rv64_get_rewrite_inst_len(uintptr_t pc, sh_rv64_rewrite_info_t *rinfo);
+size_t sh_rv64_rewrite(uint8_t *buf, uintptr_t pc, sh_rv64_rewrite_info_t *rinfo);
+
+size_t sh_rv64_nop(uint8_t *buf, size_t len);
+
+bool sh_rv64_is_in_jal_range(uintptr_t addr, uintptr_t pc);
+bool sh_rv64_is_in_auipc_range(uintptr_t addr, uintptr_t pc);
+// whether addr is within the range of JAL from anywhere in buf
+bool sh_rv64_is_near_jal(uintptr_t addr, sh_rv64_rewrite_info_t *rinfo);
+
+// jump from buf (in the enter) to addr with reg, the literal (if any) is pooled at the end of buf
+size_t sh_rv64_jump(uint8_t *buf, uint8_t reg, uintptr_t addr, sh_rv64_rewrite_info_t *rinfo);
+
+size_t sh_rv64_relative_jump(uint8_t *buf, uintptr_t addr, uintptr_t pc);
+size_t sh_rv64_auipc_jump(uint8_t *buf, uint8_t reg, uintptr_t addr, uintptr_t pc);
+// the literal is aligned by the address of the code (pc), buf can be NULL to get the length only
+size_t sh_rv64_absolute_jump(uint8_t *buf, uint8_t reg, uintptr_t addr, uintptr_t pc);
+
+size_t sh_rv64_save_rx(uint8_t *buf);
+size_t sh_rv64_restore_rx(uint8_t *buf);
@@ -0,0 +1,50 @@
+// Copyright (c) 2021-2025 ByteDance Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sh_island.h"
+#include "sh_linker.h"
+
+typedef struct {
+  uint8_t backup[32];
+  size_t backup_len;  // = 5 ~ 19 (with island) or 14 ~ 28 (without island), whole instructions
+  uint8_t exit[32];   // length = backup_len
+  uintptr_t enter;
+  size_t enter_size;        // = 32 or 64 or 128 or 256
+  uintptr_t redirect;       // for the threads hitting target while patching
+  sh_island_t island_exit;  // .size = 16
+} sh_inst_t;
+
+typedef void (*sh_inst_set_orig_addr_t)(uintptr_t orig_addr, void *arg);
+int sh_inst_hook(sh_inst_t *self, uintptr_t target_addr, sh_addr_info_t *addr_info, uintptr_t new_addr,
+                 bool is_to_interceptor, sh_inst_set_orig_addr_t set_orig_addr, void *set_orig_addr_arg);
+int sh_inst_rehook(sh_inst_t *self, uintptr_t target_addr, sh_addr_info_t *addr_info, uintptr_t new_addr,
+                   bool is_to_interceptor);
+int sh_inst_unhook(sh_inst_t *self, uintptr_t target_addr);
+
+void sh_inst_free_after_dlclose(sh_inst_t *self, uintptr_t target_addr);
+
+size_t sh_inst_get_island_count(sh_inst_t *self);
+
+void sh_inst_build_glue_launcher(void *buf, void *ctx);
@@ -0,0 +1,464 @@
+// Copyright (c) 2021-2025 ByteDance Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include "sh_x64.h"
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "sh_config.h"
+#include "sh_log.h"
+
+// https://www.intel.com/content/www/us/en/developer/articles/technical/intel-sdm.html
+// (Volume 2, Appendix A: Opcode Map)
+
+typedef enum {
+  IGNORED = 0,
+  RIP_REL,    // ModRM with RIP-relative disp32
+  JMP_REL,    // JMP rel8 / rel32
+  CALL_REL,   // CALL rel32
+  JCC_REL,    // Jcc rel8 / rel32
+  JCXZ_LOOP,  // JRCXZ, LOOP, LOOPE, LOOPNE (rel8 only)
+} sh_x64_type_t;
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wpadded"
+typedef struct {
+  size_t len;
+  size_t prefixes_len;  // legacy prefixes and REX
+  size_t disp_off;      // RIP_REL: offset of disp32, branches: offset of rel8 / rel32
+  size_t disp_size;     // 1 or 4
+  uint8_t cond;         // JCC_REL: condition code, JCXZ_LOOP: opcode
+  sh_x64_type_t type;
+  bool is_end;  // never falls through to the next instruction
+} sh_x64_inst_t;
+#pragma clang diagnostic pop
+
+#define SH_X64_INST_LEN_MAX 15
+
+#define SH_X64_IS_BIT_SET(bitmap, op) (0 != ((bitmap)[(op) >> 5u] & (1u << ((op) & 31u))))
+
+// opcodes followed by a ModRM byte, bit n of the bitmap for opcode n
+static const uint32_t sh_x64_modrm_1byte[8] = {0x0F0F0F0F, 0x0F0F0F0F, 0x00000000, 0x00000A08,
+                                               0x0000FFFF, 0x00000000, 0xFF0F00C3, 0xC0C00000};
+static const uint32_t sh_x64_modrm_0f[8] = {0xFFFFA00F, 0x0000FF0F, 0xFFFFFFFF, 0xFF7FFFFF,
+                                            0xFFFF0000, 0xFFFFF838, 0xFFFF00FF, 0xFFFFFFFF};
+
+// invalid in 64-bit mode (0x62, 0xC4 and 0xC5 are EVEX / VEX prefixes)
+static const uint32_t sh_x64_invalid_1byte[8] = {0xC0C040C0, 0x80808080, 0x00000000, 0x00000003,
+                                                 0x04000004, 0x00000000, 0x00704000, 0x00000400};
+
+static size_t sh_x64_get_imm_size_1byte(uint8_t op, uint8_t modrm, bool is_opsize16, bool is_rex_w,
+                                        bool is_addrsize32) {
+  size_t immz = is_opsize16 ? 2 : 4;
+  if (op < 0x40) {
+    if (4 == (op & 7u)) return 1;
+    if (5 == (op & 7u)) return immz;
+    return 0;
+  }
+  if (op >= 0xB0 && op <= 0xB7) return 1;
+  if (op >= 0xB8 && op <= 0xBF) return is_rex_w ? 8 : immz;
+  if (op >= 0xA0 && op <= 0xA3) return is_addrsize32 ? 4 : 8;  // moffs
+  switch (op) {
+    case 0x6A:
+    case 0x6B:
+    case 0x80:
+    case 0x83:
+    case 0xA8:
+    case 0xC0:
+    case 0xC1:
+    case 0xC6:
+    case 0xCD:
+    case 0xE4:
+    case 0xE5:
+    case 0xE6:
+    case 0xE7:
+      return 1;
+    case 0x68:
+    case 0x69:
+    case 0x81:
+    case 0xA9:
+    case 0xC7:
+      return immz;
+    case 0xC2:
+    case 0xCA:
+      return 2;
+    case 0xC8:
+      return 3;
+    case 0xF6:
+      return ((modrm >> 3u) & 7u) < 2 ? 1 : 0;  // TEST r/m8, imm8
+    case 0xF7:
+      return ((modrm >> 3u) & 7u) < 2 ? immz : 0;  // TEST r/m, imm
+    default:
+      return 0;
+  }
+}
+
+static bool sh_x64_has_imm8_0f(uint8_t op) {
+  return 0x0F == op || (op >= 0x70 && op <= 0x73) || 0xA4 == op || 0xAC == op || 0xBA == op ||
+         (op >= 0xC2 && op <= 0xC6 && 0xC3 != op);
+}
+
+// ModRM, SIB and displacement, return the length (0 if it is beyond the max length)
+static size_t sh_x64_decode_modrm(const uint8_t *inst, size_t off, sh_x64_inst_t *ins) {
+  uint8_t modrm = inst[off];
+  uint8_t mod = modrm >> 6u;
+  uint8_t rm = modrm & 7u;
+  size_t len = 1;
+
+  if (3 == mod) return len;
+  if (4 == rm) {
+    uint8_t sib = inst[off + 1];
+    len++;
+    if (0 == mod && 5 == (sib & 7u)) return len + 4;  // [index * scale + disp32]
+  } else if (0 == mod && 5 == rm) {
+    ins->type = RIP_REL;
+    ins->disp_off = off + len;
+    ins->disp_size = 4;
+    return len + 4;
+  }
+  if (1 == mod) len += 1;
+  if (2 == mod) len += 4;
+  return len;
+}
+
+static size_t sh_x64_decode(const uint8_t *inst, sh_x64_inst_t *ins) {
+  memset(ins, 0, sizeof(sh_x64_inst_t));
+
+  // legacy prefixes
+  bool is_opsize16 = false, is_addrsize32 = false;
+  size_t off = 0;
+  while (off < SH_X64_INST_LEN_MAX) {
+    uint8_t p = inst[off];
+    if (0x66 == p)
+      is_opsize16 = true;
+    else if (0x67 == p)
+      is_addrsize32 = true;
+    else if (0xF0 != p && 0xF2 != p && 0xF3 != p && 0x2E != p && 0x36 != p && 0x3E != p && 0x26 != p &&
+             0x64 != p && 0x65 != p)
+      break;
+    off++;
+  }
+
+  // REX
+  bool is_rex_w = false;
+  if (0x40 == (inst[off] & 0xF0u)) {
+    is_rex_w = (0 != (inst[off] & 0x08u));
+    off++;
+  }
+  ins->prefixes_len = off;
+
+  uint8_t op = inst[off++];
+  size_t imm_size = 0;
+
+  if (0xC4 == op || 0xC5 == op || 0x62 == op) {
+    // VEX (2-byte, 3-byte) and EVEX
+    bool is_evex = (0x62 == op);
+    uint8_t map = 1;
+    if (0xC4 == op) map = inst[off] & 0x1Fu;
+    if (is_evex) map = inst[off] & 0x07u;
+    off += (0xC5 == op ? 1 : (0xC4 == op ? 2 : 3));
+    op = inst[off++];
+    if (0 == map || 4 == map || map > 6) return 0;
+    if (1 == map && 0x77 == op && !is_evex) {
+      // VZEROUPPER, VZEROALL (no ModRM)
+      ins->len = off;
+      return off <= SH_X64_INST_LEN_MAX ? off : 0;
+    }
+    off += sh_x64_decode_modrm(inst, off, ins);
+    if (3 == map || (1 == map && sh_x64_has_imm8_0f(op))) imm_size = 1;
+  } else if (0x0F == op) {
+    op = inst[off++];
+    if (0x38 == op) {
+      off++;  // opcode
+      off += sh_x64_decode_modrm(inst, off, ins);
+    } else if (0x3A == op) {
+      off++;  // opcode
+      off += sh_x64_decode_modrm(inst, off, ins);
+      imm_size = 1;
+    } else if (op >= 0x80 && op <= 0x8F) {
+      // Jcc rel32
+      if (is_opsize16) return 0;
+      ins->type = JCC_REL;
+      ins->cond = op & 0x0Fu;
+      ins->disp_off = off;
+      ins->disp_size = 4;
+      off += 4;
+    } else {
+      if (SH_X64_IS_BIT_SET(sh_x64_modrm_0f, op)) off += sh_x64_decode_modrm(inst, off, ins);
+      if (sh_x64_has_imm8_0f(op)) imm_size = 1;
+      if (0x0B == op) ins->is_end = true;  // UD2
+    }
+  } else {
+    if (SH_X64_IS_BIT_SET(sh_x64_invalid_1byte, op)) return 0;
+
+    if ((op >= 0x70 && op <= 0x7F) || (op >= 0xE0 && op <= 0xE3) || 0xEB == op || 0xE8 == op ||
+        0xE9 == op) {
+      // relative branches (0x66 is only used as padding of CALL, e.g. the TLS general dynamic model)
+      if (is_opsize16 && 0xE8 != op) return 0;
+      ins->disp_off = off;
+      ins->disp_size = (0xE8 == op || 0xE9 == op) ? 4 : 1;
+      if (op <= 0x7F) {
+        ins->type = JCC_REL;
+        ins->cond = op & 0x0Fu;
+      } else if (op <= 0xE3) {
+        ins->type = JCXZ_LOOP;
+        ins->cond = op;
+      } else {
+        ins->type = (0xE8 == op) ? CALL_REL : JMP_REL;
+        ins->is_end = (0xE8 != op);
+      }
+      off += ins->disp_size;
+    } else {
+      uint8_t modrm = inst[off];
+      if (SH_X64_IS_BIT_SET(sh_x64_modrm_1byte, op)) {
+        if (0xC7 == op && 0xF8 == modrm) return 0;  // XBEGIN rel32
+        off += sh_x64_decode_modrm(inst, off, ins);
+      }
+      imm_size = sh_x64_get_imm_size_1byte(op, modrm, is_opsize16, is_rex_w, is_addrsize32);
+
+      // RET, RETF, IRET, INT3, HLT, JMP r/m, JMPF m
+      if (0xC3 == op || 0xC2 == op || 0xCB == op || 0xCA == op || 0xCF == op || 0xCC == op || 0xF4 == op ||
+          (0xFF == op && (4 == ((modrm >> 3u) & 7u) || 5 == ((modrm >> 3u) & 7u))))
+        ins->is_end = true;
+    }
+  }
+
+  off += imm_size;
+  if (off > SH_X64_INST_LEN_MAX) return 0;
+  ins->len = off;
+  return off;
+}
+
+size_t sh_x64_get_inst_len(const uint8_t *inst, bool *is_end) {
+  sh_x64_inst_t ins;
+  size_t len = sh_x64_decode(inst, &ins);
+  if (NULL != is_end) *is_end = ins.is_end;
+  return len;
+}
+
+static uintptr_t sh_x64_get_branch_addr(uintptr_t pc, sh_x64_inst_t *ins) {
+  int64_t rel;
+  if (1 == ins->disp_size)
+    rel = *((int8_t *)(pc + ins->disp_off));
+  else {
+    int32_t rel32;
+    memcpy(&rel32, (void *)(pc + ins->disp_off), sizeof(rel32));
+    rel = rel32;
+  }
+  return pc + ins->len + (uintptr_t)rel;
+}
+
+bool sh_x64_is_branch_into(uintptr_t start, uintptr_t end, uintptr_t low, uintptr_t high) {
+  sh_x64_inst_t ins;
+  for (uintptr_t pc = start; pc < end; pc += ins.len) {
+    if (0 == sh_x64_decode((uint8_t *)pc, &ins)) break;  // data in code? stop here
+    if (IGNORED == ins.type || RIP_REL == ins.type) continue;
+    uintptr_t addr = sh_x64_get_branch_addr(pc, &ins);
+    if (low < addr && addr < high) return true;
+  }
+  return false;
+}
+
+static bool sh_x64_is_addr_need_fix(uintptr_t addr, sh_x64_rewrite_info_t *rinfo) {
+  return (rinfo->start_addr <= addr && addr < rinfo->end_addr);
+}
+
+// return 0 if addr is not at the start of a relocated instruction
+static uintptr_t sh_x64_fix_addr(uintptr_t addr, sh_x64_rewrite_info_t *rinfo) {
+  uintptr_t cursor_addr = rinfo->start_addr;
+  size_t offset = 0;
+  for (size_t i = 0; i < rinfo->inst_lens_cnt; i++) {
+    if (cursor_addr >= addr) break;
+    size_t len = sh_x64_get_inst_len((uint8_t *)cursor_addr, NULL);
+    if (0 == len) return 0;
+    cursor_addr += len;
+    offset += rinfo->inst_lens[i];
+  }
+  if (cursor_addr != addr) return 0;
+
+  uintptr_t fixed_addr = rinfo->buf_pc + offset;
+  SH_LOG_INFO("x64 rewrite: fix addr %" PRIxPTR " -> %" PRIxPTR, addr, fixed_addr);
+  return fixed_addr;
+}
+
+bool sh_x64_is_in_rel32_range(uintptr_t addr, uintptr_t pc) {
+  int64_t offset = (int64_t)(addr - pc);
+  return offset >= INT32_MIN && offset <= INT32_MAX;
+}
+
+// The length of each rewritten instruction is measured before it is written (two-pass, the
+// lengths are needed by sh_x64_fix_addr()), so the choice of the instruction form must not
+// depend on the exact pc in buf. Check the range from both ends of buf instead.
+static bool sh_x64_is_near(uintptr_t addr, sh_x64_rewrite_info_t *rinfo) {
+  uintptr_t first = rinfo->buf_pc;
+  uintptr_t last = rinfo->buf_pc + rinfo->buf_size;
+  return sh_x64_is_in_rel32_range(addr, first) && sh_x64_is_in_rel32_range(addr, last);
+}
+
+// the address where buf is executed (buf itself may be the writable alias of it)
+static uintptr_t sh_x64_get_pc(uint8_t *buf, sh_x64_rewrite_info_t *rinfo) {
+  return rinfo->buf_pc + ((uintptr_t)buf - (uintptr_t)rinfo->buf);
+}
+
+static void sh_x64_put(uint8_t *buf, size_t *idx, const void *data, size_t len) {
+  if (NULL != buf) memcpy(buf + *idx, data, len);
+  *idx += len;
+}
+
+static void sh_x64_put_u8(uint8_t *buf, size_t *idx, uint8_t value) {
+  sh_x64_put(buf, idx, &value, sizeof(value));
+}
+
+// rel32 to addr, as the last field of the instruction
+static void sh_x64_put_rel32(uint8_t *buf, size_t *idx, uintptr_t addr, sh_x64_rewrite_info_t *rinfo) {
+  int32_t rel = (int32_t)(addr - (sh_x64_get_pc(buf, rinfo) + *idx + 4));
+  sh_x64_put(buf, idx, &rel, sizeof(rel));
+}
+
+static size_t sh_x64_rewrite_rip_rel(uint8_t *buf, uintptr_t pc, sh_x64_inst_t *ins,
+                                     sh_x64_rewrite_info_t *rinfo) {
+  int32_t disp;
+  memcpy(&disp, (void *)(pc + ins->disp_off), sizeof(disp));
+  uintptr_t addr = pc + ins->len + (uintptr_t)(int64_t)disp;
+
+  if (sh_x64_is_near(addr, rinfo)) {
+    if (NULL != buf) {
+      memcpy(buf, (void *)pc, ins->len);
+      disp = (int32_t)(addr - (sh_x64_get_pc(buf, rinfo) + ins->len));
+      memcpy(buf + ins->disp_off, &disp, sizeof(disp));
+    }
+    return ins->len;
+  }
+
+  // LEA r64, [RIP + disp32] ==> MOV r64, imm64
+  uint8_t *inst = (uint8_t *)pc;
+  if (1 == ins->prefixes_len && 0x48 == (inst[0] & 0xF8u) && 0x8D == inst[1]) {
+    size_t idx = 0;
+    uint8_t rd = (inst[2] >> 3u) & 7u;
+    sh_x64_put_u8(buf, &idx, (uint8_t)(0x48u | ((inst[0] & 0x04u) >> 2u)));  // REX.W (+ REX.B from REX.R)
+    sh_x64_put_u8(buf, &idx, (uint8_t)(0xB8u + rd));
+    sh_x64_put(buf, &idx, &addr, sizeof(addr));
+    return idx;
+  }
+
+  SH_LOG_WARN("x64 rewrite: RIP-relative address out of range %" PRIxPTR " -> %" PRIxPTR, pc, addr);
+  return 0;  // failed
+}
+
+static size_t sh_x64_rewrite_branch(uint8_t *buf, uintptr_t pc, sh_x64_inst_t *ins,
+                                    sh_x64_rewrite_info_t *rinfo) {
+  uintptr_t addr = sh_x64_get_branch_addr(pc, ins);
+
+  // the fixed address is in buf, it is always within the range
+  bool is_near = sh_x64_is_addr_need_fix(addr, rinfo) || sh_x64_is_near(addr, rinfo);
+  if (NULL != buf && sh_x64_is_addr_need_fix(addr, rinfo)) {
+    if (0 == (addr = sh_x64_fix_addr(addr, rinfo))) return 0;  // failed
+  }
+
+  size_t idx = 0;
+  if (JCC_REL == ins->type) {
+    if (is_near) {
+      sh_x64_put_u8(buf, &idx, 0x0F);
+      sh_x64_put_u8(buf, &idx, (uint8_t)(0x80u | ins->cond));  // Jcc rel32
+      sh_x64_put_rel32(buf, &idx, addr, rinfo);
+      return idx;
+    }
+    sh_x64_put_u8(buf, &idx, (uint8_t)(0x70u | (ins->cond ^ 1u)));  // J!cc <skip the jump>
+    sh_x64_put_u8(buf, &idx, 14);
+  } else if (JCXZ_LOOP == ins->type) {
+    // keep the prefixes, 0x67 selects ECX instead of RCX
+    sh_x64_put(buf, &idx, (void *)pc, ins->prefixes_len);
+    sh_x64_put_u8(buf, &idx, ins->cond);  // JRCXZ / LOOPcc <the jump>
+    sh_x64_put_u8(buf, &idx, 2);
+    sh_x64_put_u8(buf, &idx, 0xEB);  // JMP <skip the jump>
+    sh_x64_put_u8(buf, &idx, is_near ? 5 : 14);
+  } else if (CALL_REL == ins->type) {
+    if (is_near) {
+      sh_x64_put_u8(buf, &idx, 0xE8);  // CALL rel32
+      sh_x64_put_rel32(buf, &idx, addr, rinfo);
+      return idx;
+    }
+    static const uint8_t call_abs[] = {0xFF, 0x15, 0x02, 0x00, 0x00, 0x00,  // CALL [RIP + 2]
+                                       0xEB, 0x08};                         // JMP <skip the address>
+    sh_x64_put(buf, &idx, call_abs, sizeof(call_abs));
+    sh_x64_put(buf, &idx, &addr, sizeof(addr));
+    return idx;
+  }
+
+  if (is_near) {
+    sh_x64_put_u8(buf, &idx, 0xE9);  // JMP rel32
+    sh_x64_put_rel32(buf, &idx, addr, rinfo);
+  } else {
+    idx += sh_x64_absolute_jump(NULL == buf ? NULL : buf + idx, addr);
+  }
+  return idx;
+}
+
+static size_t sh_x64_do_rewrite(uint8_t *buf, uintptr_t pc, sh_x64_rewrite_info_t *rinfo) {
+  sh_x64_inst_t ins;
+  if (0 == sh_x64_decode((uint8_t *)pc, &ins)) {
+    SH_LOG_WARN("x64 rewrite: unknown instruction at %" PRIxPTR, pc);
+    return 0;  // failed
+  }
+
+  if (RIP_REL == ins.type)
+    return sh_x64_rewrite_rip_rel(buf, pc, &ins, rinfo);
+  else if (JMP_REL == ins.type || CALL_REL == ins.type || JCC_REL == ins.type || JCXZ_LOOP == ins.type)
+    return sh_x64_rewrite_branch(buf, pc, &ins, rinfo);
+  else {
+    // IGNORED
+    if (NULL != buf) memcpy(buf, (void *)pc, ins.len);
+    return ins.len;
+  }
+}
+
+size_t sh_x64_get_rewrite_inst_len(uintptr_t pc, sh_x64_rewrite_info_t *rinfo) {
+  return sh_x64_do_rewrite(NULL, pc, rinfo);
+}
+
+size_t sh_x64_rewrite(uint8_t *buf, uintptr_t pc, sh_x64_rewrite_info_t *rinfo) {
+  SH_LOG_INFO("x64 rewrite: pc %" PRIxPTR ", first byte %" PRIx8, pc, *((uint8_t *)pc));
+  return sh_x64_do_rewrite(buf, pc, rinfo);
+}
+
+size_t sh_x64_int3(uint8_t *buf, size_t len) {
+  memset(buf, 0xCC, len);  // INT3
+  return len;
+}
+
+size_t sh_x64_absolute_jump(uint8_t *buf, uintptr_t addr) {
+  if (NULL != buf) {
+    buf[0] = 0xFF;  // JMP [RIP + 0]
+    buf[1] = 0x25;
+    memset(buf + 2, 0, 4);
+    memcpy(buf + 6, &addr, sizeof(addr));
+  }
+  return 14;
+}
+
+size_t sh_x64_relative_jump(uint8_t *buf, uintptr_t addr, uintptr_t pc) {
+  buf[0] = 0xE9;  // JMP rel32
+  int32_t rel = (int32_t)(addr - (pc + 5));
+  memcpy(buf + 1, &rel, sizeof(rel));
+  return 5;
+}
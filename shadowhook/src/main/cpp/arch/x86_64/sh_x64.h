@@ -0,0 +1,56 @@
+// Copyright (c) 2021-2025 ByteDance Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// the max count of the relocated instructions (at least 1 byte each, the longest exit is 14 bytes)
+#define SH_X64_INST_CNT_MAX 16
+
+typedef struct {
+  uintptr_t start_addr;
+  uintptr_t end_addr;
+  uint8_t *buf;
+  uintptr_t buf_pc;  // where buf is executed, buf may be the writable alias of it
+  size_t buf_size;
+  size_t buf_offset;
+  size_t inst_lens[SH_X64_INST_CNT_MAX];  // rewritten length of each relocated instruction
+  size_t inst_lens_cnt;
+} sh_x64_rewrite_info_t;
+
+// Return the length of the instruction at inst (0 if it is not recognized), and whether it
+// never falls through to the next instruction (RET, JMP, UD2, HLT, ...).
+size_t sh_x64_get_inst_len(const uint8_t *inst, bool *is_end);
+
+// Whether any relative branch in [start, end) jumps into (low, high).
+bool sh_x64_is_branch_into(uintptr_t start, uintptr_t end, uintptr_t low, uintptr_t high);
+
+size_t sh_x64_get_rewrite_inst_len(uintptr_t pc, sh_x64_rewrite_info_t *rinfo);
+size_t sh_x64_rewrite(uint8_t *buf, uintptr_t pc, sh_x64_rewrite_info_t *rinfo);
+
+size_t sh_x64_int3(uint8_t *buf, size_t len);
+
+size_t sh_x64_absolute_jump(uint8_t *buf, uintptr_t addr);
+
+bool sh_x64_is_in_rel32_range(uintptr_t addr, uintptr_t pc);
+size_t sh_x64_relative_jump(uint8_t *buf, uintptr_t addr, uintptr_t pc);
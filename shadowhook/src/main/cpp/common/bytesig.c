@@ -21,7 +21,7 @@
 
 // Created by Kelun Cai (caikelun@bytedance.com) on 2021-04-11.
 
-// version 1.0.5
+// version 1.0.6
 
 #include "bytesig.h"
 
@@ -98,6 +98,7 @@ end:
 typedef struct {
   pid_t tids[BYTESIG_PROTECTED_THREADS_MAX];         // atomic
   sigjmp_buf *jbufs[BYTESIG_PROTECTED_THREADS_MAX];  // atomic
+  bytesig_interceptor_t interceptor;                 // atomic
   union {
     struct sigaction64 prev_action64;
     struct sigaction prev_action;
@@ -167,6 +168,11 @@ __attribute__((noinline)) static void bytesig_handler_internal(int signum, sigin
 // https://clang.llvm.org/docs/AttributeReference.html#disable-tail-calls
 //__attribute__((disable_tail_calls))
 static void bytesig_handler(int signum, siginfo_t *siginfo, void *context) {
+  // let the interceptor resolve the signal, e.g. by redirecting the PC in context
+  bytesig_interceptor_t interceptor =
+      __atomic_load_n(&bytesig_signal_array[signum]->interceptor, __ATOMIC_ACQUIRE);
+  if (NULL != interceptor && interceptor(signum, siginfo, context)) return;
+
   bytesig_handler_internal(signum, siginfo, context);
 
 #define CALL_PREVIOUS_SIGNAL_HANDLER(suffix)                            \
@@ -230,6 +236,17 @@ end:
   return ret;
 }
 
+int bytesig_set_interceptor(int signum, bytesig_interceptor_t interceptor) {
+  if (__predict_false(signum <= 0 || signum >= __SIGRTMIN || signum == SIGKILL || signum == SIGSTOP))
+    return -1;
+
+  bytesig_signal_t *sig = bytesig_signal_array[signum];
+  if (__predict_false(NULL == sig)) return -1;
+
+  __atomic_store_n(&sig->interceptor, interceptor, __ATOMIC_RELEASE);
+  return 0;
+}
+
 void bytesig_protect(pid_t tid, sigjmp_buf *jbuf, const int signums[], size_t signums_cnt) {
   for (size_t i = 0; i < signums_cnt; i++) {
     int signum = signums[i];
@@ -286,3 +303,16 @@ void bytesig_unprotect(pid_t tid, const int signums[], size_t signums_cnt) {
     }
   }
 }
+
+bool bytesig_is_protected(pid_t tid, int signum) {
+  if (__predict_false(signum <= 0 || signum >= __SIGRTMIN || signum == SIGKILL || signum == SIGSTOP))
+    return false;
+
+  bytesig_signal_t *sig = bytesig_signal_array[signum];
+  if (__predict_false(NULL == sig)) return false;
+
+  for (size_t i = 0; i < BYTESIG_PROTECTED_THREADS_MAX; i++) {
+    if (tid == __atomic_load_n(&sig->tids[i], __ATOMIC_ACQUIRE)) return true;
+  }
+  return false;
+}
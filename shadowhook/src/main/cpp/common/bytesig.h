@@ -21,7 +21,7 @@
 
 // Created by Kelun Cai (caikelun@bytedance.com) on 2021-04-11.
 
-// version 1.0.5
+// version 1.0.6
 
 /*
  * #include "bytesig.h"
@@ -94,6 +94,7 @@
 
 #include <setjmp.h>
 #include <signal.h>
+#include <stdbool.h>
 #include <stddef.h>
 #include <sys/syscall.h>
 #include <unistd.h>
@@ -146,8 +147,14 @@ extern "C" {
 
 int bytesig_init(int signum);
 
+// return true if the signal has been handled, the protected threads and
+// the previous signal handler will not see it then
+typedef bool (*bytesig_interceptor_t)(int signum, siginfo_t *siginfo, void *context);
+int bytesig_set_interceptor(int signum, bytesig_interceptor_t interceptor);
+
 void bytesig_protect(pid_t tid, sigjmp_buf *jbuf, const int signums[], size_t signums_cnt);
 void bytesig_unprotect(pid_t tid, const int signums[], size_t signums_cnt);
+bool bytesig_is_protected(pid_t tid, int signum);
 
 #ifdef __cplusplus
 }
@@ -76,3 +76,11 @@
 // Do not disable it in a production environment !!!
 //
 #define SH_CONFIG_CORRUPT_IP_REGS
+
+// Map the trampolines W^X instead of RWX. Each chunk of trampolines is backed by a memfd
+// and mapped twice: a read-execute alias for execution, and a read-write alias (at a fixed
+// offset after it) which is only used for writing. Requires memfd_create() (Linux 3.17+).
+//
+// Enable it when RWX mappings are forbidden by the security policy.
+//
+// #define SH_CONFIG_TRAMPO_WXORX
@@ -109,7 +109,8 @@ const char *sh_errno_to_errmsg(int error_number) {
                               /* 42 */ "Alloc island for rewrite failed",
                               /* 43 */ "Mode conflict",
                               /* 44 */ "Duplicate multi hook",
-                              /* 45 */ "Disabled"};
+                              /* 45 */ "Disabled",
+                              /* 46 */ "Tripped by circuit breaker"};
 
   if (__predict_false(error_number < 0 || error_number >= (int)(sizeof(msg) / sizeof(msg[0])))) {
     return "Unknown error number";
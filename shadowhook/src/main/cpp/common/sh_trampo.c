@@ -24,27 +24,275 @@
 #include "sh_trampo.h"
 
 #include <pthread.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
 #include <sys/prctl.h>
+#include <sys/syscall.h>
 #include <sys/time.h>
+#include <unistd.h>
 
 #include "queue.h"
+#include "sh_config.h"
 #include "sh_util.h"
+#include "tree.h"
 
-#define SH_TRAMPO_ALIGN 4
+#define SH_TRAMPO_ALIGN           4
+#define SH_TRAMPO_MAP_BITS        64
+#define SH_TRAMPO_CHUNK_SIZE      (64 * 1024)
+#define SH_TRAMPO_CHUNK_ANON_NAME "shadowhook-trampo"
 
-void sh_trampo_init_mgr(sh_trampo_mgr_t *mgr, const char *anon_page_name, size_t trampo_size,
-                        time_t delay_sec) {
-  SLIST_INIT(&mgr->pages);
+// page tree
+static __inline__ int sh_trampo_page_cmp(sh_trampo_page_t *a, sh_trampo_page_t *b) {
+  if (a->ptr == b->ptr)
+    return 0;
+  else
+    return a->ptr > b->ptr ? 1 : -1;
+}
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wunused-function"
+RB_GENERATE_STATIC(sh_trampo_page_tree, sh_trampo_page, link_rbtree, sh_trampo_page_cmp)
+#pragma clang diagnostic pop
+
+// chunk of the arena, trampo-pages of all trampo managers are carved out of the shared chunks
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wpadded"
+typedef struct sh_trampo_chunk {
+  uintptr_t ptr;      // key
+  uint64_t free_map;  // 1 bit for each page: set when it is not used by any trampo manager
+  RB_ENTRY(sh_trampo_chunk) link_rbtree;
+  TAILQ_ENTRY(sh_trampo_chunk, ) link_avail;  // linked only when free_map != 0
+} sh_trampo_chunk_t;
+#pragma clang diagnostic pop
+
+// chunk tree
+static __inline__ int sh_trampo_chunk_cmp(sh_trampo_chunk_t *a, sh_trampo_chunk_t *b) {
+  if (a->ptr == b->ptr)
+    return 0;
+  else
+    return a->ptr > b->ptr ? 1 : -1;
+}
+typedef RB_HEAD(sh_trampo_chunk_tree, sh_trampo_chunk) sh_trampo_chunk_tree_t;
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wunused-function"
+RB_GENERATE_STATIC(sh_trampo_chunk_tree, sh_trampo_chunk, link_rbtree, sh_trampo_chunk_cmp)
+#pragma clang diagnostic pop
+typedef TAILQ_HEAD(sh_trampo_chunk_queue, sh_trampo_chunk, ) sh_trampo_chunk_queue_t;
+
+// arena
+static sh_trampo_chunk_tree_t sh_trampo_chunks = RB_INITIALIZER(&sh_trampo_chunks);
+static sh_trampo_chunk_queue_t sh_trampo_chunks_avail = TAILQ_HEAD_INITIALIZER(sh_trampo_chunks_avail);
+static pthread_mutex_t sh_trampo_chunks_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static size_t sh_trampo_get_chunk_size(void) {
+  size_t page_size = sh_util_get_page_size();
+  return page_size > SH_TRAMPO_CHUNK_SIZE ? page_size : SH_TRAMPO_CHUNK_SIZE;
+}
+
+#ifdef SH_CONFIG_TRAMPO_WXORX
+
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#endif
+
+// [RX alias][RW alias], both of them are mapped from the same memfd
+static uintptr_t sh_trampo_map_chunk(void *hint, size_t chunk_size) {
+  int fd = (int)syscall(SYS_memfd_create, SH_TRAMPO_CHUNK_ANON_NAME, MFD_CLOEXEC);
+  if (fd < 0) return (uintptr_t)MAP_FAILED;
+
+  uintptr_t ptr = (uintptr_t)MAP_FAILED;
+  if (0 != ftruncate(fd, (off_t)chunk_size)) goto end;
+
+  // reserve the address space for both aliases
+  void *base = mmap(hint, chunk_size * 2, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (MAP_FAILED == base) goto end;
+
+  if (MAP_FAILED == mmap(base, chunk_size, PROT_READ | PROT_EXEC, MAP_SHARED | MAP_FIXED, fd, 0) ||
+      MAP_FAILED == mmap((void *)((uintptr_t)base + chunk_size), chunk_size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_FIXED, fd, 0)) {
+    munmap(base, chunk_size * 2);
+    goto end;
+  }
+  ptr = (uintptr_t)base;
+
+end:
+  close(fd);
+  return ptr;
+}
+
+static void sh_trampo_unmap_chunk(uintptr_t ptr, size_t chunk_size) {
+  munmap((void *)ptr, chunk_size * 2);
+}
+
+#else
+
+static uintptr_t sh_trampo_map_chunk(void *hint, size_t chunk_size) {
+  uintptr_t ptr = (uintptr_t)(mmap(hint, chunk_size, PROT_READ | PROT_WRITE | PROT_EXEC,
+                                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+  if ((uintptr_t)MAP_FAILED != ptr)
+    prctl(PR_SET_VMA, PR_SET_VMA_ANON_NAME, ptr, chunk_size, SH_TRAMPO_CHUNK_ANON_NAME);
+  return ptr;
+}
+
+static void sh_trampo_unmap_chunk(uintptr_t ptr, size_t chunk_size) {
+  munmap((void *)ptr, chunk_size);
+}
+
+#endif
+
+uintptr_t sh_trampo_get_rw_addr(uintptr_t trampo) {
+#ifdef SH_CONFIG_TRAMPO_WXORX
+  return trampo + sh_trampo_get_chunk_size();
+#else
+  return trampo;
+#endif
+}
+
+// take the first free page of the chunk, the page start is in [page_low, page_high]
+static uintptr_t sh_trampo_chunk_take_page(sh_trampo_chunk_t *chunk, uintptr_t page_low,
+                                           uintptr_t page_high) {
+  size_t page_size = sh_util_get_page_size();
+  if (page_high < chunk->ptr) return 0;
+
+  uint64_t bits = chunk->free_map;
+  if (page_low > chunk->ptr) {
+    size_t first = (page_low - chunk->ptr + page_size - 1) / page_size;
+    bits = (first >= SH_TRAMPO_MAP_BITS) ? 0 : (bits & (~0ULL << first));
+  }
+  size_t last = (page_high - chunk->ptr) / page_size;
+  if (last < SH_TRAMPO_MAP_BITS - 1) bits &= (~0ULL >> (SH_TRAMPO_MAP_BITS - 1 - last));
+  if (0 == bits) return 0;
+
+  size_t i = (size_t)__builtin_ctzll(bits);
+  chunk->free_map &= ~(1ULL << i);
+  if (0 == chunk->free_map) TAILQ_REMOVE(&sh_trampo_chunks_avail, chunk, link_avail);
+  return chunk->ptr + page_size * i;
+}
+
+// alloc a page from the arena, the page start is in [page_low, page_high]
+static uintptr_t sh_trampo_arena_alloc_page(uintptr_t page_low, uintptr_t page_high) {
+  size_t page_size = sh_util_get_page_size();
+  size_t chunk_size = sh_trampo_get_chunk_size();
+  size_t chunk_page_count = chunk_size / page_size;
+  bool between = (0 != page_low || UINTPTR_MAX != page_high);
+  uintptr_t page = 0;
+  uintptr_t new_ptr;
+  sh_trampo_chunk_t *chunk;
+  if (page_high < page_low) return 0;
+
+  pthread_mutex_lock(&sh_trampo_chunks_lock);
+
+  // try to find a free page in the existing chunks
+  if (!between) {
+    if (NULL != (chunk = TAILQ_FIRST(&sh_trampo_chunks_avail)))
+      page = sh_trampo_chunk_take_page(chunk, page_low, page_high);
+  } else {
+    // start from the chunk which may contain page_low
+    sh_trampo_chunk_t key = {.ptr = page_low};
+    chunk = RB_NFIND(sh_trampo_chunk_tree, &sh_trampo_chunks, &key);
+    sh_trampo_chunk_t *prev = (NULL == chunk ? RB_MAX(sh_trampo_chunk_tree, &sh_trampo_chunks)
+                                             : RB_PREV(sh_trampo_chunk_tree, &sh_trampo_chunks, chunk));
+    if (NULL != prev && prev->ptr + chunk_size > page_low) chunk = prev;
+    for (; NULL != chunk && chunk->ptr <= page_high;
+         chunk = RB_NEXT(sh_trampo_chunk_tree, &sh_trampo_chunks, chunk)) {
+      if (0 == chunk->free_map) continue;
+      if (0 != (page = sh_trampo_chunk_take_page(chunk, page_low, page_high))) break;
+    }
+  }
+  if (0 != page) goto end;
+
+  // map a new chunk
+  void *hint = between ? (void *)page_low : NULL;
+  if ((uintptr_t)MAP_FAILED == (new_ptr = sh_trampo_map_chunk(hint, chunk_size))) goto end;
+
+  // check chunk's range
+  if (page_high < new_ptr || new_ptr + chunk_size - page_size < page_low) goto err;
+
+  // create a new chunk info, all pages are free
+  if (NULL == (chunk = calloc(1, sizeof(sh_trampo_chunk_t)))) goto err;
+  chunk->ptr = new_ptr;
+  chunk->free_map = (chunk_page_count >= SH_TRAMPO_MAP_BITS) ? ~0ULL : ((1ULL << chunk_page_count) - 1);
+  RB_INSERT(sh_trampo_chunk_tree, &sh_trampo_chunks, chunk);
+  TAILQ_INSERT_TAIL(&sh_trampo_chunks_avail, chunk, link_avail);
+
+  // alloc page from the new chunk
+  page = sh_trampo_chunk_take_page(chunk, page_low, page_high);
+
+end:
+  pthread_mutex_unlock(&sh_trampo_chunks_lock);
+  return page;
+
+err:
+  pthread_mutex_unlock(&sh_trampo_chunks_lock);
+  sh_trampo_unmap_chunk(new_ptr, chunk_size);
+  return 0;
+}
+
+void sh_trampo_init_mgr(sh_trampo_mgr_t *mgr, size_t trampo_size, time_t delay_sec) {
+  RB_INIT(&mgr->pages);
+  TAILQ_INIT(&mgr->pages_avail);
+  TAILQ_INIT(&mgr->delays);
   pthread_mutex_init(&mgr->pages_lock, NULL);
-  mgr->anon_page_name = anon_page_name;
   mgr->trampo_size = SH_UTIL_ALIGN_END(trampo_size, SH_TRAMPO_ALIGN);
   mgr->delay_sec = delay_sec;
 }
 
+static void sh_trampo_set_free(sh_trampo_mgr_t *mgr, sh_trampo_page_t *page, size_t idx) {
+  page->free_map[idx / SH_TRAMPO_MAP_BITS] |= (1ULL << (idx % SH_TRAMPO_MAP_BITS));
+  if (0 == page->free_cnt++) TAILQ_INSERT_TAIL(&mgr->pages_avail, page, link_avail);
+}
+
+static uintptr_t sh_trampo_set_used(sh_trampo_mgr_t *mgr, sh_trampo_page_t *page, size_t idx) {
+  page->free_map[idx / SH_TRAMPO_MAP_BITS] &= ~(1ULL << (idx % SH_TRAMPO_MAP_BITS));
+  if (0 == --page->free_cnt) TAILQ_REMOVE(&mgr->pages_avail, page, link_avail);
+  return page->ptr + mgr->trampo_size * idx;
+}
+
+// find the first free trampo in the page, index range: [idx_first, idx_last]
+static bool sh_trampo_find_free(sh_trampo_page_t *page, size_t idx_first, size_t idx_last, size_t *idx) {
+  size_t word_first = idx_first / SH_TRAMPO_MAP_BITS;
+  size_t word_last = idx_last / SH_TRAMPO_MAP_BITS;
+
+  for (size_t i = word_first; i <= word_last; i++) {
+    uint64_t bits = page->free_map[i];
+    if (i == word_first) bits &= (~0ULL << (idx_first % SH_TRAMPO_MAP_BITS));
+    if (i == word_last) bits &= (~0ULL >> (SH_TRAMPO_MAP_BITS - 1 - idx_last % SH_TRAMPO_MAP_BITS));
+    if (0 != bits) {
+      *idx = i * SH_TRAMPO_MAP_BITS + (size_t)__builtin_ctzll(bits);
+      return true;
+    }
+  }
+  return false;
+}
+
+// get the index range of the trampos in the page which are in [range_low, range_high]
+static bool sh_trampo_get_idx_range(sh_trampo_mgr_t *mgr, uintptr_t page_ptr, size_t trampo_count,
+                                    uintptr_t range_low, uintptr_t range_high, size_t *idx_first,
+                                    size_t *idx_last) {
+  *idx_first = 0;
+  *idx_last = trampo_count - 1;
+  if (range_high < page_ptr) return false;
+  if (range_low > page_ptr)
+    *idx_first = (range_low - page_ptr + mgr->trampo_size - 1) / mgr->trampo_size;
+  if ((range_high - page_ptr) / mgr->trampo_size < *idx_last)
+    *idx_last = (range_high - page_ptr) / mgr->trampo_size;
+  return *idx_first <= *idx_last;
+}
+
+// move the trampos whose delay has expired from the delay queue back to their pages
+static void sh_trampo_reclaim(sh_trampo_mgr_t *mgr, time_t now) {
+  sh_trampo_delay_t *delay;
+  while (NULL != (delay = TAILQ_FIRST(&mgr->delays))) {
+    // the queue is sorted by time, so the rest are not expired either
+    if (now <= delay->ts || now - delay->ts <= mgr->delay_sec) break;
+
+    TAILQ_REMOVE(&mgr->delays, delay, link);
+    sh_trampo_set_free(mgr, delay->page, delay->idx);
+  }
+}
+
 uintptr_t sh_trampo_alloc(sh_trampo_mgr_t *mgr) {
   return sh_trampo_alloc_between(mgr, 0, 0);
 }
@@ -54,111 +302,90 @@ uintptr_t sh_trampo_alloc_between(sh_trampo_mgr_t *mgr, uintptr_t range_low, uin
   if (range_high < range_low) return 0;
   bool between = (range_low > 0 || range_high > 0);
   if (between && (range_high - range_low < mgr->trampo_size)) return 0;
+  if (!between) range_high = UINTPTR_MAX;
 
-  uint32_t now = (uint32_t)sh_util_get_stable_timestamp();
-  size_t page_size = sh_util_get_page_size();
-  size_t trampo_page_size = page_size;
-  size_t trampo_count = trampo_page_size / mgr->trampo_size;
+  size_t trampo_count = sh_util_get_page_size() / mgr->trampo_size;
+  size_t map_size = (trampo_count + SH_TRAMPO_MAP_BITS - 1) / SH_TRAMPO_MAP_BITS * sizeof(uint64_t);
   uintptr_t trampo = 0;
-  uintptr_t new_ptr = (uintptr_t)MAP_FAILED;
-  uintptr_t new_ptr_prctl = (uintptr_t)MAP_FAILED;
+  sh_trampo_page_t *page = NULL;
+  size_t idx_first, idx_last, idx;
 
   pthread_mutex_lock(&mgr->pages_lock);
 
+  // make the trampos whose delay has expired reusable
+  sh_trampo_reclaim(mgr, sh_util_get_stable_timestamp());
+
   // try to find an unused trampo
-  sh_trampo_page_t *page;
-  SLIST_FOREACH(page, &mgr->pages, link) {
-    // check page's range
-    uintptr_t trampo_first = page->ptr;
-    uintptr_t trampo_last = page->ptr + (trampo_count - 1) * mgr->trampo_size;
-    if (between && ((trampo_last < range_low) || (range_high < trampo_first))) continue;
-
-    for (uintptr_t i = 0; i < trampo_count; i++) {
-      // check current trampo's range
-      uintptr_t trampo_cur = page->ptr + (mgr->trampo_size * i);
-      if (between && ((trampo_cur < range_low) || (range_high < trampo_cur))) continue;
-
-      // check if used
-      uint32_t used = page->flags[i] >> 31;
-      if (used) continue;
-
-      // check timestamp
-      uint32_t ts = page->flags[i] & 0x7FFFFFFF;
-      if (now <= ts || now - ts <= (uint32_t)mgr->delay_sec) continue;
-
-      // OK
-      page->flags[i] |= 0x80000000;
-      trampo = trampo_cur;
-      memset((void *)trampo, 0, mgr->trampo_size);
+  if (!between) {
+    if (NULL != (page = TAILQ_FIRST(&mgr->pages_avail)) &&
+        sh_trampo_find_free(page, 0, trampo_count - 1, &idx)) {
+      trampo = sh_trampo_set_used(mgr, page, idx);
+      memset((void *)sh_trampo_get_rw_addr(trampo), 0, mgr->trampo_size);
       goto end;
     }
+  } else {
+    // start from the first page which may contain range_low
+    sh_trampo_page_t key = {.ptr = sh_util_page_start(range_low)};
+    for (page = RB_NFIND(sh_trampo_page_tree, &mgr->pages, &key); NULL != page && page->ptr <= range_high;
+         page = RB_NEXT(sh_trampo_page_tree, &mgr->pages, page)) {
+      if (0 == page->free_cnt) continue;
+      if (!sh_trampo_get_idx_range(mgr, page->ptr, trampo_count, range_low, range_high, &idx_first,
+                                   &idx_last))
+        continue;
+      if (sh_trampo_find_free(page, idx_first, idx_last, &idx)) {
+        trampo = sh_trampo_set_used(mgr, page, idx);
+        memset((void *)sh_trampo_get_rw_addr(trampo), 0, mgr->trampo_size);
+        goto end;
+      }
+    }
   }
 
-  // alloc a new memory page
-  void *hint = between ? (void *)(sh_util_page_end(range_low)) : NULL;
-  new_ptr = (uintptr_t)(mmap(hint, trampo_page_size, PROT_READ | PROT_WRITE | PROT_EXEC,
-                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
-  if ((uintptr_t)MAP_FAILED == new_ptr) goto err;
-  new_ptr_prctl = new_ptr;
-
-  // check page's range
-  uintptr_t trampo_first = new_ptr;
-  uintptr_t trampo_last = new_ptr + (trampo_count - 1) * mgr->trampo_size;
-  if (between && ((trampo_last < range_low) || (range_high < trampo_first))) goto err;
-
-  // create a new trampo-page info
-  if (NULL == (page = calloc(1, sizeof(sh_trampo_page_t) + trampo_count * sizeof(uint32_t)))) goto err;
-  memset((void *)new_ptr, 0, trampo_page_size);
-  page->ptr = new_ptr;
-  new_ptr = (uintptr_t)MAP_FAILED;
-  SLIST_INSERT_HEAD(&mgr->pages, page, link);
-
-  // alloc trampo from the new memory page
-  for (uintptr_t i = 0; i < trampo_count; i++) {
-    // check current trampo's range
-    uintptr_t trampo_cur = page->ptr + (mgr->trampo_size * i);
-    if (between && ((trampo_cur < range_low) || (range_high < trampo_cur))) continue;
-
-    // OK
-    page->flags[i] |= 0x80000000;
-    trampo = trampo_cur;
-    break;
+  // create a new trampo-page info, the delay records follow the free map
+  size_t delays_size = trampo_count * sizeof(sh_trampo_delay_t);
+  if (NULL == (page = calloc(1, sizeof(sh_trampo_page_t) + map_size + delays_size))) goto end;
+  page->delays = (sh_trampo_delay_t *)((uintptr_t)page->free_map + map_size);
+
+  // alloc a new trampo-page from the arena (zero filled)
+  uintptr_t page_low = 0;
+  if (between) {
+    page_low = sh_util_page_start(range_low);
+    if (!sh_trampo_get_idx_range(mgr, page_low, trampo_count, range_low, range_high, &idx_first, &idx_last))
+      page_low = sh_util_page_end(range_low);
+  }
+  if (0 == (page->ptr = sh_trampo_arena_alloc_page(page_low, range_high))) {
+    free(page);
+    goto end;
   }
-  if (0 == trampo) abort();
+
+  // all trampos are free
+  for (size_t i = 0; i < trampo_count; i++) sh_trampo_set_free(mgr, page, i);
+  RB_INSERT(sh_trampo_page_tree, &mgr->pages, page);
+
+  // alloc trampo from the new trampo-page
+  if (!sh_trampo_get_idx_range(mgr, page->ptr, trampo_count, range_low, range_high, &idx_first, &idx_last))
+    abort();
+  trampo = sh_trampo_set_used(mgr, page, idx_first);
 
 end:
   pthread_mutex_unlock(&mgr->pages_lock);
-  if ((uintptr_t)MAP_FAILED != new_ptr_prctl)
-    prctl(PR_SET_VMA, PR_SET_VMA_ANON_NAME, new_ptr_prctl, trampo_page_size, mgr->anon_page_name);
   return trampo;
-
-err:
-  pthread_mutex_unlock(&mgr->pages_lock);
-  if (NULL != page) {
-    if (0 != page->ptr) munmap((void *)page->ptr, trampo_page_size);
-    free(page);
-  }
-  if ((uintptr_t)MAP_FAILED != new_ptr) munmap((void *)new_ptr, trampo_page_size);
-  return 0;
 }
 
 void sh_trampo_free(sh_trampo_mgr_t *mgr, uintptr_t trampo) {
-  time_t now = sh_util_get_stable_timestamp();
-  size_t trampo_page_size = sh_util_get_page_size();
-  size_t trampo_count = trampo_page_size / mgr->trampo_size;
-
   pthread_mutex_lock(&mgr->pages_lock);
 
-  sh_trampo_page_t *page;
-  SLIST_FOREACH(page, &mgr->pages, link) {
-    // check page's hit range: [page_start, page_end)
-    uintptr_t page_start = page->ptr;
-    uintptr_t page_end = page->ptr + trampo_count * mgr->trampo_size;
-    if (page_start <= trampo && trampo < page_end) {
-      uintptr_t i = (trampo - page_start) / mgr->trampo_size;
-      page->flags[i] = now & 0x7FFFFFFF;
-      break;
-    }
+  // trampo-pages are page aligned
+  sh_trampo_page_t key = {.ptr = sh_util_page_start(trampo)};
+  sh_trampo_page_t *page = RB_FIND(sh_trampo_page_tree, &mgr->pages, &key);
+  if (NULL != page) {
+    // the delay record is preallocated in the page, so the trampo is never reused before the delay
+    size_t idx = (trampo - page->ptr) / mgr->trampo_size;
+    sh_trampo_delay_t *delay = &page->delays[idx];
+    delay->page = page;
+    delay->idx = idx;
+    // take the timestamp inside the lock to keep the delay queue sorted
+    delay->ts = sh_util_get_stable_timestamp();
+    TAILQ_INSERT_TAIL(&mgr->delays, delay, link);
   }
 
   pthread_mutex_unlock(&mgr->pages_lock);
@@ -22,29 +22,52 @@
 // Created by Kelun Cai (caikelun@bytedance.com) on 2021-04-11.
 
 #pragma once
+#include <pthread.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <sys/time.h>
 
 #include "queue.h"
+#include "tree.h"
 
+// freed trampo waiting for the delay to expire
+typedef struct sh_trampo_delay {
+  struct sh_trampo_page *page;
+  size_t idx;
+  time_t ts;
+  TAILQ_ENTRY(sh_trampo_delay, ) link;
+} sh_trampo_delay_t;
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wpadded"
 typedef struct sh_trampo_page {
-  uintptr_t ptr;
-  SLIST_ENTRY(sh_trampo_page, ) link;
-  uint32_t flags[];  // flags for each trampo: 1 bit for used/unused, 31 bits for timestamp
+  uintptr_t ptr;  // key
+  size_t free_cnt;
+  RB_ENTRY(sh_trampo_page) link_rbtree;
+  TAILQ_ENTRY(sh_trampo_page, ) link_avail;  // linked only when free_cnt > 0
+  sh_trampo_delay_t *delays;  // 1 record for each trampo, allocated with the page (free never allocates)
+  uint64_t free_map[];  // 1 bit for each trampo: set when it is unused and can be reused right now
 } sh_trampo_page_t;
-typedef SLIST_HEAD(sh_trampo_page_list, sh_trampo_page, ) sh_trampo_page_list_t;
+#pragma clang diagnostic pop
+typedef RB_HEAD(sh_trampo_page_tree, sh_trampo_page) sh_trampo_page_tree_t;
+typedef TAILQ_HEAD(sh_trampo_page_queue, sh_trampo_page, ) sh_trampo_page_queue_t;
+
+typedef TAILQ_HEAD(sh_trampo_delay_queue, sh_trampo_delay, ) sh_trampo_delay_queue_t;
 
 typedef struct sh_trampo_mgr {
-  sh_trampo_page_list_t pages;
+  sh_trampo_page_tree_t pages;         // sorted by address
+  sh_trampo_page_queue_t pages_avail;  // pages with at least one free trampo
+  sh_trampo_delay_queue_t delays;      // sorted by the time of free
   pthread_mutex_t pages_lock;
-  const char *anon_page_name;
   size_t trampo_size;
   time_t delay_sec;  // must be greater than 0
 } sh_trampo_mgr_t;
 
-void sh_trampo_init_mgr(sh_trampo_mgr_t *mgr, const char *anon_page_name, size_t trampo_size,
-                        time_t delay_sec);
+// all trampo managers carve their trampo-pages out of one shared arena of large chunks
+void sh_trampo_init_mgr(sh_trampo_mgr_t *mgr, size_t trampo_size, time_t delay_sec);
 uintptr_t sh_trampo_alloc(sh_trampo_mgr_t *mgr);
 uintptr_t sh_trampo_alloc_between(sh_trampo_mgr_t *mgr, uintptr_t range_low, uintptr_t range_high);
 void sh_trampo_free(sh_trampo_mgr_t *mgr, uintptr_t trampo);
+
+// the address for writing to the trampo (it differs from the trampo itself when it is mapped W^X)
+uintptr_t sh_trampo_get_rw_addr(uintptr_t trampo);
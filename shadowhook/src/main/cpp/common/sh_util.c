@@ -24,6 +24,7 @@
 #include "sh_util.h"
 
 #include <ctype.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -195,11 +196,45 @@ uintptr_t sh_util_page_end(uintptr_t x) {
   return sh_util_page_start(x + sh_util_page_size - 1);
 }
 
+// the pages made writable in the page session, only accessed by the thread which opened the session
+// (shadowhook never makes them read-only again)
+static uintptr_t sh_util_page_session_owner = 0;  // pthread_self() of the thread, 0: no session
+static uintptr_t sh_util_page_session_range_start = 0;
+static uintptr_t sh_util_page_session_range_end = 0;
+static int sh_util_page_session_prot = 0;
+
+void sh_util_page_session_begin(void) {
+  uintptr_t expected = 0;
+  if (__atomic_compare_exchange_n(&sh_util_page_session_owner, &expected, (uintptr_t)pthread_self(), false,
+                                  __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+    sh_util_page_session_range_start = 0;
+    sh_util_page_session_range_end = 0;
+  }
+}
+
+void sh_util_page_session_end(void) {
+  uintptr_t expected = (uintptr_t)pthread_self();
+  __atomic_compare_exchange_n(&sh_util_page_session_owner, &expected, 0, false, __ATOMIC_RELEASE,
+                              __ATOMIC_RELAXED);
+}
+
 int sh_util_mprotect(uintptr_t addr, size_t len, int prot) {
   uintptr_t start = sh_util_page_start(addr);
   uintptr_t end = sh_util_page_end(addr + len - 1);
 
-  return mprotect((void *)start, end - start, prot);
+  uintptr_t owner = __atomic_load_n(&sh_util_page_session_owner, __ATOMIC_RELAXED);
+  bool in_session = (owner == (uintptr_t)pthread_self());
+  if (in_session && prot == sh_util_page_session_prot && sh_util_page_session_range_start <= start &&
+      end <= sh_util_page_session_range_end)
+    return 0;
+
+  int r = mprotect((void *)start, end - start, prot);
+  if (in_session && 0 == r) {
+    sh_util_page_session_range_start = start;
+    sh_util_page_session_range_end = end;
+    sh_util_page_session_prot = prot;
+  }
+  return r;
 }
 
 void sh_util_clear_cache(uintptr_t addr, size_t len) {
@@ -229,7 +264,9 @@ int sh_util_write_inst(uintptr_t target_addr, void *inst, size_t inst_len) {
     return SHADOWHOOK_ERRNO_MPROT;
 
   SH_SIG_TRY(SIGSEGV, SIGBUS) {
-    if ((4 == inst_len) && (0 == target_addr % 4))
+    if ((2 == inst_len) && (0 == target_addr % 2))
+      __atomic_store_n((uint16_t *)target_addr, *((uint16_t *)inst), __ATOMIC_SEQ_CST);
+    else if ((4 == inst_len) && (0 == target_addr % 4))
       __atomic_store_n((uint32_t *)target_addr, *((uint32_t *)inst), __ATOMIC_SEQ_CST);
     else if ((8 == inst_len) && (0 == target_addr % 8))
       __atomic_store_n((uint64_t *)target_addr, *((uint64_t *)inst), __ATOMIC_SEQ_CST);
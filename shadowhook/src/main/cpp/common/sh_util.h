@@ -109,6 +109,11 @@ bool sh_util_match_pathname(const char *a, const char *b);
 
 // instruction
 int sh_util_mprotect(uintptr_t addr, size_t len, int prot);
+// while a page session is opened by a thread, its sh_util_mprotect() calls skip the mprotect() of the pages
+// it has just changed, so that patching the targets in address order costs one mprotect() for each page
+// (one session at a time, the other threads call mprotect() as usual)
+void sh_util_page_session_begin(void);
+void sh_util_page_session_end(void);
 void sh_util_clear_cache(uintptr_t addr, size_t len);
 int sh_util_write_inst(uintptr_t target_addr, void *inst, size_t inst_len);
 bool sh_util_is_thumb32(uintptr_t target_addr);
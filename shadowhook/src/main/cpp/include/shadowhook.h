@@ -83,6 +83,7 @@
 #define SHADOWHOOK_ERRNO_MODE_CONFLICT          43
 #define SHADOWHOOK_ERRNO_HOOK_MULTI_DUP         44
 #define SHADOWHOOK_ERRNO_DISABLED               45
+#define SHADOWHOOK_ERRNO_TRIPPED                46
 
 #ifdef __cplusplus
 extern "C" {
@@ -114,6 +115,18 @@ void shadowhook_set_recordable(bool recordable);
 bool shadowhook_get_disable(void);
 void shadowhook_set_disable(bool disable);
 
+// bypass all proxy-functions (in all modes) and interceptors, jump to the original functions directly
+bool shadowhook_get_bypass(void);
+void shadowhook_set_bypass(bool bypass);
+
+// circuit breaker for shared mode proxy-functions and interceptors (0 = disabled),
+// the tripped callback runs in a shadowhook thread
+#define SHADOWHOOK_TRIPPED_BY_FAULT   1
+#define SHADOWHOOK_TRIPPED_BY_LATENCY 2
+typedef void (*shadowhook_tripped_t)(void *target_addr, void *proxy_func, int reason, void *arg);
+void shadowhook_set_circuit_breaker(uint32_t max_faults, uint64_t max_latency_ns,
+                                    shadowhook_tripped_t tripped, void *arg);
+
 // get error-number and error message
 int shadowhook_get_errno(void);
 const char *shadowhook_to_errmsg(int error_number);
@@ -144,9 +157,43 @@ void *shadowhook_hook_sym_name_callback_2(const char *lib_name, const char *sym_
                                           void **orig_addr, uint32_t flags, shadowhook_hooked_t hooked,
                                           void *hooked_arg);
 
+// counter-only hook: count calls to func_addr without calling any proxy function
+// (unhook by shadowhook_unhook(), the counter is invalid after unhook)
+void *shadowhook_count(void *func_addr, void **counter);
+uint64_t shadowhook_get_count(void *counter);
+
+// latency histogram hook: record the wall-clock latency of each call to func_addr
+// (buckets[i] counts calls that took [2^i, 2^(i+1)) nanoseconds, the last bucket also counts anything longer)
+// (unhook by shadowhook_unhook(), the histogram is invalid after unhook)
+#define SHADOWHOOK_HISTOGRAM_BUCKET_CNT 32
+typedef struct {
+  uint64_t count;
+  uint64_t buckets[SHADOWHOOK_HISTOGRAM_BUCKET_CNT];
+} shadowhook_histogram_t;
+void *shadowhook_histogram(void *func_addr, void **histogram);
+int shadowhook_get_histogram(void *histogram, shadowhook_histogram_t *result);
+
+// hook-once probes: find out which functions are reached (a probe records its first hit and is removed by
+// shadowhook_probe_collect(), not by itself, hit_bitmap has (cnt + 7) / 8 bytes, bit i is for func_addrs[i])
+void *shadowhook_probe_once(void *const *func_addrs, size_t cnt);
+size_t shadowhook_probe_collect(void *probes, uint8_t *hit_bitmap);
+int shadowhook_probe_destroy(void *probes);
+
+// hook with per-target user data (shared mode only, read it back by SHADOWHOOK_GET_DATA() in proxy-function)
+void *shadowhook_hook_func_addr_with_data(void *func_addr, void *new_addr, void **orig_addr, void *data,
+                                          uint32_t flags,
+                                          ... /* char *record_lib_name, char *record_sym_name */);
+void *shadowhook_hook_sym_addr_with_data(void *sym_addr, void *new_addr, void **orig_addr, void *data,
+                                         uint32_t flags, ... /* char *record_lib_name, char *record_sym_name */);
+void *shadowhook_hook_sym_name_with_data(const char *lib_name, const char *sym_name, void *new_addr,
+                                         void **orig_addr, void *data, uint32_t flags);
+
+// replace the proxy function of a hooked stub (the patched instructions are kept)
+int shadowhook_replace_proxy(void *stub, void *new_addr);
+
 // intercept and unintercept
 typedef union {
-#if defined(__aarch64__)
+#if defined(__aarch64__) || defined(__x86_64__)
   __uint128_t q;
 #endif
   uint64_t d[2];
@@ -174,6 +221,21 @@ typedef struct {
   // (2) VFPv3-D16: q0-q7(d0-d15)
   shadowhook_vreg_t vregs[16];
 } shadowhook_cpu_context_t;
+#elif defined(__x86_64__)
+typedef struct {
+  uint64_t regs[16];  // rax, rcx, rdx, rbx, rsp, rbp, rsi, rdi, r8-r15
+  uint64_t rip;
+  uint64_t rflags;
+  shadowhook_vreg_t vregs[16];  // xmm0-xmm15
+  uint64_t mxcsr;
+} shadowhook_cpu_context_t;
+#elif defined(__riscv)
+typedef struct {
+  uint64_t regs[32];  // x0-x31 (x0 is always 0)
+  uint64_t pc;
+  uint64_t fregs[32];  // f0-f31
+  uint64_t fcsr;
+} shadowhook_cpu_context_t;
 #endif
 
 #define SHADOWHOOK_INTERCEPT_DEFAULT                0  // 0b000
@@ -181,6 +243,34 @@ typedef struct {
 #define SHADOWHOOK_INTERCEPT_WITH_FPSIMD_WRITE_ONLY 2  // 0b010
 #define SHADOWHOOK_INTERCEPT_WITH_FPSIMD_READ_WRITE 3  // 0b011
 #define SHADOWHOOK_INTERCEPT_RECORD                 4  // 0b100
+#define SHADOWHOOK_INTERCEPT_WITH_RETURN            8  // 0b1000 (function-entry intercept only)
+
+// in an interceptor added with SHADOWHOOK_INTERCEPT_WITH_RETURN: skip the original function and
+// return to the caller now (set the return value registers in cpu_context first)
+#if defined(__aarch64__)
+#define SHADOWHOOK_INTERCEPT_RETURN_NOW(cpu_context) ((cpu_context)->pc = (cpu_context)->regs[30])
+#elif defined(__arm__)
+#define SHADOWHOOK_INTERCEPT_RETURN_NOW(cpu_context) ((cpu_context)->regs[15] = (cpu_context)->regs[14])
+#elif defined(__x86_64__)
+#define SHADOWHOOK_INTERCEPT_RETURN_NOW(cpu_context)                         \
+  ((cpu_context)->rip = *((uint64_t *)(uintptr_t)(cpu_context)->regs[4]), \
+   (cpu_context)->regs[4] += 8)  // pop the return address
+#elif defined(__riscv)
+#define SHADOWHOOK_INTERCEPT_RETURN_NOW(cpu_context) ((cpu_context)->pc = (cpu_context)->regs[1])
+#endif
+#if defined(__riscv)
+#define SHADOWHOOK_INTERCEPT_RETURN(cpu_context, value)                     \
+  do {                                                                      \
+    (cpu_context)->regs[10] = (__typeof__((cpu_context)->regs[10]))(value); \
+    SHADOWHOOK_INTERCEPT_RETURN_NOW(cpu_context);                           \
+  } while (0)  // a0
+#else
+#define SHADOWHOOK_INTERCEPT_RETURN(cpu_context, value)                   \
+  do {                                                                    \
+    (cpu_context)->regs[0] = (__typeof__((cpu_context)->regs[0]))(value); \
+    SHADOWHOOK_INTERCEPT_RETURN_NOW(cpu_context);                         \
+  } while (0)
+#endif
 typedef void (*shadowhook_interceptor_t)(shadowhook_cpu_context_t *cpu_context, void *data);
 typedef void (*shadowhook_intercepted_t)(int error_number, const char *lib_name, const char *sym_name,
                                          void *sym_addr, shadowhook_interceptor_t pre, void *data, void *arg);
@@ -197,6 +287,23 @@ void *shadowhook_intercept_sym_name_callback(const char *lib_name, const char *s
                                              shadowhook_intercepted_t intercepted, void *intercepted_arg);
 int shadowhook_unintercept(void *stub);
 
+// unhook and unintercept in bulk (the affected stubs become invalid, probes are skipped)
+int shadowhook_unhook_all(void);
+int shadowhook_unhook_by_lib(const char *lib_name);  // created by code in lib_name
+
+// query hooked and intercepted target addresses (lock-free, safe to call from any thread)
+typedef struct {
+  void *target_addr;
+  uint32_t hook_mode;       // SHADOWHOOK_HOOK_WITH_*_MODE bits, 0 = intercepted only
+  size_t proxies_cnt;       // number of proxy functions (unique + multi + shared)
+  size_t interceptors_cnt;  // number of interceptors
+  size_t backup_len;        // number of bytes overwritten at target_addr
+  size_t islands_cnt;       // number of islands in use
+} shadowhook_hook_info_t;
+typedef bool (*shadowhook_hook_info_cb_t)(const shadowhook_hook_info_t *info, void *arg);  // false to stop
+bool shadowhook_is_hooked(void *addr);
+int shadowhook_foreach_hook(shadowhook_hook_info_cb_t cb, void *arg);
+
 // get operation records
 #define SHADOWHOOK_RECORD_ITEM_ALL             0x7FF  // 0b11111111111
 #define SHADOWHOOK_RECORD_ITEM_TIMESTAMP       (1 << 0)
@@ -233,6 +340,8 @@ void shadowhook_pop_stack(void *return_address);
 void shadowhook_allow_reentrant(void *return_address);
 void shadowhook_disallow_reentrant(void *return_address);
 void *shadowhook_get_return_address(void);
+void *shadowhook_get_data(void *func);
+void shadowhook_report_fault(void *func);
 
 #ifdef __cplusplus
 }
@@ -274,4 +383,10 @@ class ShadowhookStackScope {
 // get return address in proxy-function
 #define SHADOWHOOK_RETURN_ADDRESS() shadowhook_get_return_address()
 
+// get the user data passed to shadowhook_hook_*_with_data() in proxy-function
+#define SHADOWHOOK_GET_DATA(func) shadowhook_get_data((void *)(func))
+
+// report a fault caught in proxy-function to the circuit breaker
+#define SHADOWHOOK_REPORT_FAULT(func) shadowhook_report_fault((void *)(func))
+
 #endif
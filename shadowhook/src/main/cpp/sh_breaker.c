@@ -0,0 +1,190 @@
+// Copyright (c) 2021-2025 ByteDance Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include "sh_breaker.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "sh_log.h"
+#include "sh_recorder.h"
+#include "shadowhook.h"
+
+#define SH_BREAKER_SAMPLE_MASK 63  // time 1 of every 64 calls
+#define SH_BREAKER_SLOW_MAX    8   // trip after 8 consecutive slow samples
+#define SH_BREAKER_TRIP_CNT    16  // trips waiting for the breaker thread
+
+#define SH_BREAKER_TRIP_FREE    0
+#define SH_BREAKER_TRIP_WRITING 1
+#define SH_BREAKER_TRIP_READY   2
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wpadded"
+typedef struct {
+  uintptr_t target_addr;
+  void *func;
+  int reason;
+  uint8_t state;  // atomic
+} sh_breaker_trip_t;
+#pragma clang diagnostic pop
+
+// global config (0 = disabled)
+static uint32_t sh_breaker_max_faults = 0;
+static uint64_t sh_breaker_max_latency_ns = 0;
+static shadowhook_tripped_t sh_breaker_tripped = NULL;
+static void *sh_breaker_tripped_arg = NULL;
+
+// trips are written here (maybe in a signal handler), and reported by the breaker thread
+static sh_breaker_trip_t sh_breaker_trips[SH_BREAKER_TRIP_CNT];
+static uint32_t sh_breaker_trips_idx = 0;
+static sem_t sh_breaker_sem;
+static bool sh_breaker_thread_started = false;
+static pthread_mutex_t sh_breaker_thread_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t sh_breaker_get_nsec(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void sh_breaker_report(sh_breaker_trip_t *trip) {
+  SH_LOG_WARN("breaker: tripped, target %" PRIxPTR ", func %" PRIxPTR ", reason %d", trip->target_addr,
+              (uintptr_t)trip->func, trip->reason);
+  sh_recorder_add_op(SHADOWHOOK_ERRNO_TRIPPED, SH_RECORDER_OP_TRIP, trip->target_addr, "unknown", "unknown",
+                     (uintptr_t)trip->func, 0, 0, 0, (uintptr_t)trip->func, NULL);
+
+  shadowhook_tripped_t tripped = __atomic_load_n(&sh_breaker_tripped, __ATOMIC_ACQUIRE);
+  void *arg = __atomic_load_n(&sh_breaker_tripped_arg, __ATOMIC_RELAXED);
+  if (NULL != tripped) tripped((void *)trip->target_addr, trip->func, trip->reason, arg);
+}
+
+static void *sh_breaker_thread_func(void *arg) {
+  (void)arg;
+  pthread_setname_np(pthread_self(), "shadowhook-brk");
+
+  while (0 == sem_wait(&sh_breaker_sem) || EINTR == errno) {
+    for (size_t i = 0; i < SH_BREAKER_TRIP_CNT; i++) {
+      sh_breaker_trip_t *slot = &sh_breaker_trips[i];
+      if (SH_BREAKER_TRIP_READY != __atomic_load_n(&slot->state, __ATOMIC_ACQUIRE)) continue;
+      sh_breaker_trip_t trip = *slot;
+      __atomic_store_n(&slot->state, SH_BREAKER_TRIP_FREE, __ATOMIC_RELEASE);
+      sh_breaker_report(&trip);
+    }
+  }
+
+  SH_LOG_WARN("breaker: sem_wait failed, errno %d", errno);
+  return NULL;
+}
+
+static void sh_breaker_start_thread(void) {
+  if (__atomic_load_n(&sh_breaker_thread_started, __ATOMIC_ACQUIRE)) return;
+
+  pthread_mutex_lock(&sh_breaker_thread_lock);
+  if (!sh_breaker_thread_started) {
+    pthread_t thd;
+    if (0 != sem_init(&sh_breaker_sem, 0, 0)) {
+      SH_LOG_WARN("breaker: sem_init failed");
+    } else if (0 != pthread_create(&thd, NULL, &sh_breaker_thread_func, NULL)) {
+      sem_destroy(&sh_breaker_sem);
+      SH_LOG_WARN("breaker: pthread_create failed");
+    } else {
+      pthread_detach(thd);
+      __atomic_store_n(&sh_breaker_thread_started, true, __ATOMIC_RELEASE);
+    }
+  }
+  pthread_mutex_unlock(&sh_breaker_thread_lock);
+}
+
+void sh_breaker_set(uint32_t max_faults, uint64_t max_latency_ns, shadowhook_tripped_t tripped, void *arg) {
+  // without the breaker thread, the items still trip, but the trips are not reported
+  if (0 != max_faults || 0 != max_latency_ns) sh_breaker_start_thread();
+
+  __atomic_store_n(&sh_breaker_tripped_arg, arg, __ATOMIC_RELAXED);
+  __atomic_store_n(&sh_breaker_tripped, tripped, __ATOMIC_RELEASE);
+  __atomic_store_n(&sh_breaker_max_faults, max_faults, __ATOMIC_RELAXED);
+  __atomic_store_n(&sh_breaker_max_latency_ns, max_latency_ns, __ATOMIC_RELAXED);
+}
+
+bool sh_breaker_is_armed(void) {
+  return 0 != __atomic_load_n(&sh_breaker_max_faults, __ATOMIC_RELAXED);
+}
+
+void sh_breaker_reset(sh_breaker_t *self) {
+  self->faults = 0;
+  self->calls = 0;
+  self->slow_samples = 0;
+}
+
+static void sh_breaker_trip(bool *enabled, uintptr_t target_addr, void *func, int reason) {
+  // only the first thread that disables the item reports it, and the item may have been
+  // disabled by unhook / unintercept at the same time
+  bool expected = true;
+  if (!__atomic_compare_exchange_n(enabled, &expected, false, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+    return;
+
+  // hand over to the breaker thread, drop the report if all slots are in use
+  uint32_t idx = __atomic_fetch_add(&sh_breaker_trips_idx, 1, __ATOMIC_RELAXED) % SH_BREAKER_TRIP_CNT;
+  sh_breaker_trip_t *slot = &sh_breaker_trips[idx];
+  uint8_t state = SH_BREAKER_TRIP_FREE;
+  if (!__atomic_compare_exchange_n(&slot->state, &state, SH_BREAKER_TRIP_WRITING, false, __ATOMIC_ACQUIRE,
+                                   __ATOMIC_RELAXED))
+    return;
+  slot->target_addr = target_addr;
+  slot->func = func;
+  slot->reason = reason;
+  __atomic_store_n(&slot->state, SH_BREAKER_TRIP_READY, __ATOMIC_RELEASE);
+  if (__atomic_load_n(&sh_breaker_thread_started, __ATOMIC_ACQUIRE)) sem_post(&sh_breaker_sem);
+}
+
+uint64_t sh_breaker_sample(sh_breaker_t *self) {
+  if (__predict_true(0 == __atomic_load_n(&sh_breaker_max_latency_ns, __ATOMIC_RELAXED))) return 0;
+
+  uint32_t calls = __atomic_load_n(&self->calls, __ATOMIC_RELAXED) + 1;
+  __atomic_store_n(&self->calls, calls, __ATOMIC_RELAXED);
+  return 0 == (calls & SH_BREAKER_SAMPLE_MASK) ? sh_breaker_get_nsec() : 0;
+}
+
+void sh_breaker_check_latency(sh_breaker_t *self, bool *enabled, uintptr_t target_addr, void *func,
+                              uint64_t sample_ts) {
+  uint64_t max_latency_ns = __atomic_load_n(&sh_breaker_max_latency_ns, __ATOMIC_RELAXED);
+  if (0 == max_latency_ns) return;
+
+  if (sh_breaker_get_nsec() - sample_ts <= max_latency_ns) {
+    __atomic_store_n(&self->slow_samples, 0, __ATOMIC_RELAXED);
+    return;
+  }
+  uint32_t slow_samples = __atomic_add_fetch(&self->slow_samples, 1, __ATOMIC_RELAXED);
+  if (slow_samples >= SH_BREAKER_SLOW_MAX)
+    sh_breaker_trip(enabled, target_addr, func, SHADOWHOOK_TRIPPED_BY_LATENCY);
+}
+
+uint32_t sh_breaker_add_fault(sh_breaker_t *self, bool *enabled, uintptr_t target_addr, void *func) {
+  uint32_t faults = __atomic_add_fetch(&self->faults, 1, __ATOMIC_RELAXED);
+  uint32_t max_faults = __atomic_load_n(&sh_breaker_max_faults, __ATOMIC_RELAXED);
+  if (0 != max_faults && faults >= max_faults)
+    sh_breaker_trip(enabled, target_addr, func, SHADOWHOOK_TRIPPED_BY_FAULT);
+  return faults;
+}
@@ -0,0 +1,45 @@
+// Copyright (c) 2021-2025 ByteDance Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "shadowhook.h"
+
+// health counters for each proxy-function and interceptor
+typedef struct {
+  uint32_t faults;
+  uint32_t calls;
+  uint32_t slow_samples;
+} sh_breaker_t;
+
+void sh_breaker_set(uint32_t max_faults, uint64_t max_latency_ns, shadowhook_tripped_t tripped, void *arg);
+bool sh_breaker_is_armed(void);  // faults are counted
+
+void sh_breaker_reset(sh_breaker_t *self);
+
+// The following functions trip the item by clearing its enabled flag, the recorder entry and the
+// tripped callback are deferred to the breaker thread. They are async-signal-safe.
+uint64_t sh_breaker_sample(sh_breaker_t *self);
+void sh_breaker_check_latency(sh_breaker_t *self, bool *enabled, uintptr_t target_addr, void *func,
+                              uint64_t sample_ts);
+uint32_t sh_breaker_add_fault(sh_breaker_t *self, bool *enabled, uintptr_t target_addr, void *func);
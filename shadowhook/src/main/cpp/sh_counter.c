@@ -0,0 +1,268 @@
+// Copyright (c) 2021-2025 ByteDance Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include "sh_counter.h"
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sh_log.h"
+#include "sh_sig.h"
+#include "sh_trampo.h"
+#include "sh_util.h"
+#include "shadowhook.h"
+
+#define SH_COUNTER_DELAY_SEC 10
+
+// The slots are indexed by a hash of the thread pointer, so that threads rarely share a cache line.
+// The trampoline template hardcodes: index = ((tp >> 12) ^ (tp >> 20)) & 7, offset = index << 6
+#define SH_COUNTER_SLOT_CNT  8
+#define SH_COUNTER_SLOT_SIZE 64
+
+// trampoline layout: [code][data: slots_ptr, orig_addr][padding][slots]
+struct sh_counter {
+  uintptr_t trampo;
+};
+
+// global data for trampo
+static sh_trampo_mgr_t sh_counter_trampo_mgr;
+
+// global data for trampoline template
+static uintptr_t sh_counter_trampo_code_start;
+static size_t sh_counter_trampo_code_size;
+static size_t sh_counter_trampo_data_size;
+static size_t sh_counter_trampo_slots_offset;
+
+// counter trampoline template
+extern void *sh_counter_trampo_template_data __attribute__((visibility("hidden")));
+__attribute__((naked)) static void sh_counter_trampo_template(void) {
+#if defined(__arm__)
+  __asm__(
+      // Save scratch registers
+      "push   {r0 - r3}                  \n"
+
+      // Get the slot of the current thread
+      "ldr    r0, .L_counter_slots       \n"
+      "mrc    p15, 0, r1, c13, c0, 3     \n"
+      "lsr    r1, r1, #12                \n"
+      "eor    r1, r1, r1, lsr #8         \n"
+      "and    r1, r1, #7                 \n"
+      "add    r0, r0, r1, lsl #6         \n"
+
+      // Atomic increment
+      "1:                                \n"
+      "ldrexd r2, r3, [r0]               \n"
+      "adds   r2, r2, #1                 \n"
+      "adc    r3, r3, #0                 \n"
+      "strexd r1, r2, r3, [r0]           \n"
+      "cmp    r1, #0                     \n"
+      "bne    1b                         \n"
+
+      // Restore scratch registers
+      "pop    {r0 - r3}                  \n"
+
+      // Call the original function
+      "ldr    ip, .L_counter_orig        \n"
+      "bx     ip                         \n"
+
+      ".balign 4;"
+      "sh_counter_trampo_template_data:"
+      ".global sh_counter_trampo_template_data;"
+      ".L_counter_slots:"
+      ".word 0;"
+      ".L_counter_orig:"
+      ".word 0;");
+#elif defined(__aarch64__)
+  __asm__(
+      // Save scratch register
+      "str    x0, [sp, #-0x10]!          \n"
+
+      // Get the slot of the current thread
+      "ldr    x16, .L_counter_slots      \n"
+      "mrs    x17, tpidr_el0             \n"
+      "lsr    x17, x17, #12              \n"
+      "eor    x17, x17, x17, lsr #8      \n"
+      "and    x17, x17, #7               \n"
+      "add    x16, x16, x17, lsl #6      \n"
+
+      // Atomic increment
+      "1:                                \n"
+      "ldxr   x17, [x16]                 \n"
+      "add    x17, x17, #1               \n"
+      "stxr   w0, x17, [x16]             \n"
+      "cbnz   w0, 1b                     \n"
+
+      // Restore scratch register
+      "ldr    x0, [sp], #0x10            \n"
+
+      // Call the original function
+      "ldr    x16, .L_counter_orig       \n"
+      "br     x16                        \n"
+
+      ".balign 8;"
+      "sh_counter_trampo_template_data:"
+      ".global sh_counter_trampo_template_data;"
+      ".L_counter_slots:"
+      ".quad 0;"
+      ".L_counter_orig:"
+      ".quad 0;");
+#elif defined(__x86_64__)
+  __asm__(
+      // Get the slot of the current thread (R10 and R11 are free at the function entry)
+      "mov    %fs:0, %r11                \n"
+      "shr    $12, %r11                  \n"
+      "mov    %r11, %r10                 \n"
+      "shr    $8, %r10                   \n"
+      "xor    %r10, %r11                 \n"
+      "and    $7, %r11                   \n"
+      "shl    $6, %r11                   \n"
+      "add    .L_counter_slots(%rip), %r11 \n"
+
+      // Atomic increment
+      "lock incq (%r11)                  \n"
+
+      // Call the original function
+      "jmp    *.L_counter_orig(%rip)     \n"
+
+      ".balign 8;"
+      "sh_counter_trampo_template_data:"
+      ".global sh_counter_trampo_template_data;"
+      ".L_counter_slots:"
+      ".quad 0;"
+      ".L_counter_orig:"
+      ".quad 0;");
+#elif defined(__riscv)
+  __asm__(
+      ".option push                      \n"
+      ".option norelax                   \n"
+
+      // Get the slot of the current thread (T1 and T3 are free at the function entry)
+      "srli   t1, tp, 12                 \n"
+      "srli   t3, t1, 8                  \n"
+      "xor    t1, t1, t3                 \n"
+      "andi   t1, t1, 7                  \n"
+      "slli   t1, t1, 6                  \n"
+      "ld     t3, .L_counter_slots       \n"
+      "add    t3, t3, t1                 \n"
+
+      // Atomic increment
+      "li     t1, 1                      \n"
+      "amoadd.d zero, t1, (t3)           \n"
+
+      // Call the original function
+      "ld     t1, .L_counter_orig        \n"
+      "jr     t1                         \n"
+
+      ".balign 8;"
+      "sh_counter_trampo_template_data:"
+      ".global sh_counter_trampo_template_data;"
+      ".L_counter_slots:"
+      ".quad 0;"
+      ".L_counter_orig:"
+      ".quad 0;"
+      ".option pop;");
+#endif
+}
+
+void sh_counter_init(void) {
+  sh_counter_trampo_code_start = (uintptr_t)&sh_counter_trampo_template;
+#if defined(__arm__) && defined(__thumb__)
+  sh_counter_trampo_code_start = SH_UTIL_CLEAR_BIT0(sh_counter_trampo_code_start);
+#endif
+  sh_counter_trampo_code_size = (uintptr_t)(&sh_counter_trampo_template_data) - sh_counter_trampo_code_start;
+  sh_counter_trampo_data_size = sizeof(void *) + sizeof(void *);
+  sh_counter_trampo_slots_offset = SH_UTIL_ALIGN_END(sh_counter_trampo_code_size + sh_counter_trampo_data_size,
+                                                     SH_COUNTER_SLOT_SIZE);
+  size_t trampo_size = sh_counter_trampo_slots_offset + SH_COUNTER_SLOT_CNT * SH_COUNTER_SLOT_SIZE;
+
+  // the trampo size is a multiple of the slot size, so the slots in each trampo are cache line aligned
+  sh_trampo_init_mgr(&sh_counter_trampo_mgr, trampo_size, SH_COUNTER_DELAY_SEC);
+}
+
+int sh_counter_create(sh_counter_t **self) {
+  *self = NULL;
+
+  sh_counter_t *obj = malloc(sizeof(sh_counter_t));
+  if (NULL == obj) return SHADOWHOOK_ERRNO_OOM;
+
+  // alloc memory for trampoline
+  if (0 == (obj->trampo = sh_trampo_alloc(&sh_counter_trampo_mgr))) {
+    free(obj);
+    return SHADOWHOOK_ERRNO_OOM;
+  }
+
+  // fill in code
+  SH_SIG_TRY(SIGSEGV, SIGBUS) {
+    memcpy((void *)sh_trampo_get_rw_addr(obj->trampo), (void *)sh_counter_trampo_code_start,
+           sh_counter_trampo_code_size);
+  }
+  SH_SIG_CATCH() {
+    sh_trampo_free(&sh_counter_trampo_mgr, obj->trampo);
+    free(obj);
+    SH_LOG_WARN("counter: fill in code crashed");
+    return SHADOWHOOK_ERRNO_OOM;
+  }
+  SH_SIG_EXIT
+
+  // fill in data, reset slots (the trampoline increments the slots via the writable address)
+  uintptr_t trampo_rw = sh_trampo_get_rw_addr(obj->trampo);
+  uintptr_t slots = trampo_rw + sh_counter_trampo_slots_offset;
+  memset((void *)slots, 0, SH_COUNTER_SLOT_CNT * SH_COUNTER_SLOT_SIZE);
+  void **data = (void **)(trampo_rw + sh_counter_trampo_code_size);
+  *data++ = (void *)slots;
+  *data = NULL;  // orig_addr, set by switch
+
+  // clear CPU cache
+  sh_util_clear_cache(obj->trampo, sh_counter_trampo_code_size + sh_counter_trampo_data_size);
+
+  SH_LOG_INFO("counter: create trampo at %" PRIxPTR ", size %zu + %zu", obj->trampo,
+              sh_counter_trampo_code_size, sh_counter_trampo_data_size);
+  *self = obj;
+  return 0;
+}
+
+void sh_counter_destroy(sh_counter_t *self) {
+  // threads may still be running in the trampoline, it is freed with a delay by the trampo manager
+  if (0 != self->trampo) sh_trampo_free(&sh_counter_trampo_mgr, self->trampo);
+  free(self);
+}
+
+uintptr_t sh_counter_get_trampo_addr(sh_counter_t *self) {
+#if defined(__arm__) && defined(__thumb__)
+  return self->trampo + 1;
+#else
+  return self->trampo;
+#endif
+}
+
+uintptr_t *sh_counter_get_orig_addr(sh_counter_t *self) {
+  return (uintptr_t *)(sh_trampo_get_rw_addr(self->trampo) + sh_counter_trampo_code_size + sizeof(void *));
+}
+
+uint64_t sh_counter_get(sh_counter_t *self) {
+  uint64_t sum = 0;
+  uintptr_t slots = sh_trampo_get_rw_addr(self->trampo) + sh_counter_trampo_slots_offset;
+  for (size_t i = 0; i < SH_COUNTER_SLOT_CNT; i++)
+    sum += __atomic_load_n((uint64_t *)(slots + i * SH_COUNTER_SLOT_SIZE), __ATOMIC_RELAXED);
+  return sum;
+}
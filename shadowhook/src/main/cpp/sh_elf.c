@@ -46,6 +46,10 @@
 #define SH_ELF_UNIT_SIZE 8
 #elif defined(__aarch64__)
 #define SH_ELF_UNIT_SIZE 4
+#elif defined(__x86_64__)
+#define SH_ELF_UNIT_SIZE 16
+#elif defined(__riscv)
+#define SH_ELF_UNIT_SIZE 8
 #endif
 
 extern __attribute((weak)) unsigned long int getauxval(unsigned long int);
@@ -82,7 +86,7 @@ static sh_elf_useless_symbol_t sh_elf_useless_linker[] = {
 // __linker_init_post_relocation
 #if defined(__arm__)
     {"__dl__ZL29__linker_init_post_relocationR19KernelArgumentBlockj", 21, 26, false, true},
-#elif defined(__aarch64__)
+#elif defined(__aarch64__) || defined(__x86_64__) || defined(__riscv)
     {"__dl__ZL29__linker_init_post_relocationR19KernelArgumentBlocky", 21, 26, false, true},
 #endif
     {"__dl__ZL29__linker_init_post_relocationR19KernelArgumentBlock", 27, 28, false, true},
@@ -110,7 +114,7 @@ static sh_elf_useless_symbol_t sh_elf_useless_libandroid_runtime[] = {
 static sh_elf_useless_t sh_elf_useless[] = {
 #if defined(__arm__)
     USELESS_ITEM(linker, sh_elf_useless_linker),
-#elif defined(__aarch64__)
+#elif defined(__aarch64__) || defined(__x86_64__) || defined(__riscv)
     USELESS_ITEM(linker64, sh_elf_useless_linker),
 #endif
     USELESS_ITEM(libart.so, sh_elf_useless_libart),
@@ -358,8 +362,10 @@ static sh_elf_t *sh_elf_find_by_pc(uintptr_t pc) {
 // range: [range_low, range_high]
 static uintptr_t sh_elf_alloc_in_gap(size_t size, uintptr_t range_low, uintptr_t range_high, sh_elf_t *elf,
                                      sh_elf_gap_t *gap, uint32_t now) {
-  // arm   : size = 8             , SH_ELF_UNIT_SIZE = 8
-  // arm64 : size = 8 or 16 or 20 , SH_ELF_UNIT_SIZE = 4
+  // arm    : size = 8             , SH_ELF_UNIT_SIZE = 8
+  // arm64  : size = 8 or 16 or 20 , SH_ELF_UNIT_SIZE = 4
+  // x86_64 : size = 16            , SH_ELF_UNIT_SIZE = 16
+  // riscv64: size = 24            , SH_ELF_UNIT_SIZE = 8
   size_t n_unit = size / SH_ELF_UNIT_SIZE;  // the remainder is definitely 0
 
   for (size_t i = 0; i < gap->trampo_count - n_unit + 1; i++) {
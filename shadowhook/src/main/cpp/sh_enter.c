@@ -23,30 +23,80 @@
 
 #include "sh_enter.h"
 
+#include <stddef.h>
 #include <stdint.h>
 
-#include "sh_config.h"
 #include "sh_trampo.h"
 
-#define SH_ENTER_ANON_PAGE_NAME "shadowhook-enter"
-#define SH_ENTER_DELAY_SEC      10
+#define SH_ENTER_DELAY_SEC 10
 
-#ifdef SH_CONFIG_TRY_HOOK_WITHOUT_ISLAND
-#define SH_ENTER_SZ 256
-#else
-#define SH_ENTER_SZ 64
+// size classes of enter, each one is backed by its own trampo manager
+#define SH_ENTER_SZ_CNT 4
+static const size_t sh_enter_sizes[SH_ENTER_SZ_CNT] = {32, 64, 128, 256};
+
+// the enter jumps back to (near) pc with a relative branch when it is within this range
+#if defined(__aarch64__)
+#define SH_ENTER_NEAR_RANGE (134217728)  // B: [-128M, +128M - 4]
+#elif defined(__arm__)
+#define SH_ENTER_NEAR_RANGE (16777216)  // B.W (T4): [-16M, +16M - 2], B (A1) is wider
+#elif defined(__x86_64__)
+#define SH_ENTER_NEAR_RANGE (2147483647)  // JMP rel32: [-2G, +2G - 1]
+#elif defined(__riscv)
+#define SH_ENTER_NEAR_RANGE (1048574)  // JAL: [-1M, +1M - 2]
 #endif
 
-static sh_trampo_mgr_t sh_enter_trampo_mgr;
+static sh_trampo_mgr_t sh_enter_trampo_mgrs[SH_ENTER_SZ_CNT];
 
 void sh_enter_init(void) {
-  sh_trampo_init_mgr(&sh_enter_trampo_mgr, SH_ENTER_ANON_PAGE_NAME, SH_ENTER_SZ, SH_ENTER_DELAY_SEC);
+  for (size_t i = 0; i < SH_ENTER_SZ_CNT; i++)
+    sh_trampo_init_mgr(&sh_enter_trampo_mgrs[i], sh_enter_sizes[i], SH_ENTER_DELAY_SEC);
+}
+
+size_t sh_enter_get_max_size(void) {
+  return sh_enter_sizes[SH_ENTER_SZ_CNT - 1];
+}
+
+static sh_trampo_mgr_t *sh_enter_get_mgr(size_t size) {
+  for (size_t i = 0; i < SH_ENTER_SZ_CNT; i++)
+    if (size == sh_enter_sizes[i]) return &sh_enter_trampo_mgrs[i];
+  return NULL;
+}
+
+size_t sh_enter_get_size(size_t len) {
+  for (size_t i = 0; i < SH_ENTER_SZ_CNT; i++)
+    if (len <= sh_enter_sizes[i]) return sh_enter_sizes[i];
+  return 0;  // too long
+}
+
+uintptr_t sh_enter_alloc(size_t size) {
+  sh_trampo_mgr_t *mgr = sh_enter_get_mgr(size);
+  if (NULL == mgr) return 0;
+
+  return sh_trampo_alloc(mgr);
+}
+
+uintptr_t sh_enter_alloc_near(uintptr_t pc, size_t size) {
+  sh_trampo_mgr_t *mgr = sh_enter_get_mgr(size);
+  if (NULL == mgr) return 0;
+
+  // keep the whole enter (and the jump back at its end) within the range
+  uintptr_t range = SH_ENTER_NEAR_RANGE - size;
+  uintptr_t range_low = pc > range ? pc - range : 0;
+  uintptr_t range_high = UINTPTR_MAX - pc > range ? pc + range : UINTPTR_MAX;
+
+  uintptr_t enter = sh_trampo_alloc_between(mgr, range_low, range_high);
+  if (0 != enter) return enter;
+
+  return sh_trampo_alloc(mgr);
 }
 
-uintptr_t sh_enter_alloc(void) {
-  return sh_trampo_alloc(&sh_enter_trampo_mgr);
+void sh_enter_free(uintptr_t enter, size_t size) {
+  sh_trampo_mgr_t *mgr = sh_enter_get_mgr(size);
+  if (NULL == mgr) return;
+
+  sh_trampo_free(mgr, enter);
 }
 
-void sh_enter_free(uintptr_t enter) {
-  sh_trampo_free(&sh_enter_trampo_mgr, enter);
+uintptr_t sh_enter_get_rw_addr(uintptr_t enter) {
+  return sh_trampo_get_rw_addr(enter);
 }
@@ -22,9 +22,16 @@
 // Created by Kelun Cai (caikelun@bytedance.com) on 2021-04-11.
 
 #pragma once
+#include <stddef.h>
 #include <stdint.h>
 
 void sh_enter_init(void);
 
-uintptr_t sh_enter_alloc(void);
-void sh_enter_free(uintptr_t enter);
+// size: one of the size classes, returned by sh_enter_get_size()
+size_t sh_enter_get_max_size(void);
+size_t sh_enter_get_size(size_t len);
+
+uintptr_t sh_enter_alloc(size_t size);
+uintptr_t sh_enter_alloc_near(uintptr_t pc, size_t size);
+void sh_enter_free(uintptr_t enter, size_t size);
+uintptr_t sh_enter_get_rw_addr(uintptr_t enter);
@@ -0,0 +1,714 @@
+// Copyright (c) 2021-2025 ByteDance Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include "sh_histo.h"
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <time.h>
+
+#include "queue.h"
+#include "sh_log.h"
+#include "sh_safe.h"
+#include "sh_sig.h"
+#include "sh_trampo.h"
+#include "sh_util.h"
+#include "shadowhook.h"
+
+#define SH_HISTO_STACK_ANON_PAGE_NAME "shadowhook-histo-stack"
+#define SH_HISTO_STACK_SIZE           4096
+#define SH_HISTO_STACK_FRAME_MAX      120  // keep sizeof(sh_histo_stack_t) < 4K
+#define SH_HISTO_STRIPE_CNT           8
+#define SH_HISTO_DELAY_SEC            10
+#define SH_HISTO_THREAD_CNT           256
+
+// frame in the shadow stack, one for each in-flight call
+// (reg and lr are read by the CFI of shadowhook_histogram_glue, keep them at the beginning)
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wpadded"
+struct sh_histo_frame {
+  uintptr_t reg;  // the caller's value of the register that holds the frame address (x28/r10/r15/s11)
+  uintptr_t lr;
+  sh_histo_t *histo;
+  uint64_t ts;
+};
+
+// shadow stack for each thread
+typedef struct {
+  size_t frames_cnt;
+  bool busy;  // reading the clock, do not record the functions called by ourselves
+  sh_histo_frame_t frames[SH_HISTO_STACK_FRAME_MAX];
+} sh_histo_stack_t;
+#pragma clang diagnostic pop
+
+// buckets and in-flight count, striped by thread to avoid sharing cache lines
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wpadded"
+typedef struct {
+  uint64_t buckets[SHADOWHOOK_HISTOGRAM_BUCKET_CNT];
+  int64_t inflight;
+} __attribute__((aligned(64))) sh_histo_stripe_t;
+
+struct sh_histo {
+  uintptr_t trampo;
+  time_t retire_ts;
+  TAILQ_ENTRY(sh_histo, ) link;
+  sh_histo_stripe_t stripes[SH_HISTO_STRIPE_CNT];
+};
+#pragma clang diagnostic pop
+
+// retired histo queue (freed after all in-flight calls have returned)
+typedef TAILQ_HEAD(sh_histo_queue, sh_histo, ) sh_histo_queue_t;
+static sh_histo_queue_t sh_histos_retired = TAILQ_HEAD_INITIALIZER(sh_histos_retired);
+static pthread_mutex_t sh_histo_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// global data for trampo
+static sh_trampo_mgr_t sh_histo_trampo_mgr;
+
+// global data for stack
+static pthread_key_t sh_histo_stack_tls_key;
+static pthread_key_t sh_histo_stack_reserved_tls_key;
+
+#if defined(__aarch64__)
+// the stacks of the threads, indexed by the hash of TPIDR_EL0, so that the entry trampoline can push a frame
+// without calling any function. a thread whose slot is taken by another thread takes the slow path.
+typedef struct {
+  uintptr_t tp;
+  sh_histo_stack_t *stack;
+} sh_histo_thread_t;
+static sh_histo_thread_t sh_histo_threads[SH_HISTO_THREAD_CNT];
+
+// the offsets used by the fast path of the entry trampoline
+_Static_assert(sizeof(sh_histo_thread_t) == 0x10 && SH_HISTO_THREAD_CNT == 0x100, "histo: thread slot");
+_Static_assert(offsetof(sh_histo_stack_t, busy) == 0x8 && offsetof(sh_histo_stack_t, frames) == 0x10 &&
+                   sizeof(sh_histo_frame_t) == 0x20 && SH_HISTO_STACK_FRAME_MAX == 120,
+               "histo: stack");
+_Static_assert(offsetof(sh_histo_t, stripes) == 0x40 && sizeof(sh_histo_stripe_t) == 0x140 &&
+                   offsetof(sh_histo_stripe_t, inflight) == 0x100 && SH_HISTO_STRIPE_CNT == 8,
+               "histo: stripe");
+#endif
+
+// global data for trampoline template
+static uintptr_t sh_histo_trampo_code_start;
+static size_t sh_histo_trampo_code_size;
+static size_t sh_histo_trampo_data_size;
+
+#if defined(__aarch64__)
+static uint64_t sh_histo_cntfrq;
+#endif
+
+// entry trampoline template:
+// push a frame (inline on arm64 when the stack of the thread is in its slot, otherwise by calling
+// sh_histo_enter()), then call the original function with the exit glue as LR.
+// while the original function runs, a callee-saved register (x28/r10/r15/s11) points to the frame,
+// which holds the caller's value of that register and the real LR. shadowhook_histogram_glue's CFI
+// describes them, so the stack can be unwound through the original function.
+extern void *sh_histo_trampo_template_data __attribute__((visibility("hidden")));
+extern void shadowhook_histogram_glue_ret(void);
+__attribute__((naked)) static void sh_histo_trampo_template(void) {
+#if defined(__arm__)
+  __asm__(
+      // Save parameter registers, LR (r4 is only for 8-byte stack alignment)
+      "push  {r0 - r4, lr}       \n"
+
+      // Call sh_histo_enter()
+      "ldr   r0, .L_histo_ptr    \n"
+      "mov   r1, lr              \n"
+      "mov   r2, r10             \n"
+      "ldr   ip, .L_histo_enter  \n"
+      "blx   ip                  \n"
+
+      // Save the frame address to IP register
+      "mov   ip, r0              \n"
+
+      // Restore parameter registers, LR
+      "pop   {r0 - r4, lr}       \n"
+
+      // No frame is pushed, keep LR
+      "cmp   ip, #0              \n"
+      "beq   1f                  \n"
+
+      // Point R10 to the frame, replace LR with the exit glue
+      "mov   r10, ip             \n"
+      "ldr   lr, .L_histo_exit   \n"
+
+      // Call the original function
+      "1:                        \n"
+      "ldr   ip, .L_histo_orig   \n"
+      "bx    ip                  \n"
+
+      ".balign 4;"
+      "sh_histo_trampo_template_data:"
+      ".global sh_histo_trampo_template_data;"
+      ".L_histo_enter:"
+      ".word 0;"
+      ".L_histo_ptr:"
+      ".word 0;"
+      ".L_histo_orig:"
+      ".word 0;"
+      ".L_histo_exit:"
+      ".word 0;");
+#elif defined(__aarch64__)
+  __asm__(
+      // Fast path: get the stack of the current thread from its slot (X9 - X17 are free at the entry)
+      "mrs   x9, tpidr_el0            \n"
+      "lsr   x10, x9, #12             \n"
+      "eor   x10, x10, x10, lsr #8    \n"
+      "and   x10, x10, #0xff          \n"
+      "ldr   x11, .L_histo_threads    \n"
+      "add   x11, x11, x10, lsl #4    \n"
+      "ldp   x12, x13, [x11]          \n"
+      "cmp   x12, x9                  \n"
+      "b.ne  2f                       \n"
+      "cbz   x13, 2f                  \n"
+
+      // The stack is busy or full, let sh_histo_enter() decide
+      "ldrb  w14, [x13, #0x8]         \n"
+      "cbnz  w14, 2f                  \n"
+      "ldr   x14, [x13]               \n"
+      "cmp   x14, #120                \n"
+      "b.hs  2f                       \n"
+
+      // Atomic increment the in-flight count of the stripe
+      "ldr   x16, .L_histo_ptr        \n"
+      "lsr   x10, x13, #12            \n"
+      "eor   x10, x10, x10, lsr #8    \n"
+      "and   x10, x10, #7             \n"
+      "mov   x11, #0x140              \n"
+      "madd  x11, x10, x11, x16       \n"
+      "add   x11, x11, #0x140         \n"
+      "3:                             \n"
+      "ldxr  x12, [x11]               \n"
+      "add   x12, x12, #1             \n"
+      "stxr  w10, x12, [x11]          \n"
+      "cbnz  w10, 3b                  \n"
+
+      // Push a new frame (count it first, so that a signal handler pushes above it)
+      "add   x15, x13, #0x10          \n"
+      "add   x15, x15, x14, lsl #5    \n"
+      "add   x14, x14, #1             \n"
+      "str   x14, [x13]               \n"
+      "isb                            \n"
+      "mrs   x12, cntvct_el0          \n"
+      "stp   x28, lr, [x15]           \n"
+      "stp   x16, x12, [x15, #0x10]   \n"
+
+      // Point X28 to the frame, replace LR with the exit glue, call the original function
+      "mov   x28, x15                 \n"
+      "ldr   lr, .L_histo_exit        \n"
+      "ldr   x16, .L_histo_orig       \n"
+      "br    x16                      \n"
+
+      // Slow path: save parameter registers, XR(X8), LR
+      "2:                             \n"
+      "stp   x0, x1, [sp, #-0xd0]!    \n"
+      "stp   x2, x3, [sp, #0x10]      \n"
+      "stp   x4, x5, [sp, #0x20]      \n"
+      "stp   x6, x7, [sp, #0x30]      \n"
+      "stp   x8, lr, [sp, #0x40]      \n"
+      "stp   q0, q1, [sp, #0x50]      \n"
+      "stp   q2, q3, [sp, #0x70]      \n"
+      "stp   q4, q5, [sp, #0x90]      \n"
+      "stp   q6, q7, [sp, #0xb0]      \n"
+
+      // Call sh_histo_enter()
+      "ldr   x0, .L_histo_ptr         \n"
+      "mov   x1, lr                   \n"
+      "mov   x2, x28                  \n"
+      "ldr   x16, .L_histo_enter      \n"
+      "blr   x16                      \n"
+
+      // Save the frame address to IP register
+      "mov   x17, x0                  \n"
+
+      // Restore parameter registers, XR(X8), LR
+      "ldp   q6, q7, [sp, #0xb0]      \n"
+      "ldp   q4, q5, [sp, #0x90]      \n"
+      "ldp   q2, q3, [sp, #0x70]      \n"
+      "ldp   q0, q1, [sp, #0x50]      \n"
+      "ldp   x8, lr, [sp, #0x40]      \n"
+      "ldp   x6, x7, [sp, #0x30]      \n"
+      "ldp   x4, x5, [sp, #0x20]      \n"
+      "ldp   x2, x3, [sp, #0x10]      \n"
+      "ldp   x0, x1, [sp], #0xd0      \n"
+
+      // No frame is pushed, keep LR
+      "cbz   x17, 1f                  \n"
+
+      // Point X28 to the frame, replace LR with the exit glue
+      "mov   x28, x17                 \n"
+      "ldr   lr, .L_histo_exit        \n"
+
+      // Call the original function
+      "1:                             \n"
+      "ldr   x16, .L_histo_orig       \n"
+      "br    x16                      \n"
+
+      ".balign 8;"
+      "sh_histo_trampo_template_data:"
+      ".global sh_histo_trampo_template_data;"
+      ".L_histo_enter:"
+      ".quad 0;"
+      ".L_histo_ptr:"
+      ".quad 0;"
+      ".L_histo_orig:"
+      ".quad 0;"
+      ".L_histo_exit:"
+      ".quad 0;"
+      ".L_histo_threads:"
+      ".quad 0;");
+#elif defined(__x86_64__)
+  __asm__(
+      // Save parameter registers, RAX (number of vector registers for varargs)
+      "push  %rdi                     \n"
+      "push  %rsi                     \n"
+      "push  %rdx                     \n"
+      "push  %rcx                     \n"
+      "push  %r8                      \n"
+      "push  %r9                      \n"
+      "push  %rax                     \n"
+      "sub   $0x80, %rsp              \n"
+      "movdqu %xmm0, 0x00(%rsp)       \n"
+      "movdqu %xmm1, 0x10(%rsp)       \n"
+      "movdqu %xmm2, 0x20(%rsp)       \n"
+      "movdqu %xmm3, 0x30(%rsp)       \n"
+      "movdqu %xmm4, 0x40(%rsp)       \n"
+      "movdqu %xmm5, 0x50(%rsp)       \n"
+      "movdqu %xmm6, 0x60(%rsp)       \n"
+      "movdqu %xmm7, 0x70(%rsp)       \n"
+
+      // Call sh_histo_enter()
+      "mov   .L_histo_ptr(%rip), %rdi \n"
+      "mov   0xb8(%rsp), %rsi         \n"
+      "mov   %r15, %rdx               \n"
+      "call  *.L_histo_enter(%rip)    \n"
+
+      // No frame is pushed, keep the return address
+      "test  %rax, %rax               \n"
+      "jz    1f                       \n"
+
+      // Point R15 to the frame, replace the return address with the exit glue
+      "mov   %rax, %r15               \n"
+      "mov   .L_histo_exit(%rip), %rax\n"
+      "mov   %rax, 0xb8(%rsp)         \n"
+
+      // Restore parameter registers, RAX
+      "1:                             \n"
+      "movdqu 0x70(%rsp), %xmm7       \n"
+      "movdqu 0x60(%rsp), %xmm6       \n"
+      "movdqu 0x50(%rsp), %xmm5       \n"
+      "movdqu 0x40(%rsp), %xmm4       \n"
+      "movdqu 0x30(%rsp), %xmm3       \n"
+      "movdqu 0x20(%rsp), %xmm2       \n"
+      "movdqu 0x10(%rsp), %xmm1       \n"
+      "movdqu 0x00(%rsp), %xmm0       \n"
+      "add   $0x80, %rsp              \n"
+      "pop   %rax                     \n"
+      "pop   %r9                      \n"
+      "pop   %r8                      \n"
+      "pop   %rcx                     \n"
+      "pop   %rdx                     \n"
+      "pop   %rsi                     \n"
+      "pop   %rdi                     \n"
+
+      // Call the original function
+      "jmp   *.L_histo_orig(%rip)     \n"
+
+      ".balign 8;"
+      "sh_histo_trampo_template_data:"
+      ".global sh_histo_trampo_template_data;"
+      ".L_histo_enter:"
+      ".quad 0;"
+      ".L_histo_ptr:"
+      ".quad 0;"
+      ".L_histo_orig:"
+      ".quad 0;"
+      ".L_histo_exit:"
+      ".quad 0;");
+#elif defined(__riscv)
+  __asm__(
+      ".option push                   \n"
+      ".option norelax                \n"
+
+      // Save parameter registers, RA
+      "addi  sp, sp, -0x90            \n"
+      "sd    a0, 0x00(sp)             \n"
+      "sd    a1, 0x08(sp)             \n"
+      "sd    a2, 0x10(sp)             \n"
+      "sd    a3, 0x18(sp)             \n"
+      "sd    a4, 0x20(sp)             \n"
+      "sd    a5, 0x28(sp)             \n"
+      "sd    a6, 0x30(sp)             \n"
+      "sd    a7, 0x38(sp)             \n"
+      "sd    ra, 0x40(sp)             \n"
+      "fsd   fa0, 0x48(sp)            \n"
+      "fsd   fa1, 0x50(sp)            \n"
+      "fsd   fa2, 0x58(sp)            \n"
+      "fsd   fa3, 0x60(sp)            \n"
+      "fsd   fa4, 0x68(sp)            \n"
+      "fsd   fa5, 0x70(sp)            \n"
+      "fsd   fa6, 0x78(sp)            \n"
+      "fsd   fa7, 0x80(sp)            \n"
+
+      // Call sh_histo_enter()
+      "ld    a0, .L_histo_ptr         \n"
+      "mv    a1, ra                   \n"
+      "mv    a2, s11                  \n"
+      "ld    t1, .L_histo_enter       \n"
+      "jalr  t1                       \n"
+
+      // Save the frame address to T1 register
+      "mv    t1, a0                   \n"
+
+      // Restore parameter registers, RA
+      "fld   fa7, 0x80(sp)            \n"
+      "fld   fa6, 0x78(sp)            \n"
+      "fld   fa5, 0x70(sp)            \n"
+      "fld   fa4, 0x68(sp)            \n"
+      "fld   fa3, 0x60(sp)            \n"
+      "fld   fa2, 0x58(sp)            \n"
+      "fld   fa1, 0x50(sp)            \n"
+      "fld   fa0, 0x48(sp)            \n"
+      "ld    ra, 0x40(sp)             \n"
+      "ld    a7, 0x38(sp)             \n"
+      "ld    a6, 0x30(sp)             \n"
+      "ld    a5, 0x28(sp)             \n"
+      "ld    a4, 0x20(sp)             \n"
+      "ld    a3, 0x18(sp)             \n"
+      "ld    a2, 0x10(sp)             \n"
+      "ld    a1, 0x08(sp)             \n"
+      "ld    a0, 0x00(sp)             \n"
+      "addi  sp, sp, 0x90             \n"
+
+      // No frame is pushed, keep RA
+      "beqz  t1, 1f                   \n"
+
+      // Point S11 to the frame, replace RA with the exit glue
+      "mv    s11, t1                  \n"
+      "ld    ra, .L_histo_exit        \n"
+
+      // Call the original function
+      "1:                             \n"
+      "ld    t1, .L_histo_orig        \n"
+      "jr    t1                       \n"
+
+      ".balign 8;"
+      "sh_histo_trampo_template_data:"
+      ".global sh_histo_trampo_template_data;"
+      ".L_histo_enter:"
+      ".quad 0;"
+      ".L_histo_ptr:"
+      ".quad 0;"
+      ".L_histo_orig:"
+      ".quad 0;"
+      ".L_histo_exit:"
+      ".quad 0;"
+      ".option pop;");
+#endif
+}
+
+__attribute__((always_inline)) static uint64_t sh_histo_now(void) {
+#if defined(__aarch64__)
+  // the generic timer's virtual counter is readable from EL0 on all arm64 Android devices
+  uint64_t ticks;
+  __asm__ __volatile__("isb; mrs %0, cntvct_el0" : "=r"(ticks));
+  return ticks;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+__attribute__((always_inline)) static uint64_t sh_histo_to_nsec(uint64_t delta) {
+#if defined(__aarch64__)
+  if (__predict_false(0 == sh_histo_cntfrq)) return delta;
+  if (__predict_false(delta > UINT64_MAX / 1000000000ULL)) return UINT64_MAX;
+  return delta * 1000000000ULL / sh_histo_cntfrq;
+#else
+  return delta;
+#endif
+}
+
+__attribute__((always_inline)) static size_t sh_histo_get_stripe_idx(sh_histo_stack_t *stack) {
+  uintptr_t n = (uintptr_t)stack >> 12;
+  return (size_t)((n ^ (n >> 8)) & (SH_HISTO_STRIPE_CNT - 1));
+}
+
+#if defined(__aarch64__)
+__attribute__((always_inline)) static uintptr_t sh_histo_get_tp(void) {
+  uintptr_t tp;
+  __asm__("mrs %0, tpidr_el0" : "=r"(tp));
+  return tp;
+}
+
+__attribute__((always_inline)) static sh_histo_thread_t *sh_histo_get_thread(uintptr_t tp) {
+  uintptr_t n = tp >> 12;
+  return &sh_histo_threads[(n ^ (n >> 8)) & (SH_HISTO_THREAD_CNT - 1)];
+}
+
+// only the current thread reads the stack of a slot which holds its TPIDR_EL0
+static void sh_histo_thread_attach(sh_histo_stack_t *stack) {
+  uintptr_t tp = sh_histo_get_tp();
+  sh_histo_thread_t *thread = sh_histo_get_thread(tp);
+  if (0 != __atomic_load_n(&thread->tp, __ATOMIC_RELAXED)) return;
+
+  uintptr_t expected = 0;
+  if (__atomic_compare_exchange_n(&thread->tp, &expected, tp, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+    __atomic_store_n(&thread->stack, stack, __ATOMIC_RELAXED);
+}
+
+static void sh_histo_thread_detach(sh_histo_stack_t *stack) {
+  sh_histo_thread_t *thread = sh_histo_get_thread(sh_histo_get_tp());
+  if (stack != __atomic_load_n(&thread->stack, __ATOMIC_RELAXED)) return;
+
+  __atomic_store_n(&thread->stack, NULL, __ATOMIC_RELAXED);
+  __atomic_store_n(&thread->tp, 0, __ATOMIC_RELEASE);
+}
+#endif
+
+static sh_histo_stack_t *sh_histo_stack_create(void) {
+  int prot = PROT_READ | PROT_WRITE;
+  int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+  void *buf = sh_safe_mmap(NULL, SH_HISTO_STACK_SIZE, prot, flags, -1, 0);
+  if (__predict_false(MAP_FAILED == buf)) return NULL;  // failed
+  sh_safe_prctl(PR_SET_VMA, PR_SET_VMA_ANON_NAME, (unsigned long)buf, SH_HISTO_STACK_SIZE,
+                (unsigned long)SH_HISTO_STACK_ANON_PAGE_NAME);
+  sh_histo_stack_t *stack = (sh_histo_stack_t *)buf;
+  stack->frames_cnt = 0;
+  stack->busy = false;
+  return stack;  // OK
+}
+
+static void sh_histo_stack_destroy(void *buf) {
+  if (NULL == buf) return;
+#if defined(__aarch64__)
+  sh_histo_thread_detach((sh_histo_stack_t *)buf);
+#endif
+  sh_safe_munmap(buf, SH_HISTO_STACK_SIZE);
+  sh_safe_pthread_setspecific(sh_histo_stack_reserved_tls_key, (const void *)1);
+}
+
+// return the pushed frame, or NULL if the call is not recorded (keep the original LR)
+// (the slow path of the entry trampoline on arm64)
+static sh_histo_frame_t *sh_histo_enter(sh_histo_t *self, uintptr_t lr, uintptr_t reg) {
+  if (__predict_false(NULL != sh_safe_pthread_getspecific(sh_histo_stack_reserved_tls_key))) return NULL;
+
+  // get stack, create stack(only once)
+  sh_histo_stack_t *stack = (sh_histo_stack_t *)sh_safe_pthread_getspecific(sh_histo_stack_tls_key);
+  if (__predict_false(NULL == stack)) {
+    if (__predict_false(NULL == (stack = sh_histo_stack_create()))) return NULL;
+    sh_safe_pthread_setspecific(sh_histo_stack_tls_key, (void *)stack);
+  }
+#if defined(__aarch64__)
+  sh_histo_thread_attach(stack);
+#endif
+  if (__predict_false(stack->busy || stack->frames_cnt >= SH_HISTO_STACK_FRAME_MAX)) return NULL;
+
+  // push a new frame
+  __atomic_add_fetch(&self->stripes[sh_histo_get_stripe_idx(stack)].inflight, 1, __ATOMIC_RELAXED);
+  sh_histo_frame_t *frame = &stack->frames[stack->frames_cnt];
+  frame->reg = reg;
+  frame->lr = lr;
+  frame->histo = self;
+  stack->busy = true;
+  frame->ts = sh_histo_now();
+  stack->busy = false;
+  stack->frames_cnt++;
+
+  return frame;
+}
+
+void sh_histo_exit(sh_histo_frame_t *frame) {
+  sh_histo_stack_t *stack = (sh_histo_stack_t *)sh_safe_pthread_getspecific(sh_histo_stack_tls_key);
+  if (__predict_false(NULL == stack || frame < stack->frames || frame >= stack->frames + stack->frames_cnt))
+    sh_safe_abort();  // not from sh_histo_enter?
+
+  stack->busy = true;
+  uint64_t now = sh_histo_now();
+  stack->busy = false;
+
+  // drop the frames above, their calls were left by longjmp() or by an exception
+  size_t stripe_idx = sh_histo_get_stripe_idx(stack);
+  size_t frame_idx = (size_t)(frame - stack->frames);
+  while (stack->frames_cnt > frame_idx + 1) {
+    sh_histo_frame_t *dropped = &stack->frames[--stack->frames_cnt];
+    __atomic_sub_fetch(&dropped->histo->stripes[stripe_idx].inflight, 1, __ATOMIC_RELEASE);
+  }
+
+  // pop the frame
+  stack->frames_cnt--;
+  uint64_t nsec = sh_histo_to_nsec(now - frame->ts);
+
+  // log-scale bucket: [2^i, 2^(i+1)) nanoseconds
+  size_t i = (size_t)(63 - __builtin_clzll(nsec | 1));
+  if (i >= SHADOWHOOK_HISTOGRAM_BUCKET_CNT) i = SHADOWHOOK_HISTOGRAM_BUCKET_CNT - 1;
+  sh_histo_stripe_t *stripe = &frame->histo->stripes[stripe_idx];
+  __atomic_add_fetch(&stripe->buckets[i], 1, __ATOMIC_RELAXED);
+  __atomic_sub_fetch(&stripe->inflight, 1, __ATOMIC_RELEASE);
+}
+
+// called with sh_histo_lock held
+static int sh_histo_init(void) {
+  static int init_r = -1;
+  if (__predict_true(-1 != init_r)) return init_r;
+
+  // init TLS key
+  if (__predict_false(0 != pthread_key_create(&sh_histo_stack_tls_key, sh_histo_stack_destroy))) goto err;
+  if (__predict_false(0 != pthread_key_create(&sh_histo_stack_reserved_tls_key, NULL))) goto err;
+
+#if defined(__aarch64__)
+  __asm__ __volatile__("mrs %0, cntfrq_el0" : "=r"(sh_histo_cntfrq));
+#endif
+
+  // init trampo start, code size, data size
+  sh_histo_trampo_code_start = (uintptr_t)&sh_histo_trampo_template;
+#if defined(__arm__) && defined(__thumb__)
+  sh_histo_trampo_code_start = SH_UTIL_CLEAR_BIT0(sh_histo_trampo_code_start);
+#endif
+  sh_histo_trampo_code_size = (uintptr_t)(&sh_histo_trampo_template_data) - sh_histo_trampo_code_start;
+#if defined(__aarch64__)
+  sh_histo_trampo_data_size = sizeof(void *) * 5;
+#else
+  sh_histo_trampo_data_size = sizeof(void *) * 4;
+#endif
+
+  // init histo's trampoline manager
+  sh_trampo_init_mgr(&sh_histo_trampo_mgr, sh_histo_trampo_code_size + sh_histo_trampo_data_size,
+                     SH_HISTO_DELAY_SEC);
+
+  init_r = 0;
+  return init_r;
+
+err:
+  init_r = SHADOWHOOK_ERRNO_INIT_HUB;
+  return init_r;
+}
+
+static void sh_histo_free_retired(void) {
+  time_t now = sh_util_get_stable_timestamp();
+  sh_histo_t *histo, *tmp;
+  TAILQ_FOREACH_SAFE(histo, &sh_histos_retired, link, tmp) {
+    if (now - histo->retire_ts <= SH_HISTO_DELAY_SEC) break;
+
+    // there may be calls that have not yet returned, keep waiting for them
+    int64_t inflight = 0;
+    for (size_t i = 0; i < SH_HISTO_STRIPE_CNT; i++)
+      inflight += __atomic_load_n(&histo->stripes[i].inflight, __ATOMIC_ACQUIRE);
+    if (0 != inflight) continue;
+
+    TAILQ_REMOVE(&sh_histos_retired, histo, link);
+    free(histo);
+  }
+}
+
+int sh_histo_create(sh_histo_t **self) {
+  *self = NULL;
+
+  pthread_mutex_lock(&sh_histo_lock);
+  int r = sh_histo_init();
+  if (0 == r) sh_histo_free_retired();
+  pthread_mutex_unlock(&sh_histo_lock);
+  if (0 != r) return r;
+
+  sh_histo_t *obj = NULL;
+  if (0 != posix_memalign((void **)&obj, 64, sizeof(sh_histo_t))) return SHADOWHOOK_ERRNO_OOM;
+  memset(obj, 0, sizeof(sh_histo_t));
+
+  // alloc memory for trampoline
+  if (0 == (obj->trampo = sh_trampo_alloc(&sh_histo_trampo_mgr))) {
+    free(obj);
+    return SHADOWHOOK_ERRNO_OOM;
+  }
+
+  // fill in code
+  SH_SIG_TRY(SIGSEGV, SIGBUS) {
+    memcpy((void *)sh_trampo_get_rw_addr(obj->trampo), (void *)sh_histo_trampo_code_start,
+           sh_histo_trampo_code_size);
+  }
+  SH_SIG_CATCH() {
+    sh_trampo_free(&sh_histo_trampo_mgr, obj->trampo);
+    free(obj);
+    SH_LOG_WARN("histo: fill in code crashed");
+    return SHADOWHOOK_ERRNO_OOM;
+  }
+  SH_SIG_EXIT
+
+  // fill in data
+  void **data = (void **)(sh_trampo_get_rw_addr(obj->trampo) + sh_histo_trampo_code_size);
+  *data++ = (void *)sh_histo_enter;
+  *data++ = (void *)obj;
+  *data++ = NULL;  // orig_addr, set by switch
+  *data = (void *)shadowhook_histogram_glue_ret;
+#if defined(__aarch64__)
+  *++data = (void *)sh_histo_threads;
+#endif
+
+  // clear CPU cache
+  sh_util_clear_cache(obj->trampo, sh_histo_trampo_code_size + sh_histo_trampo_data_size);
+
+  SH_LOG_INFO("histo: create trampo at %" PRIxPTR ", size %zu + %zu", obj->trampo, sh_histo_trampo_code_size,
+              sh_histo_trampo_data_size);
+  *self = obj;
+  return 0;
+}
+
+void sh_histo_destroy(sh_histo_t *self) {
+  // the trampoline is freed with a delay by the trampo manager,
+  // the histo is freed after the delay and after all in-flight calls have returned
+  if (0 != self->trampo) sh_trampo_free(&sh_histo_trampo_mgr, self->trampo);
+
+  pthread_mutex_lock(&sh_histo_lock);
+  sh_histo_free_retired();
+  self->retire_ts = sh_util_get_stable_timestamp();
+  TAILQ_INSERT_TAIL(&sh_histos_retired, self, link);
+  pthread_mutex_unlock(&sh_histo_lock);
+}
+
+uintptr_t sh_histo_get_trampo_addr(sh_histo_t *self) {
+#if defined(__arm__) && defined(__thumb__)
+  return self->trampo + 1;
+#else
+  return self->trampo;
+#endif
+}
+
+uintptr_t *sh_histo_get_orig_addr(sh_histo_t *self) {
+  return (uintptr_t *)(sh_trampo_get_rw_addr(self->trampo) + sh_histo_trampo_code_size + sizeof(void *) * 2);
+}
+
+void sh_histo_get(sh_histo_t *self, shadowhook_histogram_t *histogram) {
+  memset(histogram, 0, sizeof(shadowhook_histogram_t));
+  for (size_t i = 0; i < SH_HISTO_STRIPE_CNT; i++) {
+    for (size_t j = 0; j < SHADOWHOOK_HISTOGRAM_BUCKET_CNT; j++) {
+      uint64_t n = __atomic_load_n(&self->stripes[i].buckets[j], __ATOMIC_RELAXED);
+      histogram->buckets[j] += n;
+      histogram->count += n;
+    }
+  }
+}
@@ -0,0 +1,38 @@
+// Copyright (c) 2021-2025 ByteDance Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#pragma once
+#include <stdint.h>
+
+#include "shadowhook.h"
+
+typedef struct sh_histo sh_histo_t;
+typedef struct sh_histo_frame sh_histo_frame_t;
+
+int sh_histo_create(sh_histo_t **self);
+void sh_histo_destroy(sh_histo_t *self);
+
+uintptr_t sh_histo_get_trampo_addr(sh_histo_t *self);
+uintptr_t *sh_histo_get_orig_addr(sh_histo_t *self);
+void sh_histo_get(sh_histo_t *self, shadowhook_histogram_t *histogram);
+
+// called by shadowhook_histogram_glue only
+void sh_histo_exit(sh_histo_frame_t *frame);
@@ -30,8 +30,10 @@
 #include <string.h>
 #include <sys/mman.h>
 #include <sys/prctl.h>
+#include <time.h>
 
 #include "queue.h"
+#include "sh_breaker.h"
 #include "sh_log.h"
 #include "sh_safe.h"
 #include "sh_sig.h"
@@ -40,22 +42,44 @@
 #include "shadowhook.h"
 #include "tree.h"
 
-#define SH_HUB_TRAMPO_ANON_PAGE_NAME "shadowhook-hub-trampo"
-#define SH_HUB_STACK_ANON_PAGE_NAME  "shadowhook-hub-stack"
-#define SH_HUB_STACK_SIZE            4096  // 4K is enough
-#define SH_HUB_STACK_FRAME_MAX       16    // keep sizeof(sh_hub_stack_t) < 4K
-#define SH_HUB_THREAD_MAX            1024
+#define SH_HUB_STACK_ANON_PAGE_NAME "shadowhook-hub-stack"
+#define SH_HUB_STACK_SIZE           4096  // 4K is enough
+#define SH_HUB_STACK_FRAME_MAX      16    // keep sizeof(sh_hub_stack_t) < 4K
+#define SH_HUB_THREAD_MAX           1024
+#define SH_HUB_DELAY_SEC            10
 
 #define SH_HUB_FRAME_FLAG_NONE            ((uintptr_t)0)
 #define SH_HUB_FRAME_FLAG_ALLOW_REENTRANT ((uintptr_t)(1 << 0))
+#define SH_HUB_FRAME_FLAG_FAULTED         ((uintptr_t)(1 << 1))  // counted by the SIGSEGV / SIGBUS handler
+
+#if defined(__aarch64__)
+// B: [-128M, +128M - 4]
+#define SH_HUB_NEAR_OFFSET_LOW  (134217728)
+#define SH_HUB_NEAR_OFFSET_HIGH (134217724)
+#elif defined(__x86_64__)
+// JMP rel32: [-2G + 5, +2G + 4] from the exit (the high end is rounded down)
+#define SH_HUB_NEAR_OFFSET_LOW  (2147483643)
+#define SH_HUB_NEAR_OFFSET_HIGH (2147483647)
+#elif defined(__riscv)
+// AUIPC + JALR: [-2G - 2K, +2G - 2K - 1] (the low end is rounded up)
+#define SH_HUB_NEAR_OFFSET_LOW  (2147483648)
+#define SH_HUB_NEAR_OFFSET_HIGH (2147481599)
+#endif
 
 // proxy for each hook-task in the same target-address
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wpadded"
 typedef struct sh_hub_proxy {
   void *func;
-  bool enabled;
+  void *data;
+  bool enabled;     // atomic, cleared by del and by the circuit breaker
+  bool registered;  // not deleted, a tripped proxy is registered but not enabled
+  bool retired;     // replaced, never re-enabled
+  bool unlinked;    // retired and no longer in the proxy-list
+  time_t retire_ts;
+  sh_breaker_t breaker;
   SLIST_ENTRY(sh_hub_proxy, ) link;
+  SLIST_ENTRY(sh_hub_proxy, ) retire_link;
 } sh_hub_proxy_t;
 #pragma clang diagnostic pop
 
@@ -65,9 +89,12 @@ typedef SLIST_HEAD(sh_hub_proxy_list, sh_hub_proxy, ) sh_hub_proxy_list_t;
 // frame in the stack
 typedef struct {
   sh_hub_proxy_list_t proxies;
+  sh_hub_proxy_t *proxy;  // the first enabled proxy
+  struct sh_hub *hub;
   uintptr_t orig_addr;
   void *return_address;
   uintptr_t flags;
+  uint64_t sample_ts;  // 0: this call is not sampled by the circuit breaker
 } sh_hub_frame_t;
 
 // stack for each thread
@@ -79,7 +106,9 @@ typedef struct {
 // hub for each target-address
 struct sh_hub {
   sh_hub_proxy_list_t proxies;
+  sh_hub_proxy_list_t retired;  // replaced proxies, linked by retire_link
   size_t proxies_size;
+  uintptr_t target_addr;
   uintptr_t orig_addr;
   uintptr_t trampo;
   LIST_ENTRY(sh_hub, ) link;
@@ -102,6 +131,9 @@ static uintptr_t sh_hub_trampo_code_start;
 static size_t sh_hub_trampo_code_size;
 static size_t sh_hub_trampo_data_size;
 
+// global kill switch: bumped on every on/off change, odd value = all proxies and interceptors are bypassed
+static uint32_t sh_hub_bypass_gen = 0;
+
 // hub trampoline template
 extern void *sh_hub_trampo_template_data __attribute__((visibility("hidden")));
 __attribute__((naked)) static void sh_hub_trampo_template(void) {
@@ -175,6 +207,127 @@ __attribute__((naked)) static void sh_hub_trampo_template(void) {
       ".quad 0;"
       ".L_hub_ptr:"
       ".quad 0;");
+#elif defined(__x86_64__)
+  __asm__(
+      // Save parameter registers, RAX (number of vector registers for varargs)
+      "push  %rdi                     \n"
+      "push  %rsi                     \n"
+      "push  %rdx                     \n"
+      "push  %rcx                     \n"
+      "push  %r8                      \n"
+      "push  %r9                      \n"
+      "push  %rax                     \n"
+      "sub   $0x80, %rsp              \n"
+      "movdqu %xmm0, 0x00(%rsp)       \n"
+      "movdqu %xmm1, 0x10(%rsp)       \n"
+      "movdqu %xmm2, 0x20(%rsp)       \n"
+      "movdqu %xmm3, 0x30(%rsp)       \n"
+      "movdqu %xmm4, 0x40(%rsp)       \n"
+      "movdqu %xmm5, 0x50(%rsp)       \n"
+      "movdqu %xmm6, 0x60(%rsp)       \n"
+      "movdqu %xmm7, 0x70(%rsp)       \n"
+
+      // Call sh_hub_push_stack()
+      "mov   .L_hub_ptr(%rip), %rdi   \n"
+      "mov   0xb8(%rsp), %rsi         \n"
+      "call  *.L_push_stack(%rip)     \n"
+
+      // Save the hook function's address to R11 register
+      "mov   %rax, %r11               \n"
+
+      // Restore parameter registers, RAX
+      "movdqu 0x70(%rsp), %xmm7       \n"
+      "movdqu 0x60(%rsp), %xmm6       \n"
+      "movdqu 0x50(%rsp), %xmm5       \n"
+      "movdqu 0x40(%rsp), %xmm4       \n"
+      "movdqu 0x30(%rsp), %xmm3       \n"
+      "movdqu 0x20(%rsp), %xmm2       \n"
+      "movdqu 0x10(%rsp), %xmm1       \n"
+      "movdqu 0x00(%rsp), %xmm0       \n"
+      "add   $0x80, %rsp              \n"
+      "pop   %rax                     \n"
+      "pop   %r9                      \n"
+      "pop   %r8                      \n"
+      "pop   %rcx                     \n"
+      "pop   %rdx                     \n"
+      "pop   %rsi                     \n"
+      "pop   %rdi                     \n"
+
+      // Call hook function
+      "jmp   *%r11                    \n"
+
+      ".balign 8;"
+      "sh_hub_trampo_template_data:"
+      ".global sh_hub_trampo_template_data;"
+      ".L_push_stack:"
+      ".quad 0;"
+      ".L_hub_ptr:"
+      ".quad 0;");
+#elif defined(__riscv)
+  __asm__(
+      ".option push                   \n"
+      ".option norelax                \n"
+
+      // Save parameter registers, RA
+      "addi  sp, sp, -0x90            \n"
+      "sd    a0, 0x00(sp)             \n"
+      "sd    a1, 0x08(sp)             \n"
+      "sd    a2, 0x10(sp)             \n"
+      "sd    a3, 0x18(sp)             \n"
+      "sd    a4, 0x20(sp)             \n"
+      "sd    a5, 0x28(sp)             \n"
+      "sd    a6, 0x30(sp)             \n"
+      "sd    a7, 0x38(sp)             \n"
+      "sd    ra, 0x40(sp)             \n"
+      "fsd   fa0, 0x48(sp)            \n"
+      "fsd   fa1, 0x50(sp)            \n"
+      "fsd   fa2, 0x58(sp)            \n"
+      "fsd   fa3, 0x60(sp)            \n"
+      "fsd   fa4, 0x68(sp)            \n"
+      "fsd   fa5, 0x70(sp)            \n"
+      "fsd   fa6, 0x78(sp)            \n"
+      "fsd   fa7, 0x80(sp)            \n"
+
+      // Call sh_hub_push_stack()
+      "ld    a0, .L_hub_ptr           \n"
+      "mv    a1, ra                   \n"
+      "ld    t1, .L_push_stack        \n"
+      "jalr  t1                       \n"
+
+      // Save the hook function's address to T1 register
+      "mv    t1, a0                   \n"
+
+      // Restore parameter registers, RA
+      "fld   fa7, 0x80(sp)            \n"
+      "fld   fa6, 0x78(sp)            \n"
+      "fld   fa5, 0x70(sp)            \n"
+      "fld   fa4, 0x68(sp)            \n"
+      "fld   fa3, 0x60(sp)            \n"
+      "fld   fa2, 0x58(sp)            \n"
+      "fld   fa1, 0x50(sp)            \n"
+      "fld   fa0, 0x48(sp)            \n"
+      "ld    ra, 0x40(sp)             \n"
+      "ld    a7, 0x38(sp)             \n"
+      "ld    a6, 0x30(sp)             \n"
+      "ld    a5, 0x28(sp)             \n"
+      "ld    a4, 0x20(sp)             \n"
+      "ld    a3, 0x18(sp)             \n"
+      "ld    a2, 0x10(sp)             \n"
+      "ld    a1, 0x08(sp)             \n"
+      "ld    a0, 0x00(sp)             \n"
+      "addi  sp, sp, 0x90             \n"
+
+      // Call hook function
+      "jr    t1                       \n"
+
+      ".balign 8;"
+      "sh_hub_trampo_template_data:"
+      ".global sh_hub_trampo_template_data;"
+      ".L_push_stack:"
+      ".quad 0;"
+      ".L_hub_ptr:"
+      ".quad 0;"
+      ".option pop;");
 #endif
 }
 
@@ -282,7 +435,7 @@ static int sh_hub_init(void) {
 #if defined(__thumb__)
   sh_hub_trampo_code_start = SH_UTIL_CLEAR_BIT0(sh_hub_trampo_code_start);
 #endif
-#elif defined(__aarch64__)
+#elif defined(__aarch64__) || defined(__x86_64__) || defined(__riscv)
   sh_hub_trampo_code_start = (uintptr_t)&sh_hub_trampo_template;
   data_start = (uintptr_t)(&sh_hub_trampo_template_data);
 #endif
@@ -291,7 +444,7 @@ static int sh_hub_init(void) {
   uintptr_t trampo_size = sh_hub_trampo_code_size + sh_hub_trampo_data_size;
 
   // init hub's trampoline manager
-  sh_trampo_init_mgr(&sh_hub_trampo_mgr, SH_HUB_TRAMPO_ANON_PAGE_NAME, trampo_size, 0);
+  sh_trampo_init_mgr(&sh_hub_trampo_mgr, trampo_size, 0);
 
   init_r = 0;
   return init_r;
@@ -302,6 +455,8 @@ err:
 }
 
 static void *sh_hub_push_stack(sh_hub_t *self, void *return_address) {
+  if (__predict_false(sh_hub_is_bypassed())) goto end;
+
   sh_hub_stack_t *reserved_stack =
       (sh_hub_stack_t *)sh_safe_pthread_getspecific(sh_hub_stack_reserved_tls_key);
   if (__predict_false(reserved_stack != NULL)) goto end;
@@ -337,9 +492,12 @@ static void *sh_hub_push_stack(sh_hub_t *self, void *return_address) {
         SH_LOG_DEBUG("hub: frames_cnt++ = %zu", stack->frames_cnt);
         sh_hub_frame_t *frame = &stack->frames[stack->frames_cnt - 1];
         frame->proxies = self->proxies;
+        frame->proxy = proxy;
+        frame->hub = self;
         frame->orig_addr = self->orig_addr;
         frame->return_address = return_address;
         frame->flags = SH_HUB_FRAME_FLAG_NONE;
+        frame->sample_ts = sh_breaker_sample(&proxy->breaker);
 
         // return the first enabled proxy's function
         SH_LOG_DEBUG("hub: push_stack() return first enabled proxy %p", proxy->func);
@@ -362,30 +520,53 @@ void sh_hub_pop_stack(void *return_address) {
 
   // only the first proxy will actually execute pop-stack()
   if (__predict_true(frame->return_address == return_address)) {
+    if (__predict_false(0 != frame->sample_ts))
+      sh_breaker_check_latency(&frame->proxy->breaker, &frame->proxy->enabled, frame->hub->target_addr,
+                               frame->proxy->func, frame->sample_ts);
     stack->frames_cnt--;
     SH_LOG_DEBUG("hub: frames_cnt-- = %zu", stack->frames_cnt);
   }
 }
 
-int sh_hub_create(sh_hub_t **self) {
+static uintptr_t sh_hub_trampo_alloc(uintptr_t target_addr) {
+#if defined(__aarch64__) || defined(__x86_64__) || defined(__riscv)
+  // try to alloc within the range of B (JMP rel32 on x86_64, AUIPC + JALR on riscv64) from target_addr,
+  // so target_addr can jump to the trampo directly
+  uintptr_t range_low = target_addr > SH_HUB_NEAR_OFFSET_LOW ? target_addr - SH_HUB_NEAR_OFFSET_LOW : 0;
+  uintptr_t range_high = UINTPTR_MAX - target_addr > SH_HUB_NEAR_OFFSET_HIGH
+                             ? target_addr + SH_HUB_NEAR_OFFSET_HIGH
+                             : UINTPTR_MAX;
+  uintptr_t trampo = sh_trampo_alloc_between(&sh_hub_trampo_mgr, range_low, range_high);
+  if (0 != trampo) return trampo;
+#else
+  (void)target_addr;
+#endif
+
+  return sh_trampo_alloc(&sh_hub_trampo_mgr);
+}
+
+int sh_hub_create(sh_hub_t **self, uintptr_t target_addr) {
   int r = sh_hub_init();
   if (0 != r) return r;
 
   sh_hub_t *obj = malloc(sizeof(sh_hub_t));
   if (NULL == obj) goto err;
   SLIST_INIT(&obj->proxies);
+  SLIST_INIT(&obj->retired);
   obj->proxies_size = 0;
+  obj->target_addr = target_addr;
   obj->orig_addr = 0;
 
   // alloc memory for trampoline
-  if (0 == (obj->trampo = sh_trampo_alloc(&sh_hub_trampo_mgr))) {
+  if (0 == (obj->trampo = sh_hub_trampo_alloc(target_addr))) {
     free(obj);
     goto err;
   }
 
   // fill in code
   SH_SIG_TRY(SIGSEGV, SIGBUS) {
-    memcpy((void *)obj->trampo, (void *)sh_hub_trampo_code_start, sh_hub_trampo_code_size);
+    memcpy((void *)sh_trampo_get_rw_addr(obj->trampo), (void *)sh_hub_trampo_code_start,
+           sh_hub_trampo_code_size);
   }
   SH_SIG_CATCH() {
     sh_trampo_free(&sh_hub_trampo_mgr, obj->trampo);
@@ -396,7 +577,7 @@ int sh_hub_create(sh_hub_t **self) {
   SH_SIG_EXIT
 
   // fill in data
-  void **data = (void **)(obj->trampo + sh_hub_trampo_code_size);
+  void **data = (void **)(sh_trampo_get_rw_addr(obj->trampo) + sh_hub_trampo_code_size);
   *data++ = (void *)sh_hub_push_stack;
   *data = (void *)obj;
 
@@ -429,6 +610,13 @@ uintptr_t *sh_hub_get_orig_addr(sh_hub_t *self) {
 void sh_hub_destroy(sh_hub_t *self) {
   if (0 != self->trampo) sh_trampo_free(&sh_hub_trampo_mgr, self->trampo);
 
+  // the retired proxies still in the proxy-list are freed with it
+  while (!SLIST_EMPTY(&self->retired)) {
+    sh_hub_proxy_t *proxy = SLIST_FIRST(&self->retired);
+    SLIST_REMOVE_HEAD(&self->retired, retire_link);
+    if (proxy->unlinked) free(proxy);
+  }
+
   while (!SLIST_EMPTY(&self->proxies)) {
     sh_hub_proxy_t *proxy = SLIST_FIRST(&self->proxies);
     SLIST_REMOVE_HEAD(&self->proxies, link);
@@ -441,21 +629,53 @@ void sh_hub_destroy(sh_hub_t *self) {
 bool sh_hub_is_proxy_duplicated(sh_hub_t *self, uintptr_t proxy_func) {
   sh_hub_proxy_t *proxy;
   SLIST_FOREACH(proxy, &self->proxies, link) {
-    if (proxy->enabled && proxy->func == (void *)proxy_func) return true;
+    if (proxy->registered && proxy->func == (void *)proxy_func) return true;
   }
   return false;
 }
 
-int sh_hub_add_proxy(sh_hub_t *self, uintptr_t proxy_func) {
+// A replaced proxy stays in the proxy-list for the delay, because the threads still running in it look
+// it up from the proxy-list to continue with the chain after it. Then it is unlinked, and it is freed
+// after another delay, because the threads walking the proxy-list may still be on it.
+static void sh_hub_reclaim_retired(sh_hub_t *self) {
+  if (SLIST_EMPTY(&self->retired)) return;
+
+  time_t now = sh_util_get_stable_timestamp();
+  sh_hub_proxy_t **retire_link = &SLIST_FIRST(&self->retired);
+  sh_hub_proxy_t *proxy;
+  while (NULL != (proxy = *retire_link)) {
+    if (now - proxy->retire_ts <= SH_HUB_DELAY_SEC) {
+      retire_link = &SLIST_NEXT(proxy, retire_link);
+    } else if (!proxy->unlinked) {
+      sh_hub_proxy_t **link = &SLIST_FIRST(&self->proxies);
+      while (*link != proxy) link = &SLIST_NEXT(*link, link);
+      __atomic_store_n((uintptr_t *)link, (uintptr_t)SLIST_NEXT(proxy, link), __ATOMIC_RELEASE);
+      proxy->unlinked = true;
+      proxy->retire_ts = now;
+      retire_link = &SLIST_NEXT(proxy, retire_link);
+      SH_LOG_INFO("hub: unlink replaced func %" PRIxPTR, (uintptr_t)proxy->func);
+    } else {
+      *retire_link = SLIST_NEXT(proxy, retire_link);
+      free(proxy);
+    }
+  }
+}
+
+int sh_hub_add_proxy(sh_hub_t *self, uintptr_t proxy_func, void *data) {
+  sh_hub_reclaim_retired(self);
+
   // check duplicated proxy function
   if (sh_hub_is_proxy_duplicated(self, proxy_func)) return SHADOWHOOK_ERRNO_HOOK_HUB_DUP;
 
   // try to re-enable an exists item
   sh_hub_proxy_t *proxy;
   SLIST_FOREACH(proxy, &self->proxies, link) {
-    if (proxy->func == (void *)proxy_func) {
+    if (proxy->func == (void *)proxy_func && !proxy->retired) {
       self->proxies_size++;
-      if (!proxy->enabled) __atomic_store_n((bool *)&proxy->enabled, true, __ATOMIC_RELEASE);
+      proxy->data = data;
+      proxy->registered = true;
+      sh_breaker_reset(&proxy->breaker);
+      __atomic_store_n((bool *)&proxy->enabled, true, __ATOMIC_RELEASE);
       SH_LOG_INFO("hub: add(re-enable) func %" PRIxPTR, proxy_func);
       return 0;
     }
@@ -464,7 +684,13 @@ int sh_hub_add_proxy(sh_hub_t *self, uintptr_t proxy_func) {
   // create new item
   if (NULL == (proxy = malloc(sizeof(sh_hub_proxy_t)))) return SHADOWHOOK_ERRNO_OOM;
   proxy->func = (void *)proxy_func;
+  proxy->data = data;
   proxy->enabled = true;
+  proxy->registered = true;
+  proxy->retired = false;
+  proxy->unlinked = false;
+  proxy->retire_ts = 0;
+  sh_breaker_reset(&proxy->breaker);
 
   // insert to the head of the proxy-list
   // equivalent to: SLIST_INSERT_HEAD(&self->proxies, proxy, link);
@@ -477,10 +703,13 @@ int sh_hub_add_proxy(sh_hub_t *self, uintptr_t proxy_func) {
 }
 
 int sh_hub_del_proxy(sh_hub_t *self, uintptr_t proxy_func) {
+  sh_hub_reclaim_retired(self);
+
   sh_hub_proxy_t *proxy;
   SLIST_FOREACH(proxy, &self->proxies, link) {
-    if (proxy->func == (void *)proxy_func && proxy->enabled) {
+    if (proxy->func == (void *)proxy_func && proxy->registered) {
       self->proxies_size--;
+      proxy->registered = false;
       __atomic_store_n((bool *)&proxy->enabled, false, __ATOMIC_RELEASE);
       SH_LOG_INFO("hub: del func %" PRIxPTR, proxy_func);
       return 0;
@@ -490,6 +719,49 @@ int sh_hub_del_proxy(sh_hub_t *self, uintptr_t proxy_func) {
   return SHADOWHOOK_ERRNO_UNHOOK_NOTFOUND;
 }
 
+int sh_hub_replace_proxy(sh_hub_t *self, uintptr_t proxy_func, uintptr_t new_proxy_func) {
+  sh_hub_reclaim_retired(self);
+
+  // check duplicated proxy function
+  if (sh_hub_is_proxy_duplicated(self, new_proxy_func)) return SHADOWHOOK_ERRNO_HOOK_HUB_DUP;
+
+  // find the registered item and the link pointing to it
+  sh_hub_proxy_t **link = &SLIST_FIRST(&self->proxies);
+  sh_hub_proxy_t *proxy;
+  while (NULL != (proxy = *link)) {
+    if (proxy->func == (void *)proxy_func && proxy->registered) break;
+    link = &SLIST_NEXT(proxy, link);
+  }
+  if (NULL == proxy) return SHADOWHOOK_ERRNO_UNHOOK_NOTFOUND;
+
+  // create new item
+  sh_hub_proxy_t *new_proxy;
+  if (NULL == (new_proxy = malloc(sizeof(sh_hub_proxy_t)))) return SHADOWHOOK_ERRNO_OOM;
+  new_proxy->func = (void *)new_proxy_func;
+  new_proxy->data = proxy->data;
+  new_proxy->enabled = true;
+  new_proxy->registered = true;
+  new_proxy->retired = false;
+  new_proxy->unlinked = false;
+  new_proxy->retire_ts = 0;
+  sh_breaker_reset(&new_proxy->breaker);
+
+  // insert the new item in front of the old one (same position in the proxy-list), then disable
+  // the old one like del does and retire it. The old item is kept in the list for the delay, so the
+  // threads still running in the old proxy continue with the same chain after it, and the threads
+  // entering the new proxy skip the disabled old one.
+  // __ATOMIC_RELEASE ensures readers see only fully-constructed item
+  SLIST_NEXT(new_proxy, link) = proxy;
+  __atomic_store_n((uintptr_t *)link, (uintptr_t)new_proxy, __ATOMIC_RELEASE);
+  proxy->registered = false;
+  __atomic_store_n((bool *)&proxy->enabled, false, __ATOMIC_RELEASE);
+  proxy->retired = true;
+  proxy->retire_ts = sh_util_get_stable_timestamp();
+  SLIST_INSERT_HEAD(&self->retired, proxy, retire_link);
+  SH_LOG_INFO("hub: replace func %" PRIxPTR " -> %" PRIxPTR, proxy_func, new_proxy_func);
+  return 0;
+}
+
 size_t sh_hub_get_proxy_count(sh_hub_t *self) {
   return self->proxies_size;
 }
@@ -517,21 +789,45 @@ void sh_hub_disallow_reentrant(void *return_address) {
   }
 }
 
+void sh_hub_set_bypass(bool bypass) {
+  uint32_t gen = __atomic_load_n(&sh_hub_bypass_gen, __ATOMIC_RELAXED);
+  do {
+    if ((0 != (gen & 1)) == bypass) return;
+  } while (!__atomic_compare_exchange_n(&sh_hub_bypass_gen, &gen, gen + 1, true, __ATOMIC_RELEASE,
+                                        __ATOMIC_RELAXED));
+}
+
+bool sh_hub_is_bypassed(void) {
+  return 0 != (__atomic_load_n(&sh_hub_bypass_gen, __ATOMIC_ACQUIRE) & 1);
+}
+
+uint32_t *sh_hub_get_bypass_gen_addr(void) {
+  return &sh_hub_bypass_gen;
+}
+
+// find the item of func in the proxy-list: the registered one, otherwise the first unregistered one
+// (the replaced or deleted items are kept in the list, and may have the same func)
+static sh_hub_proxy_t *sh_hub_find_proxy(sh_hub_proxy_list_t *proxies, void *func) {
+  sh_hub_proxy_t *found = NULL;
+  sh_hub_proxy_t *proxy;
+  SLIST_FOREACH(proxy, proxies, link) {
+    if (proxy->func != func) continue;
+    if (proxy->registered) return proxy;
+    if (NULL == found) found = proxy;
+  }
+  return found;
+}
+
 void *sh_hub_get_prev_func(void *func) {
   sh_hub_stack_t *stack = (sh_hub_stack_t *)sh_safe_pthread_getspecific(sh_hub_stack_tls_key);
   if (0 == stack->frames_cnt) sh_safe_abort();  // called in a non-hook status?
   sh_hub_frame_t *frame = &stack->frames[stack->frames_cnt - 1];
 
   // find and return the next enabled proxy in the proxy-list
-  bool found = false;
-  sh_hub_proxy_t *proxy;
-  SLIST_FOREACH(proxy, &(frame->proxies), link) {
-    if (!found) {
-      if (proxy->func == func) found = true;
-    } else {
-      if (proxy->enabled) {
-        break;
-      }
+  sh_hub_proxy_t *proxy = sh_hub_find_proxy(&(frame->proxies), func);
+  if (NULL != proxy) {
+    while (NULL != (proxy = SLIST_NEXT(proxy, link))) {
+      if (proxy->enabled) break;
     }
   }
   if (NULL != proxy) {
@@ -551,3 +847,51 @@ void *sh_hub_get_return_address(void) {
 
   return frame->return_address;
 }
+
+void *sh_hub_get_data(void *func) {
+  sh_hub_stack_t *stack = (sh_hub_stack_t *)sh_safe_pthread_getspecific(sh_hub_stack_tls_key);
+  if (0 == stack->frames_cnt) sh_safe_abort();  // called in a non-hook status?
+  sh_hub_frame_t *frame = &stack->frames[stack->frames_cnt - 1];
+
+  // the first enabled proxy is the one that was entered from the hub trampoline
+  if (__predict_true(frame->proxy->func == func)) return frame->proxy->data;
+
+  // called in a proxy entered via SHADOWHOOK_CALL_PREV()
+  sh_hub_proxy_t *proxy = sh_hub_find_proxy(&(frame->proxies), func);
+  return NULL != proxy ? proxy->data : NULL;
+}
+
+void sh_hub_report_fault(void *func) {
+  sh_hub_stack_t *stack = (sh_hub_stack_t *)sh_safe_pthread_getspecific(sh_hub_stack_tls_key);
+  if (NULL == stack || 0 == stack->frames_cnt) return;  // called in a non-hook status
+  sh_hub_frame_t *frame = &stack->frames[stack->frames_cnt - 1];
+
+  // the fault has been counted by the SIGSEGV / SIGBUS handler already
+  if (0 != (frame->flags & SH_HUB_FRAME_FLAG_FAULTED)) {
+    frame->flags &= ~SH_HUB_FRAME_FLAG_FAULTED;
+    return;
+  }
+
+  // find the proxy in the current frame
+  sh_hub_proxy_t *proxy = frame->proxy;
+  if (proxy->func != func) {
+    if (NULL == (proxy = sh_hub_find_proxy(&(frame->proxies), func))) return;
+  }
+
+  uint32_t faults = sh_breaker_add_fault(&proxy->breaker, &proxy->enabled, frame->hub->target_addr, func);
+  SH_LOG_WARN("hub: fault reported, target %" PRIxPTR ", func %" PRIxPTR ", faults %" PRIu32,
+              frame->hub->target_addr, (uintptr_t)func, faults);
+}
+
+bool sh_hub_report_sig_fault(void) {
+  if (NULL == sh_hub_stack_cache) return false;  // hub not initialized
+  sh_hub_stack_t *stack = (sh_hub_stack_t *)sh_safe_pthread_getspecific(sh_hub_stack_tls_key);
+  if (NULL == stack || 0 == stack->frames_cnt) return false;
+  sh_hub_frame_t *frame = &stack->frames[stack->frames_cnt - 1];
+
+  // charge the first proxy of the innermost hooked call on this thread
+  sh_hub_proxy_t *proxy = frame->proxy;
+  sh_breaker_add_fault(&proxy->breaker, &proxy->enabled, frame->hub->target_addr, proxy->func);
+  frame->flags |= SH_HUB_FRAME_FLAG_FAULTED;
+  return true;
+}
@@ -25,21 +25,32 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#include "shadowhook.h"
+
 typedef struct sh_hub sh_hub_t;
 
-int sh_hub_create(sh_hub_t **self);
+int sh_hub_create(sh_hub_t **self, uintptr_t target_addr);
 void sh_hub_destroy(sh_hub_t *self);
 
 uintptr_t sh_hub_get_trampo_addr(sh_hub_t *self);
 uintptr_t *sh_hub_get_orig_addr(sh_hub_t *self);
 
 bool sh_hub_is_proxy_duplicated(sh_hub_t *self, uintptr_t proxy_func);
-int sh_hub_add_proxy(sh_hub_t *self, uintptr_t proxy_func);
+int sh_hub_add_proxy(sh_hub_t *self, uintptr_t proxy_func, void *data);
 int sh_hub_del_proxy(sh_hub_t *self, uintptr_t proxy_func);
+int sh_hub_replace_proxy(sh_hub_t *self, uintptr_t proxy_func, uintptr_t new_proxy_func);
 size_t sh_hub_get_proxy_count(sh_hub_t *self);
 
+void sh_hub_set_bypass(bool bypass);
+bool sh_hub_is_bypassed(void);
+uint32_t *sh_hub_get_bypass_gen_addr(void);  // for the bypass check in trampolines
+
+void sh_hub_report_fault(void *func);
+bool sh_hub_report_sig_fault(void);  // async-signal-safe
+
 void *sh_hub_get_prev_func(void *func);
 void sh_hub_pop_stack(void *return_address);
 void sh_hub_allow_reentrant(void *return_address);
 void sh_hub_disallow_reentrant(void *return_address);
 void *sh_hub_get_return_address(void);
+void *sh_hub_get_data(void *func);
@@ -38,19 +38,21 @@
 #define SH_ISLAND_TYPE_ELF_GAP   1
 // add more island type here ......
 
-#define SH_ISLAND_ANON_PAGE_NAME "shadowhook-island"
-#define SH_ISLAND_DELAY_SEC      3
+#define SH_ISLAND_DELAY_SEC 3
 #if defined(__arm__)
 #define SH_ISLAND_SIZE_MAX 8
 #elif defined(__aarch64__)
 #define SH_ISLAND_SIZE_MAX 20
+#elif defined(__x86_64__)
+#define SH_ISLAND_SIZE_MAX 16
+#elif defined(__riscv)
+#define SH_ISLAND_SIZE_MAX 24
 #endif
 
 static sh_trampo_mgr_t sh_island_trampo_mgr;
 
 void sh_island_init(void) {
-  sh_trampo_init_mgr(&sh_island_trampo_mgr, SH_ISLAND_ANON_PAGE_NAME, SH_ISLAND_SIZE_MAX,
-                     SH_ISLAND_DELAY_SEC);
+  sh_trampo_init_mgr(&sh_island_trampo_mgr, SH_ISLAND_SIZE_MAX, SH_ISLAND_DELAY_SEC);
 }
 
 // range: [range_low, range_high]
@@ -87,6 +89,12 @@ void sh_island_free(sh_island_t *self) {
   self->addr = 0;
 }
 
+uintptr_t sh_island_get_rw_addr(sh_island_t *self) {
+  // the ELF-gap is writable in place
+  if (SH_ISLAND_TYPE_ANON_PAGE == self->type) return sh_trampo_get_rw_addr(self->addr);
+  return self->addr;
+}
+
 void sh_island_free_after_dlclose(sh_island_t *self) {
   if (SH_ISLAND_TYPE_ANON_PAGE == self->type && 0 != self->addr) {
     sh_trampo_free(&sh_island_trampo_mgr, self->addr);
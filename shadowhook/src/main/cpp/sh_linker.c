@@ -148,9 +148,15 @@ static void *sh_linker_get_base_addr(xdl_info_t *dlinfo) {
 static bool sh_linker_check_arch(xdl_info_t *dlinfo) {
   ElfW(Ehdr) *ehdr = (ElfW(Ehdr) *)sh_linker_get_base_addr(dlinfo);
 
-#if defined(__LP64__)
+#if defined(__aarch64__)
 #define SH_LINKER_ELF_CLASS   ELFCLASS64
 #define SH_LINKER_ELF_MACHINE EM_AARCH64
+#elif defined(__x86_64__)
+#define SH_LINKER_ELF_CLASS   ELFCLASS64
+#define SH_LINKER_ELF_MACHINE EM_X86_64
+#elif defined(__riscv)
+#define SH_LINKER_ELF_CLASS   ELFCLASS64
+#define SH_LINKER_ELF_MACHINE EM_RISCV
 #else
 #define SH_LINKER_ELF_CLASS   ELFCLASS32
 #define SH_LINKER_ELF_MACHINE EM_ARM
@@ -0,0 +1,231 @@
+// Copyright (c) 2021-2025 ByteDance Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include "sh_patch.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/ucontext.h>
+
+#include "bytesig.h"
+#include "sh_log.h"
+#include "sh_util.h"
+
+// trap instructions, "SH" as the immediate, and the signal raised by them (the PC of the signal context is
+// the address of the trap instruction)
+#if defined(__aarch64__)
+#define SH_PATCH_A64_TRAP 0xD42A6900u  // BRK #0x5348
+#define SH_PATCH_TRAP_SIG SIGTRAP
+#elif defined(__arm__)
+#define SH_PATCH_T16_TRAP 0xBE53u      // BKPT #0x53
+#define SH_PATCH_A32_TRAP 0xE1253478u  // BKPT #0x5348
+#define SH_PATCH_TRAP_SIG SIGTRAP
+#elif defined(__x86_64__)
+#define SH_PATCH_X64_TRAP 0x0B0Fu  // UD2
+#define SH_PATCH_TRAP_SIG SIGILL
+#elif defined(__riscv)
+#define SH_PATCH_RV64_TRAP 0x0000u  // C.UNIMP
+#define SH_PATCH_TRAP_SIG SIGILL
+#endif
+
+#if defined(__arm__)
+#define SH_PATCH_CPSR_T 0x20u  // thumb state
+#endif
+
+// B: [-128M, +128M - 4] (arm64), [-32M, +32M - 4] (a32)
+#if defined(__aarch64__)
+#define SH_PATCH_B_OFFSET_LOW  (134217728)
+#define SH_PATCH_B_OFFSET_HIGH (134217724)
+#elif defined(__arm__)
+#define SH_PATCH_B_OFFSET_LOW  (33554432)
+#define SH_PATCH_B_OFFSET_HIGH (33554428)
+#endif
+
+// the targets being patched, a slot is retired (but not cleared) after patching, so that
+// the late signals for it can still be recognized until the slot is reused
+#define SH_PATCH_SLOT_CNT 16
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wpadded"
+typedef struct {
+  uintptr_t addr;      // atomic
+  uintptr_t redirect;  // atomic, 0: wait for the end of patching
+  bool is_patching;    // atomic
+} sh_patch_slot_t;
+#pragma clang diagnostic pop
+
+static sh_patch_slot_t sh_patch_slots[SH_PATCH_SLOT_CNT];
+static size_t sh_patch_slots_idx = 0;
+static pthread_mutex_t sh_patch_lock = PTHREAD_MUTEX_INITIALIZER;
+static bool sh_patch_trap_enabled = false;
+
+static bool sh_patch_sig_interceptor(int signum, siginfo_t *siginfo, void *context) {
+  (void)signum;
+  (void)siginfo;
+
+  ucontext_t *uc = (ucontext_t *)context;
+#if defined(__aarch64__)
+  uintptr_t pc = (uintptr_t)uc->uc_mcontext.pc;
+#elif defined(__arm__)
+  uintptr_t pc = (uintptr_t)uc->uc_mcontext.arm_pc;
+#elif defined(__x86_64__)
+  uintptr_t pc = (uintptr_t)uc->uc_mcontext.gregs[REG_RIP];
+#elif defined(__riscv)
+  uintptr_t pc = (uintptr_t)uc->uc_mcontext.__gregs[REG_PC];
+#endif
+
+  // the same target may also be in the retired slots of its previous patching
+  bool is_found = false;
+  for (size_t i = 0; i < SH_PATCH_SLOT_CNT; i++) {
+    sh_patch_slot_t *slot = &sh_patch_slots[i];
+    if (pc != __atomic_load_n(&slot->addr, __ATOMIC_ACQUIRE)) continue;
+    is_found = true;
+    if (!__atomic_load_n(&slot->is_patching, __ATOMIC_ACQUIRE)) continue;
+
+    // the redirection is not possible: run the instruction at pc again after the patching
+    uintptr_t redirect = __atomic_load_n(&slot->redirect, __ATOMIC_RELAXED);
+    if (0 == redirect) return true;
+
+#if defined(__aarch64__)
+    uc->uc_mcontext.pc = redirect;
+#elif defined(__arm__)
+    uc->uc_mcontext.arm_pc = SH_UTIL_CLEAR_BIT0(redirect);
+    if (redirect & 1u)
+      uc->uc_mcontext.arm_cpsr |= SH_PATCH_CPSR_T;
+    else
+      uc->uc_mcontext.arm_cpsr &= ~SH_PATCH_CPSR_T;
+#elif defined(__x86_64__)
+    uc->uc_mcontext.gregs[REG_RIP] = (greg_t)redirect;
+#elif defined(__riscv)
+    uc->uc_mcontext.__gregs[REG_PC] = (unsigned long)redirect;
+#endif
+    return true;
+  }
+
+  // retired: run the (new) instruction at pc again
+  return is_found;
+}
+
+void sh_patch_init(void) {
+  if (0 != bytesig_init(SH_PATCH_TRAP_SIG)) {
+    SH_LOG_WARN("patch: init signal %d failed, patching without trap", SH_PATCH_TRAP_SIG);
+    return;
+  }
+  if (0 != bytesig_set_interceptor(SH_PATCH_TRAP_SIG, sh_patch_sig_interceptor)) return;
+  sh_patch_trap_enabled = true;
+}
+
+static sh_patch_slot_t *sh_patch_slot_acquire(uintptr_t addr, uintptr_t redirect) {
+  sh_patch_slot_t *slot = &sh_patch_slots[sh_patch_slots_idx];
+  sh_patch_slots_idx = (sh_patch_slots_idx + 1) % SH_PATCH_SLOT_CNT;
+
+  __atomic_store_n(&slot->addr, 0, __ATOMIC_RELEASE);
+  __atomic_store_n(&slot->redirect, redirect, __ATOMIC_RELAXED);
+  __atomic_store_n(&slot->is_patching, true, __ATOMIC_RELAXED);
+  __atomic_store_n(&slot->addr, addr, __ATOMIC_RELEASE);
+  return slot;
+}
+
+static void sh_patch_slot_retire(sh_patch_slot_t *slot) {
+  __atomic_store_n(&slot->is_patching, false, __ATOMIC_RELEASE);
+}
+
+// the first instruction unit to block the target while writing the tail
+static bool sh_patch_get_block_inst(uintptr_t target_addr, uintptr_t redirect_addr, bool is_thumb,
+                                    uint32_t *block_inst) {
+#if defined(__aarch64__)
+  (void)is_thumb;
+  if (0 != redirect_addr) {
+    if (redirect_addr >= target_addr ? redirect_addr - target_addr <= SH_PATCH_B_OFFSET_HIGH
+                                     : target_addr - redirect_addr <= SH_PATCH_B_OFFSET_LOW) {
+      *block_inst = 0x14000000u | (((uint32_t)(redirect_addr - target_addr) >> 2u) & 0x3FFFFFFu);
+      return false;
+    }
+  }
+  *block_inst = SH_PATCH_A64_TRAP;
+#elif defined(__arm__)
+  if (is_thumb) {
+    *block_inst = SH_PATCH_T16_TRAP;
+    return true;
+  }
+  if (0 != redirect_addr) {
+    uintptr_t pc = target_addr + 8;
+    if (redirect_addr >= pc ? redirect_addr - pc <= SH_PATCH_B_OFFSET_HIGH
+                            : pc - redirect_addr <= SH_PATCH_B_OFFSET_LOW) {
+      *block_inst = 0xEA000000u | (((uint32_t)(redirect_addr - pc) >> 2u) & 0xFFFFFFu);
+      return false;
+    }
+  }
+  *block_inst = SH_PATCH_A32_TRAP;
+#elif defined(__x86_64__)
+  // JMP rel32 is longer than the unit, always trap and redirect in the signal handler
+  (void)target_addr;
+  (void)redirect_addr;
+  (void)is_thumb;
+  *block_inst = SH_PATCH_X64_TRAP;
+#elif defined(__riscv)
+  // J (JAL X0) is longer than the unit (C.J is too short), always trap
+  (void)target_addr;
+  (void)redirect_addr;
+  (void)is_thumb;
+  *block_inst = SH_PATCH_RV64_TRAP;
+#endif
+  return true;
+}
+
+int sh_patch_write_inst(uintptr_t target_addr, void *inst, size_t inst_len, uintptr_t redirect_addr,
+                        bool is_thumb) {
+#if defined(__x86_64__)
+  size_t unit = 2;  // UD2
+#elif defined(__riscv)
+  size_t unit = 2;  // C.UNIMP
+#else
+  size_t unit = is_thumb ? 2 : 4;
+#endif
+  if (inst_len <= unit) return sh_util_write_inst(target_addr, inst, inst_len);
+
+  uint32_t block_inst;
+  bool is_trap = sh_patch_get_block_inst(target_addr, redirect_addr, is_thumb, &block_inst);
+  if (is_trap && !sh_patch_trap_enabled) return sh_util_write_inst(target_addr, inst, inst_len);
+
+  pthread_mutex_lock(&sh_patch_lock);
+  sh_patch_slot_t *slot = is_trap ? sh_patch_slot_acquire(target_addr, redirect_addr) : NULL;
+
+  // (1) block, (2) write the tail, (3) publish
+  uint32_t orig_inst = 0;
+  memcpy(&orig_inst, (void *)target_addr, unit);
+  int r;
+  if (0 != (r = sh_util_write_inst(target_addr, &block_inst, unit))) goto end;
+  if (0 != (r = sh_util_write_inst(target_addr + unit, (void *)((uintptr_t)inst + unit), inst_len - unit))) {
+    sh_util_write_inst(target_addr, &orig_inst, unit);
+    goto end;
+  }
+  r = sh_util_write_inst(target_addr, inst, unit);
+
+end:
+  if (NULL != slot) sh_patch_slot_retire(slot);
+  pthread_mutex_unlock(&sh_patch_lock);
+  return r;
+}
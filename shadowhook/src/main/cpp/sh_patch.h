@@ -0,0 +1,37 @@
+// Copyright (c) 2021-2025 ByteDance Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Install the process-wide signal handler (bytesig) for the traps: SIGTRAP for BRK (arm64) and BKPT (arm),
+// SIGILL for UD2 (x86_64) and C.UNIMP (riscv64). It only handles the signals raised at the targets being
+// patched and passes the others on. Without it, the instructions which need a trap are written in one step.
+void sh_patch_init(void);
+
+// Write the instructions which are longer than one instruction unit (4 bytes, 2 bytes for thumb, x86_64 and
+// riscv64) in three steps: (1) block the target with a B to redirect_addr or a trap, (2) write the tail,
+// (3) publish the first instruction unit. The threads hitting the target between (1) and (3) go
+// to redirect_addr, or wait until (3) is done if redirect_addr is 0.
+int sh_patch_write_inst(uintptr_t target_addr, void *inst, size_t inst_len, uintptr_t redirect_addr,
+                        bool is_thumb);
@@ -0,0 +1,221 @@
+// Copyright (c) 2021-2025 ByteDance Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include "sh_probe.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sh_log.h"
+#include "sh_sig.h"
+#include "sh_trampo.h"
+#include "sh_util.h"
+#include "shadowhook.h"
+
+#define SH_PROBE_DELAY_SEC 10
+
+// trampoline layout: [code][data: orig_addr, hit_ptr, hit]
+struct sh_probe {
+  uintptr_t trampo;
+};
+
+// global data for trampo
+static sh_trampo_mgr_t sh_probe_trampo_mgr;
+
+// global data for trampoline template
+static uintptr_t sh_probe_trampo_code_start;
+static size_t sh_probe_trampo_code_size;
+static size_t sh_probe_trampo_data_size;
+
+// probe trampoline template:
+// store a non-zero value (its own address) to the hit word, then jump to the original function
+// (no stack access and no atomic RMW, only the scratch registers are used). The hit word is written
+// via hit_ptr, which is the writable address of it (the trampoline may be mapped W^X)
+extern void *sh_probe_trampo_template_data __attribute__((visibility("hidden")));
+__attribute__((naked)) static void sh_probe_trampo_template(void) {
+#if defined(__arm__)
+  __asm__(
+      // Mark as hit
+      "ldr    ip, .L_probe_hit_ptr       \n"
+      "str    ip, [ip]                   \n"
+
+      // Call the original function
+      "ldr    ip, .L_probe_orig          \n"
+      "bx     ip                         \n"
+
+      ".balign 4;"
+      "sh_probe_trampo_template_data:"
+      ".global sh_probe_trampo_template_data;"
+      ".L_probe_orig:"
+      ".word 0;"
+      ".L_probe_hit_ptr:"
+      ".word 0;"
+      ".L_probe_hit:"
+      ".word 0;");
+#elif defined(__aarch64__)
+  __asm__(
+      // Mark as hit (only the first time, keep the cache line clean after that)
+      "ldr    x16, .L_probe_hit_ptr      \n"
+      "ldr    x17, [x16]                 \n"
+      "cbnz   x17, 1f                    \n"
+      "str    x16, [x16]                 \n"
+
+      // Call the original function
+      "1:                                \n"
+      "ldr    x16, .L_probe_orig         \n"
+      "br     x16                        \n"
+
+      ".balign 8;"
+      "sh_probe_trampo_template_data:"
+      ".global sh_probe_trampo_template_data;"
+      ".L_probe_orig:"
+      ".quad 0;"
+      ".L_probe_hit_ptr:"
+      ".quad 0;"
+      ".L_probe_hit:"
+      ".quad 0;");
+#elif defined(__x86_64__)
+  __asm__(
+      // Mark as hit (only the first time, keep the cache line clean after that)
+      "mov    .L_probe_hit_ptr(%rip), %r11 \n"
+      "cmpq   $0, (%r11)                 \n"
+      "jne    1f                         \n"
+      "mov    %r11, (%r11)               \n"
+
+      // Call the original function
+      "1:                                \n"
+      "jmp    *.L_probe_orig(%rip)       \n"
+
+      ".balign 8;"
+      "sh_probe_trampo_template_data:"
+      ".global sh_probe_trampo_template_data;"
+      ".L_probe_orig:"
+      ".quad 0;"
+      ".L_probe_hit_ptr:"
+      ".quad 0;"
+      ".L_probe_hit:"
+      ".quad 0;");
+#elif defined(__riscv)
+  __asm__(
+      ".option push                      \n"
+      ".option norelax                   \n"
+
+      // Mark as hit (only the first time, keep the cache line clean after that)
+      "ld     t1, .L_probe_hit_ptr       \n"
+      "ld     t3, 0(t1)                  \n"
+      "bnez   t3, 1f                     \n"
+      "sd     t1, 0(t1)                  \n"
+
+      // Call the original function
+      "1:                                \n"
+      "ld     t1, .L_probe_orig          \n"
+      "jr     t1                         \n"
+
+      ".balign 8;"
+      "sh_probe_trampo_template_data:"
+      ".global sh_probe_trampo_template_data;"
+      ".L_probe_orig:"
+      ".quad 0;"
+      ".L_probe_hit_ptr:"
+      ".quad 0;"
+      ".L_probe_hit:"
+      ".quad 0;"
+      ".option pop;");
+#endif
+}
+
+void sh_probe_init(void) {
+  sh_probe_trampo_code_start = (uintptr_t)&sh_probe_trampo_template;
+#if defined(__arm__) && defined(__thumb__)
+  sh_probe_trampo_code_start = SH_UTIL_CLEAR_BIT0(sh_probe_trampo_code_start);
+#endif
+  sh_probe_trampo_code_size = (uintptr_t)(&sh_probe_trampo_template_data) - sh_probe_trampo_code_start;
+  sh_probe_trampo_data_size = sizeof(void *) * 3;
+
+  sh_trampo_init_mgr(&sh_probe_trampo_mgr, sh_probe_trampo_code_size + sh_probe_trampo_data_size,
+                     SH_PROBE_DELAY_SEC);
+}
+
+int sh_probe_create(sh_probe_t **self) {
+  *self = NULL;
+
+  sh_probe_t *obj = malloc(sizeof(sh_probe_t));
+  if (NULL == obj) return SHADOWHOOK_ERRNO_OOM;
+
+  // alloc memory for trampoline
+  if (0 == (obj->trampo = sh_trampo_alloc(&sh_probe_trampo_mgr))) {
+    free(obj);
+    return SHADOWHOOK_ERRNO_OOM;
+  }
+
+  // fill in code
+  SH_SIG_TRY(SIGSEGV, SIGBUS) {
+    memcpy((void *)sh_trampo_get_rw_addr(obj->trampo), (void *)sh_probe_trampo_code_start,
+           sh_probe_trampo_code_size);
+  }
+  SH_SIG_CATCH() {
+    sh_trampo_free(&sh_probe_trampo_mgr, obj->trampo);
+    free(obj);
+    SH_LOG_WARN("probe: fill in code crashed");
+    return SHADOWHOOK_ERRNO_OOM;
+  }
+  SH_SIG_EXIT
+
+  // fill in data
+  void **data = (void **)(sh_trampo_get_rw_addr(obj->trampo) + sh_probe_trampo_code_size);
+  data[0] = NULL;               // orig_addr, set by switch
+  data[1] = (void *)(&data[2]);  // hit_ptr
+  data[2] = NULL;               // hit
+
+  // clear CPU cache
+  sh_util_clear_cache(obj->trampo, sh_probe_trampo_code_size + sh_probe_trampo_data_size);
+
+  SH_LOG_DEBUG("probe: create trampo at %" PRIxPTR ", size %zu + %zu", obj->trampo, sh_probe_trampo_code_size,
+               sh_probe_trampo_data_size);
+  *self = obj;
+  return 0;
+}
+
+void sh_probe_destroy(sh_probe_t *self) {
+  // threads may still be running in the trampoline, it is freed with a delay by the trampo manager
+  if (0 != self->trampo) sh_trampo_free(&sh_probe_trampo_mgr, self->trampo);
+  free(self);
+}
+
+uintptr_t sh_probe_get_trampo_addr(sh_probe_t *self) {
+#if defined(__arm__) && defined(__thumb__)
+  return self->trampo + 1;
+#else
+  return self->trampo;
+#endif
+}
+
+uintptr_t *sh_probe_get_orig_addr(sh_probe_t *self) {
+  return (uintptr_t *)(sh_trampo_get_rw_addr(self->trampo) + sh_probe_trampo_code_size);
+}
+
+bool sh_probe_is_hit(sh_probe_t *self) {
+  uintptr_t hit = sh_trampo_get_rw_addr(self->trampo) + sh_probe_trampo_code_size + sizeof(void *) * 2;
+  return 0 != __atomic_load_n((uintptr_t *)hit, __ATOMIC_RELAXED);
+}
@@ -375,6 +375,8 @@ static const char *sh_recorder_get_op_name(uint8_t op) {
       return "intercept_sym_name";
     case SH_RECORDER_OP_UNINTERCEPT:
       return "unintercept";
+    case SH_RECORDER_OP_TRIP:
+      return "trip";
     default:
       return "error";
   }
@@ -35,6 +35,7 @@
 #define SH_RECORDER_OP_INTERCEPT_SYM_ADDR   7
 #define SH_RECORDER_OP_INTERCEPT_SYM_NAME   8
 #define SH_RECORDER_OP_UNINTERCEPT          9
+#define SH_RECORDER_OP_TRIP                 10
 
 bool sh_recorder_get_recordable(void);
 void sh_recorder_set_recordable(bool recordable);
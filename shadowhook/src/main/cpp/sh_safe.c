@@ -29,6 +29,11 @@
 
 #include "sh_util.h"
 #include "xdl.h"
+
+#if defined(__riscv)
+#include <errno.h>
+#include <sys/syscall.h>
+#else
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wreserved-id-macro"
 #pragma clang diagnostic ignored "-Wvariadic-macros"
@@ -40,6 +45,7 @@
 #pragma clang diagnostic ignored "-Wpadded"
 #include "linux_syscall_support.h"
 #pragma clang diagnostic pop
+#endif
 
 #define SH_SAFE_IDX_PTHREAD_GETSPECIFIC 0
 #define SH_SAFE_IDX_PTHREAD_SETSPECIFIC 1
@@ -113,6 +119,10 @@ __attribute__((always_inline)) int sh_safe_pthread_setspecific(pthread_key_t key
     __asm__("mrs %0, tpidr_el0" : "=r"(tls));
 #elif defined(__arm__)
     __asm__("mrc p15, 0, %0, c13, c0, 3" : "=r"(tls));
+#elif defined(__x86_64__)
+    __asm__("mov %%fs:0, %0" : "=r"(tls));
+#elif defined(__riscv)
+    __asm__("mv %0, tp" : "=r"(tls));
 #endif
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wcast-qual"
@@ -127,16 +137,48 @@ __attribute__((always_inline)) void sh_safe_abort(void) {
   ((void (*)(void))addr)();
 }
 
+#if defined(__riscv)
+// LSS does not support riscv64, make the raw syscalls (ECALL) instead
+static long sh_safe_syscall6(long nr, long arg0, long arg1, long arg2, long arg3, long arg4, long arg5) {
+  register long a0 __asm__("a0") = arg0;
+  register long a1 __asm__("a1") = arg1;
+  register long a2 __asm__("a2") = arg2;
+  register long a3 __asm__("a3") = arg3;
+  register long a4 __asm__("a4") = arg4;
+  register long a5 __asm__("a5") = arg5;
+  register long a7 __asm__("a7") = nr;
+  __asm__ volatile("ecall" : "+r"(a0) : "r"(a1), "r"(a2), "r"(a3), "r"(a4), "r"(a5), "r"(a7) : "memory");
+
+  if (__predict_false((unsigned long)a0 > (unsigned long)-4096)) {
+    errno = (int)-a0;
+    return -1;
+  }
+  return a0;
+}
+#endif
+
 __attribute__((always_inline)) void *sh_safe_mmap(void *addr, size_t length, int prot, int flags, int fd,
                                                   off_t offset) {
+#if defined(__riscv)
+  return (void *)sh_safe_syscall6(__NR_mmap, (long)addr, (long)length, prot, flags, fd, (long)offset);
+#else
   return sys_mmap(addr, length, prot, flags, fd, offset);
+#endif
 }
 
 __attribute__((always_inline)) int sh_safe_munmap(void *addr, size_t size) {
+#if defined(__riscv)
+  return (int)sh_safe_syscall6(__NR_munmap, (long)addr, (long)size, 0, 0, 0, 0);
+#else
   return sys_munmap(addr, size);
+#endif
 }
 
 __attribute__((always_inline)) int sh_safe_prctl(int option, unsigned long arg2, unsigned long arg3,
                                                  unsigned long arg4, unsigned long arg5) {
+#if defined(__riscv)
+  return (int)sh_safe_syscall6(__NR_prctl, option, (long)arg2, (long)arg3, (long)arg4, (long)arg5, 0);
+#else
   return sys_prctl(option, arg2, arg3, arg4, arg5);
+#endif
 }
@@ -32,6 +32,7 @@
 #include <unistd.h>
 
 #include "queue.h"
+#include "sh_breaker.h"
 #include "sh_config.h"
 #include "sh_errno.h"
 #include "sh_hub.h"
@@ -46,12 +47,15 @@
 #include "shadowhook.h"
 #include "tree.h"
 
-#define SH_SWITCH_DELAY_SEC                    10
-#define SH_SWITCH_GLUE_LAUNCHER_ANON_PAGE_NAME "shadowhook-interceptor-glue-launcher"
+#define SH_SWITCH_DELAY_SEC 10
 #if defined(__arm__)
 #define SH_SWITCH_GLUE_LAUNCHER_SZ 20
 #elif defined(__aarch64__)
 #define SH_SWITCH_GLUE_LAUNCHER_SZ 28
+#elif defined(__x86_64__)
+#define SH_SWITCH_GLUE_LAUNCHER_SZ 33
+#elif defined(__riscv)
+#define SH_SWITCH_GLUE_LAUNCHER_SZ 40
 #endif
 
 #define SH_SWITCH_HOOK_MODE_NONE   0  // only interceptors
@@ -65,7 +69,9 @@ typedef struct sh_switch_interceptor {
   shadowhook_interceptor_t pre;
   void *data;
   size_t flags;
-  bool enabled;
+  bool enabled;     // atomic, cleared by del and by the circuit breaker
+  bool registered;  // not deleted, a tripped interceptor is registered but not enabled
+  sh_breaker_t breaker;
   SLIST_ENTRY(sh_switch_interceptor, ) link;
 } sh_switch_interceptor_t;
 #pragma clang diagnostic pop
@@ -92,12 +98,13 @@ typedef struct sh_switch {
   uintptr_t target_addr;  // key
   sh_addr_info_t addr_info;
   sh_inst_t inst;
-  uintptr_t start_addr;  // = proxy_addr(without interceptor) / glue_launcher_addr(with interceptor)
+  uintptr_t start_addr;  // = gate_addr(without interceptor) / glue_launcher_addr(with interceptor)
   uintptr_t proxy_addr;  // = 0 (none mode) / = new_addr(unique mode) / first new_addr(queue mode)
   uintptr_t resume_addr;
   sh_hub_t *hub;                    // for shared mode
   sh_switch_proxy_queue_t proxies;  // for multi mode
   uintptr_t glue_launcher_addr;     // trampoline for shadowhook_interceptor_glue()
+  uintptr_t gate_addr;              // trampoline for the bypass check, then jump to proxy_addr
   sh_switch_interceptor_list_t interceptors;
   size_t interceptors_size;
   time_t destroy_ts;
@@ -123,6 +130,33 @@ RB_GENERATE_STATIC(sh_switch_tree, sh_switch, link_rbtree, sh_switch_cmp)
 static sh_switch_tree_t sh_switches = RB_INITIALIZER(&sh_switches);
 static pthread_mutex_t sh_switches_lock = PTHREAD_MUTEX_INITIALIZER;
 
+// snapshot of the switch tree, published for lock-free readers
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wpadded"
+typedef struct sh_switch_snapshot {
+  TAILQ_ENTRY(sh_switch_snapshot, ) link;
+  size_t infos_cnt;
+  shadowhook_hook_info_t infos[];  // sorted by target_addr
+} sh_switch_snapshot_t;
+#pragma clang diagnostic pop
+
+// snapshot queue
+typedef TAILQ_HEAD(sh_switch_snapshot_queue, sh_switch_snapshot, ) sh_switch_snapshot_queue_t;
+
+// snapshot objects (retired snapshots are protected by sh_switches_lock)
+static sh_switch_snapshot_t *sh_switches_snapshot = NULL;
+static sh_switch_snapshot_queue_t sh_switches_snapshot_retired =
+    TAILQ_HEAD_INITIALIZER(sh_switches_snapshot_retired);
+
+// The count of the readers in sh_switch_is_hooked() and sh_switch_foreach() (atomic). A reader counts
+// itself before loading the snapshot, so once it is 0 after a snapshot is replaced, no reader can hold
+// any of the retired snapshots.
+static size_t sh_switches_snapshot_readers = 0;
+
+// while a batch is open, publishing is deferred to the end of the batch (protected by sh_switches_lock)
+static size_t sh_switches_batch_depth = 0;
+static bool sh_switches_snapshot_dirty = false;
+
 // switch queue
 typedef TAILQ_HEAD(sh_switch_queue, sh_switch, ) sh_switch_queue_t;
 
@@ -130,7 +164,119 @@ typedef TAILQ_HEAD(sh_switch_queue, sh_switch, ) sh_switch_queue_t;
 static sh_switch_queue_t sh_switches_delayed_destroy = TAILQ_HEAD_INITIALIZER(sh_switches_delayed_destroy);
 static pthread_mutex_t sh_switches_delayed_destroy_lock = PTHREAD_MUTEX_INITIALIZER;
 
+// while sh_switch_undo_batch() runs, the switches destroyed with delay are collected here, and queued
+// together at its end (protected by sh_switches_lock)
+static sh_switch_queue_t sh_switches_undo_destroy = TAILQ_HEAD_INITIALIZER(sh_switches_undo_destroy);
+static bool sh_switches_undo_batching = false;
+
 static sh_trampo_mgr_t sh_switch_interceptor_trampo_mgr;
+static sh_trampo_mgr_t sh_switch_gate_trampo_mgr;
+
+// global data for gate trampoline template
+static uintptr_t sh_switch_gate_code_start;
+static size_t sh_switch_gate_code_size;
+static size_t sh_switch_gate_data_size;
+
+// gate trampoline template: jump to the original function when bypassed, otherwise to the proxy
+// functions (the scratch registers and flags are corrupted, the same as by a proxy function)
+extern void *sh_switch_gate_template_data __attribute__((visibility("hidden")));
+__attribute__((naked)) static void sh_switch_gate_template(void) {
+#if defined(__arm__)
+  __asm__(
+      "ldr   ip, .L_gate_bypass       \n"
+      "ldr   ip, [ip]                 \n"
+      "tst   ip, #1                   \n"
+      "bne   1f                       \n"
+      "ldr   ip, .L_gate_proxy        \n"
+      "bx    ip                       \n"
+      "1:                             \n"
+      "ldr   ip, .L_gate_resume       \n"
+      "bx    ip                       \n"
+
+      ".balign 4;"
+      "sh_switch_gate_template_data:"
+      ".global sh_switch_gate_template_data;"
+      ".L_gate_bypass:"
+      ".word 0;"
+      ".L_gate_proxy:"
+      ".word 0;"
+      ".L_gate_resume:"
+      ".word 0;");
+#elif defined(__aarch64__)
+  __asm__(
+      "ldr   x16, .L_gate_bypass      \n"
+      "ldr   w16, [x16]               \n"
+      "tbnz  w16, #0, 1f              \n"
+      "ldr   x16, .L_gate_proxy       \n"
+      "br    x16                      \n"
+      "1:                             \n"
+      "ldr   x16, .L_gate_resume      \n"
+      "br    x16                      \n"
+
+      ".balign 8;"
+      "sh_switch_gate_template_data:"
+      ".global sh_switch_gate_template_data;"
+      ".L_gate_bypass:"
+      ".quad 0;"
+      ".L_gate_proxy:"
+      ".quad 0;"
+      ".L_gate_resume:"
+      ".quad 0;");
+#elif defined(__x86_64__)
+  __asm__(
+      "mov   .L_gate_bypass(%rip), %r11 \n"
+      "testb $1, (%r11)               \n"
+      "jnz   1f                       \n"
+      "jmp   *.L_gate_proxy(%rip)     \n"
+      "1:                             \n"
+      "jmp   *.L_gate_resume(%rip)    \n"
+
+      ".balign 8;"
+      "sh_switch_gate_template_data:"
+      ".global sh_switch_gate_template_data;"
+      ".L_gate_bypass:"
+      ".quad 0;"
+      ".L_gate_proxy:"
+      ".quad 0;"
+      ".L_gate_resume:"
+      ".quad 0;");
+#elif defined(__riscv)
+  __asm__(
+      ".option push                   \n"
+      ".option norelax                \n"
+
+      "ld    t1, .L_gate_bypass       \n"
+      "lw    t1, 0(t1)                \n"
+      "andi  t1, t1, 1                \n"
+      "bnez  t1, 1f                   \n"
+      "ld    t1, .L_gate_proxy        \n"
+      "jr    t1                       \n"
+      "1:                             \n"
+      "ld    t1, .L_gate_resume       \n"
+      "jr    t1                       \n"
+
+      ".balign 8;"
+      "sh_switch_gate_template_data:"
+      ".global sh_switch_gate_template_data;"
+      ".L_gate_bypass:"
+      ".quad 0;"
+      ".L_gate_proxy:"
+      ".quad 0;"
+      ".L_gate_resume:"
+      ".quad 0;"
+      ".option pop;");
+#endif
+}
+
+// the interceptor running on the current thread, for the circuit breaker
+// (a local of sh_switch_interceptor_call_pre(), it is left behind if pre() is left by siglongjmp())
+typedef struct {
+  sh_switch_t *sw;
+  sh_switch_interceptor_t *interceptor;
+  uintptr_t cookie;  // the address of the frame itself
+} sh_switch_pre_frame_t;
+static pthread_key_t sh_switch_pre_tls_key;
+static bool sh_switch_pre_tls_key_ok = false;
 
 static size_t sh_switch_get_hook_mode(size_t flags) {
   if (flags & SHADOWHOOK_HOOK_WITH_SHARED_MODE) {
@@ -154,8 +300,57 @@ static size_t sh_switch_get_hook_mode(size_t flags) {
 }
 
 void sh_switch_init(void) {
-  sh_trampo_init_mgr(&sh_switch_interceptor_trampo_mgr, SH_SWITCH_GLUE_LAUNCHER_ANON_PAGE_NAME,
-                     SH_SWITCH_GLUE_LAUNCHER_SZ, 0);
+  sh_trampo_init_mgr(&sh_switch_interceptor_trampo_mgr, SH_SWITCH_GLUE_LAUNCHER_SZ, 0);
+
+  sh_switch_gate_code_start = (uintptr_t)&sh_switch_gate_template;
+#if defined(__arm__) && defined(__thumb__)
+  sh_switch_gate_code_start = SH_UTIL_CLEAR_BIT0(sh_switch_gate_code_start);
+#endif
+  sh_switch_gate_code_size = (uintptr_t)(&sh_switch_gate_template_data) - sh_switch_gate_code_start;
+  sh_switch_gate_data_size = sizeof(void *) * 3;
+  sh_trampo_init_mgr(&sh_switch_gate_trampo_mgr, sh_switch_gate_code_size + sh_switch_gate_data_size, 0);
+
+  if (0 == pthread_key_create(&sh_switch_pre_tls_key, NULL))
+    __atomic_store_n(&sh_switch_pre_tls_key_ok, true, __ATOMIC_RELEASE);
+}
+
+// data of gate: [bypass_gen_addr][proxy_addr][resume_addr]
+static uintptr_t *sh_switch_gate_get_data(sh_switch_t *self) {
+  uintptr_t trampo = SH_UTIL_CLEAR_BIT0(self->gate_addr);
+  return (uintptr_t *)(sh_trampo_get_rw_addr(trampo) + sh_switch_gate_code_size);
+}
+
+static void sh_switch_set_resume_addr(sh_switch_t *self, uintptr_t resume_addr) {
+  self->resume_addr = resume_addr;
+  uintptr_t *data = sh_switch_gate_get_data(self);
+  __atomic_store_n(&data[2], resume_addr, __ATOMIC_RELEASE);
+  if (0 == self->proxy_addr) __atomic_store_n(&data[1], resume_addr, __ATOMIC_RELEASE);
+}
+
+static void sh_switch_set_proxy_addr(sh_switch_t *self, uintptr_t proxy_addr) {
+  __atomic_store_n(&self->proxy_addr, proxy_addr, __ATOMIC_RELEASE);
+
+  // the gate goes to the original function when there is no proxy function (e.g. while unhooking)
+  uintptr_t *data = sh_switch_gate_get_data(self);
+  __atomic_store_n(&data[1], 0 != proxy_addr ? proxy_addr : self->resume_addr, __ATOMIC_RELEASE);
+}
+
+static int sh_switch_create_gate(sh_switch_t *self) {
+  uintptr_t trampo = sh_trampo_alloc(&sh_switch_gate_trampo_mgr);
+  if (0 == trampo) return SHADOWHOOK_ERRNO_OOM;
+#if defined(__arm__) && defined(__thumb__)
+  self->gate_addr = trampo + 1;
+#else
+  self->gate_addr = trampo;
+#endif
+
+  memcpy((void *)sh_trampo_get_rw_addr(trampo), (void *)sh_switch_gate_code_start, sh_switch_gate_code_size);
+  uintptr_t *data = sh_switch_gate_get_data(self);
+  data[0] = (uintptr_t)sh_hub_get_bypass_gen_addr();
+  data[1] = 0 != self->proxy_addr ? self->proxy_addr : self->resume_addr;
+  data[2] = self->resume_addr;
+  sh_util_clear_cache(trampo, sh_switch_gate_code_size + sh_switch_gate_data_size);
+  return 0;
 }
 
 static void sh_switch_inst_set_orig_addr(uintptr_t addr, void *arg) {
@@ -167,7 +362,7 @@ static void sh_switch_inst_set_orig_addr(uintptr_t addr, void *arg) {
   if (NULL != orig_addr) __atomic_store_n(orig_addr, addr, __ATOMIC_SEQ_CST);
   if (NULL != orig_addr2) __atomic_store_n(orig_addr2, addr, __ATOMIC_SEQ_CST);
   if (self->addr_info.is_proc_start) sh_safe_set_orig_addr(self->target_addr, addr);
-  self->resume_addr = addr;
+  sh_switch_set_resume_addr(self, addr);
 }
 
 static int sh_switch_inst_hook(sh_switch_t *self, uintptr_t new_addr, uintptr_t *orig_addr,
@@ -194,7 +389,8 @@ static int sh_switch_inst_unhook(sh_switch_t *self) {
   return 0;
 }
 
-static int sh_switch_proxy_add(sh_switch_t *self, uintptr_t new_addr, uintptr_t *orig_addr, bool add_to_hub) {
+static int sh_switch_proxy_add(sh_switch_t *self, uintptr_t new_addr, uintptr_t *orig_addr, void *data,
+                               bool add_to_hub) {
   int r;
   uintptr_t hub_trampo_addr = (NULL == self->hub ? 0 : sh_hub_get_trampo_addr(self->hub));
   bool is_hub_in_queue = false;
@@ -214,9 +410,9 @@ static int sh_switch_proxy_add(sh_switch_t *self, uintptr_t new_addr, uintptr_t
 
   if (add_to_hub) {
     if (NULL == self->hub) {
-      if (0 != (r = sh_hub_create(&self->hub))) return r;
+      if (0 != (r = sh_hub_create(&self->hub, self->target_addr))) return r;
     }
-    if (0 != (r = sh_hub_add_proxy(self->hub, new_addr))) return r;
+    if (0 != (r = sh_hub_add_proxy(self->hub, new_addr, data))) return r;
     if (NULL != orig_addr) *orig_addr = self->resume_addr;
   }
 
@@ -237,19 +433,20 @@ static int sh_switch_proxy_add(sh_switch_t *self, uintptr_t new_addr, uintptr_t
       __atomic_store_n(prev->orig_addr, proxy->new_addr, __ATOMIC_RELEASE);
     } else {
       self->hook_mode = SH_SWITCH_HOOK_MODE_QUEUE;
-      __atomic_store_n(&self->proxy_addr, proxy->new_addr, __ATOMIC_RELEASE);
+      sh_switch_set_proxy_addr(self, proxy->new_addr);
     }
   }
 
   return 0;
 }
 
-static int sh_switch_proxy_add_shared(sh_switch_t *self, uintptr_t new_addr, uintptr_t *orig_addr) {
-  return sh_switch_proxy_add(self, new_addr, orig_addr, true);
+static int sh_switch_proxy_add_shared(sh_switch_t *self, uintptr_t new_addr, uintptr_t *orig_addr,
+                                      void *data) {
+  return sh_switch_proxy_add(self, new_addr, orig_addr, data, true);
 }
 
 static int sh_switch_proxy_add_multi(sh_switch_t *self, uintptr_t new_addr, uintptr_t *orig_addr) {
-  return sh_switch_proxy_add(self, new_addr, orig_addr, false);
+  return sh_switch_proxy_add(self, new_addr, orig_addr, NULL, false);
 }
 
 static int sh_switch_proxy_del(sh_switch_t *self, uintptr_t new_addr, bool del_from_hub) {
@@ -287,14 +484,10 @@ static int sh_switch_proxy_del(sh_switch_t *self, uintptr_t new_addr, bool del_f
     }
   } else {
     if (NULL != next) {
-      if (self->proxy_addr == self->start_addr) {
-        // prev == NULL && next != NULL && proxy_addr == start_addr
-        if (0 != (r = sh_switch_inst_rehook(self, next->new_addr))) return r;
-      }
-      __atomic_store_n(&self->proxy_addr, next->new_addr, __ATOMIC_RELEASE);
+      sh_switch_set_proxy_addr(self, next->new_addr);
     } else {
       self->hook_mode = SH_SWITCH_HOOK_MODE_NONE;
-      __atomic_store_n(&self->proxy_addr, 0, __ATOMIC_RELEASE);
+      sh_switch_set_proxy_addr(self, 0);
     }
   }
 
@@ -312,18 +505,110 @@ static int sh_switch_proxy_del_multi(sh_switch_t *self, uintptr_t new_addr) {
   return sh_switch_proxy_del(self, new_addr, false);
 }
 
+static int sh_switch_proxy_replace_multi(sh_switch_t *self, uintptr_t new_addr, uintptr_t new_new_addr) {
+  uintptr_t hub_trampo_addr = (NULL == self->hub ? 0 : sh_hub_get_trampo_addr(self->hub));
+
+  // check duplicated proxy function, and find in proxy-info queue
+  sh_switch_proxy_t *proxy, *found = NULL;
+  TAILQ_FOREACH(proxy, &self->proxies, link) {
+    if (proxy->new_addr == hub_trampo_addr) continue;
+    if (proxy->new_addr == new_new_addr) return SHADOWHOOK_ERRNO_HOOK_MULTI_DUP;
+    if (proxy->new_addr == new_addr) found = proxy;
+  }
+  if (NULL == found) return SHADOWHOOK_ERRNO_UNHOOK_NOTFOUND;
+
+  // replace node in runtime proxy queue
+  // (the new proxy function keeps using the same orig_addr as the old one)
+  sh_switch_proxy_t *prev = TAILQ_PREV(found, sh_switch_proxy_queue, link);
+  if (NULL != prev) {
+    __atomic_store_n(prev->orig_addr, new_new_addr, __ATOMIC_RELEASE);
+  } else {
+    sh_switch_set_proxy_addr(self, new_new_addr);
+  }
+  found->new_addr = new_new_addr;
+  return 0;
+}
+
+static void sh_switch_interceptor_call_pre(sh_switch_t *self, sh_switch_interceptor_t *interceptor,
+                                           shadowhook_cpu_context_t *cpu_context) {
+  if (__predict_true(!sh_breaker_is_armed() || !sh_switch_pre_tls_key_ok)) {
+    interceptor->pre(cpu_context, interceptor->data);
+    return;
+  }
+
+  // let the SIGSEGV / SIGBUS handler find the interceptor (interceptors may be nested)
+  sh_switch_pre_frame_t frame = {self, interceptor, 0};
+  frame.cookie = (uintptr_t)&frame;
+  void *prev_frame = sh_safe_pthread_getspecific(sh_switch_pre_tls_key);
+  sh_safe_pthread_setspecific(sh_switch_pre_tls_key, &frame);
+  interceptor->pre(cpu_context, interceptor->data);
+  sh_safe_pthread_setspecific(sh_switch_pre_tls_key, prev_frame);
+}
+
+bool sh_switch_report_sig_fault(uintptr_t sp) {
+  if (!__atomic_load_n(&sh_switch_pre_tls_key_ok, __ATOMIC_ACQUIRE)) return false;
+  sh_switch_pre_frame_t *frame = (sh_switch_pre_frame_t *)sh_safe_pthread_getspecific(sh_switch_pre_tls_key);
+  if (NULL == frame) return false;
+
+  // the frame of a running pre() is above the SP of the fault, otherwise it was left behind
+  if ((uintptr_t)frame < sp || frame->cookie != (uintptr_t)frame) {
+    sh_safe_pthread_setspecific(sh_switch_pre_tls_key, NULL);
+    return false;
+  }
+
+  sh_switch_interceptor_t *interceptor = frame->interceptor;
+  sh_breaker_add_fault(&interceptor->breaker, &interceptor->enabled, frame->sw->target_addr,
+                       (void *)(uintptr_t)interceptor->pre);
+  return true;
+}
+
 void shadowhook_interceptor_caller(void *ctx, shadowhook_cpu_context_t *cpu_context, void **next_hop) {
   sh_switch_t *self = (sh_switch_t *)ctx;
 
-#if defined(__aarch64__)
-  cpu_context->pc = self->target_addr;
+#if defined(__aarch64__) || defined(__riscv)
+  uintptr_t pc = self->target_addr;
+  cpu_context->pc = pc;
 #elif defined(__arm__)
-  cpu_context->regs[15] = SH_UTIL_CLEAR_BIT0(self->target_addr);
+  uintptr_t pc = SH_UTIL_CLEAR_BIT0(self->target_addr);
+  cpu_context->regs[15] = pc;
+#elif defined(__x86_64__)
+  uintptr_t pc = self->target_addr;
+  cpu_context->rip = pc;
+  uint64_t sp = cpu_context->regs[4];  // the return address is popped when returning now
 #endif
 
+  // global kill switch: skip interceptors and proxies, go straight back to the original function
+  if (__predict_false(sh_hub_is_bypassed())) {
+    *next_hop = (void *)self->resume_addr;
+    return;
+  }
+
   sh_switch_interceptor_t *interceptor;
   SLIST_FOREACH(interceptor, &self->interceptors, link) {
-    if (interceptor->enabled) interceptor->pre(cpu_context, interceptor->data);
+    if (!interceptor->enabled) continue;
+    sh_switch_interceptor_call_pre(self, interceptor, cpu_context);
+
+    // the interceptor changed PC to LR: skip the original function and return to the caller now
+    // (only at the function entry, where SP and callee-saved registers still belong to the caller)
+#if defined(__aarch64__) || defined(__riscv)
+    uintptr_t new_pc = (uintptr_t)cpu_context->pc;
+    cpu_context->pc = pc;
+#elif defined(__arm__)
+    uintptr_t new_pc = (uintptr_t)cpu_context->regs[15];
+    cpu_context->regs[15] = pc;
+#elif defined(__x86_64__)
+    uintptr_t new_pc = (uintptr_t)cpu_context->rip;
+    cpu_context->rip = pc;
+    uint64_t new_sp = cpu_context->regs[4];
+    cpu_context->regs[4] = sp;
+#endif
+    if (__predict_false(new_pc != pc && (interceptor->flags & SHADOWHOOK_INTERCEPT_WITH_RETURN))) {
+#if defined(__x86_64__)
+      cpu_context->regs[4] = new_sp;
+#endif
+      *next_hop = (void *)new_pc;
+      return;
+    }
   }
 
   uintptr_t proxy_addr = __atomic_load_n(&self->proxy_addr, __ATOMIC_ACQUIRE);
@@ -335,15 +620,17 @@ static int sh_switch_interceptor_add(sh_switch_t *self, shadowhook_interceptor_t
   // check repeated interceptor
   sh_switch_interceptor_t *interceptor;
   SLIST_FOREACH(interceptor, &self->interceptors, link) {
-    if (interceptor->pre == pre && interceptor->data == data && interceptor->enabled) {
+    if (interceptor->pre == pre && interceptor->data == data && interceptor->registered) {
       return SHADOWHOOK_ERRNO_INTERCEPT_DUP;
     }
   }
 
   // try to re-enable an exists item
   SLIST_FOREACH(interceptor, &self->interceptors, link) {
-    if (interceptor->pre == pre && interceptor->data == data && !interceptor->enabled) {
+    if (interceptor->pre == pre && interceptor->data == data && !interceptor->registered) {
       interceptor->flags = flags;
+      interceptor->registered = true;
+      sh_breaker_reset(&interceptor->breaker);
       self->intercept_flags_union |= flags;
       self->interceptors_size++;
       __atomic_store_n((bool *)&interceptor->enabled, true, __ATOMIC_RELEASE);
@@ -359,6 +646,8 @@ static int sh_switch_interceptor_add(sh_switch_t *self, shadowhook_interceptor_t
   interceptor->data = data;
   interceptor->flags = flags;
   interceptor->enabled = true;
+  interceptor->registered = true;
+  sh_breaker_reset(&interceptor->breaker);
 
   self->intercept_flags_union |= flags;
   self->interceptors_size++;
@@ -381,9 +670,10 @@ static int sh_switch_interceptor_del(sh_switch_t *self, shadowhook_interceptor_t
 
   sh_switch_interceptor_t *interceptor;
   SLIST_FOREACH(interceptor, &self->interceptors, link) {
-    if (interceptor->enabled) {
+    if (interceptor->registered) {
       if (interceptor->pre == pre && interceptor->data == data) {
         self->interceptors_size--;
+        interceptor->registered = false;
         __atomic_store_n((bool *)&interceptor->enabled, false, __ATOMIC_RELEASE);
         SH_LOG_INFO("switch-interceptor: size %zu: del pre %" PRIxPTR ", data %" PRIxPTR,
                     self->interceptors_size, (uintptr_t)pre, (uintptr_t)data);
@@ -403,7 +693,7 @@ static int sh_switch_create_glue_launcher(sh_switch_t *self) {
   self->glue_launcher_addr = sh_trampo_alloc(&sh_switch_interceptor_trampo_mgr);
   if (0 == self->glue_launcher_addr) return SHADOWHOOK_ERRNO_OOM;
 
-  sh_inst_build_glue_launcher((void *)(self->glue_launcher_addr), self);
+  sh_inst_build_glue_launcher((void *)sh_trampo_get_rw_addr(self->glue_launcher_addr), self);
   sh_util_clear_cache(self->glue_launcher_addr, SH_SWITCH_GLUE_LAUNCHER_SZ);
 
   SH_LOG_INFO("switch: create glue_launcher, target_addr %" PRIxPTR, self->target_addr);
@@ -416,6 +706,8 @@ static void sh_switch_destroy_inner(sh_switch_t *self) {
   if (0 != self->glue_launcher_addr)
     sh_trampo_free(&sh_switch_interceptor_trampo_mgr, self->glue_launcher_addr);
 
+  if (0 != self->gate_addr) sh_trampo_free(&sh_switch_gate_trampo_mgr, SH_UTIL_CLEAR_BIT0(self->gate_addr));
+
   while (!TAILQ_EMPTY(&self->proxies)) {
     sh_switch_proxy_t *proxy = TAILQ_FIRST(&self->proxies);
     TAILQ_REMOVE(&self->proxies, proxy, link);
@@ -431,29 +723,43 @@ static void sh_switch_destroy_inner(sh_switch_t *self) {
   free(self);
 }
 
+// destroy the expired switches, then queue the switches of queue (with the same timestamp)
+static void sh_switch_destroy_delayed(sh_switch_queue_t *queue) {
+  pthread_mutex_lock(&sh_switches_delayed_destroy_lock);
+  time_t now = 0;
+  sh_switch_t *sw, *tmp;
+  TAILQ_FOREACH_SAFE(sw, &sh_switches_delayed_destroy, link_tailq, tmp) {
+    if (0 == now) now = sh_util_get_stable_timestamp();
+    if (now - sw->destroy_ts > SH_SWITCH_DELAY_SEC) {
+      TAILQ_REMOVE(&sh_switches_delayed_destroy, sw, link_tailq);
+      SH_LOG_INFO("switch: delayed destroy, target_addr %" PRIxPTR, sw->target_addr);
+      sh_switch_destroy_inner(sw);
+    } else {
+      break;
+    }
+  }
+  if (!TAILQ_EMPTY(queue)) {
+    if (0 == now) now = sh_util_get_stable_timestamp();
+    TAILQ_FOREACH(sw, queue, link_tailq) {
+      sw->destroy_ts = now;
+    }
+    TAILQ_CONCAT(&sh_switches_delayed_destroy, queue, link_tailq);
+  }
+  pthread_mutex_unlock(&sh_switches_delayed_destroy_lock);
+}
+
 static void sh_switch_destroy(sh_switch_t *self, bool with_delay) {
   SH_LOG_INFO("switch: destroy, target_addr %" PRIxPTR, self->target_addr);
 
+  if (with_delay && sh_switches_undo_batching) {
+    TAILQ_INSERT_TAIL(&sh_switches_undo_destroy, self, link_tailq);
+    return;
+  }
+
   if (!TAILQ_EMPTY(&sh_switches_delayed_destroy) || with_delay) {
-    pthread_mutex_lock(&sh_switches_delayed_destroy_lock);
-    time_t now = 0;
-    sh_switch_t *sw, *tmp;
-    TAILQ_FOREACH_SAFE(sw, &sh_switches_delayed_destroy, link_tailq, tmp) {
-      if (0 == now) now = sh_util_get_stable_timestamp();
-      if (now - sw->destroy_ts > SH_SWITCH_DELAY_SEC) {
-        TAILQ_REMOVE(&sh_switches_delayed_destroy, sw, link_tailq);
-        SH_LOG_INFO("switch: delayed destroy, target_addr %" PRIxPTR, sw->target_addr);
-        sh_switch_destroy_inner(sw);
-      } else {
-        break;
-      }
-    }
-    if (with_delay) {
-      if (0 == now) now = sh_util_get_stable_timestamp();
-      self->destroy_ts = now;
-      TAILQ_INSERT_TAIL(&sh_switches_delayed_destroy, self, link_tailq);
-    }
-    pthread_mutex_unlock(&sh_switches_delayed_destroy_lock);
+    sh_switch_queue_t queue = TAILQ_HEAD_INITIALIZER(queue);
+    if (with_delay) TAILQ_INSERT_TAIL(&queue, self, link_tailq);
+    sh_switch_destroy_delayed(&queue);
   }
 
   if (!with_delay) {
@@ -473,10 +779,135 @@ static int sh_switch_create(sh_switch_t **self, uintptr_t target_addr, sh_addr_i
   (*self)->proxy_addr = new_addr;
   TAILQ_INIT(&((*self)->proxies));
   SLIST_INIT(&(*self)->interceptors);
+  if (0 != sh_switch_create_gate(*self)) {
+    free(*self);
+    *self = NULL;
+    return SHADOWHOOK_ERRNO_OOM;
+  }
   SH_LOG_INFO("switch: create, target_addr %" PRIxPTR, target_addr);
   return 0;
 }
 
+static void sh_switch_snapshot_fill(sh_switch_t *self, shadowhook_hook_info_t *info) {
+  info->target_addr = (void *)self->target_addr;
+  info->hook_mode = 0;
+  info->proxies_cnt = 0;
+  if (SH_SWITCH_HOOK_MODE_UNIQUE == self->hook_mode) {
+    info->hook_mode = SHADOWHOOK_HOOK_WITH_UNIQUE_MODE;
+    info->proxies_cnt = 1;
+  } else if (SH_SWITCH_HOOK_MODE_QUEUE == self->hook_mode) {
+    uintptr_t hub_trampo_addr = (NULL == self->hub ? 0 : sh_hub_get_trampo_addr(self->hub));
+    sh_switch_proxy_t *proxy;
+    TAILQ_FOREACH(proxy, &self->proxies, link) {
+      if (0 != hub_trampo_addr && proxy->new_addr == hub_trampo_addr) {
+        info->hook_mode |= SHADOWHOOK_HOOK_WITH_SHARED_MODE;
+        info->proxies_cnt += sh_hub_get_proxy_count(self->hub);
+      } else {
+        info->hook_mode |= SHADOWHOOK_HOOK_WITH_MULTI_MODE;
+        info->proxies_cnt++;
+      }
+    }
+  }
+  info->interceptors_cnt = self->interceptors_size;
+  info->backup_len = self->inst.backup_len;
+  info->islands_cnt = sh_inst_get_island_count(&self->inst);
+}
+
+// must be called with sh_switches_lock held
+static void sh_switch_snapshot_publish(void) {
+  if (sh_switches_batch_depth > 0) {
+    sh_switches_snapshot_dirty = true;
+    return;
+  }
+
+  size_t cnt = 0;
+  sh_switch_t *sw;
+  RB_FOREACH(sw, sh_switch_tree, &sh_switches) {
+    cnt++;
+  }
+
+  sh_switch_snapshot_t *snapshot =
+      malloc(sizeof(sh_switch_snapshot_t) + cnt * sizeof(shadowhook_hook_info_t));
+  if (NULL == snapshot) {
+    SH_LOG_WARN("switch: publish snapshot failed, keep the previous one");
+    return;
+  }
+  snapshot->infos_cnt = 0;
+  RB_FOREACH(sw, sh_switch_tree, &sh_switches) {
+    sh_switch_snapshot_fill(sw, &snapshot->infos[snapshot->infos_cnt++]);
+  }
+
+  sh_switch_snapshot_t *old = __atomic_exchange_n(&sh_switches_snapshot, snapshot, __ATOMIC_SEQ_CST);
+  if (NULL != old) TAILQ_INSERT_TAIL(&sh_switches_snapshot_retired, old, link);
+
+  // free the retired snapshots when no reader can hold them, otherwise at a later publish
+  if (0 != __atomic_load_n(&sh_switches_snapshot_readers, __ATOMIC_SEQ_CST)) return;
+  sh_switch_snapshot_t *ss, *tmp;
+  TAILQ_FOREACH_SAFE(ss, &sh_switches_snapshot_retired, link, tmp) {
+    TAILQ_REMOVE(&sh_switches_snapshot_retired, ss, link);
+    free(ss);
+  }
+}
+
+static sh_switch_snapshot_t *sh_switch_snapshot_acquire(void) {
+  __atomic_add_fetch(&sh_switches_snapshot_readers, 1, __ATOMIC_SEQ_CST);
+  return __atomic_load_n(&sh_switches_snapshot, __ATOMIC_SEQ_CST);
+}
+
+static void sh_switch_snapshot_release(void) {
+  __atomic_sub_fetch(&sh_switches_snapshot_readers, 1, __ATOMIC_RELEASE);
+}
+
+void sh_switch_batch_begin(void) {
+  pthread_mutex_lock(&sh_switches_lock);
+  sh_switches_batch_depth++;
+  pthread_mutex_unlock(&sh_switches_lock);
+}
+
+void sh_switch_batch_end(void) {
+  pthread_mutex_lock(&sh_switches_lock);
+  if (0 == --sh_switches_batch_depth && sh_switches_snapshot_dirty) {
+    sh_switches_snapshot_dirty = false;
+    sh_switch_snapshot_publish();
+  }
+  pthread_mutex_unlock(&sh_switches_lock);
+}
+
+bool sh_switch_is_hooked(uintptr_t target_addr) {
+  bool r = false;
+  sh_switch_snapshot_t *snapshot = sh_switch_snapshot_acquire();
+  if (NULL == snapshot) goto end;
+
+  // binary search
+  size_t low = 0, high = snapshot->infos_cnt;
+  while (low < high) {
+    size_t mid = low + (high - low) / 2;
+    uintptr_t addr = (uintptr_t)snapshot->infos[mid].target_addr;
+    if (addr == target_addr) {
+      r = true;
+      break;
+    } else if (addr < target_addr) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+
+end:
+  sh_switch_snapshot_release();
+  return r;
+}
+
+void sh_switch_foreach(shadowhook_hook_info_cb_t cb, void *arg) {
+  sh_switch_snapshot_t *snapshot = sh_switch_snapshot_acquire();
+  if (NULL != snapshot) {
+    for (size_t i = 0; i < snapshot->infos_cnt; i++) {
+      if (!cb(&snapshot->infos[i], arg)) break;
+    }
+  }
+  sh_switch_snapshot_release();
+}
+
 static sh_switch_t *sh_switch_find(uintptr_t target_addr) {
   sh_switch_t key = {.target_addr = target_addr};
   return RB_FIND(sh_switch_tree, &sh_switches, &key);
@@ -499,12 +930,12 @@ static int sh_switch_hook_unique(uintptr_t target_addr, sh_addr_info_t *addr_inf
     } else {
       self->hook_mode = SH_SWITCH_HOOK_MODE_UNIQUE;
       if (NULL != orig_addr) *orig_addr = self->resume_addr;
-      __atomic_store_n(&self->proxy_addr, new_addr, __ATOMIC_RELEASE);
+      sh_switch_set_proxy_addr(self, new_addr);
     }
   } else {
     if (0 != (r = sh_switch_create(&self, target_addr, addr_info, new_addr, SH_SWITCH_HOOK_MODE_UNIQUE)))
       goto end;
-    if (0 != (r = sh_switch_inst_hook(self, self->proxy_addr, orig_addr, NULL))) {
+    if (0 != (r = sh_switch_inst_hook(self, self->gate_addr, orig_addr, NULL))) {
       sh_switch_destroy(self, false);
       goto end;
     }
@@ -514,6 +945,7 @@ static int sh_switch_hook_unique(uintptr_t target_addr, sh_addr_info_t *addr_inf
   r = 0;  // OK
 
 end:
+  if (0 == r) sh_switch_snapshot_publish();
   pthread_mutex_unlock(&sh_switches_lock);
   return r;
 }
@@ -537,7 +969,7 @@ static int sh_switch_hook_multi(uintptr_t target_addr, sh_addr_info_t *addr_info
       sh_switch_destroy(self, false);
       goto end;
     }
-    if (0 != (r = sh_switch_inst_hook(self, self->proxy_addr, orig_addr, NULL))) {
+    if (0 != (r = sh_switch_inst_hook(self, self->gate_addr, orig_addr, NULL))) {
       sh_switch_destroy(self, false);
       goto end;
     }
@@ -548,12 +980,13 @@ static int sh_switch_hook_multi(uintptr_t target_addr, sh_addr_info_t *addr_info
   r = 0;  // OK
 
 end:
+  if (0 == r) sh_switch_snapshot_publish();
   pthread_mutex_unlock(&sh_switches_lock);
   return r;
 }
 
 static int sh_switch_hook_shared(uintptr_t target_addr, sh_addr_info_t *addr_info, uintptr_t new_addr,
-                                 uintptr_t *orig_addr, size_t *backup_len) {
+                                 uintptr_t *orig_addr, void *data, size_t *backup_len) {
   int r;
   pthread_mutex_lock(&sh_switches_lock);
 
@@ -563,15 +996,15 @@ static int sh_switch_hook_shared(uintptr_t target_addr, sh_addr_info_t *addr_inf
       r = SHADOWHOOK_ERRNO_MODE_CONFLICT;
       goto end;
     }
-    if (0 != (r = sh_switch_proxy_add_shared(self, new_addr, orig_addr))) goto end;
+    if (0 != (r = sh_switch_proxy_add_shared(self, new_addr, orig_addr, data))) goto end;
   } else {
     if (0 != (r = sh_switch_create(&self, target_addr, addr_info, new_addr, SH_SWITCH_HOOK_MODE_QUEUE)))
       goto end;
-    if (0 != (r = sh_switch_proxy_add_shared(self, new_addr, orig_addr))) {
+    if (0 != (r = sh_switch_proxy_add_shared(self, new_addr, orig_addr, data))) {
       sh_switch_destroy(self, false);
       goto end;
     }
-    if (0 != (r = sh_switch_inst_hook(self, self->proxy_addr, orig_addr, sh_hub_get_orig_addr(self->hub)))) {
+    if (0 != (r = sh_switch_inst_hook(self, self->gate_addr, orig_addr, sh_hub_get_orig_addr(self->hub)))) {
       sh_switch_destroy(self, false);
       goto end;
     }
@@ -582,12 +1015,13 @@ static int sh_switch_hook_shared(uintptr_t target_addr, sh_addr_info_t *addr_inf
   r = 0;  // OK
 
 end:
+  if (0 == r) sh_switch_snapshot_publish();
   pthread_mutex_unlock(&sh_switches_lock);
   return r;
 }
 
 int sh_switch_hook(uintptr_t target_addr, sh_addr_info_t *addr_info, uintptr_t new_addr, uintptr_t *orig_addr,
-                   size_t flags, size_t *backup_len) {
+                   void *data, size_t flags, size_t *backup_len) {
   int r;
   size_t hook_mode = sh_switch_get_hook_mode(flags);
   char *hook_mode_str;
@@ -596,7 +1030,7 @@ int sh_switch_hook(uintptr_t target_addr, sh_addr_info_t *addr_info, uintptr_t n
     r = sh_switch_hook_unique(target_addr, addr_info, new_addr, orig_addr, backup_len);
     hook_mode_str = "UNIQUE";
   } else if (SHADOWHOOK_HOOK_WITH_SHARED_MODE == hook_mode) {
-    r = sh_switch_hook_shared(target_addr, addr_info, new_addr, orig_addr, backup_len);
+    r = sh_switch_hook_shared(target_addr, addr_info, new_addr, orig_addr, data, backup_len);
     hook_mode_str = "SHARED";
   } else {
     r = sh_switch_hook_multi(target_addr, addr_info, new_addr, orig_addr, backup_len);
@@ -633,10 +1067,8 @@ int sh_switch_hook_invisible(uintptr_t target_addr, sh_addr_info_t *addr_info, u
   return r;
 }
 
-static int sh_switch_unhook_unique(uintptr_t target_addr) {
+static int sh_switch_unhook_unique_nolock(uintptr_t target_addr) {
   int r;
-  pthread_mutex_lock(&sh_switches_lock);
-
   sh_switch_t *self = sh_switch_find(target_addr);
   if (NULL == self) {
     r = SHADOWHOOK_ERRNO_UNHOOK_NOTFOUND;
@@ -647,7 +1079,7 @@ static int sh_switch_unhook_unique(uintptr_t target_addr) {
       goto end;
     }
     self->hook_mode = SH_SWITCH_HOOK_MODE_NONE;
-    __atomic_store_n(&self->proxy_addr, 0, __ATOMIC_RELEASE);
+    sh_switch_set_proxy_addr(self, 0);
     r = 0;
     if (0 == self->interceptors_size) {
       r = sh_switch_inst_unhook(self);
@@ -658,14 +1090,19 @@ static int sh_switch_unhook_unique(uintptr_t target_addr) {
   }
 
 end:
-  pthread_mutex_unlock(&sh_switches_lock);
   return r;
 }
 
-static int sh_switch_unhook_multi(uintptr_t target_addr, uintptr_t new_addr) {
-  int r;
+static int sh_switch_unhook_unique(uintptr_t target_addr) {
   pthread_mutex_lock(&sh_switches_lock);
+  int r = sh_switch_unhook_unique_nolock(target_addr);
+  if (0 == r) sh_switch_snapshot_publish();
+  pthread_mutex_unlock(&sh_switches_lock);
+  return r;
+}
 
+static int sh_switch_unhook_multi_nolock(uintptr_t target_addr, uintptr_t new_addr) {
+  int r;
   sh_switch_t *self = sh_switch_find(target_addr);
   if (NULL == self) {
     r = SHADOWHOOK_ERRNO_UNHOOK_NOTFOUND;
@@ -684,14 +1121,19 @@ static int sh_switch_unhook_multi(uintptr_t target_addr, uintptr_t new_addr) {
   }
 
 end:
-  pthread_mutex_unlock(&sh_switches_lock);
   return r;
 }
 
-static int sh_switch_unhook_shared(uintptr_t target_addr, uintptr_t new_addr) {
-  int r;
+static int sh_switch_unhook_multi(uintptr_t target_addr, uintptr_t new_addr) {
   pthread_mutex_lock(&sh_switches_lock);
+  int r = sh_switch_unhook_multi_nolock(target_addr, new_addr);
+  if (0 == r) sh_switch_snapshot_publish();
+  pthread_mutex_unlock(&sh_switches_lock);
+  return r;
+}
 
+static int sh_switch_unhook_shared_nolock(uintptr_t target_addr, uintptr_t new_addr) {
+  int r;
   sh_switch_t *self = sh_switch_find(target_addr);
   if (NULL == self) {
     r = SHADOWHOOK_ERRNO_UNHOOK_NOTFOUND;
@@ -710,6 +1152,13 @@ static int sh_switch_unhook_shared(uintptr_t target_addr, uintptr_t new_addr) {
   }
 
 end:
+  return r;
+}
+
+static int sh_switch_unhook_shared(uintptr_t target_addr, uintptr_t new_addr) {
+  pthread_mutex_lock(&sh_switches_lock);
+  int r = sh_switch_unhook_shared_nolock(target_addr, new_addr);
+  if (0 == r) sh_switch_snapshot_publish();
   pthread_mutex_unlock(&sh_switches_lock);
   return r;
 }
@@ -737,8 +1186,104 @@ int sh_switch_unhook(uintptr_t target_addr, uintptr_t new_addr, size_t flags) {
   return r;
 }
 
+static int sh_switch_replace_proxy_unique(uintptr_t target_addr, uintptr_t new_addr, uintptr_t new_new_addr) {
+  int r;
+  pthread_mutex_lock(&sh_switches_lock);
+
+  sh_switch_t *self = sh_switch_find(target_addr);
+  if (NULL == self) {
+    r = SHADOWHOOK_ERRNO_UNHOOK_NOTFOUND;
+    goto end;
+  } else {
+    if (SH_SWITCH_HOOK_MODE_UNIQUE != self->hook_mode) {
+      r = SHADOWHOOK_ERRNO_MODE_CONFLICT;
+      goto end;
+    }
+    if (self->proxy_addr != new_addr) {
+      r = SHADOWHOOK_ERRNO_UNHOOK_NOTFOUND;
+      goto end;
+    }
+    sh_switch_set_proxy_addr(self, new_new_addr);
+    r = 0;  // OK
+  }
+
+end:
+  pthread_mutex_unlock(&sh_switches_lock);
+  return r;
+}
+
+static int sh_switch_replace_proxy_multi(uintptr_t target_addr, uintptr_t new_addr, uintptr_t new_new_addr) {
+  int r;
+  pthread_mutex_lock(&sh_switches_lock);
+
+  sh_switch_t *self = sh_switch_find(target_addr);
+  if (NULL == self) {
+    r = SHADOWHOOK_ERRNO_UNHOOK_NOTFOUND;
+    goto end;
+  } else {
+    if (SH_SWITCH_HOOK_MODE_QUEUE != self->hook_mode) {
+      r = SHADOWHOOK_ERRNO_MODE_CONFLICT;
+      goto end;
+    }
+    r = sh_switch_proxy_replace_multi(self, new_addr, new_new_addr);
+  }
+
+end:
+  pthread_mutex_unlock(&sh_switches_lock);
+  return r;
+}
+
+static int sh_switch_replace_proxy_shared(uintptr_t target_addr, uintptr_t new_addr, uintptr_t new_new_addr) {
+  int r;
+  pthread_mutex_lock(&sh_switches_lock);
+
+  sh_switch_t *self = sh_switch_find(target_addr);
+  if (NULL == self) {
+    r = SHADOWHOOK_ERRNO_UNHOOK_NOTFOUND;
+    goto end;
+  } else {
+    if (SH_SWITCH_HOOK_MODE_QUEUE != self->hook_mode || NULL == self->hub) {
+      r = SHADOWHOOK_ERRNO_MODE_CONFLICT;
+      goto end;
+    }
+    r = sh_hub_replace_proxy(self->hub, new_addr, new_new_addr);
+  }
+
+end:
+  pthread_mutex_unlock(&sh_switches_lock);
+  return r;
+}
+
+int sh_switch_replace_proxy(uintptr_t target_addr, uintptr_t new_addr, uintptr_t new_new_addr, size_t flags) {
+  int r;
+  size_t hook_mode = sh_switch_get_hook_mode(flags);
+  char *hook_mode_str;
+
+  if (SHADOWHOOK_HOOK_WITH_UNIQUE_MODE == hook_mode) {
+    r = sh_switch_replace_proxy_unique(target_addr, new_addr, new_new_addr);
+    hook_mode_str = "UNIQUE";
+  } else if (SHADOWHOOK_HOOK_WITH_SHARED_MODE == hook_mode) {
+    r = sh_switch_replace_proxy_shared(target_addr, new_addr, new_new_addr);
+    hook_mode_str = "SHARED";
+  } else {
+    r = sh_switch_replace_proxy_multi(target_addr, new_addr, new_new_addr);
+    hook_mode_str = "MULTI";
+  }
+
+  if (0 == r)
+    SH_LOG_INFO("switch: replace proxy in %s mode OK: target_addr %" PRIxPTR ", new_addr %" PRIxPTR
+                " -> %" PRIxPTR,
+                hook_mode_str, target_addr, new_addr, new_new_addr);
+
+  return r;
+}
+
 int sh_switch_intercept(uintptr_t target_addr, sh_addr_info_t *addr_info, shadowhook_interceptor_t pre,
                         void *data, size_t flags, size_t *backup_len) {
+  // returning early from the interceptor is only safe at the function entry
+  if ((flags & SHADOWHOOK_INTERCEPT_WITH_RETURN) && !addr_info->is_proc_start)
+    return SHADOWHOOK_ERRNO_INVALID_ARG;
+
   int r;
   pthread_mutex_lock(&sh_switches_lock);
 
@@ -767,14 +1312,13 @@ int sh_switch_intercept(uintptr_t target_addr, sh_addr_info_t *addr_info, shadow
   r = 0;  // OK
 
 end:
+  if (0 == r) sh_switch_snapshot_publish();
   pthread_mutex_unlock(&sh_switches_lock);
   return r;
 }
 
-int sh_switch_unintercept(uintptr_t target_addr, shadowhook_interceptor_t pre, void *data) {
+static int sh_switch_unintercept_nolock(uintptr_t target_addr, shadowhook_interceptor_t pre, void *data) {
   int r;
-  pthread_mutex_lock(&sh_switches_lock);
-
   sh_switch_t *self = sh_switch_find(target_addr);
   if (NULL == self) {
     r = SHADOWHOOK_ERRNO_UNHOOK_NOTFOUND;
@@ -787,28 +1331,89 @@ int sh_switch_unintercept(uintptr_t target_addr, shadowhook_interceptor_t pre, v
         RB_REMOVE(sh_switch_tree, &sh_switches, self);
         sh_switch_destroy(self, true);
       } else {
-        if (0 != (r = sh_switch_inst_rehook(self, self->proxy_addr))) goto end;
+        if (0 != (r = sh_switch_inst_rehook(self, self->gate_addr))) goto end;
       }
     }
   }
 
 end:
+  return r;
+}
+
+int sh_switch_unintercept(uintptr_t target_addr, shadowhook_interceptor_t pre, void *data) {
+  pthread_mutex_lock(&sh_switches_lock);
+  int r = sh_switch_unintercept_nolock(target_addr, pre, data);
+  if (0 == r) sh_switch_snapshot_publish();
   pthread_mutex_unlock(&sh_switches_lock);
   return r;
 }
 
+static int sh_switch_undo_cmp(const void *a, const void *b) {
+  uintptr_t addr_a = ((const sh_switch_undo_t *)a)->target_addr;
+  uintptr_t addr_b = ((const sh_switch_undo_t *)b)->target_addr;
+  if (addr_a == addr_b) return 0;
+  return addr_a > addr_b ? 1 : -1;
+}
+
+void sh_switch_undo_batch(sh_switch_undo_t *undos, size_t undos_cnt) {
+  if (0 == undos_cnt) return;
+
+  // restore in address order within a page session, so that each page is mprotect()ed once
+  qsort(undos, undos_cnt, sizeof(sh_switch_undo_t), sh_switch_undo_cmp);
+
+  bool changed = false;
+  pthread_mutex_lock(&sh_switches_lock);
+  sh_switches_undo_batching = true;
+  sh_util_page_session_begin();
+  for (size_t i = 0; i < undos_cnt; i++) {
+    sh_switch_undo_t *undo = &undos[i];
+    if (undo->is_hook) {
+      size_t hook_mode = sh_switch_get_hook_mode(undo->flags);
+      if (SHADOWHOOK_HOOK_WITH_UNIQUE_MODE == hook_mode)
+        undo->r = sh_switch_unhook_unique_nolock(undo->target_addr);
+      else if (SHADOWHOOK_HOOK_WITH_SHARED_MODE == hook_mode)
+        undo->r = sh_switch_unhook_shared_nolock(undo->target_addr, undo->new_addr);
+      else
+        undo->r = sh_switch_unhook_multi_nolock(undo->target_addr, undo->new_addr);
+    } else {
+      undo->r = sh_switch_unintercept_nolock(undo->target_addr, undo->pre, undo->data);
+    }
+    if (0 == undo->r) changed = true;
+  }
+  sh_util_page_session_end();
+  sh_switches_undo_batching = false;
+
+  // the switches of the batch are destroyed together after the delay
+  sh_switch_destroy_delayed(&sh_switches_undo_destroy);
+  if (changed) sh_switch_snapshot_publish();
+  pthread_mutex_unlock(&sh_switches_lock);
+
+  SH_LOG_INFO("switch: undo batch OK, count %zu", undos_cnt);
+}
+
 void sh_switch_free_after_dlclose(struct dl_phdr_info *info) {
+  bool freed = false;
   pthread_mutex_lock(&sh_switches_lock);
-  sh_switch_t *sw, *tmp;
-  RB_FOREACH_SAFE(sw, sh_switch_tree, &sh_switches, tmp) {
-    if (sh_linker_is_addr_in_elf_pt_load(sw->target_addr, (void *)info->dlpi_addr, info->dlpi_phdr,
-                                         info->dlpi_phnum)) {
+  for (size_t i = 0; i < info->dlpi_phnum; i++) {
+    const ElfW(Phdr) *phdr = &info->dlpi_phdr[i];
+    if (PT_LOAD != phdr->p_type) continue;
+
+    // the switch tree is ordered by target_addr, only walk the range of this segment
+    uintptr_t seg_start = (uintptr_t)info->dlpi_addr + phdr->p_vaddr;
+    uintptr_t seg_end = seg_start + phdr->p_memsz;
+    sh_switch_t key = {.target_addr = seg_start};
+    sh_switch_t *sw = RB_NFIND(sh_switch_tree, &sh_switches, &key), *tmp;
+    while (NULL != sw && sw->target_addr < seg_end) {
+      tmp = RB_NEXT(sh_switch_tree, &sh_switches, sw);
       RB_REMOVE(sh_switch_tree, &sh_switches, sw);
       sh_inst_free_after_dlclose(&sw->inst, sw->target_addr);
       SH_LOG_INFO("switch: free_after_dlclose OK. target_addr %" PRIxPTR, sw->target_addr);
       sh_switch_destroy(sw, false);
+      freed = true;
+      sw = tmp;
     }
   }
+  if (freed) sh_switch_snapshot_publish();
   pthread_mutex_unlock(&sh_switches_lock);
 
   sh_island_cleanup_after_dlclose((uintptr_t)info->dlpi_addr);
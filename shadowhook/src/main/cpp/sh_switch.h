@@ -31,10 +31,12 @@
 void shadowhook_interceptor_caller(void *ctx, shadowhook_cpu_context_t *cpu_context, void **next_hop);
 
 void sh_switch_init(void);
+bool sh_switch_report_sig_fault(uintptr_t sp);  // async-signal-safe, sp: of the signal context
 
 int sh_switch_hook(uintptr_t target_addr, sh_addr_info_t *addr_info, uintptr_t new_addr, uintptr_t *orig_addr,
-                   size_t flags, size_t *backup_len);
+                   void *data, size_t flags, size_t *backup_len);
 int sh_switch_unhook(uintptr_t target_addr, uintptr_t new_addr, size_t flags);
+int sh_switch_replace_proxy(uintptr_t target_addr, uintptr_t new_addr, uintptr_t new_new_addr, size_t flags);
 
 int sh_switch_hook_invisible(uintptr_t target_addr, sh_addr_info_t *addr_info, uintptr_t new_addr,
                              uintptr_t *orig_addr, size_t *backup_len);
@@ -43,4 +45,27 @@ int sh_switch_intercept(uintptr_t target_addr, sh_addr_info_t *addr_info, shadow
                         void *data, size_t flags, size_t *backup_len);
 int sh_switch_unintercept(uintptr_t target_addr, shadowhook_interceptor_t pre, void *data);
 
+// unhook / unintercept many targets in one lock session
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wpadded"
+typedef struct {
+  uintptr_t target_addr;
+  bool is_hook;
+  uintptr_t new_addr;            // for hook
+  size_t flags;                  // for hook
+  shadowhook_interceptor_t pre;  // for intercept
+  void *data;                    // for intercept
+  void *arg;                     // for caller
+  int r;                         // result
+} sh_switch_undo_t;
+#pragma clang diagnostic pop
+void sh_switch_undo_batch(sh_switch_undo_t *undos, size_t undos_cnt);
+
+// defer publishing the snapshot of hooked addresses until the outermost batch ends
+void sh_switch_batch_begin(void);
+void sh_switch_batch_end(void);
+
 void sh_switch_free_after_dlclose(struct dl_phdr_info *info);
+
+bool sh_switch_is_hooked(uintptr_t target_addr);
+void sh_switch_foreach(shadowhook_hook_info_cb_t cb, void *arg);
@@ -36,14 +36,18 @@
 
 #include "queue.h"
 #include "sh_config.h"
+#include "sh_counter.h"
 #include "sh_errno.h"
+#include "sh_histo.h"
 #include "sh_linker.h"
 #include "sh_log.h"
+#include "sh_probe.h"
 #include "sh_recorder.h"
 #include "sh_sig.h"
 #include "sh_switch.h"
 #include "sh_util.h"
 #include "shadowhook.h"
+#include "tree.h"
 #include "xdl.h"
 
 typedef enum { SH_TASK_HOOK, SH_TASK_INTERCEPT } sh_task_type_t;
@@ -62,9 +66,13 @@ struct sh_task {
     struct {
       uintptr_t new_addr;
       uintptr_t *orig_addr;
+      void *data;
       size_t flags;
       shadowhook_hooked_t hooked;
       void *hooked_arg;
+      sh_counter_t *counter;  // for counter-only hook
+      sh_histo_t *histo;      // for latency histogram hook
+      sh_probe_t *probe;      // for hook-once probe
     } hook;
     struct {
       shadowhook_interceptor_t pre;
@@ -80,7 +88,11 @@ struct sh_task {
   bool is_proc_start;
   bool is_finished;
   bool is_corrupted;
+  bool is_indexed;
+  uintptr_t load_bias;  // load_bias of the ELF where target_addr is located (for finished sym-name task)
+  uintptr_t index_id;   // = self (0 for search key)
   TAILQ_ENTRY(sh_task, ) link;
+  RB_ENTRY(sh_task) link_rbtree;
 };
 #pragma clang diagnostic pop
 
@@ -92,8 +104,46 @@ static sh_task_queue_t sh_tasks = TAILQ_HEAD_INITIALIZER(sh_tasks);
 static pthread_rwlock_t sh_tasks_lock = PTHREAD_RWLOCK_INITIALIZER;
 static int sh_tasks_unfinished_cnt = 0;
 
+// finished sym-name task tree (indexed by load_bias of the ELF)
+static __inline__ int sh_task_cmp(sh_task_t *a, sh_task_t *b) {
+  if (a->load_bias != b->load_bias) return a->load_bias > b->load_bias ? 1 : -1;
+  if (a->index_id == b->index_id) return 0;
+  return a->index_id > b->index_id ? 1 : -1;
+}
+typedef RB_HEAD(sh_task_tree, sh_task) sh_task_tree_t;
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wunused-function"
+RB_GENERATE_STATIC(sh_task_tree, sh_task, link_rbtree, sh_task_cmp)
+#pragma clang diagnostic pop
+
+// finished sym-name task tree object
+static sh_task_tree_t sh_tasks_by_load_bias = RB_INITIALIZER(&sh_tasks_by_load_bias);
+static pthread_mutex_t sh_tasks_by_load_bias_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void sh_task_index_add(sh_task_t *self, uintptr_t load_bias) {
+  if (self->is_by_target_addr || 0 == self->target_addr || 0 == load_bias) return;
+
+  pthread_mutex_lock(&sh_tasks_by_load_bias_lock);
+  if (!self->is_indexed) {
+    self->load_bias = load_bias;
+    self->index_id = (uintptr_t)self;
+    RB_INSERT(sh_task_tree, &sh_tasks_by_load_bias, self);
+    self->is_indexed = true;
+  }
+  pthread_mutex_unlock(&sh_tasks_by_load_bias_lock);
+}
+
+static void sh_task_index_del(sh_task_t *self) {
+  pthread_mutex_lock(&sh_tasks_by_load_bias_lock);
+  if (self->is_indexed) {
+    RB_REMOVE(sh_task_tree, &sh_tasks_by_load_bias, self);
+    self->is_indexed = false;
+  }
+  pthread_mutex_unlock(&sh_tasks_by_load_bias_lock);
+}
+
 sh_task_t *sh_task_create_hook_by_target_addr(uintptr_t target_addr, uintptr_t new_addr, uintptr_t *orig_addr,
-                                              uint32_t flags, bool is_sym_addr, bool is_proc_start,
+                                              void *data, uint32_t flags, bool is_sym_addr, bool is_proc_start,
                                               uintptr_t caller_addr, char *record_lib_name,
                                               char *record_sym_name) {
   sh_task_t *self = calloc(1, sizeof(sh_task_t));
@@ -114,6 +164,7 @@ sh_task_t *sh_task_create_hook_by_target_addr(uintptr_t target_addr, uintptr_t n
   self->type = SH_TASK_HOOK;
   self->typed.hook.new_addr = new_addr;
   self->typed.hook.orig_addr = orig_addr;
+  self->typed.hook.data = data;
   self->typed.hook.flags = (size_t)flags;
   self->typed.hook.hooked = NULL;
   self->typed.hook.hooked_arg = NULL;
@@ -131,8 +182,8 @@ err:
 }
 
 sh_task_t *sh_task_create_hook_by_sym_name(const char *lib_name, const char *sym_name, uintptr_t new_addr,
-                                           uintptr_t *orig_addr, uint32_t flags, shadowhook_hooked_t hooked,
-                                           void *hooked_arg, uintptr_t caller_addr) {
+                                           uintptr_t *orig_addr, void *data, uint32_t flags,
+                                           shadowhook_hooked_t hooked, void *hooked_arg, uintptr_t caller_addr) {
   sh_task_t *self = calloc(1, sizeof(sh_task_t));
   if (NULL == self) return NULL;
   if (NULL == (self->lib_name = strdup(lib_name))) goto err;
@@ -143,6 +194,7 @@ sh_task_t *sh_task_create_hook_by_sym_name(const char *lib_name, const char *sym
   self->type = SH_TASK_HOOK;
   self->typed.hook.new_addr = new_addr;
   self->typed.hook.orig_addr = orig_addr;
+  self->typed.hook.data = data;
   self->typed.hook.flags = (size_t)flags;
   self->typed.hook.hooked = hooked;
   self->typed.hook.hooked_arg = hooked_arg;
@@ -227,7 +279,59 @@ err:
   return NULL;
 }
 
+sh_task_t *sh_task_create_count_by_target_addr(uintptr_t target_addr, uintptr_t caller_addr) {
+  sh_counter_t *counter;
+  if (0 != sh_counter_create(&counter)) return NULL;
+
+  // the counter trampoline is a proxy in multi mode, so that it can coexist with other hooks
+  sh_task_t *self = sh_task_create_hook_by_target_addr(
+      target_addr, sh_counter_get_trampo_addr(counter), sh_counter_get_orig_addr(counter), NULL,
+      SHADOWHOOK_HOOK_WITH_MULTI_MODE, false, true, caller_addr, NULL, NULL);
+  if (NULL == self) {
+    sh_counter_destroy(counter);
+    return NULL;
+  }
+  self->typed.hook.counter = counter;
+  return self;
+}
+
+sh_task_t *sh_task_create_histo_by_target_addr(uintptr_t target_addr, uintptr_t caller_addr) {
+  sh_histo_t *histo;
+  if (0 != sh_histo_create(&histo)) return NULL;
+
+  // the histogram trampoline is a proxy in multi mode, same as the counter trampoline
+  sh_task_t *self = sh_task_create_hook_by_target_addr(
+      target_addr, sh_histo_get_trampo_addr(histo), sh_histo_get_orig_addr(histo), NULL,
+      SHADOWHOOK_HOOK_WITH_MULTI_MODE, false, true, caller_addr, NULL, NULL);
+  if (NULL == self) {
+    sh_histo_destroy(histo);
+    return NULL;
+  }
+  self->typed.hook.histo = histo;
+  return self;
+}
+
+sh_task_t *sh_task_create_probe_by_target_addr(uintptr_t target_addr, uintptr_t caller_addr) {
+  sh_probe_t *probe;
+  if (0 != sh_probe_create(&probe)) return NULL;
+
+  // the probe trampoline is a proxy in multi mode, same as the counter trampoline
+  sh_task_t *self = sh_task_create_hook_by_target_addr(
+      target_addr, sh_probe_get_trampo_addr(probe), sh_probe_get_orig_addr(probe), NULL,
+      SHADOWHOOK_HOOK_WITH_MULTI_MODE, false, true, caller_addr, NULL, NULL);
+  if (NULL == self) {
+    sh_probe_destroy(probe);
+    return NULL;
+  }
+  self->typed.hook.probe = probe;
+  return self;
+}
+
 void sh_task_destroy(sh_task_t *self) {
+  if (SH_TASK_HOOK == self->type && NULL != self->typed.hook.counter)
+    sh_counter_destroy(self->typed.hook.counter);
+  if (SH_TASK_HOOK == self->type && NULL != self->typed.hook.histo) sh_histo_destroy(self->typed.hook.histo);
+  if (SH_TASK_HOOK == self->type && NULL != self->typed.hook.probe) sh_probe_destroy(self->typed.hook.probe);
   if (NULL != self->lib_name) free(self->lib_name);
   if (NULL != self->sym_name) free(self->sym_name);
   if (NULL != self->record_lib_name) free(self->record_lib_name);
@@ -265,7 +369,8 @@ static int sh_task_hook_pending(struct dl_phdr_info *info, size_t size, void *ar
       if (0 == r) {
         if (SH_TASK_HOOK == task->type)
           r = sh_switch_hook(task->target_addr, &addr_info, task->typed.hook.new_addr,
-                             task->typed.hook.orig_addr, task->typed.hook.flags, &backup_len);
+                             task->typed.hook.orig_addr, task->typed.hook.data, task->typed.hook.flags,
+                             &backup_len);
         else
           r = sh_switch_intercept(task->target_addr, &addr_info, task->typed.intercept.pre,
                                   task->typed.intercept.data, task->typed.intercept.flags, &backup_len);
@@ -290,6 +395,7 @@ static int sh_task_hook_pending(struct dl_phdr_info *info, size_t size, void *ar
                          backup_len, (uintptr_t)task, task->caller_addr, NULL);
 
       task->is_finished = true;
+      sh_task_index_add(task, (uintptr_t)addr_info.dli_fbase);
       sh_task_do_callback(task, r);
       if (0 == __atomic_sub_fetch(&sh_tasks_unfinished_cnt, 1, __ATOMIC_SEQ_CST)) break;
     }
@@ -328,19 +434,22 @@ static void sh_task_dl_fini_post(struct dl_phdr_info *info, size_t size, void *d
 
   // reset "finished flag" for finished-task (for the currently dlclosed ELF)
   pthread_rwlock_rdlock(&sh_tasks_lock);
-  sh_task_t *task;
-  TAILQ_FOREACH(task, &sh_tasks, link) {
-    if (task->is_finished && !task->is_by_target_addr && 0 != task->target_addr &&
-        sh_linker_is_addr_in_elf_pt_load(task->target_addr, (void *)info->dlpi_addr, info->dlpi_phdr,
-                                         info->dlpi_phnum)) {
-      task->target_addr = 0;
-      task->is_finished = false;
-      task->is_corrupted = false;
-      __atomic_add_fetch(&sh_tasks_unfinished_cnt, 1, __ATOMIC_SEQ_CST);
-      SH_LOG_INFO("task: reset finished flag for: %s lib_name %s, sym_name %s",
-                  SH_TASK_HOOK == task->type ? "hook" : "intercept", task->lib_name, task->sym_name);
-    }
+  pthread_mutex_lock(&sh_tasks_by_load_bias_lock);
+  sh_task_t key = {.load_bias = (uintptr_t)info->dlpi_addr, .index_id = 0};
+  sh_task_t *task = RB_NFIND(sh_task_tree, &sh_tasks_by_load_bias, &key), *tmp;
+  while (NULL != task && task->load_bias == (uintptr_t)info->dlpi_addr) {
+    tmp = RB_NEXT(sh_task_tree, &sh_tasks_by_load_bias, task);
+    RB_REMOVE(sh_task_tree, &sh_tasks_by_load_bias, task);
+    task->is_indexed = false;
+    task->target_addr = 0;
+    task->is_finished = false;
+    task->is_corrupted = false;
+    __atomic_add_fetch(&sh_tasks_unfinished_cnt, 1, __ATOMIC_SEQ_CST);
+    SH_LOG_INFO("task: reset finished flag for: %s lib_name %s, sym_name %s",
+                SH_TASK_HOOK == task->type ? "hook" : "intercept", task->lib_name, task->sym_name);
+    task = tmp;
   }
+  pthread_mutex_unlock(&sh_tasks_by_load_bias_lock);
   pthread_rwlock_unlock(&sh_tasks_lock);
 }
 
@@ -417,7 +526,7 @@ int sh_task_do(sh_task_t *self) {
   // hook/intercept by target-address
   if (SH_TASK_HOOK == self->type)
     r = sh_switch_hook(self->target_addr, &addr_info, self->typed.hook.new_addr, self->typed.hook.orig_addr,
-                       self->typed.hook.flags, &backup_len);
+                       self->typed.hook.data, self->typed.hook.flags, &backup_len);
   else
     r = sh_switch_intercept(self->target_addr, &addr_info, self->typed.intercept.pre,
                             self->typed.intercept.data, self->typed.intercept.flags, &backup_len);
@@ -427,7 +536,10 @@ end:
   if (0 == r || SHADOWHOOK_ERRNO_PENDING == r /* "PENDING" is NOT an error */) {
     pthread_rwlock_wrlock(&sh_tasks_lock);
     TAILQ_INSERT_TAIL(&sh_tasks, self, link);
-    if (!self->is_finished) __atomic_add_fetch(&sh_tasks_unfinished_cnt, 1, __ATOMIC_SEQ_CST);
+    if (!self->is_finished)
+      __atomic_add_fetch(&sh_tasks_unfinished_cnt, 1, __ATOMIC_SEQ_CST);
+    else
+      sh_task_index_add(self, (uintptr_t)addr_info.dli_fbase);
     pthread_rwlock_unlock(&sh_tasks_lock);
   }
 
@@ -483,6 +595,7 @@ int sh_task_undo(sh_task_t *self, uintptr_t caller_addr) {
   pthread_rwlock_wrlock(&sh_tasks_lock);
   TAILQ_REMOVE(&sh_tasks, self, link);
   if (!self->is_finished) __atomic_sub_fetch(&sh_tasks_unfinished_cnt, 1, __ATOMIC_SEQ_CST);
+  sh_task_index_del(self);
   pthread_rwlock_unlock(&sh_tasks_lock);
 
   // check task status
@@ -508,3 +621,194 @@ end:
                        (uintptr_t)self, caller_addr, NULL);
   return r;
 }
+
+#define SH_TASK_LIB_SEGMENTS_MAX 16
+
+typedef struct {
+  const char *lib_name;
+  size_t segments_cnt;
+  uintptr_t segments[SH_TASK_LIB_SEGMENTS_MAX][2];  // [start, end)
+} sh_task_lib_segments_t;
+
+static int sh_task_get_lib_segments(struct dl_phdr_info *info, size_t size, void *arg) {
+  (void)size;
+
+  sh_task_lib_segments_t *segs = (sh_task_lib_segments_t *)arg;
+  if (NULL == info->dlpi_name || !sh_util_match_pathname(info->dlpi_name, segs->lib_name)) return 0;
+
+  for (size_t i = 0; i < info->dlpi_phnum && segs->segments_cnt < SH_TASK_LIB_SEGMENTS_MAX; i++) {
+    const ElfW(Phdr) *phdr = &info->dlpi_phdr[i];
+    if (PT_LOAD != phdr->p_type) continue;
+    uintptr_t start = (uintptr_t)info->dlpi_addr + phdr->p_vaddr;
+    segs->segments[segs->segments_cnt][0] = start;
+    segs->segments[segs->segments_cnt][1] = start + phdr->p_memsz;
+    segs->segments_cnt++;
+  }
+  return 0;
+}
+
+// is the task created by code located in the lib (the same answer as dladdr(caller_addr))
+static bool sh_task_is_called_by_lib(sh_task_t *self, sh_task_lib_segments_t *segs) {
+  if (NULL == segs) return true;  // all
+  if (0 == self->caller_addr) return false;
+
+  for (size_t i = 0; i < segs->segments_cnt; i++)
+    if (segs->segments[i][0] <= self->caller_addr && self->caller_addr < segs->segments[i][1]) return true;
+  return false;
+}
+
+static void sh_task_fill_undo(sh_task_t *self, sh_switch_undo_t *undo) {
+  memset(undo, 0, sizeof(sh_switch_undo_t));
+  undo->arg = self;
+  undo->target_addr = self->target_addr;
+  undo->is_hook = (SH_TASK_HOOK == self->type);
+  if (undo->is_hook) {
+    undo->new_addr = self->typed.hook.new_addr;
+    undo->flags = self->typed.hook.flags;
+  } else {
+    undo->pre = self->typed.intercept.pre;
+    undo->data = self->typed.intercept.data;
+  }
+}
+
+static void sh_task_record_undo(sh_task_t *self, int r, uintptr_t caller_addr) {
+  sh_recorder_add_unop(r, SH_TASK_HOOK == self->type ? SH_RECORDER_OP_UNHOOK : SH_RECORDER_OP_UNINTERCEPT,
+                       (uintptr_t)self, caller_addr, NULL);
+}
+
+// undo and destroy the tasks that have been removed from the task queue
+static int sh_task_undo_matched(sh_task_queue_t *matched, size_t matched_cnt, uintptr_t caller_addr) {
+  sh_task_t *task;
+
+  // unhook and unintercept all finished tasks in one switch session
+  int r = 0;
+  sh_switch_undo_t *undos = calloc(matched_cnt, sizeof(sh_switch_undo_t));
+  size_t undos_cnt = 0;
+  TAILQ_FOREACH(task, matched, link) {
+    int task_r;
+    if (task->is_corrupted) {
+      task_r = SHADOWHOOK_ERRNO_UNHOOK_ON_ERROR;
+    } else if (!task->is_finished) {
+      task_r = SHADOWHOOK_ERRNO_UNHOOK_ON_UNFINISHED;
+    } else if (NULL != undos) {
+      sh_task_fill_undo(task, &undos[undos_cnt++]);
+      continue;  // record after the batch is done
+    } else {
+      // OOM, fallback to one by one
+      sh_switch_undo_t undo;
+      sh_task_fill_undo(task, &undo);
+      sh_switch_undo_batch(&undo, 1);
+      if (0 != (task_r = undo.r)) r = task_r;
+    }
+    sh_task_record_undo(task, task_r, caller_addr);
+  }
+  if (NULL != undos) {
+    sh_switch_undo_batch(undos, undos_cnt);
+    for (size_t i = 0; i < undos_cnt; i++) {
+      if (0 != undos[i].r) r = undos[i].r;
+      sh_task_record_undo((sh_task_t *)undos[i].arg, undos[i].r, caller_addr);
+    }
+    free(undos);
+  }
+
+  // destroy tasks
+  while (!TAILQ_EMPTY(matched)) {
+    task = TAILQ_FIRST(matched);
+    TAILQ_REMOVE(matched, task, link);
+    sh_task_destroy(task);
+  }
+
+  return r;
+}
+
+int sh_task_undo_batch(const char *lib_name, uintptr_t caller_addr, size_t *undo_cnt) {
+  *undo_cnt = 0;
+
+  // the linker's lock must not be taken while holding sh_tasks_lock, get the ELF ranges first
+  sh_task_lib_segments_t lib_segs = {.lib_name = lib_name, .segments_cnt = 0};
+  sh_task_lib_segments_t *segs = NULL;
+  if (NULL != lib_name) {
+    xdl_iterate_phdr(sh_task_get_lib_segments, &lib_segs, XDL_DEFAULT);
+    segs = &lib_segs;
+  }
+
+  // remove all matched tasks from the task queue in one lock session
+  sh_task_queue_t matched = TAILQ_HEAD_INITIALIZER(matched);
+  size_t matched_cnt = 0;
+  pthread_rwlock_wrlock(&sh_tasks_lock);
+  sh_task_t *task, *tmp;
+  TAILQ_FOREACH_SAFE(task, &sh_tasks, link, tmp) {
+    // probe tasks are owned by their probes set, only shadowhook_probe_*() may remove them
+    if (SH_TASK_HOOK == task->type && NULL != task->typed.hook.probe) continue;
+    if (!sh_task_is_called_by_lib(task, segs)) continue;
+    TAILQ_REMOVE(&sh_tasks, task, link);
+    if (!task->is_finished) __atomic_sub_fetch(&sh_tasks_unfinished_cnt, 1, __ATOMIC_SEQ_CST);
+    sh_task_index_del(task);
+    TAILQ_INSERT_TAIL(&matched, task, link);
+    matched_cnt++;
+  }
+  pthread_rwlock_unlock(&sh_tasks_lock);
+  if (0 == matched_cnt) return 0;
+
+  *undo_cnt = matched_cnt;
+  return sh_task_undo_matched(&matched, matched_cnt, caller_addr);
+}
+
+int sh_task_undo_list(sh_task_t **tasks, size_t tasks_cnt, uintptr_t caller_addr) {
+  if (0 == tasks_cnt) return 0;
+
+  // remove all tasks from the task queue in one lock session
+  sh_task_queue_t matched = TAILQ_HEAD_INITIALIZER(matched);
+  pthread_rwlock_wrlock(&sh_tasks_lock);
+  for (size_t i = 0; i < tasks_cnt; i++) {
+    sh_task_t *task = tasks[i];
+    TAILQ_REMOVE(&sh_tasks, task, link);
+    if (!task->is_finished) __atomic_sub_fetch(&sh_tasks_unfinished_cnt, 1, __ATOMIC_SEQ_CST);
+    sh_task_index_del(task);
+    TAILQ_INSERT_TAIL(&matched, task, link);
+  }
+  pthread_rwlock_unlock(&sh_tasks_lock);
+
+  return sh_task_undo_matched(&matched, tasks_cnt, caller_addr);
+}
+
+int sh_task_replace_proxy(sh_task_t *self, uintptr_t new_addr) {
+  if (SH_TASK_HOOK != self->type || NULL != self->typed.hook.counter || NULL != self->typed.hook.histo ||
+      NULL != self->typed.hook.probe)
+    return SHADOWHOOK_ERRNO_INVALID_ARG;
+
+  int r;
+  pthread_rwlock_wrlock(&sh_tasks_lock);
+
+  // check task status
+  if (self->is_corrupted) {
+    r = SHADOWHOOK_ERRNO_UNHOOK_ON_ERROR;
+    goto end;
+  }
+
+  // replace proxy function in switch,
+  // the unfinished task will be hooked with the new proxy function later
+  if (self->is_finished) {
+    if (0 != (r = sh_switch_replace_proxy(self->target_addr, self->typed.hook.new_addr, new_addr,
+                                          self->typed.hook.flags)))
+      goto end;
+  }
+  self->typed.hook.new_addr = new_addr;
+  r = 0;  // OK
+
+end:
+  pthread_rwlock_unlock(&sh_tasks_lock);
+  return r;
+}
+
+sh_counter_t *sh_task_get_counter(sh_task_t *self) {
+  return SH_TASK_HOOK == self->type ? self->typed.hook.counter : NULL;
+}
+
+sh_histo_t *sh_task_get_histo(sh_task_t *self) {
+  return SH_TASK_HOOK == self->type ? self->typed.hook.histo : NULL;
+}
+
+sh_probe_t *sh_task_get_probe(sh_task_t *self) {
+  return SH_TASK_HOOK == self->type ? self->typed.hook.probe : NULL;
+}
@@ -25,6 +25,9 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#include "sh_counter.h"
+#include "sh_histo.h"
+#include "sh_probe.h"
 #include "shadowhook.h"
 
 typedef struct sh_task sh_task_t;
@@ -32,12 +35,12 @@ typedef struct sh_task sh_task_t;
 int sh_task_init(void);
 
 sh_task_t *sh_task_create_hook_by_target_addr(uintptr_t target_addr, uintptr_t new_addr, uintptr_t *orig_addr,
-                                              uint32_t flags, bool is_sym_addr, bool is_proc_start,
+                                              void *data, uint32_t flags, bool is_sym_addr, bool is_proc_start,
                                               uintptr_t caller_addr, char *record_lib_name,
                                               char *record_sym_name);
 sh_task_t *sh_task_create_hook_by_sym_name(const char *lib_name, const char *sym_name, uintptr_t new_addr,
-                                           uintptr_t *orig_addr, uint32_t flags, shadowhook_hooked_t hooked,
-                                           void *hooked_arg, uintptr_t caller_addr);
+                                           uintptr_t *orig_addr, void *data, uint32_t flags,
+                                           shadowhook_hooked_t hooked, void *hooked_arg, uintptr_t caller_addr);
 
 sh_task_t *sh_task_create_intercept_by_target_addr(uintptr_t target_addr, shadowhook_interceptor_t pre,
                                                    void *data, uint32_t flags, bool is_sym_addr,
@@ -48,7 +51,17 @@ sh_task_t *sh_task_create_intercept_by_sym_name(const char *lib_name, const char
                                                 shadowhook_intercepted_t intercepted, void *intercepted_arg,
                                                 uintptr_t caller_addr);
 
+sh_task_t *sh_task_create_count_by_target_addr(uintptr_t target_addr, uintptr_t caller_addr);
+sh_task_t *sh_task_create_histo_by_target_addr(uintptr_t target_addr, uintptr_t caller_addr);
+sh_task_t *sh_task_create_probe_by_target_addr(uintptr_t target_addr, uintptr_t caller_addr);
+
 void sh_task_destroy(sh_task_t *self);
 
 int sh_task_do(sh_task_t *self);
 int sh_task_undo(sh_task_t *self, uintptr_t caller_addr);
+int sh_task_undo_batch(const char *lib_name, uintptr_t caller_addr, size_t *undo_cnt);
+int sh_task_undo_list(sh_task_t **tasks, size_t tasks_cnt, uintptr_t caller_addr);
+int sh_task_replace_proxy(sh_task_t *self, uintptr_t new_addr);
+sh_counter_t *sh_task_get_counter(sh_task_t *self);
+sh_histo_t *sh_task_get_histo(sh_task_t *self);
+sh_probe_t *sh_task_get_probe(sh_task_t *self);
@@ -28,14 +28,20 @@
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/ucontext.h>
 
 #include "bytesig.h"
+#include "sh_breaker.h"
+#include "sh_counter.h"
 #include "sh_enter.h"
 #include "sh_errno.h"
+#include "sh_histo.h"
 #include "sh_hub.h"
 #include "sh_island.h"
 #include "sh_linker.h"
 #include "sh_log.h"
+#include "sh_patch.h"
+#include "sh_probe.h"
 #include "sh_recorder.h"
 #include "sh_safe.h"
 #include "sh_sig.h"
@@ -54,6 +60,30 @@ static bool shadowhook_disable = false;
 static int shadowhook_init_errno = SHADOWHOOK_ERRNO_UNINIT;
 static shadowhook_mode_t shadowhook_default_mode = SHADOWHOOK_MODE_SHARED;
 
+// count the faults raised in interceptors and shared mode proxy-functions for the circuit breaker,
+// then pass the signal on to the protected threads and the previous signal handler
+static bool shadowhook_fault_interceptor(int signum, siginfo_t *siginfo, void *context) {
+  (void)siginfo;
+
+  if (__predict_true(!sh_breaker_is_armed())) return false;
+  pid_t tid = gettid();
+  if (__predict_false(0 == tid)) tid = (pid_t)syscall(SYS_gettid);
+  if (bytesig_is_protected(tid, signum)) return false;  // caught by shadowhook itself
+
+  ucontext_t *uc = (ucontext_t *)context;
+#if defined(__aarch64__)
+  uintptr_t sp = (uintptr_t)uc->uc_mcontext.sp;
+#elif defined(__arm__)
+  uintptr_t sp = (uintptr_t)uc->uc_mcontext.arm_sp;
+#elif defined(__x86_64__)
+  uintptr_t sp = (uintptr_t)uc->uc_mcontext.gregs[REG_RSP];
+#elif defined(__riscv)
+  uintptr_t sp = (uintptr_t)uc->uc_mcontext.__gregs[REG_SP];
+#endif
+  if (!sh_switch_report_sig_fault(sp)) sh_hub_report_sig_fault();
+  return false;
+}
+
 const char *shadowhook_get_version(void) {
   return "shadowhook version " SHADOWHOOK_VERSION;
 }
@@ -80,10 +110,15 @@ int shadowhook_init(shadowhook_mode_t default_mode, bool debuggable) {
       sh_util_init();
       if (__predict_false(0 != bytesig_init(SIGSEGV))) GOTO_END(SHADOWHOOK_ERRNO_INIT_SIGSEGV);
       if (__predict_false(0 != bytesig_init(SIGBUS))) GOTO_END(SHADOWHOOK_ERRNO_INIT_SIGBUS);
+      bytesig_set_interceptor(SIGSEGV, shadowhook_fault_interceptor);
+      bytesig_set_interceptor(SIGBUS, shadowhook_fault_interceptor);
       if (__predict_false(0 != sh_safe_init())) GOTO_END(SHADOWHOOK_ERRNO_INIT_SAFE);
       sh_island_init();
       sh_enter_init();
+      sh_patch_init();
       sh_switch_init();
+      sh_counter_init();
+      sh_probe_init();
       if (__predict_false(0 != sh_linker_init())) GOTO_END(SHADOWHOOK_ERRNO_INIT_LINKER);
       if (__predict_false(0 != sh_task_init())) GOTO_END(SHADOWHOOK_ERRNO_INIT_TASK);
 
@@ -141,6 +176,22 @@ void shadowhook_set_disable(bool disable) {
   shadowhook_disable = disable;
 }
 
+bool shadowhook_get_bypass(void) {
+  return sh_hub_is_bypassed();
+}
+
+void shadowhook_set_bypass(bool bypass) {
+  SH_LOG_ALWAYS_SHOW("shadowhook set bypass = %s", bypass ? "TRUE" : "FALSE");
+  sh_hub_set_bypass(bypass);
+}
+
+void shadowhook_set_circuit_breaker(uint32_t max_faults, uint64_t max_latency_ns,
+                                    shadowhook_tripped_t tripped, void *arg) {
+  SH_LOG_ALWAYS_SHOW("shadowhook set circuit breaker: max_faults %" PRIu32 ", max_latency_ns %" PRIu64,
+                     max_faults, max_latency_ns);
+  sh_breaker_set(max_faults, max_latency_ns, tripped, arg);
+}
+
 int shadowhook_get_errno(void) {
   return sh_errno_get();
 }
@@ -168,8 +219,9 @@ static bool shadowhook_check_record_name_valid(char *name) {
 }
 
 static void *shadowhook_hook_addr_impl(const char *api_name, void *target_addr, void *new_addr,
-                                       void **orig_addr, uint32_t flags, bool is_sym_addr, bool is_proc_start,
-                                       uintptr_t caller_addr, char *record_lib_name, char *record_sym_name) {
+                                       void **orig_addr, void *data, uint32_t flags, bool is_sym_addr,
+                                       bool is_proc_start, uintptr_t caller_addr, char *record_lib_name,
+                                       char *record_sym_name) {
   SH_LOG_INFO("shadowhook: %s(%s, %s, %p, %p, %" PRIu32 ") ...", api_name,
               NULL == record_lib_name ? "unknown" : record_lib_name,
               NULL == record_sym_name ? "unknown" : record_sym_name, target_addr, new_addr, flags);
@@ -189,8 +241,8 @@ static void *shadowhook_hook_addr_impl(const char *api_name, void *target_addr,
 
   // create task
   sh_task_t *task = sh_task_create_hook_by_target_addr(
-      (uintptr_t)target_addr, (uintptr_t)new_addr, (uintptr_t *)orig_addr, flags, is_sym_addr, is_proc_start,
-      (uintptr_t)caller_addr, record_lib_name, record_sym_name);
+      (uintptr_t)target_addr, (uintptr_t)new_addr, (uintptr_t *)orig_addr, data, flags, is_sym_addr,
+      is_proc_start, (uintptr_t)caller_addr, record_lib_name, record_sym_name);
   if (NULL == task) GOTO_ERR(SHADOWHOOK_ERRNO_OOM);
 
   // do hook
@@ -213,8 +265,8 @@ err:
 
 void *shadowhook_hook_func_addr(void *func_addr, void *new_addr, void **orig_addr) {
   const void *caller_addr = __builtin_return_address(0);
-  return shadowhook_hook_addr_impl("hook_func_addr", func_addr, new_addr, orig_addr, SHADOWHOOK_HOOK_DEFAULT,
-                                   false, true, (uintptr_t)caller_addr, NULL, NULL);
+  return shadowhook_hook_addr_impl("hook_func_addr", func_addr, new_addr, orig_addr, NULL,
+                                   SHADOWHOOK_HOOK_DEFAULT, false, true, (uintptr_t)caller_addr, NULL, NULL);
 }
 
 void *shadowhook_hook_func_addr_2(void *func_addr, void *new_addr, void **orig_addr, uint32_t flags, ...) {
@@ -228,14 +280,14 @@ void *shadowhook_hook_func_addr_2(void *func_addr, void *new_addr, void **orig_a
     record_sym_name = va_arg(args, char *);
     va_end(args);
   }
-  return shadowhook_hook_addr_impl("hook_func_addr", func_addr, new_addr, orig_addr, flags, false, true,
-                                   (uintptr_t)caller_addr, record_lib_name, record_sym_name);
+  return shadowhook_hook_addr_impl("hook_func_addr", func_addr, new_addr, orig_addr, NULL, flags, false,
+                                   true, (uintptr_t)caller_addr, record_lib_name, record_sym_name);
 }
 
 void *shadowhook_hook_sym_addr(void *sym_addr, void *new_addr, void **orig_addr) {
   const void *caller_addr = __builtin_return_address(0);
-  return shadowhook_hook_addr_impl("hook_sym_addr", sym_addr, new_addr, orig_addr, SHADOWHOOK_HOOK_DEFAULT,
-                                   true, true, (uintptr_t)caller_addr, NULL, NULL);
+  return shadowhook_hook_addr_impl("hook_sym_addr", sym_addr, new_addr, orig_addr, NULL,
+                                   SHADOWHOOK_HOOK_DEFAULT, true, true, (uintptr_t)caller_addr, NULL, NULL);
 }
 
 void *shadowhook_hook_sym_addr_2(void *sym_addr, void *new_addr, void **orig_addr, uint32_t flags, ...) {
@@ -249,13 +301,13 @@ void *shadowhook_hook_sym_addr_2(void *sym_addr, void *new_addr, void **orig_add
     record_sym_name = va_arg(args, char *);
     va_end(args);
   }
-  return shadowhook_hook_addr_impl("hook_sym_addr", sym_addr, new_addr, orig_addr, flags, true, true,
-                                   (uintptr_t)caller_addr, record_lib_name, record_sym_name);
+  return shadowhook_hook_addr_impl("hook_sym_addr", sym_addr, new_addr, orig_addr, NULL, flags, true,
+                                   true, (uintptr_t)caller_addr, record_lib_name, record_sym_name);
 }
 
 static void *shadowhook_hook_sym_name_impl(const char *lib_name, const char *sym_name, void *new_addr,
-                                           void **orig_addr, uint32_t flags, shadowhook_hooked_t hooked,
-                                           void *hooked_arg, uintptr_t caller_addr) {
+                                           void **orig_addr, void *data, uint32_t flags,
+                                           shadowhook_hooked_t hooked, void *hooked_arg, uintptr_t caller_addr) {
   SH_LOG_INFO("shadowhook: hook_sym_name(%s, %s, %p, %" PRIu32 ") ...", lib_name, sym_name, new_addr, flags);
   sh_errno_reset();
 
@@ -270,8 +322,8 @@ static void *shadowhook_hook_sym_name_impl(const char *lib_name, const char *sym
 
   // create task
   sh_task_t *task =
-      sh_task_create_hook_by_sym_name(lib_name, sym_name, (uintptr_t)new_addr, (uintptr_t *)orig_addr, flags,
-                                      hooked, hooked_arg, (uintptr_t)caller_addr);
+      sh_task_create_hook_by_sym_name(lib_name, sym_name, (uintptr_t)new_addr, (uintptr_t *)orig_addr, data,
+                                      flags, hooked, hooked_arg, (uintptr_t)caller_addr);
   if (NULL == task) GOTO_ERR(SHADOWHOOK_ERRNO_OOM);
 
   // do hook
@@ -294,21 +346,21 @@ err:
 
 void *shadowhook_hook_sym_name(const char *lib_name, const char *sym_name, void *new_addr, void **orig_addr) {
   const void *caller_addr = __builtin_return_address(0);
-  return shadowhook_hook_sym_name_impl(lib_name, sym_name, new_addr, orig_addr, SHADOWHOOK_HOOK_DEFAULT, NULL,
-                                       NULL, (uintptr_t)caller_addr);
+  return shadowhook_hook_sym_name_impl(lib_name, sym_name, new_addr, orig_addr, NULL, SHADOWHOOK_HOOK_DEFAULT,
+                                       NULL, NULL, (uintptr_t)caller_addr);
 }
 
 void *shadowhook_hook_sym_name_2(const char *lib_name, const char *sym_name, void *new_addr, void **orig_addr,
                                  uint32_t flags) {
   const void *caller_addr = __builtin_return_address(0);
-  return shadowhook_hook_sym_name_impl(lib_name, sym_name, new_addr, orig_addr, flags, NULL, NULL,
+  return shadowhook_hook_sym_name_impl(lib_name, sym_name, new_addr, orig_addr, NULL, flags, NULL, NULL,
                                        (uintptr_t)caller_addr);
 }
 
 void *shadowhook_hook_sym_name_callback(const char *lib_name, const char *sym_name, void *new_addr,
                                         void **orig_addr, shadowhook_hooked_t hooked, void *hooked_arg) {
   const void *caller_addr = __builtin_return_address(0);
-  return shadowhook_hook_sym_name_impl(lib_name, sym_name, new_addr, orig_addr, SHADOWHOOK_HOOK_DEFAULT,
+  return shadowhook_hook_sym_name_impl(lib_name, sym_name, new_addr, orig_addr, NULL, SHADOWHOOK_HOOK_DEFAULT,
                                        hooked, hooked_arg, (uintptr_t)caller_addr);
 }
 
@@ -316,10 +368,319 @@ void *shadowhook_hook_sym_name_callback_2(const char *lib_name, const char *sym_
                                           void **orig_addr, uint32_t flags, shadowhook_hooked_t hooked,
                                           void *hooked_arg) {
   const void *caller_addr = __builtin_return_address(0);
-  return shadowhook_hook_sym_name_impl(lib_name, sym_name, new_addr, orig_addr, flags, hooked, hooked_arg,
+  return shadowhook_hook_sym_name_impl(lib_name, sym_name, new_addr, orig_addr, NULL, flags, hooked,
+                                       hooked_arg, (uintptr_t)caller_addr);
+}
+
+static bool shadowhook_check_with_data_flags(uint32_t *flags) {
+  // per-proxy user data lives in the hub's proxy-list, which only exists in shared mode
+  uint32_t mode = *flags & (SHADOWHOOK_HOOK_WITH_SHARED_MODE | SHADOWHOOK_HOOK_WITH_UNIQUE_MODE |
+                            SHADOWHOOK_HOOK_WITH_MULTI_MODE);
+  if (SHADOWHOOK_HOOK_DEFAULT != mode && SHADOWHOOK_HOOK_WITH_SHARED_MODE != mode) return false;
+  *flags |= SHADOWHOOK_HOOK_WITH_SHARED_MODE;
+  return true;
+}
+
+void *shadowhook_hook_func_addr_with_data(void *func_addr, void *new_addr, void **orig_addr, void *data,
+                                          uint32_t flags, ...) {
+  const void *caller_addr = __builtin_return_address(0);
+  char *record_lib_name = NULL;
+  char *record_sym_name = NULL;
+  if (flags & SHADOWHOOK_HOOK_RECORD) {
+    va_list args;
+    va_start(args, flags);
+    record_lib_name = va_arg(args, char *);
+    record_sym_name = va_arg(args, char *);
+    va_end(args);
+  }
+  if (__predict_false(!shadowhook_check_with_data_flags(&flags))) {
+    SH_LOG_ERROR("shadowhook: hook_func_addr_with_data(%p, %p, %" PRIu32 ") FAILED. shared mode only",
+                 func_addr, new_addr, flags);
+    SH_ERRNO_SET_RET_NULL(SHADOWHOOK_ERRNO_INVALID_ARG);
+  }
+  return shadowhook_hook_addr_impl("hook_func_addr_with_data", func_addr, new_addr, orig_addr, data, flags,
+                                   false, true, (uintptr_t)caller_addr, record_lib_name, record_sym_name);
+}
+
+void *shadowhook_hook_sym_addr_with_data(void *sym_addr, void *new_addr, void **orig_addr, void *data,
+                                         uint32_t flags, ...) {
+  const void *caller_addr = __builtin_return_address(0);
+  char *record_lib_name = NULL;
+  char *record_sym_name = NULL;
+  if (flags & SHADOWHOOK_HOOK_RECORD) {
+    va_list args;
+    va_start(args, flags);
+    record_lib_name = va_arg(args, char *);
+    record_sym_name = va_arg(args, char *);
+    va_end(args);
+  }
+  if (__predict_false(!shadowhook_check_with_data_flags(&flags))) {
+    SH_LOG_ERROR("shadowhook: hook_sym_addr_with_data(%p, %p, %" PRIu32 ") FAILED. shared mode only", sym_addr,
+                 new_addr, flags);
+    SH_ERRNO_SET_RET_NULL(SHADOWHOOK_ERRNO_INVALID_ARG);
+  }
+  return shadowhook_hook_addr_impl("hook_sym_addr_with_data", sym_addr, new_addr, orig_addr, data, flags, true,
+                                   true, (uintptr_t)caller_addr, record_lib_name, record_sym_name);
+}
+
+void *shadowhook_hook_sym_name_with_data(const char *lib_name, const char *sym_name, void *new_addr,
+                                         void **orig_addr, void *data, uint32_t flags) {
+  const void *caller_addr = __builtin_return_address(0);
+  if (__predict_false(!shadowhook_check_with_data_flags(&flags))) {
+    SH_LOG_ERROR("shadowhook: hook_sym_name_with_data(%s, %s, %p, %" PRIu32 ") FAILED. shared mode only",
+                 lib_name, sym_name, new_addr, flags);
+    SH_ERRNO_SET_RET_NULL(SHADOWHOOK_ERRNO_INVALID_ARG);
+  }
+  return shadowhook_hook_sym_name_impl(lib_name, sym_name, new_addr, orig_addr, data, flags, NULL, NULL,
                                        (uintptr_t)caller_addr);
 }
 
+void *shadowhook_count(void *func_addr, void **counter) {
+  const void *caller_addr = __builtin_return_address(0);
+  SH_LOG_INFO("shadowhook: count(%p) ...", func_addr);
+  sh_errno_reset();
+
+  int r;
+  if (__predict_false(NULL == func_addr || NULL == counter)) GOTO_ERR(SHADOWHOOK_ERRNO_INVALID_ARG);
+  if (__predict_false(shadowhook_disable)) GOTO_ERR(SHADOWHOOK_ERRNO_DISABLED);
+  if (__predict_false(SHADOWHOOK_ERRNO_OK != shadowhook_init_errno)) GOTO_ERR(shadowhook_init_errno);
+
+  // create task
+  sh_task_t *task = sh_task_create_count_by_target_addr((uintptr_t)func_addr, (uintptr_t)caller_addr);
+  if (NULL == task) GOTO_ERR(SHADOWHOOK_ERRNO_OOM);
+
+  // do hook
+  r = sh_task_do(task);
+  if (0 != r) {
+    sh_task_destroy(task);
+    GOTO_ERR(r);
+  }
+  *counter = (void *)sh_task_get_counter(task);
+
+  // OK
+  SH_LOG_INFO("shadowhook: count(%p) OK. return: %p", func_addr, (void *)task);
+  SH_ERRNO_SET_RET(SHADOWHOOK_ERRNO_OK, (void *)task);
+
+err:
+  SH_LOG_ERROR("shadowhook: count(%p) FAILED. %d - %s", func_addr, r, sh_errno_to_errmsg(r));
+  SH_ERRNO_SET_RET_NULL(r);
+}
+
+uint64_t shadowhook_get_count(void *counter) {
+  if (__predict_false(NULL == counter)) return 0;
+  return sh_counter_get((sh_counter_t *)counter);
+}
+
+void *shadowhook_histogram(void *func_addr, void **histogram) {
+  const void *caller_addr = __builtin_return_address(0);
+  SH_LOG_INFO("shadowhook: histogram(%p) ...", func_addr);
+  sh_errno_reset();
+
+  int r;
+  if (__predict_false(NULL == func_addr || NULL == histogram)) GOTO_ERR(SHADOWHOOK_ERRNO_INVALID_ARG);
+  if (__predict_false(shadowhook_disable)) GOTO_ERR(SHADOWHOOK_ERRNO_DISABLED);
+  if (__predict_false(SHADOWHOOK_ERRNO_OK != shadowhook_init_errno)) GOTO_ERR(shadowhook_init_errno);
+
+  // create task
+  sh_task_t *task = sh_task_create_histo_by_target_addr((uintptr_t)func_addr, (uintptr_t)caller_addr);
+  if (NULL == task) GOTO_ERR(SHADOWHOOK_ERRNO_OOM);
+
+  // do hook
+  r = sh_task_do(task);
+  if (0 != r) {
+    sh_task_destroy(task);
+    GOTO_ERR(r);
+  }
+  *histogram = (void *)sh_task_get_histo(task);
+
+  // OK
+  SH_LOG_INFO("shadowhook: histogram(%p) OK. return: %p", func_addr, (void *)task);
+  SH_ERRNO_SET_RET(SHADOWHOOK_ERRNO_OK, (void *)task);
+
+err:
+  SH_LOG_ERROR("shadowhook: histogram(%p) FAILED. %d - %s", func_addr, r, sh_errno_to_errmsg(r));
+  SH_ERRNO_SET_RET_NULL(r);
+}
+
+int shadowhook_get_histogram(void *histogram, shadowhook_histogram_t *result) {
+  if (__predict_false(NULL == histogram || NULL == result)) return SHADOWHOOK_ERRNO_INVALID_ARG;
+  sh_histo_get((sh_histo_t *)histogram, result);
+  return SHADOWHOOK_ERRNO_OK;
+}
+
+// a set of hook-once probes
+typedef struct {
+  pthread_mutex_t lock;  // for hits_cnt, hits and tasks
+  size_t cnt;
+  size_t hits_cnt;
+  uint8_t *hits;      // bitmap, bit i is set after func_addrs[i] has been hit
+  sh_task_t **tasks;  // NULL after the probe has been removed (or was never installed)
+} shadowhook_probes_t;
+
+static void shadowhook_probes_free(shadowhook_probes_t *self) {
+  if (NULL != self->hits) free(self->hits);
+  if (NULL != self->tasks) free(self->tasks);
+  pthread_mutex_destroy(&self->lock);
+  free(self);
+}
+
+// the probes are installed in address order, so that the targets on the same page share one mprotect()
+typedef struct {
+  uintptr_t addr;
+  size_t idx;
+} shadowhook_probe_order_t;
+
+static int shadowhook_probe_order_cmp(const void *a, const void *b) {
+  uintptr_t addr_a = ((const shadowhook_probe_order_t *)a)->addr;
+  uintptr_t addr_b = ((const shadowhook_probe_order_t *)b)->addr;
+  if (addr_a == addr_b) return 0;
+  return addr_a > addr_b ? 1 : -1;
+}
+
+void *shadowhook_probe_once(void *const *func_addrs, size_t cnt) {
+  const void *caller_addr = __builtin_return_address(0);
+  SH_LOG_INFO("shadowhook: probe_once(%p, %zu) ...", (void *)func_addrs, cnt);
+  sh_errno_reset();
+
+  int r;
+  shadowhook_probes_t *self = NULL;
+  shadowhook_probe_order_t *order = NULL;
+  if (__predict_false(NULL == func_addrs || 0 == cnt)) GOTO_ERR(SHADOWHOOK_ERRNO_INVALID_ARG);
+  if (__predict_false(shadowhook_disable)) GOTO_ERR(SHADOWHOOK_ERRNO_DISABLED);
+  if (__predict_false(SHADOWHOOK_ERRNO_OK != shadowhook_init_errno)) GOTO_ERR(shadowhook_init_errno);
+
+  // create probe set
+  if (NULL == (self = calloc(1, sizeof(shadowhook_probes_t)))) GOTO_ERR(SHADOWHOOK_ERRNO_OOM);
+  pthread_mutex_init(&self->lock, NULL);
+  self->cnt = cnt;
+  if (NULL == (self->hits = calloc((cnt + 7) / 8, sizeof(uint8_t)))) GOTO_ERR(SHADOWHOOK_ERRNO_OOM);
+  if (NULL == (self->tasks = calloc(cnt, sizeof(sh_task_t *)))) GOTO_ERR(SHADOWHOOK_ERRNO_OOM);
+  if (NULL == (order = malloc(cnt * sizeof(shadowhook_probe_order_t)))) GOTO_ERR(SHADOWHOOK_ERRNO_OOM);
+  size_t order_cnt = 0;
+  for (size_t i = 0; i < cnt; i++) {
+    if (NULL == func_addrs[i]) continue;
+    order[order_cnt].addr = (uintptr_t)func_addrs[i];
+    order[order_cnt++].idx = i;
+  }
+  qsort(order, order_cnt, sizeof(shadowhook_probe_order_t), shadowhook_probe_order_cmp);
+
+  // install all probes in one switch batch and one page session, the snapshot of hooked addresses is
+  // published only once, and each page of the targets is made writable only once
+  size_t ok_cnt = 0;
+  r = SHADOWHOOK_ERRNO_INVALID_ARG;
+  sh_switch_batch_begin();
+  sh_util_page_session_begin();
+  for (size_t j = 0; j < order_cnt; j++) {
+    size_t i = order[j].idx;
+    sh_task_t *task = sh_task_create_probe_by_target_addr((uintptr_t)func_addrs[i], (uintptr_t)caller_addr);
+    if (NULL == task) {
+      r = SHADOWHOOK_ERRNO_OOM;
+      continue;
+    }
+    int task_r = sh_task_do(task);
+    if (0 != task_r) {
+      SH_LOG_WARN("shadowhook: probe_once: probe %p FAILED. %d - %s", func_addrs[i], task_r,
+                  sh_errno_to_errmsg(task_r));
+      sh_task_destroy(task);
+      r = task_r;
+      continue;
+    }
+    self->tasks[i] = task;
+    ok_cnt++;
+  }
+  sh_util_page_session_end();
+  sh_switch_batch_end();
+  free(order);
+  order = NULL;
+  if (0 == ok_cnt) GOTO_ERR(r);
+
+  // OK
+  SH_LOG_INFO("shadowhook: probe_once(%p, %zu) OK. installed: %zu. return: %p", (void *)func_addrs, cnt, ok_cnt,
+              (void *)self);
+  SH_ERRNO_SET_RET(SHADOWHOOK_ERRNO_OK, (void *)self);
+
+err:
+  if (NULL != order) free(order);
+  if (NULL != self) shadowhook_probes_free(self);
+  SH_LOG_ERROR("shadowhook: probe_once(%p, %zu) FAILED. %d - %s", (void *)func_addrs, cnt, r,
+               sh_errno_to_errmsg(r));
+  SH_ERRNO_SET_RET_NULL(r);
+}
+
+// must be called with self->lock held
+static int shadowhook_probes_remove(shadowhook_probes_t *self, bool hit_only, uintptr_t caller_addr) {
+  sh_task_t **tasks = malloc(self->cnt * sizeof(sh_task_t *));
+  size_t tasks_cnt = 0;
+
+  for (size_t i = 0; i < self->cnt; i++) {
+    sh_task_t *task = self->tasks[i];
+    if (NULL == task) continue;
+
+    bool is_hit = sh_probe_is_hit(sh_task_get_probe(task));
+    if (is_hit) {
+      self->hits[i / 8] |= (uint8_t)(1u << (i % 8));
+      self->hits_cnt++;
+    }
+    if (hit_only && !is_hit) continue;
+
+    if (NULL != tasks) {
+      tasks[tasks_cnt++] = task;
+    } else {
+      // OOM, fallback to one by one
+      sh_task_undo_list(&task, 1, caller_addr);
+    }
+    self->tasks[i] = NULL;
+  }
+
+  // remove in one switch session
+  int r = 0;
+  if (NULL != tasks) {
+    r = sh_task_undo_list(tasks, tasks_cnt, caller_addr);
+    free(tasks);
+  }
+  return r;
+}
+
+size_t shadowhook_probe_collect(void *probes, uint8_t *hit_bitmap) {
+  const void *caller_addr = __builtin_return_address(0);
+  if (__predict_false(NULL == probes)) return 0;
+  shadowhook_probes_t *self = (shadowhook_probes_t *)probes;
+
+  pthread_mutex_lock(&self->lock);
+  int r = shadowhook_probes_remove(self, true, (uintptr_t)caller_addr);
+  if (0 != r)
+    SH_LOG_WARN("shadowhook: probe_collect(%p) remove probes FAILED. %d - %s", probes, r, sh_errno_to_errmsg(r));
+
+  if (NULL != hit_bitmap) memcpy(hit_bitmap, self->hits, (self->cnt + 7) / 8);
+  size_t hits_cnt = self->hits_cnt;
+  pthread_mutex_unlock(&self->lock);
+  return hits_cnt;
+}
+
+int shadowhook_probe_destroy(void *probes) {
+  const void *caller_addr = __builtin_return_address(0);
+  SH_LOG_INFO("shadowhook: probe_destroy(%p) ...", probes);
+  sh_errno_reset();
+
+  int r;
+  if (__predict_false(NULL == probes)) GOTO_ERR(SHADOWHOOK_ERRNO_INVALID_ARG);
+
+  shadowhook_probes_t *self = (shadowhook_probes_t *)probes;
+  pthread_mutex_lock(&self->lock);
+  r = shadowhook_probes_remove(self, false, (uintptr_t)caller_addr);
+  pthread_mutex_unlock(&self->lock);
+  shadowhook_probes_free(self);
+  if (0 != r) GOTO_ERR(r);
+
+  // OK
+  SH_LOG_INFO("shadowhook: probe_destroy(%p) OK", probes);
+  SH_ERRNO_SET_RET_ERRNUM(SHADOWHOOK_ERRNO_OK);
+
+err:
+  SH_LOG_ERROR("shadowhook: probe_destroy(%p) FAILED. %d - %s", probes, r, sh_errno_to_errmsg(r));
+  SH_ERRNO_SET_RET_FAIL(r);
+}
+
 int shadowhook_unhook(void *stub) {
   const void *caller_addr = __builtin_return_address(0);
   SH_LOG_INFO("shadowhook: unhook(%p) ...", stub);
@@ -344,6 +705,27 @@ err:
   SH_ERRNO_SET_RET_FAIL(r);
 }
 
+int shadowhook_replace_proxy(void *stub, void *new_addr) {
+  SH_LOG_INFO("shadowhook: replace_proxy(%p, %p) ...", stub, new_addr);
+  sh_errno_reset();
+
+  int r;
+  if (__predict_false(NULL == stub || NULL == new_addr)) GOTO_ERR(SHADOWHOOK_ERRNO_INVALID_ARG);
+  if (__predict_false(shadowhook_disable)) GOTO_ERR(SHADOWHOOK_ERRNO_DISABLED);
+  if (__predict_false(SHADOWHOOK_ERRNO_OK != shadowhook_init_errno)) GOTO_ERR(shadowhook_init_errno);
+
+  sh_task_t *task = (sh_task_t *)stub;
+  if (0 != (r = sh_task_replace_proxy(task, (uintptr_t)new_addr))) GOTO_ERR(r);
+
+  // OK
+  SH_LOG_INFO("shadowhook: replace_proxy(%p, %p) OK", stub, new_addr);
+  SH_ERRNO_SET_RET_ERRNUM(SHADOWHOOK_ERRNO_OK);
+
+err:
+  SH_LOG_ERROR("shadowhook: replace_proxy(%p, %p) FAILED. %d - %s", stub, new_addr, r, sh_errno_to_errmsg(r));
+  SH_ERRNO_SET_RET_FAIL(r);
+}
+
 static void *shadowhook_intercept_addr_impl(const char *api_name, void *target_addr,
                                             shadowhook_interceptor_t pre, void *data, uint32_t flags,
                                             bool is_sym_addr, bool is_proc_start, uintptr_t caller_addr,
@@ -510,6 +892,56 @@ err:
   SH_ERRNO_SET_RET_FAIL(r);
 }
 
+static int shadowhook_unhook_batch_impl(const char *api_name, const char *lib_name, uintptr_t caller_addr) {
+  SH_LOG_INFO("shadowhook: %s(%s) ...", api_name, NULL == lib_name ? "" : lib_name);
+  sh_errno_reset();
+
+  int r;
+  size_t cnt = 0;
+  if (__predict_false(shadowhook_disable)) GOTO_ERR(SHADOWHOOK_ERRNO_DISABLED);
+  if (__predict_false(SHADOWHOOK_ERRNO_OK != shadowhook_init_errno)) GOTO_ERR(shadowhook_init_errno);
+
+  r = sh_task_undo_batch(lib_name, caller_addr, &cnt);
+  if (0 != r) GOTO_ERR(r);
+
+  // OK
+  SH_LOG_INFO("shadowhook: %s(%s) OK. count: %zu", api_name, NULL == lib_name ? "" : lib_name, cnt);
+  SH_ERRNO_SET_RET_ERRNUM(SHADOWHOOK_ERRNO_OK);
+
+err:
+  SH_LOG_ERROR("shadowhook: %s(%s) FAILED. count: %zu. %d - %s", api_name, NULL == lib_name ? "" : lib_name,
+               cnt, r, sh_errno_to_errmsg(r));
+  SH_ERRNO_SET_RET_FAIL(r);
+}
+
+int shadowhook_unhook_all(void) {
+  const void *caller_addr = __builtin_return_address(0);
+  return shadowhook_unhook_batch_impl("unhook_all", NULL, (uintptr_t)caller_addr);
+}
+
+int shadowhook_unhook_by_lib(const char *lib_name) {
+  const void *caller_addr = __builtin_return_address(0);
+  if (__predict_false(NULL == lib_name || '\0' == lib_name[0])) {
+    SH_LOG_ERROR("shadowhook: unhook_by_lib(NULL) FAILED. invalid arg");
+    SH_ERRNO_SET_RET_FAIL(SHADOWHOOK_ERRNO_INVALID_ARG);
+  }
+  return shadowhook_unhook_batch_impl("unhook_by_lib", lib_name, (uintptr_t)caller_addr);
+}
+
+bool shadowhook_is_hooked(void *addr) {
+  if (__predict_false(NULL == addr)) return false;
+  return sh_switch_is_hooked((uintptr_t)addr);
+}
+
+int shadowhook_foreach_hook(shadowhook_hook_info_cb_t cb, void *arg) {
+  if (__predict_false(NULL == cb)) SH_ERRNO_SET_RET_FAIL(SHADOWHOOK_ERRNO_INVALID_ARG);
+  if (__predict_false(SHADOWHOOK_ERRNO_OK != shadowhook_init_errno))
+    SH_ERRNO_SET_RET_FAIL(shadowhook_init_errno);
+
+  sh_switch_foreach(cb, arg);
+  SH_ERRNO_SET_RET_ERRNUM(SHADOWHOOK_ERRNO_OK);
+}
+
 char *shadowhook_get_records(uint32_t item_flags) {
   return sh_recorder_get(item_flags);
 }
@@ -662,3 +1094,11 @@ void shadowhook_disallow_reentrant(void *return_address) {
 void *shadowhook_get_return_address(void) {
   return sh_hub_get_return_address();
 }
+
+void *shadowhook_get_data(void *func) {
+  return sh_hub_get_data(func);
+}
+
+void shadowhook_report_fault(void *func) {
+  sh_hub_report_fault(func);
+}